@@ -5,18 +5,34 @@
 #include <mutex>
 #include "KCDUtils.h"
 #include "KCDPipeline.h"
-#include "Subject.h"
+#include "KCDEngagementTracker.h"
+
+/*
+* Body frame acquisition and user engagement
+* Every engaged user holds a stable slot and is announced with ENGAGED_USER_NEW / ENGAGED_USER_LOST;
+* the active user of the single-user API is the user engaged longest.
+* Events are published on the pipeline thread once per body frame, engaged users first;
+* main thread subscribers get them in update().
+*/
 
 namespace kcd
 {
-	class ActiveUserStage : public Subject<ActiveUserEvent>, public IBodyDataSource, public IStage
+	class ActiveUserStage : public IActiveUserOutput, public IBodyDataSource, public IStage
 	{
 	public:
 		ActiveUserStage();
 		virtual ~ActiveUserStage();
 
 		void setDeviceSource(IDeviceSourceRef deviceSrc);
-		void setActiveUserDistanceSource(IActiveUserDistanceSourceRef distanceSrc);
+
+		// optional, bodies hidden in the body index frame don't engage
+		void setBodyIndexStatsSource(IBodyIndexStatsSourceRef bodyIndexStatsSrc);
+
+		void setEngagementParams(const EngagementParams& params);
+		EngagementParams getEngagementParams();
+
+		// per-user NEW / LOST
+		IEngagedUserOutputRef getEngagedUserOutput() { return mEngagedUserOutput; }
 
 		virtual BodyData getLatestBodyData();
 
@@ -25,11 +41,10 @@ namespace kcd
 		virtual void update();
 
 		//virtual HRESULT thread_setup();
-		virtual HRESULT thread_teardown();
 		
 	private:
 		IDeviceSourceRef mDeviceSrc;
-		IActiveUserDistanceSourceRef mDistanceSrc;
+		IBodyIndexStatsSourceRef mBodyIndexStatsSrc;
 
 		IBodyFrame* mBodyFrame;
 		IBodyFrameReference* bodyFrameRef;
@@ -37,12 +52,18 @@ namespace kcd
 
 		BodyData mLatestBodyData;
 
-		float mUserEngagedThreshold; // meters, from camera
-		float mUserLostThreshold; // meters, from camera
+		EngagementTracker mEngagement;
+		std::mutex mEngagementMutex;
+		std::vector<EngagementTransition> mEngagementTransitions;
+
+		// events of the current frame, published once the engagement lock is released
+		std::vector<ActiveUserEvent> mActiveUserEvents;
+		std::vector<EngagedUserEvent> mEngagedUserEvents;
+
+		IEngagedUserOutputRef mEngagedUserOutput;
 
-		std::vector<ActiveUserEvent> mActiveUserEventBuffer;
-		std::mutex mActiveUserEventBufferMutex;
-		std::atomic<bool> mHasNewActiveUserData;
+		void updateActiveUser();
+		void updateEngagedUsers();
 	};
 
 	typedef std::shared_ptr<ActiveUserStage> ActiveUserStageRef;
@@ -0,0 +1,63 @@
+#ifndef __KCD_BODY_INDEX_STATS_STAGE_H__
+#define __KCD_BODY_INDEX_STATS_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <emmintrin.h>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+
+/*
+* Pixel count, centroid, bounding box and mean depth of every body index, from one pass over the
+* body index frame: 16 pixels per step with SSE2, blocks without any body are skipped after one compare.
+* Columns hit by a body are OR-ed together and rows are tracked as they go, so the bounding box needs
+* no per-pixel branches. Added before the stages that decide on users, they read this frame's statistics.
+*/
+
+#define BODY_INDEX_STATS_BLOCKS (512 / 16) // 16 pixel blocks per depth row
+
+namespace kcd
+{
+	class BodyIndexStatsStage : public IStage, public IBodyIndexStatsSource, public IBodyIndexStatsOutput
+	{
+	public:
+		BodyIndexStatsStage();
+		virtual ~BodyIndexStatsStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+
+		// time of the latest scan
+		float getScanMicroseconds() const { return mScanMicroseconds; }
+
+		virtual const BodyIndexStats& getLatestBodyIndexStats();
+		virtual BodyIndexStats copyLatestBodyIndexStats();
+
+		virtual HRESULT thread_process();
+		virtual HRESULT post_thread_process();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+
+		IDepthFrameReference* mDepthFrameRef;
+		IDepthFrame* mDepthFrame;
+		IBodyIndexFrameReference* mBodyIndexFrameRef;
+		IBodyIndexFrame* mBodyIndexFrame;
+
+		BodyIndexStats mStats; // pipeline thread
+		BodyIndexStats mLatestStats;
+		std::mutex mLatestStatsMutex;
+
+		double mPerformanceFrequency; // counts per second
+		std::atomic<float> mScanMicroseconds;
+
+		// per body, columns any of its pixels fell in, one mask byte per column
+		__m128i* mColumnHits;
+
+		void scan(const BYTE* bodyIndexBuffer, const UINT16* depthBuffer, BodyIndexStats& stats);
+	};
+
+	typedef std::shared_ptr<BodyIndexStatsStage> BodyIndexStatsStageRef;
+};
+
+#endif //__KCD_BODY_INDEX_STATS_STAGE_H__
\ No newline at end of file
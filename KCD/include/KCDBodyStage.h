@@ -5,31 +5,28 @@
 #include <mutex>
 #include "KCDUtils.h"
 #include "KCDPipeline.h"
-#include "Subject.h"
-#include <map>
+#include "KCDJointStore.h"
+#include "KCDJointHistory.h"
+#include "KCDJointMapper.h"
+#include "SpscQueue.h"
 
 #define DEFAULT_HANDLEFT_ID 0
 #define DEFAULT_HANDRIGHT_ID 1
+#define BODY_JOINT_EVENT_QUEUE_SIZE 1024 // about 20 frames of full skeleton events
 
 namespace kcd
 {
-	struct Observation
+	// consumers of the joint store, each sets its own stored joints
+	typedef enum StoredJointsClient
 	{
-	public:
-		Observation() : id(JointType_Count) {}
-		Observation(JointType _id) : id(_id), isValid(false), seen(false){ xy = { 0 }; }
-		// let's use the joint enum as unique id for now
-		// limited to a single user, of course, as this whole code is
-		JointType id;
-		ColorSpacePoint xy;
-		bool isValid;
-		bool seen;
+		STORED_JOINTS_APP,
+		STORED_JOINTS_GESTURE,
+		STORED_JOINTS_POSE,
+		STORED_JOINTS_FILTER,
+		STORED_JOINTS_CLIENT_COUNT
 	};
 
-	typedef std::pair<JointType, Observation> ObservationPair;
-	typedef std::map<JointType, Observation>::iterator ObservationIt;
-
-	class BodyStage : public IActiveUserDistanceSource, public IStage, public Subject<BodyJointEvent>
+	class BodyStage : public IActiveUserDistanceSource, public IJointStoreSource, public IJointStoreOutput, public IStage, public IBodyJointOutput
 	{
 	public:
 		BodyStage();
@@ -38,7 +35,40 @@ namespace kcd
 		void setDeviceSource(IDeviceSourceRef deviceSrc);
 		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
 
+		/*
+		* Joints stored for every body and reported as events for the active user, one bit per JointType
+		* SpineBase is always stored, the active user distance depends on it
+		*/
+		void setJointSubscription(JointMask subscription);
+		JointMask getJointSubscription() const { return mSubscription; }
+
+		// joints stored in addition to the subscription, for consumers of the joint store, without events
+		// the stored joints are the union of the joints set by every client
+		void setStoredJoints(JointMask joints, StoredJointsClient client = STORED_JOINTS_APP);
+		JointMask getStoredJoints() const { return mStoredJoints; }
+
+		/*
+		* Batch delivery: all joint events of a device frame in one batch, published on the pipeline thread
+		* The stage itself publishes the compatibility stream in update(): events of the frames since the
+		* last update, with polled joints repeated every update, skipped when nobody subscribes to it
+		*/
+		IBodyJointBatchOutputRef getBatchOutput() { return mBatchOutput; }
+
+		// joint screen space, depth space scaled to this size
+		void setScreenSize(float width, float height);
+
+		// mapper calls of the latest frame, all joints of all bodies are mapped in one batch
+		UINT getMapperCallCount() const { return mMapperCalls; }
+
+		// events lost because the app thread or a dispatcher fell behind
+		UINT64 getDroppedEventCount() const { return mDroppedEvents + mBatchOutput->getDroppedCount() + this->getDroppedCount(); }
+
+		// one sample per body frame, lock-free queries from any thread
+		const JointHistory& getJointHistory() const { return mHistory; }
+
 		virtual float getLatestDistance();
+		virtual const JointStore& getLatestJoints();
+		virtual void copyLatestJoints(JointStore& joints);
 
 		virtual HRESULT thread_process();
 		//virtual HRESULT post_thread_process();
@@ -51,22 +81,51 @@ namespace kcd
 		IDeviceSourceRef mDeviceSrc;
 		IBodyDataSourceRef mBodyDataSrc;
 		
-		std::map<JointType, Observation> mObservations;
-
-		std::vector<BodyJointEvent> mBodyJointEventBuffer;
-		std::mutex mBodyJointEventBufferMutex;
-		std::atomic<bool> mHasNewBodyJointEvents;
-
-		std::map<JointType, BodyJointEvent> mBodyJointEventPolling;
+		std::atomic<JointMask> mSubscription;
+		std::atomic<JointMask> mStoredJoints;
+		JointMask mClientStoredJoints[STORED_JOINTS_CLIENT_COUNT];
+		std::mutex mStoredJointsMutex;
+
+		JointStore mJoints; // pipeline thread only
+		JointStore mLatestJoints;
+		JointMask mLatestActiveJoints; // mActiveJoints as of mLatestJoints
+		std::mutex mLatestJointsMutex;
+
+		JointMapper mMapper;
+		std::atomic<float> mScreenWidth;
+		std::atomic<float> mScreenHeight;
+		std::atomic<UINT> mMapperCalls;
+
+		JointHistory mHistory;
+		INT64 mLastRelativeTime;
+
+		// active user joints with an outstanding APPEAR or MOVE, and the body they were seen on
+		JointMask mActiveJoints;
+		int mActiveBody;
+
+		// events of the current frame, one batch
+		std::vector<BodyJointEvent> mFrameEvents;
+		IBodyJointBatchOutputRef mBatchOutput;
+
+		// pipeline thread to app thread for the compatibility stream, drained into the dispatch buffer in update
+		SpscQueue<BodyJointEvent> mEventQueue;
+		std::vector<BodyJointEvent> mBodyJointEventDispatch;
+		std::vector<BodyJointEvent> mCompatEvents;
+		std::atomic<UINT> mDroppedEvents;
+		std::atomic<bool> mEventQueueOverflow;
+		UINT64 mFrameId;
+
+		// latest event of every polled joint, repeated each update
+		BodyJointEvent mBodyJointEventPolling[JointType_Count];
+		JointMask mPolledJoints;
 
 		float mLatestUserDistance;
 
 		bool trackIfInferred;
 
-		void markObservationsUnseen();
-		void processObservationsUnseen();
-		BodyJointEvent eventFromObservation(BodyJointEventType eventType, const Observation& obs);
-
+		void pushEvents(BodyJointEventType eventType, JointMask joints, int body);
+		void publishFrameEvents();
+		void reconcilePolledJoints(bool publishEvents);
 	};
 
 	typedef std::shared_ptr<BodyStage> BodyStageRef;
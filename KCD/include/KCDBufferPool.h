@@ -0,0 +1,132 @@
+#ifndef __KCD_BUFFER_POOL_H__
+#define __KCD_BUFFER_POOL_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include "KCDPipeline.h"
+
+/*
+* Frame sized buffers shared by the stages, kept by format and size and handed out as refcounted leases
+* A lease's reference count lives in its buffer's slot, allocated with the buffer, so leasing allocates nothing.
+* Every buffer carries a leased flag, set by acquire() under the pool lock and cleared with release order
+* when the last copy of its lease is dropped and the count is given back, nothing to return by hand;
+* acquire() reads it with acquire order, so the leaseholder's writes are done before the buffer is handed
+* out again. Buffers are allocated in reserve() or on a first acquire and never freed while the pool lives,
+* so the steady state allocates nothing; past maxBuffersPerKey an acquire fails and is counted as exhausted.
+* A lease outliving the pool keeps its buffer.
+*/
+
+#define BUFFER_POOL_DEFAULT_MAX_BUFFERS 8
+#define BUFFER_POOL_CONTROL_BLOCK_SIZE 64 // bytes per slot for the lease's shared_ptr control block
+
+namespace kcd
+{
+	struct PooledBuffer
+	{
+		ImageView view; // data, size and format of the buffer; frameId is the leaseholder's
+		size_t size; // bytes
+
+		template <class T>
+		T* as() const { return reinterpret_cast<T*>(const_cast<BYTE*>(view.data)); }
+	};
+
+	typedef std::shared_ptr<PooledBuffer> BufferLease;
+
+	struct BufferPoolStats
+	{
+		UINT64 allocations; // buffers allocated, in reserve() or on a first acquire
+		UINT64 reuses; // acquires served by a returned buffer
+		UINT64 exhausted; // acquires failed, every buffer of the key leased
+		UINT buffers;
+		UINT leased; // buffers out at the time of the call
+		size_t bytes;
+	};
+
+	class BufferPool
+	{
+	public:
+		BufferPool(int maxBuffersPerKey = BUFFER_POOL_DEFAULT_MAX_BUFFERS);
+		virtual ~BufferPool();
+
+		static int getBytesPerPixel(ImageFormat format);
+
+		// allocates up to count buffers of the key ahead, in setup()
+		void reserve(ImageFormat format, int width, int height, int count);
+
+		// a buffer no lease is held on, 16 byte aligned, NULL when exhausted; any thread
+		BufferLease acquire(ImageFormat format, int width, int height);
+
+		BufferPoolStats getStats();
+
+	private:
+		BufferPool(BufferPool const&);
+		void operator=(BufferPool const&);
+
+		struct Slot
+		{
+			PooledBuffer buffer;
+			std::atomic<bool> leased; // until the lease's control block is given back
+			std::aligned_storage<BUFFER_POOL_CONTROL_BLOCK_SIZE, 16>::type controlBlock;
+
+			Slot() : leased(false) {}
+			~Slot();
+		};
+
+		typedef std::shared_ptr<Slot> SlotRef;
+
+		// the buffer stays with its slot
+		struct KeepBuffer
+		{
+			void operator()(PooledBuffer*) const {}
+		};
+
+		// serves a lease's control block from its slot; the copy kept in the block holds the slot past the pool
+		template <class T>
+		struct SlotAllocator
+		{
+			typedef T value_type;
+
+			SlotRef slot;
+
+			SlotAllocator(const SlotRef& slot) : slot(slot) {}
+			template <class U> SlotAllocator(const SlotAllocator<U>& other) : slot(other.slot) {}
+
+			T* allocate(size_t)
+			{
+				static_assert(sizeof(T) <= BUFFER_POOL_CONTROL_BLOCK_SIZE, "BUFFER_POOL_CONTROL_BLOCK_SIZE too small for the lease control block");
+				return reinterpret_cast<T*>(&slot->controlBlock);
+			}
+
+			// last step of dropping a lease, the block is free for the next one
+			void deallocate(T*, size_t) { slot->leased.store(false, std::memory_order_release); }
+
+			template <class U> bool operator==(const SlotAllocator<U>& other) const { return slot == other.slot; }
+			template <class U> bool operator!=(const SlotAllocator<U>& other) const { return slot != other.slot; }
+		};
+
+		struct Shelf
+		{
+			ImageFormat format;
+			int width;
+			int height;
+			std::vector<SlotRef> buffers;
+		};
+
+		std::vector<Shelf> mShelves; // a handful of keys, searched in order
+		int mMaxBuffersPerKey;
+		std::mutex mShelvesMutex;
+
+		BufferPoolStats mStats; // under mShelvesMutex
+
+		Shelf& findShelf(ImageFormat format, int width, int height);
+		SlotRef allocateBuffer(const Shelf& shelf);
+		static BufferLease lease(const SlotRef& slot);
+	};
+
+	typedef std::shared_ptr<BufferPool> BufferPoolRef;
+};
+
+#endif //__KCD_BUFFER_POOL_H__
\ No newline at end of file
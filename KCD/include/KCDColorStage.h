@@ -7,6 +7,8 @@
 #include "KCDPipeline.h"
 #include "cinder/gl/gl.h"
 #include "cinder/gl/Texture.h"
+#include "TextureStream.h"
+#include "KCDImagePublisher.h"
 
 /*
 * TODO: get rid of this awful coupling between color and mask
@@ -20,21 +22,33 @@
 
 namespace kcd
 {
-	class ColorStage : public ITimeSource, public IStage, public ITextureOutput
+	class ColorStage : public ITimeSource, public IColorBufferSource, public IStage, public ITextureOutput, public IImageOutput
 	{
 	public:
 		ColorStage();
 		virtual ~ColorStage();
 
 		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		// frame buffers, shared with the other stages; before setup()
+		void setBufferPool(BufferPoolRef pool) { mColorImages.setBufferPool(pool); }
 		void setMaskSource(IMaskBufferSourceRef maskSrc);
 
 		virtual INT64 getLatestTime();
 		virtual bool hasTimeMeasurement();
 		virtual void invalidateTimeMeasurement();
+
+		virtual const BYTE* getLatestColorBuffer();
+
+		// BGRA frames for consumers without GL
+		virtual ImageViewRef tryGetLatestImage();
+		virtual ImageViewRef waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds);
+		ImagePublisherStats getImageStats() { return mColorImages.getStats(); }
 		
 		virtual ci::gl::TextureRef getTextureReference();
 
+		// texture upload counters and timings
+		TextureStreamStats getTextureStreamStats() { return mColorStream.getStats(); }
+
 		virtual void setup();
 		//virtual HRESULT thread_setup();
 		virtual HRESULT thread_process();
@@ -50,14 +64,12 @@ namespace kcd
 		IColorFrame* mColorFrame;
 		IColorFrameReference* mColorFrameRef;
 
-		BYTE* mColorBuffer;
-		std::mutex mColorDataMutex;
+		ImagePublisher mColorImages; // converted frames, kept readable for the stages after this one and for consumers
+		const BYTE* mLatestColorBuffer; // this iteration's BGRA pixels, a buffer of mColorImages
 		INT64 mColorTime;
 		bool mHasColorTime;
-		std::atomic<bool> mHasNewColorData;
 
-		GLuint colorTextureName;
-		ci::gl::TextureRef mColorTextureRef;
+		TextureStream mColorStream;
 	};
 
 	typedef std::shared_ptr<ColorStage> ColorStageRef;
@@ -0,0 +1,72 @@
+#ifndef __KCD_COMPOSITE_STAGE_H__
+#define __KCD_COMPOSITE_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Texture.h"
+#include "TextureStream.h"
+
+/*
+* Color frame with the user mask as alpha, composited on the CPU into one texture
+* The color buffer and the mask of the iteration are read once and the composite written once, four pixels
+* per step with SSE2; optionally premultiplied, with the exact x * a / 255 rounding. Without an active user
+* the frame is opaque, as drawn by the app without a mask. Disabled by default: it costs a full frame pass
+* that the two texture shader path doesn't need. The texture keeps the color frame's BGRA layout; the composite
+* is written straight into a mapped upload buffer of the texture stream.
+*/
+
+namespace kcd
+{
+	class CompositeStage : public IStage, public ITextureOutput
+	{
+	public:
+		CompositeStage();
+		virtual ~CompositeStage();
+
+		void setColorBufferSource(IColorBufferSourceRef colorBufferSrc);
+		void setMaskBufferSource(IMaskBufferSourceRef maskBufferSrc);
+
+		void setEnabled(bool enabled) { mEnabled = enabled; }
+		bool isEnabled() const { return mEnabled; }
+
+		// rgb scaled by alpha, for GL_ONE, GL_ONE_MINUS_SRC_ALPHA blending
+		void setPremultiplied(bool premultiplied) { mPremultiplied = premultiplied; }
+		bool isPremultiplied() const { return mPremultiplied; }
+
+		// time of the latest composite
+		float getCompositeMicroseconds() const { return mCompositeMicroseconds; }
+
+		virtual ci::gl::TextureRef getTextureReference();
+
+		// texture upload counters and timings
+		TextureStreamStats getTextureStreamStats() { return mCompositeStream.getStats(); }
+
+		virtual void setup();
+		virtual HRESULT thread_process();
+		virtual void teardown();
+
+		virtual void update();
+
+	private:
+		IColorBufferSourceRef mColorBufferSrc;
+		IMaskBufferSourceRef mMaskBufferSrc;
+
+		std::atomic<bool> mEnabled;
+		std::atomic<bool> mPremultiplied;
+
+		double mPerformanceFrequency; // counts per second
+		std::atomic<float> mCompositeMicroseconds;
+
+		TextureStream mCompositeStream; // BGRA
+
+		void composite(const BYTE* colorBuffer, const BYTE* maskBuffer, bool premultiplied, BYTE* dst);
+	};
+
+	typedef std::shared_ptr<CompositeStage> CompositeStageRef;
+};
+
+#endif //__KCD_COMPOSITE_STAGE_H__
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef __KCD_CONTOURS_H__
+#define __KCD_CONTOURS_H__
+
+#include <Kinect.h>
+#include <vector>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+
+/*
+* Contour extraction on a binary mask
+* Border following after Suzuki & Abe, 8-connected: every outer border and hole border
+* is traced once, in a single raster scan over a padded label image.
+* Each closed border is then simplified with Ramer-Douglas-Peucker.
+* All buffers are kept between frames, steady state does not allocate.
+*/
+
+namespace kcd
+{
+	class ContourTracer
+	{
+	public:
+		ContourTracer();
+		virtual ~ContourTracer();
+
+		void allocate(int width, int height);
+		void release();
+
+		void setTolerance(float tolerance) { mTolerance = tolerance; }
+		void setMinimumBorderLength(UINT pixels) { mMinimumBorderLength = pixels; }
+
+		/*
+		* mask: width x height, non-zero is inside
+		* simplified polylines are appended to points/contours, scaled by scale and offset by offset
+		*/
+		void trace(const BYTE* mask, float scale, float offset, std::vector<ci::Vec2f>& points, std::vector<SilhouetteContour>& contours);
+
+	private:
+		int mWidth;
+		int mHeight;
+		int mStride;
+		int* mLabels; // padded by one pixel on every side
+		int mOffsets[8];
+
+		float mTolerance;
+		UINT mMinimumBorderLength;
+
+		std::vector<int> mBorder; // label image indices of the border being followed
+		std::vector<BYTE> mKeep; // per border point, kept by the simplification
+		std::vector<std::pair<UINT, UINT> > mStack;
+
+		void followBorder(int start, int from, int nbd);
+		void simplify(UINT first, UINT last);
+	};
+};
+
+#endif //__KCD_CONTOURS_H__
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef __KCD_COORDINATE_FIELD_H__
+#define __KCD_COORDINATE_FIELD_H__
+
+#include <Kinect.h>
+#include <emmintrin.h>
+#include <limits>
+#include <vector>
+#include "KCDUtils.h"
+
+#define COORDINATE_FIELD_SMOOTH_CELL -1
+#define COORDINATE_FIELD_EMPTY_CELL -2 // refined, no depth sample reaches it
+
+/*
+* Approximate color-to-depth coordinate field
+* Instead of asking the mapper for a DepthSpacePoint for every color pixel,
+* the depth frame (~10x fewer points) is mapped to color space once and splatted
+* onto a sparse grid of color nodes, every mStep pixels.
+* Inside a grid cell the field is affine (depth and color cameras have a constant
+* focal ratio), so smooth cells are interpolated bilinearly, four pixels at a time.
+* Cells whose corners disagree (invalid corner or a jump in parallax, i.e. a depth edge)
+* are remapped per pixel at build time with the same front-most rule the nodes use;
+* color pixels no depth sample reaches there are invalid (-inf).
+*
+* The resolved field is never stored: each run of four color pixels is handed
+* to a sink as two __m128 (depth X and depth Y), the same way the full mapping is consumed.
+*/
+
+namespace kcd
+{
+	typedef enum CoordinateFieldMode
+	{
+		COORDINATE_FIELD_FULL,
+		COORDINATE_FIELD_SPARSE
+	};
+
+	struct CoordinateFieldStats
+	{
+		UINT mappedPoints; // points sent to the mapper last frame
+		UINT totalCells;
+		UINT refinedCells;
+		UINT validatedFrames;
+		float meanError; // depth pixels, against the full mapping
+		float maxError; // depth pixels, against the full mapping
+		float validityMismatch; // fraction of pixels valid in one mapping only
+	};
+
+	class SparseCoordinateField
+	{
+	public:
+		SparseCoordinateField();
+		virtual ~SparseCoordinateField();
+
+		void allocate(int colorWidth, int colorHeight, int depthWidth, int depthHeight, int step);
+		void release();
+
+		HRESULT build(ICoordinateMapper* coordinateMapper, const UINT16* depthBuffer);
+
+		/*
+		* Sink: void operator()(int colorIndex, const __m128& depthX, const __m128& depthY)
+		* colorIndex is the first of four consecutive color pixels
+		*/
+		template <class Sink>
+		void resolve(Sink& sink);
+
+		void measureError(const DepthSpacePoint* fullField, CoordinateFieldStats& stats);
+
+		void setEdgeTolerance(float depthPixels) { mEdgeTolerance = depthPixels; }
+		void setDepthTolerance(UINT16 millimeters) { mDepthTolerance = millimeters; }
+
+		int getStep() const { return mStep; }
+		UINT getMappedPoints() const { return mDepthArea; }
+		UINT getTotalCells() const { return mCellsX * mCellsY; }
+		UINT getRefinedCells() const { return mRefinedCells; }
+
+	private:
+		int mColorWidth;
+		int mColorHeight;
+		int mDepthWidth;
+		int mDepthHeight;
+		UINT mDepthArea;
+
+		int mStep;
+		int mNodesX;
+		int mNodesY;
+		int mCellsX;
+		int mCellsY;
+
+		ColorSpacePoint* mColorPoints; // depth frame mapped to color space
+		DepthSpacePoint* mNodes;
+		UINT16* mNodeDepth;
+		float* mNodeDistance;
+
+		// color pixels per depth pixel, estimated every frame
+		float mScaleX;
+		float mScaleY;
+
+		float mEdgeTolerance;
+		UINT16 mDepthTolerance;
+		UINT mRefinedCells;
+
+		// per cell: smooth, empty, or its slot of mStep * mStep pixels in the refined arrays
+		int* mCellSlot;
+		std::vector<float> mRefinedX;
+		std::vector<float> mRefinedY;
+		std::vector<UINT16> mRefinedDepth;
+		std::vector<float> mRefinedDistance;
+
+		void estimateScale(const UINT16* depthBuffer);
+		void splat(const UINT16* depthBuffer);
+		void remapRefinedCells(const UINT16* depthBuffer);
+		void clearRefinedSlot(int slot, float distance);
+
+		bool isSameSurface(const UINT16* depthBuffer, int x, int y, float depthX, float depthY) const;
+		bool isSmoothCell(int cx, int cy) const;
+	};
+
+	inline bool isValidDepthSpacePoint(const DepthSpacePoint& p)
+	{
+		return p.X != -std::numeric_limits<float>::infinity() && p.Y != -std::numeric_limits<float>::infinity();
+	}
+
+	template <class Sink>
+	void SparseCoordinateField::resolve(Sink& sink)
+	{
+		__declspec(align(16)) float ramp[8];
+
+		const float invStep = 1.0f / static_cast<float>(mStep);
+
+		for (int i = 0; i < 8; ++i)
+		{
+			ramp[i] = static_cast<float>(i) * invStep;
+		}
+
+		for (int cy = 0; cy < mCellsY; ++cy)
+		{
+			for (int cx = 0; cx < mCellsX; ++cx)
+			{
+				int colorIndex = (cy * mStep) * mColorWidth + (cx * mStep);
+				int slot = mCellSlot[cy * mCellsX + cx];
+
+				if (slot == COORDINATE_FIELD_SMOOTH_CELL)
+				{
+					const DepthSpacePoint& n00 = mNodes[cy * mNodesX + cx];
+					const DepthSpacePoint& n10 = mNodes[cy * mNodesX + cx + 1];
+					const DepthSpacePoint& n01 = mNodes[(cy + 1) * mNodesX + cx];
+					const DepthSpacePoint& n11 = mNodes[(cy + 1) * mNodesX + cx + 1];
+
+					for (int j = 0; j < mStep; ++j)
+					{
+						float v = static_cast<float>(j) * invStep;
+
+						// left and right cell edges at this row
+						__m128 lx = _mm_set1_ps(n00.X + (n01.X - n00.X) * v);
+						__m128 ly = _mm_set1_ps(n00.Y + (n01.Y - n00.Y) * v);
+						__m128 dx = _mm_sub_ps(_mm_set1_ps(n10.X + (n11.X - n10.X) * v), lx);
+						__m128 dy = _mm_sub_ps(_mm_set1_ps(n10.Y + (n11.Y - n10.Y) * v), ly);
+
+						for (int i = 0; i < mStep; i += 4)
+						{
+							__m128 u = _mm_load_ps(ramp + i);
+							__m128 x = _mm_add_ps(lx, _mm_mul_ps(dx, u));
+							__m128 y = _mm_add_ps(ly, _mm_mul_ps(dy, u));
+							sink(colorIndex + i, x, y);
+						}
+
+						colorIndex += mColorWidth;
+					}
+				}
+				else if (slot == COORDINATE_FIELD_EMPTY_CELL)
+				{
+					__m128 invalid = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+
+					for (int j = 0; j < mStep; ++j)
+					{
+						for (int i = 0; i < mStep; i += 4)
+						{
+							sink(colorIndex + i, invalid, invalid);
+						}
+
+						colorIndex += mColorWidth;
+					}
+				}
+				else
+				{
+					const float* refinedX = &mRefinedX[slot * mStep * mStep];
+					const float* refinedY = &mRefinedY[slot * mStep * mStep];
+
+					for (int j = 0; j < mStep; ++j)
+					{
+						for (int i = 0; i < mStep; i += 4)
+						{
+							sink(colorIndex + i, _mm_loadu_ps(refinedX + i), _mm_loadu_ps(refinedY + i));
+						}
+
+						refinedX += mStep;
+						refinedY += mStep;
+						colorIndex += mColorWidth;
+					}
+				}
+			}
+		}
+	}
+};
+
+#endif //__KCD_COORDINATE_FIELD_H__
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef __KCD_DEPTH_STAGE_H__
+#define __KCD_DEPTH_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Texture.h"
+#include "TextureStream.h"
+#include "KCDImagePublisher.h"
+
+/*
+* Colorized depth frame, for setting up an installation
+* Depth in millimeters indexes a table of DEPTH_LUT_SIZE BGRA colors built for the current range and color map,
+* rebuilt on the pipeline thread when the parameters change. Eight pixels are clamped to the table per step with
+* SSE2, the table lookups are scalar loads (no gather before AVX2). Nothing reads the colors back, so they are
+* written straight into a mapped upload buffer of the texture stream, sixteen bytes per store.
+*/
+
+#define DEPTH_LUT_SIZE 8192 // millimeters, past the sensor's 8 m maximum
+
+namespace kcd
+{
+	typedef enum DepthColorMap
+	{
+		DEPTH_COLOR_MAP_GRAY, // white near, dark far
+		DEPTH_COLOR_MAP_HEAT // red near, through yellow and green, blue far
+	};
+
+	struct DepthColorParams
+	{
+		DepthColorParams() : colorMap(DEPTH_COLOR_MAP_HEAT), minDepth(500), maxDepth(4500) {}
+
+		DepthColorMap colorMap;
+		UINT16 minDepth; // millimeters, nearer is clamped to the first color
+		UINT16 maxDepth; // farther is clamped to the last color
+	};
+
+	class DepthStage : public IStage, public ITextureOutput, public IImageOutput
+	{
+	public:
+		DepthStage();
+		virtual ~DepthStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		// frame buffers, shared with the other stages; before setup()
+		void setBufferPool(BufferPoolRef pool) { mDepthImages.setBufferPool(pool); }
+
+		void setParams(const DepthColorParams& params);
+		DepthColorParams getParams();
+
+		// time of the latest colorization
+		float getColorizeMicroseconds() const { return mColorizeMicroseconds; }
+
+		virtual ci::gl::TextureRef getTextureReference();
+
+		// texture upload counters and timings
+		TextureStreamStats getTextureStreamStats() { return mDepthStream.getStats(); }
+
+		// raw depth frames in millimeters, for consumers without GL
+		virtual ImageViewRef tryGetLatestImage();
+		virtual ImageViewRef waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds);
+		ImagePublisherStats getImageStats() { return mDepthImages.getStats(); }
+
+		virtual void setup();
+		virtual HRESULT thread_process();
+		virtual HRESULT post_thread_process();
+		virtual void teardown();
+
+		virtual void update();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IDepthFrameReference* mDepthFrameRef;
+		IDepthFrame* mDepthFrame;
+
+		DepthColorParams mParams;
+		std::mutex mParamsMutex;
+		std::atomic<bool> mParamsChanged;
+
+		UINT* mLut; // BGRA per millimeter, entry 0 (no reading) black
+
+		double mPerformanceFrequency; // counts per second
+		std::atomic<float> mColorizeMicroseconds;
+
+		TextureStream mDepthStream; // BGRA
+		ImagePublisher mDepthImages; // UINT16 millimeters
+
+		void buildLut(const DepthColorParams& params);
+		void colorize(const UINT16* depthBuffer, UINT* dst);
+	};
+
+	typedef std::shared_ptr<DepthStage> DepthStageRef;
+};
+
+#endif //__KCD_DEPTH_STAGE_H__
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <Kinect.h>
 #include <mutex>
+#include <string>
 #include "KCDUtils.h"
 #include "KCDPipeline.h"
 
@@ -32,6 +33,25 @@ namespace kcd
 		// TODO: use weak_ptr
 		virtual IMultiSourceFrame* getLatestFrame();
 		virtual ICoordinateMapper* getCoordinateMapper();
+		virtual UINT64 getLatestFrameId();
+		virtual const SoftwareMapper* getSoftwareMapper();
+
+		/*
+		* Software mapper calibration, read in thread_setup; without one it is exported from the sensor
+		* once frames arrive and saved to the file, if any
+		*/
+		void setCalibrationFile(const std::string& path);
+
+		// software mapper against the samples held out of the latest calibration; over the limits it isn't used or saved
+		MapperValidation getCalibrationValidation();
+
+		// depth space position of a camera space point times scale, zero without a mapper
+		ci::Vec2f CameraSpaceToScreenSpace(const CameraSpacePoint& csp, const ci::Vec2f& scale);
+		ci::Vec2f CameraSpaceToScreenSpace(const CameraSpacePoint& csp, const int screenwidth, const int screenheight);
+
+		// camera space points to the screen, depth space scaled to the screen size, with one mapper call
+		// depthPoints: count points of scratch owned by the caller, so concurrent callers don't share state
+		HRESULT CameraSpaceToScreenSpace(UINT count, const CameraSpacePoint* cameraPoints, DepthSpacePoint* depthPoints, ci::Vec2f* screenPoints, const ci::Vec2f& screenSize);
 		
 	private:
 		IKinectSensor* mKinectSensor;
@@ -39,9 +59,16 @@ namespace kcd
 		IMultiSourceFrameReader *mFrameReader;
 
 		IMultiSourceFrame* multiSourceFrame;
-		
-		ci::Vec2f CameraSpaceToScreenSpace(const CameraSpacePoint& csp, const ci::Vec2f& scale);
-		ci::Vec2f CameraSpaceToScreenSpace(const CameraSpacePoint& csp, const int screenwidth, const int screenheight);
+		UINT64 mFrameId; // counts acquired frames, written and read on the pipeline thread
+
+		SoftwareMapper mSoftwareMapper;
+		std::string mCalibrationPath;
+		bool mCalibrationFailed;
+		MapperValidation mValidation;
+		std::mutex mValidationMutex;
+
+		void calibrate();
+		HRESULT validateCalibration();
 		
 		void handleKinectError(const HRESULT& error);
 	};
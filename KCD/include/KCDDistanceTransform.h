@@ -0,0 +1,57 @@
+#ifndef __KCD_DISTANCE_TRANSFORM_H__
+#define __KCD_DISTANCE_TRANSFORM_H__
+
+#include <Kinect.h>
+#include "KCDUtils.h"
+#include "WorkerPool.h"
+
+/*
+* Exact Euclidean distance transform of a binary mask (Felzenszwalb & Huttenlocher)
+* Separable: a 1D lower envelope of parabolas per column, then per row, linear in the pixel count.
+* Columns and rows are spread over the worker pool.
+*
+* The output is signed, in field pixels: positive outside the mask (distance to the user),
+* negative inside (distance to the silhouette), clamped to +/- maxDistance.
+* With a region of interest only the mask bounding box grown by maxDistance is transformed,
+* which gives the same clamped result.
+*/
+
+#define DISTANCE_TRANSFORM_MAX_DIMENSION 2048
+
+namespace kcd
+{
+	class DistanceTransform
+	{
+	public:
+		DistanceTransform();
+		virtual ~DistanceTransform();
+
+		void allocate(int width, int height);
+		void release();
+
+		void setMaxDistance(float maxDistance) { mMaxDistance = maxDistance; }
+		float getMaxDistance() const { return mMaxDistance; }
+
+		void setUseRegionOfInterest(bool useRoi) { mUseRoi = useRoi; }
+
+		/*
+		* mask: width x height, non-zero is inside
+		* distance: signed float output, clamped: 8 bit output, 128 on the silhouette
+		*/
+		void compute(const BYTE* mask, float* distance, BYTE* clamped);
+
+	private:
+		int mWidth;
+		int mHeight;
+		float mMaxDistance;
+		bool mUseRoi;
+
+		// squared distances to the nearest inside and outside pixel, after the column pass
+		float* mOutsideSq;
+		float* mInsideSq;
+
+		static void transform1D(const float* f, int n, float* d, int* v, float* z);
+	};
+};
+
+#endif //__KCD_DISTANCE_TRANSFORM_H__
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef __KCD_ENGAGEMENT_TRACKER_H__
+#define __KCD_ENGAGEMENT_TRACKER_H__
+
+#include <Kinect.h>
+#include <vector>
+#include "KCDUtils.h"
+
+/*
+* Engaged users: up to maxUsers bodies, each holding a stable slot until it is lost
+* Every body frame all bodies are read once and scored on distance to the sensor, facing
+* (shoulder line square to the sensor) and time present. A body engages inside the engage limits
+* and stays engaged inside the wider release limits, so users at the edge don't flicker.
+* When more bodies qualify than slots are free, the best scores win; engaged users are never displaced.
+*/
+
+namespace kcd
+{
+	struct EngagementParams
+	{
+		EngagementParams() :
+			maxUsers(BODY_COUNT),
+			engageDistance(2.5f),
+			releaseDistance(2.75f),
+			engageFacing(0.5f),
+			releaseFacing(0.25f),
+			minPresenceSeconds(0),
+			minVisiblePixels(1500) {}
+
+		UINT maxUsers;
+		float engageDistance; // meters, SpineBase from the sensor
+		float releaseDistance;
+		float engageFacing; // 1 facing the sensor, 0 side on
+		float releaseFacing;
+		float minPresenceSeconds; // tracked this long before engaging
+		UINT minVisiblePixels; // body index pixels needed to engage, when pixel counts are given
+	};
+
+	struct BodyEngagement
+	{
+		bool tracked;
+		UINT64 trackingId;
+		float distance; // meters
+		float facing;
+		float presence; // seconds tracked
+		UINT visiblePixels; // body index pixels, 0 when unknown
+		float score; // 0..1, facing x closeness x presence
+		int slot; // -1 when not engaged
+	};
+
+	struct EngagementSlot
+	{
+		bool engaged;
+		int bodyIndex;
+		UINT64 trackingId;
+		double since; // seconds, sensor clock
+	};
+
+	struct EngagementTransition
+	{
+		bool engaged; // false: lost
+		int slot;
+		int bodyIndex;
+		UINT64 trackingId;
+	};
+
+	class EngagementTracker
+	{
+	public:
+		EngagementTracker();
+		virtual ~EngagementTracker();
+
+		void setParams(const EngagementParams& params);
+		const EngagementParams& getParams() const { return mParams; }
+
+		void reset();
+
+		/*
+		* one body frame, NULL bodies are not tracked, time in seconds, transitions are appended
+		* pixelCounts: body index pixels of the same frame per body, NULL when not available
+		*/
+		void update(IBody** bodies, double time, std::vector<EngagementTransition>& transitions, const UINT* pixelCounts = NULL);
+
+		const BodyEngagement& getBody(int body) const { return mBodies[body]; }
+		const EngagementSlot& getSlot(int slot) const { return mSlots[slot]; }
+		UINT getEngagedCount() const;
+
+		// the slot engaged longest, -1 for none
+		int getLongestEngagedSlot() const;
+
+	private:
+		EngagementParams mParams;
+		BodyEngagement mBodies[BODY_COUNT];
+		EngagementSlot mSlots[BODY_COUNT];
+		double mFirstSeen[BODY_COUNT];
+
+		void observe(int body, IBody* pBody, double time);
+	};
+};
+
+#endif //__KCD_ENGAGEMENT_TRACKER_H__
\ No newline at end of file
@@ -0,0 +1,177 @@
+#ifndef __KCD_EVENT_LOG_H__
+#define __KCD_EVENT_LOG_H__
+
+#include <Kinect.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "Process.h"
+
+/*
+* Compact binary log of the high-level pipeline outputs: active user events, body joint event batches
+* and per-frame contexts, no raw frames
+*
+* File, little endian: header (16 bytes): magic "KEVL", version, reserved; then records until the end.
+* A record is a type byte, the microseconds since the previous record as a varint, then its payload:
+*   frame context: zigzag deltas of frameId and relativeTime, flags, active body, zigzag delta of the
+*     active tracking id, engaged user count
+*   active user batch: count, one byte per event
+*   body joint batch: count, then per event a byte (event type << 5 | joint), the zigzag delta of its frameId
+*     from the previous joint event, and of its position, in 1 / EVENT_LOG_POSITION_SCALE pixels,
+*     from the previous event of the same joint
+* Deltas start from 0 at the top of the file, a log reads without any other state. Records are in publish order.
+* Positions are rounded to 1 / EVENT_LOG_POSITION_SCALE pixel, unmapped ones (infinite) come back as -infinity;
+* a typical joint event takes 4 to 5 bytes instead of 24.
+*/
+
+#define EVENT_LOG_MAGIC 0x4C56454B // "KEVL"
+#define EVENT_LOG_VERSION 1
+#define EVENT_LOG_POSITION_SCALE 64.0f
+#define EVENT_LOG_POSITION_INVALID (-(1 << 30)) // encoded position of a non-finite coordinate
+#define EVENT_LOG_FLUSH_BYTES (64 * 1024) // the writer thread wakes up at this much pending
+#define EVENT_LOG_FLUSH_MILLISECONDS 100 // or this often
+#define EVENT_LOG_MAX_PENDING (16 * 1024 * 1024) // records beyond it are dropped when the disk falls behind
+
+namespace kcd
+{
+	typedef enum EventLogRecordType
+	{
+		EVENT_LOG_FRAME_CONTEXT = 1,
+		EVENT_LOG_ACTIVE_USER,
+		EVENT_LOG_BODY_JOINT
+	};
+
+	// what a frame was about, from BodyData and the device frame id
+	struct EventFrameContext
+	{
+		UINT64 frameId;
+		INT64 relativeTime; // body frame time, 100 ns units
+		bool hasActiveUser;
+		UINT activeBodyIndex;
+		UINT64 activeTrackingId;
+		UINT engagedUserCount;
+	};
+
+	typedef EventBus<EventFrameContext> IFrameContextOutput;
+	typedef std::shared_ptr<IFrameContextOutput> IFrameContextOutputRef;
+
+	// a decoded record, the event pointers are valid until the next read
+	struct EventLogRecord
+	{
+		EventLogRecordType type;
+		UINT64 time; // microseconds since the log was opened
+		EventFrameContext context;
+		const ActiveUserEvent* activeUserEvents;
+		const BodyJointEvent* bodyJointEvents;
+		size_t count;
+	};
+
+	/*
+	* Encodes on the calling thread, any thread, and writes on its own thread
+	* A failed write closes the log: later records are dropped and hasFailed() tells why it closed
+	*/
+	class EventLogWriter
+	{
+	public:
+		EventLogWriter();
+		virtual ~EventLogWriter();
+
+		bool open(const std::string& path);
+		// writes what is pending
+		void close();
+		bool isOpen() const { return mIsOpen; }
+		// a write to the file failed, cleared by open
+		bool hasFailed() const { return mHasFailed; }
+
+		void writeFrameContext(const EventFrameContext& context);
+		void writeActiveUserEvents(const EventBatch<ActiveUserEvent>& events);
+		void writeBodyJointEvents(const EventBatch<BodyJointEvent>& events);
+
+		UINT64 getRecordCount() const { return mRecords; }
+		UINT64 getEventCount() const { return mEvents; }
+		// bytes the file accepted
+		UINT64 getBytesWritten() const { return mBytesWritten; }
+		UINT64 getDroppedRecordCount() const { return mDroppedRecords; }
+
+	private:
+		EventLogWriter(EventLogWriter const&);
+		void operator=(EventLogWriter const&);
+
+		std::atomic<bool> mIsOpen;
+		std::atomic<bool> mHasFailed;
+		std::ofstream mFile; // writer thread
+
+		// encoder state, under mPendingMutex
+		std::vector<BYTE> mPending;
+		std::mutex mPendingMutex;
+		std::condition_variable mPendingReady;
+		std::chrono::steady_clock::time_point mLastTime;
+		EventFrameContext mLastContext;
+		UINT64 mLastJointFrameId;
+		int mLastJointX[JointType_Count];
+		int mLastJointY[JointType_Count];
+
+		Process mWriter;
+		std::vector<BYTE> mWriting;
+
+		std::atomic<UINT64> mRecords;
+		std::atomic<UINT64> mEvents;
+		std::atomic<UINT64> mBytesWritten;
+		std::atomic<UINT64> mDroppedRecords;
+
+		bool beginRecord(EventLogRecordType type, size_t maxBytes);
+		void endRecord(size_t events);
+		void resetEncoder();
+		void writerLoop();
+		void stopOnError();
+	};
+
+	/*
+	* Reads a whole log into memory and decodes it record by record
+	*/
+	class EventLogReader
+	{
+	public:
+		EventLogReader();
+		virtual ~EventLogReader();
+
+		bool open(const std::string& path);
+		// a log already in memory, copied
+		bool open(const BYTE* data, size_t size);
+
+		// back to the first record
+		void rewind();
+
+		// false at the end of the log or on a damaged record
+		bool next(EventLogRecord& record);
+
+		bool isDamaged() const { return mIsDamaged; }
+		size_t getSize() const { return mData.size(); }
+
+	private:
+		std::vector<BYTE> mData;
+		size_t mOffset;
+		bool mIsDamaged;
+
+		// decoder state
+		UINT64 mTime;
+		EventFrameContext mLastContext;
+		UINT64 mLastJointFrameId;
+		int mLastJointX[JointType_Count];
+		int mLastJointY[JointType_Count];
+
+		std::vector<ActiveUserEvent> mActiveUserEvents;
+		std::vector<BodyJointEvent> mBodyJointEvents;
+
+		bool readVarint(UINT64& value);
+		bool readSigned(INT64& value);
+	};
+};
+
+#endif //__KCD_EVENT_LOG_H__
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef __KCD_EVENT_RECORDER_STAGE_H__
+#define __KCD_EVENT_RECORDER_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "KCDEventLog.h"
+
+/*
+* Records the active user events, the per-frame body joint batches and a context per frame into an EventLogWriter
+* The events are taken on the pipeline thread as they are published and the context at the end of the frame,
+* so in the log a frame context closes the frame it follows. Replay with EventReplayer.
+*/
+
+namespace kcd
+{
+	class EventRecorderStage : public IStage
+	{
+	public:
+		EventRecorderStage();
+		virtual ~EventRecorderStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+		void setActiveUserOutput(IActiveUserOutputRef activeUserOutput);
+		void setBodyJointBatchOutput(IBodyJointBatchOutputRef bodyJointOutput);
+
+		// any thread, recording starts with the next frame
+		bool startRecording(const std::string& path);
+		void stopRecording();
+		// false again after a failed write, getWriter().hasFailed() tells
+		bool isRecording() const { return mWriter.isOpen(); }
+
+		const EventLogWriter& getWriter() const { return mWriter; }
+
+		virtual HRESULT thread_process();
+		virtual void teardown();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+		IActiveUserOutputRef mActiveUserOutput;
+		IBodyJointBatchOutputRef mBodyJointOutput;
+
+		EventLogWriter mWriter;
+		EventSubscriptionRef mActiveUserSubscription;
+		EventSubscriptionRef mBodyJointSubscription;
+		std::mutex mRecordingMutex;
+
+		UINT64 mLastFrameId;
+	};
+
+	typedef std::shared_ptr<EventRecorderStage> EventRecorderStageRef;
+};
+
+#endif //__KCD_EVENT_RECORDER_STAGE_H__
\ No newline at end of file
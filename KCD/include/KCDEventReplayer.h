@@ -0,0 +1,97 @@
+#ifndef __KCD_EVENT_REPLAYER_H__
+#define __KCD_EVENT_REPLAYER_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "KCDEventLog.h"
+#include "Process.h"
+
+#define EVENT_REPLAY_QUEUE_SIZE 4096 // queued events per bus, as fast as possible replays outrun the app thread
+
+/*
+* Feeds an event log back into event buses, each record as one batch, at its original timing or as fast as possible
+* The buses are the replayer's own by default; the pipeline's can be set instead, with the pipeline stopped,
+* so the app's subscriptions see the replay as if it came from the sensor.
+* play() publishes on the calling thread, start() on a thread of the replayer. Main thread subscribers get
+* the events in update(), or from play() itself when it is asked to dispatch them.
+*/
+
+namespace kcd
+{
+	typedef enum EventReplayTiming
+	{
+		EVENT_REPLAY_ORIGINAL_TIMING,
+		EVENT_REPLAY_AS_FAST_AS_POSSIBLE
+	};
+
+	struct EventReplayStats
+	{
+		UINT64 records;
+		UINT64 events;
+		double seconds;
+		double eventsPerSecond;
+		bool damaged; // the log ended on a damaged record
+	};
+
+	class EventReplayer
+	{
+	public:
+		EventReplayer();
+		virtual ~EventReplayer();
+
+		bool open(const std::string& path);
+		bool open(const BYTE* data, size_t size);
+
+		// before playing
+		void setActiveUserOutput(IActiveUserOutputRef activeUserOutput);
+		void setBodyJointBatchOutput(IBodyJointBatchOutputRef bodyJointOutput);
+		void setFrameContextOutput(IFrameContextOutputRef frameContextOutput);
+
+		IActiveUserOutputRef getActiveUserOutput() { return mActiveUserOutput; }
+		IBodyJointBatchOutputRef getBodyJointBatchOutput() { return mBodyJointOutput; }
+		IFrameContextOutputRef getFrameContextOutput() { return mFrameContextOutput; }
+
+		// the whole log, loops times, on the calling thread; with dispatchMain it is also the app thread
+		EventReplayStats play(EventReplayTiming timing = EVENT_REPLAY_ORIGINAL_TIMING, bool dispatchMain = false, UINT loops = 1);
+
+		// on the replayer's thread, until the end of the log or stop()
+		void start(EventReplayTiming timing = EVENT_REPLAY_ORIGINAL_TIMING, bool loop = false);
+		void stop();
+		bool isPlaying() const { return mIsPlaying; }
+
+		// app thread
+		void update();
+
+		// of the latest replay, or of the one in progress
+		EventReplayStats getStats();
+
+	private:
+		EventReplayer(EventReplayer const&);
+		void operator=(EventReplayer const&);
+
+		EventLogReader mReader;
+		std::mutex mReaderMutex;
+
+		IActiveUserOutputRef mActiveUserOutput;
+		IBodyJointBatchOutputRef mBodyJointOutput;
+		IFrameContextOutputRef mFrameContextOutput;
+
+		Process mPlayer;
+		std::atomic<bool> mIsPlaying;
+
+		EventReplayStats mStats;
+		std::mutex mStatsMutex;
+		double mPerformanceFrequency; // counts per second
+
+		void replay(EventReplayTiming timing, bool dispatchMain, UINT loops, const std::atomic_bool* running);
+		void dispatchMain();
+	};
+
+	typedef std::shared_ptr<EventReplayer> EventReplayerRef;
+};
+
+#endif //__KCD_EVENT_REPLAYER_H__
\ No newline at end of file
@@ -0,0 +1,123 @@
+#ifndef __KCD_FLOOR_STAGE_H__
+#define __KCD_FLOOR_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "Process.h"
+
+/*
+* Floor plane of the depth frame and the height of every tracked body above it
+* Once per interval a grid of depth samples is taken to camera space through the software mapper and handed
+* to a worker thread, which fits a plane by RANSAC: a fixed number of three point hypotheses, each scored on
+* every sample, then a least squares refit on the inliers of the best. Sample count and iterations are capped,
+* so a fit costs the same whatever the scene. Hypotheses tilted away from the body frame floor clip plane
+* (or the last estimate) are rejected, walls and table tops don't win. The clip plane stands in until the
+* first estimate and after it goes stale; user metrics are taken every body frame against the current plane.
+*/
+
+namespace kcd
+{
+	struct FloorParams
+	{
+		FloorParams() : interval(1.0), staleSeconds(5.0), maxSamples(2048), iterations(64), inlierThreshold(0.03f), minInlierRatio(0.15f), maxTilt(0.9f), trackIfInferred(true) {}
+
+		double interval; // seconds between fits
+		double staleSeconds; // an estimate older than this gives way to the clip plane
+		UINT maxSamples; // depth samples per fit
+		UINT iterations; // RANSAC hypotheses per fit
+		float inlierThreshold; // meters off the plane
+		float minInlierRatio; // of the samples, below it a fit is dropped
+		float maxTilt; // minimum cosine between a hypothesis and the prior normal
+		bool trackIfInferred; // an inferred head joint still gives a height
+	};
+
+	class FloorStage : public IStage, public IFloorOutput
+	{
+	public:
+		FloorStage();
+		virtual ~FloorStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+
+		void setParams(const FloorParams& params);
+		FloorParams getParams();
+
+		// time of the latest fit, on the worker thread
+		float getFitMicroseconds() const { return mFitMicroseconds; }
+
+		virtual FloorData copyLatestFloor();
+
+		virtual HRESULT thread_setup();
+		virtual HRESULT thread_process();
+		virtual HRESULT post_thread_process();
+		virtual HRESULT thread_teardown();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+
+		IDepthFrameReference* mDepthFrameRef;
+		IDepthFrame* mDepthFrame;
+
+		FloorParams mParams;
+		std::mutex mParamsMutex;
+
+		// camera space samples, X Y Z triplets
+		struct FloorJob
+		{
+			std::vector<float> points;
+			Vector4 prior;
+			INT64 time;
+		};
+
+		struct FloorEstimate
+		{
+			Vector4 plane;
+			float inlierRatio;
+			INT64 time; // body frame time of the sampled depth frame, 100 ns units
+			bool valid;
+		};
+
+		// one job at a time: posted by the pipeline thread when the worker is idle
+		Process mWorker;
+		FloorJob mJob;
+		FloorJob mWorkerJob;
+		bool mJobPending;
+		std::atomic<bool> mWorkerBusy;
+		std::mutex mJobMutex;
+		std::condition_variable mJobReady;
+
+		FloorEstimate mEstimate;
+		std::mutex mEstimateMutex;
+		INT64 mLastJobTime;
+
+		FloorData mLatestFloor;
+		std::mutex mLatestFloorMutex;
+
+		// metrics of the latest body frame, pipeline thread
+		FloorUserMetrics mUsers[BODY_COUNT];
+		INT64 mLastMeasureTime;
+
+		UINT mRandom; // xorshift state, worker thread
+
+		double mPerformanceFrequency; // counts per second
+		std::atomic<float> mFitMicroseconds;
+
+		void postJob(const UINT16* depthBuffer, const SoftwareMapper* mapper, const BodyData& bodyData, const FloorParams& params);
+		void workerLoop();
+		void stopWorker();
+		bool fit(const FloorJob& job, const FloorParams& params, FloorEstimate& estimate);
+		void measureUsers(const BodyData& bodyData, const Vector4& plane, const FloorParams& params);
+		UINT nextRandom();
+	};
+
+	typedef std::shared_ptr<FloorStage> FloorStageRef;
+};
+
+#endif //__KCD_FLOOR_STAGE_H__
\ No newline at end of file
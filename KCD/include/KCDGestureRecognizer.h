@@ -0,0 +1,124 @@
+#ifndef __KCD_GESTURE_RECOGNIZER_H__
+#define __KCD_GESTURE_RECOGNIZER_H__
+
+#include <Kinect.h>
+#include <vector>
+#include <string>
+#include "KCDUtils.h"
+#include "KCDJointStore.h"
+#include "cinder/Vector.h"
+
+/*
+* Streaming gesture matching with dynamic time warping
+* Every body frame, the trajectory of a joint relative to a reference joint (in torso lengths,
+* mean centered) over the last template length frames is compared to each template:
+* first the LB_Keogh lower bound against the template envelope, then, only if the bound passes,
+* a Sakoe-Chiba banded DTW that is abandoned as soon as a whole row exceeds the threshold.
+* A budget caps the DTW evaluations per frame, the pairs left over go first on the next frame.
+* Frames are stored as four floats (x, y, z, 0) so a frame distance is one SSE operation.
+*/
+
+#define GESTURE_MAX_LENGTH 64 // frames, also the history length
+#define GESTURE_DEFAULT_BUDGET 64 // DTW evaluations per frame
+
+namespace kcd
+{
+	struct GestureTemplate
+	{
+		std::string name;
+		JointType joint;
+		JointType reference;
+		int length; // frames
+		int band; // Sakoe-Chiba radius, frames
+		float threshold; // mean squared distance per frame, torso lengths^2
+		std::vector<float> frames; // length x 4, mean centered
+		std::vector<float> upper; // LB_Keogh envelope, length x 4
+		std::vector<float> lower;
+	};
+
+	struct GestureMatch
+	{
+		int gestureId;
+		int body;
+		UINT64 trackingId;
+		float distance;
+	};
+
+	struct GestureStats
+	{
+		UINT windows; // body / template pairs with a full window
+		UINT pruned; // rejected by LB_Keogh
+		UINT abandoned; // DTW stopped early
+		UINT evaluated; // DTW completed
+		UINT deferred; // over budget, left for the next frame
+		float processMicroseconds; // set by the owning stage
+	};
+
+	class GestureRecognizer
+	{
+	public:
+		GestureRecognizer();
+		virtual ~GestureRecognizer();
+
+		/*
+		* trajectory: joint position minus reference position, in torso lengths, one entry per body frame (30 Hz)
+		* bandFraction: warping allowed, as a fraction of the template length
+		* returns the gesture id, -1 if the trajectory is too short or too long
+		*/
+		int addTemplate(const std::string& name, JointType joint, JointType reference, const std::vector<ci::Vec3f>& trajectory, float threshold, float bandFraction = 0.2f);
+
+		// swipes, pushes and waves for both hands, synthetic
+		void addDefaultTemplates(float threshold = 0.02f);
+
+		size_t getTemplateCount() const { return mTemplates.size(); }
+		const GestureTemplate& getTemplate(int gestureId) const { return mTemplates[gestureId]; }
+
+		void setMaxEvaluationsPerFrame(UINT evaluations) { mBudget = evaluations; }
+
+		// joints the templates and the torso scale read, all must be in the joint store
+		JointMask getRequiredJoints() const;
+
+		void reset();
+
+		// one body frame, matches are appended
+		void process(const JointStore& joints, std::vector<GestureMatch>& matches);
+
+		const GestureStats& getStats() const { return mStats; }
+
+	private:
+		struct BodyHistory
+		{
+			UINT64 trackingId;
+			UINT frameCount;
+			float torso; // SpineBase to SpineShoulder, meters, smoothed
+			UINT seenCount[JointType_Count]; // consecutive frames each joint was seen
+			float frames[GESTURE_MAX_LENGTH][JointType_Count][4]; // ring, torso lengths from SpineBase
+		};
+
+		// per body and template, a match is reported at the distance minimum
+		struct MatchState
+		{
+			bool pending;
+			float pendingDistance;
+			UINT cooldown;
+		};
+
+		std::vector<GestureTemplate> mTemplates;
+		std::vector<MatchState> mMatchStates; // body * templates + template
+		BodyHistory* mHistory;
+		UINT mBudget;
+		UINT mNextPair;
+		GestureStats mStats;
+
+		float mWindow[GESTURE_MAX_LENGTH * 4];
+		float mRows[2][GESTURE_MAX_LENGTH + 1];
+
+		void appendFrame(int body, const JointStore& joints);
+		void extractWindow(int body, const GestureTemplate& gesture);
+		float lowerBound(const GestureTemplate& gesture, float limit) const;
+		float dtw(const GestureTemplate& gesture, float limit);
+		void updateMatch(int body, int gestureId, float distance, bool matched, std::vector<GestureMatch>& matches);
+	};
+};
+
+#endif //__KCD_GESTURE_RECOGNIZER_H__
\ No newline at end of file
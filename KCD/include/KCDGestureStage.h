@@ -0,0 +1,68 @@
+#ifndef __KCD_GESTURE_STAGE_H__
+#define __KCD_GESTURE_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <vector>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "KCDGestureRecognizer.h"
+
+#define GESTURE_EVENT_QUEUE_SIZE 64
+
+/*
+* Matches the joint trajectories of every tracked body against gesture templates once per body frame
+* Gestures found on the pipeline thread are published on the pipeline thread once per body frame;
+* main thread subscribers get them in update()
+*/
+
+namespace kcd
+{
+	class GestureStage : public IStage, public IGestureOutput
+	{
+	public:
+		GestureStage();
+		virtual ~GestureStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+		void setJointStoreSource(IJointStoreSourceRef jointStoreSrc);
+
+		// templates are added before the pipeline starts, see GestureRecognizer::addTemplate
+		int addTemplate(const std::string& name, JointType joint, JointType reference, const std::vector<ci::Vec3f>& trajectory, float threshold, float bandFraction = 0.2f);
+		void addDefaultTemplates(float threshold = 0.02f);
+		const std::string& getGestureName(int gestureId) const;
+		JointMask getRequiredJoints();
+
+		void setMaxEvaluationsPerFrame(UINT evaluations);
+
+		// counts of the latest body frame
+		GestureStats getStats();
+
+		// events lost because the app thread or a dispatcher fell behind
+		UINT64 getDroppedEventCount() const { return this->getDroppedCount(); }
+
+		virtual HRESULT thread_setup();
+		virtual HRESULT thread_process();
+		virtual void update();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+		IJointStoreSourceRef mJointStoreSrc;
+
+		GestureRecognizer mRecognizer;
+		std::mutex mRecognizerMutex;
+		GestureStats mStats;
+
+		INT64 mLastRelativeTime;
+		double mPerformanceFrequency; // counts per second
+
+		std::vector<GestureMatch> mMatches;
+		std::vector<GestureEvent> mEvents; // of the current body frame
+	};
+
+	typedef std::shared_ptr<GestureStage> GestureStageRef;
+};
+
+#endif //__KCD_GESTURE_STAGE_H__
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef __KCD_HOLE_FILLING_H__
+#define __KCD_HOLE_FILLING_H__
+
+#include <Kinect.h>
+#include "KCDUtils.h"
+
+/*
+* Depth hole filling, run on the depth and body index planes before mask generation
+* First, short horizontal runs of invalid (zero) depth take the depth and body index of
+* the farther run end: IR/color parallax shadows are filled with background and silhouettes don't grow.
+* Then the remaining holes take their farthest valid 4-neighbour, one pixel per iteration,
+* eight pixels at a time with SSE2, so holes inside a body close up from all sides.
+* Run length and iteration count bound both the cost and the largest hole that gets closed.
+*/
+
+namespace kcd
+{
+	class DepthHoleFiller
+	{
+	public:
+		DepthHoleFiller();
+		virtual ~DepthHoleFiller();
+
+		void allocate(int width, int height);
+		void release();
+
+		void setIterations(int iterations) { mIterations = iterations; }
+		int getIterations() const { return mIterations; }
+		void setMaxRunLength(int pixels) { mMaxRunLength = pixels; }
+
+		void fill(const UINT16* depthBuffer, const BYTE* bodyIndexBuffer);
+
+		// contiguous width x height planes, valid until the next fill()
+		const UINT16* getDepthBuffer() const { return mDepthOut; }
+		const BYTE* getBodyIndexBuffer() const { return mBodyIndexOut; }
+
+	private:
+		int mWidth;
+		int mHeight;
+		int mStride; // padded row length of the work planes, in pixels
+		int mIterations;
+		int mMaxRunLength;
+
+		// work planes, padded with an invalid column on each side
+		UINT16* mDepthPlanes[2];
+		UINT16* mBodyPlanes[2];
+
+		UINT16* mDepthOut;
+		BYTE* mBodyIndexOut;
+
+		void fillRowRuns(UINT16* depthRow, UINT16* bodyRow);
+		void iterate(const UINT16* depthSrc, const UINT16* bodySrc, UINT16* depthDst, UINT16* bodyDst);
+	};
+};
+
+#endif //__KCD_HOLE_FILLING_H__
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef __KCD_IMAGE_PUBLISHER_H__
+#define __KCD_IMAGE_PUBLISHER_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <condition_variable>
+#include "KCDPipeline.h"
+#include "KCDBufferPool.h"
+
+/*
+* Backing of IImageOutput: frames written into pooled buffers and handed out as views of them, without copies
+* The pipeline thread leases a buffer, writes the frame into it and publishes it. A view shares the lease,
+* so a buffer stays untouched while a consumer holds its view and goes back to the pool with the last one.
+* When the pool is exhausted the stage gets a scratch buffer that is never published, and the frame is counted
+* as held back.
+*/
+
+#define IMAGE_PUBLISHER_DEFAULT_BUFFERS 4
+
+namespace kcd
+{
+	struct ImagePublisherStats
+	{
+		UINT64 published;
+		UINT64 heldBack; // frames written to the scratch buffer, the pool exhausted
+	};
+
+	class ImagePublisher
+	{
+	public:
+		ImagePublisher();
+		virtual ~ImagePublisher();
+
+		// before allocate(); a pool of its own otherwise
+		void setBufferPool(BufferPoolRef pool) { mPool = pool; }
+
+		// reserves the buffers in the pool
+		void allocate(int width, int height, ImageFormat format, int buffers = IMAGE_PUBLISHER_DEFAULT_BUFFERS);
+		// drops the publisher's leases; buffers still viewed return to the pool with their last view
+		void release();
+
+		// pipeline thread: 16 byte aligned, width * height pixels of the format, valid until the next acquireBuffer
+		BYTE* acquireBuffer();
+		// pipeline thread: the acquired buffer becomes the latest image
+		void publish(UINT64 frameId);
+
+		ImageViewRef tryGetLatest();
+		ImageViewRef waitForNewer(UINT64 frameId, DWORD timeoutMilliseconds);
+
+		ImagePublisherStats getStats();
+
+	private:
+		ImagePublisher(ImagePublisher const&);
+		void operator=(ImagePublisher const&);
+
+		BufferPoolRef mPool;
+		ImageFormat mFormat;
+		int mWidth;
+		int mHeight;
+
+		BufferLease mAcquired; // empty: none, or the scratch buffer
+		BufferLease mLatest;
+		BufferLease mScratch; // leased for the publisher's lifetime
+		std::mutex mLeasesMutex;
+		std::condition_variable mPublished;
+
+		ImagePublisherStats mStats; // under mLeasesMutex
+	};
+};
+
+#endif //__KCD_IMAGE_PUBLISHER_H__
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef __KCD_JOINT_FILTER_H__
+#define __KCD_JOINT_FILTER_H__
+
+#include <Kinect.h>
+#include "KCDUtils.h"
+#include "KCDJointStore.h"
+
+/*
+* Joint smoothing and prediction, for every joint of every body
+* Each camera space coordinate is a channel: a One Euro filter removes the jitter
+* (low cutoff at rest, opening up with speed), then a Holt double exponential smoother
+* tracks level and trend, the trend being what predictions extrapolate with.
+* Channels are laid out per axis in JointStore order and updated four at a time with SSE.
+*/
+
+#define JOINT_FILTER_STRIDE ((JointStore::Size + 3) & ~3)
+#define JOINT_FILTER_CHANNELS (3 * JOINT_FILTER_STRIDE)
+
+namespace kcd
+{
+	struct JointFilterParams
+	{
+		float minCutoff; // Hz, One Euro cutoff at rest
+		float beta; // Hz per m/s, cutoff increase with speed
+		float derivativeCutoff; // Hz, for the speed estimate
+		float levelSmoothing; // Holt alpha, 1 follows the One Euro output
+		float trendSmoothing; // Holt beta, 0 never updates the trend
+	};
+
+	struct JointFilterStats
+	{
+		UINT samples; // one frame ahead predictions checked against the next frame
+		float meanError; // meters
+		float maxError; // meters
+		float processMicroseconds; // whole stage, filled by JointFilterStage
+	};
+
+	class JointFilter
+	{
+	public:
+		JointFilter();
+		virtual ~JointFilter();
+
+		void setParams(const JointFilterParams& params);
+		void setParams(JointType jointType, const JointFilterParams& params);
+		const JointFilterParams& getParams(JointType jointType) const { return mParams[jointType]; }
+
+		void reset();
+
+		// one sensor frame, dt in seconds since the previous one
+		void filter(const JointStore& raw, float dt);
+
+		// joint i (JointStore index) on axis a is channel a * JOINT_FILTER_STRIDE + i
+		const float* getLevel() const { return mLevel; }
+		const float* getTrend() const { return mTrend; } // per second
+
+		JointFilterStats getStats() const { return mStats; }
+		void resetStats();
+
+	private:
+		JointFilterParams mParams[JointType_Count];
+
+		// per channel parameters, expanded from mParams
+		float mMinCutoff[JOINT_FILTER_CHANNELS];
+		float mBeta[JOINT_FILTER_CHANNELS];
+		float mDerivativeCutoff[JOINT_FILTER_CHANNELS];
+		float mLevelSmoothing[JOINT_FILTER_CHANNELS];
+		float mTrendSmoothing[JOINT_FILTER_CHANNELS];
+
+		float mRaw[JOINT_FILTER_CHANNELS];
+		float mSmoothed[JOINT_FILTER_CHANNELS]; // One Euro output
+		float mDerivative[JOINT_FILTER_CHANNELS];
+		float mLevel[JOINT_FILTER_CHANNELS];
+		float mTrend[JOINT_FILTER_CHANNELS];
+
+		JointMask mInitialized[BODY_COUNT];
+		UINT64 mTrackingId[BODY_COUNT];
+
+		JointFilterStats mStats;
+		double mErrorSum;
+
+		void expandParams(int jointType);
+	};
+};
+
+#endif //__KCD_JOINT_FILTER_H__
\ No newline at end of file
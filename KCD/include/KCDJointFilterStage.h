@@ -0,0 +1,101 @@
+#ifndef __KCD_JOINT_FILTER_STAGE_H__
+#define __KCD_JOINT_FILTER_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "KCDJointFilter.h"
+
+#define JOINT_FILTER_MIN_DT (1.0f / 120.0f)
+#define JOINT_FILTER_MAX_DT 0.25f
+#define JOINT_FILTER_MAX_HORIZON 0.2f
+#define JOINT_FILTER_VELOCITY_STEP 0.1f // seconds ahead used to map velocities to color space
+
+/*
+* Filters the joints of every tracked body once per body frame, timed by the sensor RelativeTime
+* The app thread extrapolates the latest filtered frame to the expected render time:
+* sensor latency + time since the frame was filtered + one app frame (GlobalTime delta)
+*/
+
+namespace kcd
+{
+	struct FilteredJoints
+	{
+		JointStore joints; // filtered positions and their color space positions, at the sensor frame time
+		float velocityX[JointStore::Size]; // m/s
+		float velocityY[JointStore::Size];
+		float velocityZ[JointStore::Size];
+		float colorVelocityX[JointStore::Size]; // pixels/s
+		float colorVelocityY[JointStore::Size];
+		INT64 relativeTime;
+		INT64 filteredCounter; // QueryPerformanceCounter when filtered
+	};
+
+	class JointFilterStage : public IStage, public IJointStoreOutput
+	{
+	public:
+		JointFilterStage();
+		virtual ~JointFilterStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+		void setJointStoreSource(IJointStoreSourceRef jointStoreSrc);
+
+		void setFilterParams(const JointFilterParams& params);
+		void setFilterParams(JointType jointType, const JointFilterParams& params);
+
+		// capture to frame arrival, not measurable from here
+		void setSensorLatency(float seconds) { mSensorLatency = seconds; }
+
+		JointFilterStats getFilterStats();
+		void resetFilterStats();
+
+		// filtered joints of the latest body frame, any thread
+		virtual void copyLatestJoints(JointStore& joints);
+
+		// joints predicted at the render time of the current app frame, app thread only
+		void copyPredictedJoints(JointStore& joints);
+
+		virtual HRESULT thread_setup();
+		virtual HRESULT thread_process();
+		virtual void update();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+		IJointStoreSourceRef mJointStoreSrc;
+
+		JointFilter mFilter;
+		std::mutex mFilterMutex;
+		JointFilterStats mStats;
+
+		INT64 mLastRelativeTime;
+		double mPerformanceFrequency; // counts per second
+		float mSensorLatency;
+
+		// mapping scratch: filtered positions, then positions one velocity step ahead
+		CameraSpacePoint mCameraPoints[2 * JointStore::Size];
+		ColorSpacePoint mColorPoints[2 * JointStore::Size];
+		int mMappedJoints[JointStore::Size];
+
+		// triple buffered: written by the thread, latest complete, read by the app
+		FilteredJoints mFiltered[3];
+		int mFilteredBack;
+		int mFilteredPending;
+		int mFilteredFront;
+		std::mutex mFilteredMutex;
+		std::atomic<bool> mHasNewFilteredJoints;
+
+		JointStore mLatestJoints; // filtered joints of mFiltered[mFilteredBack] once published
+		std::mutex mLatestJointsMutex;
+
+		JointStore mPredicted; // app thread
+
+		HRESULT mapToColorSpace(ICoordinateMapper* coordinateMapper, FilteredJoints& filtered);
+	};
+
+	typedef std::shared_ptr<JointFilterStage> JointFilterStageRef;
+};
+
+#endif //__KCD_JOINT_FILTER_STAGE_H__
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef __KCD_JOINT_HISTORY_H__
+#define __KCD_JOINT_HISTORY_H__
+
+#include <Kinect.h>
+#include <atomic>
+#include "KCDUtils.h"
+#include "KCDJointStore.h"
+
+/*
+* Ring of timestamped skeleton samples, all bodies and joints, allocated once
+* One writer (the pipeline thread) pushes a sample per body frame; readers on any thread query
+* position, velocity and acceleration of every joint of a body at a given sensor time.
+* Every slot is guarded by its own sequence counter (seqlock): the writer never waits,
+* readers retry in the rare case the slot they copied was being overwritten.
+*
+* Queries use a window of four samples around the requested time: positions are interpolated
+* linearly, velocity and acceleration are central differences at the two inner samples,
+* interpolated the same way. Joints are processed four at a time with SSE.
+*/
+
+#define JOINT_HISTORY_CAPACITY 64 // about two seconds of body frames
+#define JOINT_HISTORY_STRIDE ((JointType_Count + 3) & ~3)
+#define JOINT_HISTORY_RETRIES 4
+
+namespace kcd
+{
+	struct JointKinematics
+	{
+		double time; // seconds, sensor clock
+		JointMask valid; // joints seen in every sample of the window
+		UINT64 trackingId;
+		// [axis][JointType], meters, m/s, m/s^2
+		float position[3][JOINT_HISTORY_STRIDE];
+		float velocity[3][JOINT_HISTORY_STRIDE];
+		float acceleration[3][JOINT_HISTORY_STRIDE];
+	};
+
+	class JointHistory
+	{
+	public:
+		JointHistory(UINT capacity = JOINT_HISTORY_CAPACITY);
+		virtual ~JointHistory();
+
+		void clear();
+
+		// writer only, relativeTime in 100 ns units
+		void push(const JointStore& joints, INT64 relativeTime);
+
+		// time of the newest and oldest queryable samples in seconds, false while fewer than four samples are held
+		bool getTimeRange(double& oldest, double& newest) const;
+
+		/*
+		* Kinematics of all joints of a body at the given time, clamped to the held range
+		* Returns false without enough samples, when the body changed identity inside the window,
+		* or when the writer kept overwriting the window
+		*/
+		bool query(int body, double time, JointKinematics& kinematics) const;
+
+	private:
+		JointHistory(JointHistory const&);
+		void operator=(JointHistory const&);
+
+		struct Slot
+		{
+			std::atomic<UINT> sequence; // odd while being written
+			UINT64 index; // push count of the sample held
+			double time;
+			UINT64 trackingId[BODY_COUNT];
+			JointMask seen[BODY_COUNT];
+			float position[BODY_COUNT][3][JOINT_HISTORY_STRIDE];
+		};
+
+		struct Sample
+		{
+			double time;
+			UINT64 trackingId;
+			JointMask seen;
+			float position[3][JOINT_HISTORY_STRIDE];
+		};
+
+		Slot* mSlots;
+		UINT mCapacity;
+		std::atomic<UINT64> mCount;
+
+		bool readSample(UINT64 index, int body, Sample& sample) const;
+		bool readTime(UINT64 index, double& time) const;
+	};
+};
+
+#endif //__KCD_JOINT_HISTORY_H__
\ No newline at end of file
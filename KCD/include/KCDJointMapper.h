@@ -0,0 +1,57 @@
+#ifndef __KCD_JOINT_MAPPER_H__
+#define __KCD_JOINT_MAPPER_H__
+
+#include <Kinect.h>
+#include "KCDUtils.h"
+#include "KCDJointStore.h"
+
+/*
+* Color, depth and screen space positions of every seen joint of a joint store
+* All joints of all bodies are gathered and mapped with one MapCameraPointsToColorSpace and one
+* MapCameraPointsToDepthSpace call; joints whose camera position did not change since the last map
+* reuse their cached results, so a body frame read twice costs no mapper call at all.
+*/
+
+namespace kcd
+{
+	class JointMapper
+	{
+	public:
+		JointMapper();
+		virtual ~JointMapper();
+
+		// screen space is depth space scaled to this size, the depth frame size by default
+		void setScreenSize(float width, float height);
+
+		// the next map calls the mapper for every joint, after the store was cleared
+		void invalidate();
+
+		HRESULT map(ICoordinateMapper* coordinateMapper, JointStore& joints);
+
+		// of the latest map: mapper calls, joints mapped by the mapper, joints taken from the cache
+		UINT getMapperCalls() const { return mMapperCalls; }
+		UINT getMappedCount() const { return mMappedCount; }
+		UINT getCachedCount() const { return mCachedCount; }
+
+	private:
+		float mScreenScaleX;
+		float mScreenScaleY;
+
+		UINT mMapperCalls;
+		UINT mMappedCount;
+		UINT mCachedCount;
+
+		// camera position each cached result was mapped from
+		JointMask mCached[BODY_COUNT];
+		float mCachedX[JointStore::Size];
+		float mCachedY[JointStore::Size];
+		float mCachedZ[JointStore::Size];
+
+		int mMappedJoints[JointStore::Size];
+		CameraSpacePoint mCameraPoints[JointStore::Size];
+		ColorSpacePoint mColorPoints[JointStore::Size];
+		DepthSpacePoint mDepthPoints[JointStore::Size];
+	};
+};
+
+#endif //__KCD_JOINT_MAPPER_H__
\ No newline at end of file
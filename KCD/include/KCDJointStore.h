@@ -0,0 +1,70 @@
+#ifndef __KCD_JOINT_STORE_H__
+#define __KCD_JOINT_STORE_H__
+
+#include <Kinect.h>
+#include "KCDUtils.h"
+
+/*
+* Joint store: every joint of every body, in flat structure-of-arrays form
+* A joint lives at index(body, jointType) in each array, no lookups, no allocations.
+* Per body, the joints seen this frame and the joints seen the frame before are kept as bitmasks
+* (bit n is JointType n), so appear / move / disappear fall out of two mask operations.
+*/
+
+typedef UINT JointMask;
+
+#define JOINT_BIT(jointType) (1u << (jointType))
+#define JOINT_MASK_ALL ((1u << JointType_Count) - 1u)
+#define JOINT_MASK_DEFAULT (JOINT_BIT(JointType_HandLeft) | JOINT_BIT(JointType_HandRight) | JOINT_BIT(JointType_Head) | JOINT_BIT(JointType_SpineBase))
+
+namespace kcd
+{
+	class JointStore
+	{
+	public:
+		static const int BodyCount = BODY_COUNT;
+		static const int JointCount = JointType_Count;
+		static const int Size = BODY_COUNT * JointType_Count;
+
+		static int index(int body, int jointType) { return body * JointType_Count + jointType; }
+
+	public:
+		JointStore();
+
+		void clear();
+
+		// the current seen masks become the previous ones
+		void beginFrame();
+
+		// reads the subscribed joints of a tracked body, inferred joints count as seen if trackInferred
+		HRESULT updateBody(int body, IBody* pBody, JointMask subscription, bool trackInferred);
+
+		JointMask appeared(int body) const { return seen[body] & ~previous[body]; }
+		JointMask moved(int body) const { return seen[body] & previous[body]; }
+		JointMask disappeared(int body) const { return previous[body] & ~seen[body]; }
+
+		// camera space, meters
+		float positionX[Size];
+		float positionY[Size];
+		float positionZ[Size];
+
+		// color space, pixels
+		float colorX[Size];
+		float colorY[Size];
+
+		// depth space, pixels, and depth space scaled to the screen (JointMapper)
+		float depthX[Size];
+		float depthY[Size];
+		float screenX[Size];
+		float screenY[Size];
+
+		BYTE trackingState[Size]; // TrackingState
+
+		JointMask seen[BODY_COUNT];
+		JointMask previous[BODY_COUNT];
+		UINT64 trackingId[BODY_COUNT];
+		bool isTracked[BODY_COUNT];
+	};
+};
+
+#endif //__KCD_JOINT_STORE_H__
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef __KCD_MAPPER_CALIBRATION_H__
+#define __KCD_MAPPER_CALIBRATION_H__
+
+#include <Kinect.h>
+#include "KCDUtils.h"
+#include "SoftwareMapper.h"
+
+#define MAPPER_CALIBRATION_GRID 32 // depth pixels between sampled rays
+#define MAPPER_CALIBRATION_DEPTHS 5 // sampled depths per ray
+#define MAPPER_VALIDATION_DEPTHS 4 // held out depths per ray, between the sampled ones
+#define MAPPER_MAX_COLOR_ERROR 4.0f // color pixels, mean over the held out samples
+#define MAPPER_MAX_DEPTH_ERROR 1.0f // depth pixels, mean over the held out samples
+
+namespace kcd
+{
+	/*
+	* Calibration of the sensor mapper for SoftwareMapper
+	* The depth intrinsics and the depth to camera space table are taken as they are. Rays on a grid, at several
+	* depths, are mapped to color and depth space by the sensor and the color projection is fitted to them.
+	* Rays halfway between, at depths in between, are mapped too and held out, to validate the software mapper
+	* against. The sensor reports zero intrinsics until it delivered frames, E_PENDING then.
+	*/
+	HRESULT exportMapperCalibration(ICoordinateMapper* coordinateMapper, MapperCalibration& calibration);
+
+	// the mapper against the held out samples of its calibration, E_FAIL without any or over the error limits
+	HRESULT validateMapperCalibration(const SoftwareMapper& mapper, MapperValidation& validation);
+};
+
+#endif //__KCD_MAPPER_CALIBRATION_H__
\ No newline at end of file
@@ -5,24 +5,85 @@
 #include <mutex>
 #include "KCDUtils.h"
 #include "KCDPipeline.h"
+#include "KCDCoordinateField.h"
+#include "KCDHoleFilling.h"
+#include "KCDDistanceTransform.h"
+#include "KCDContours.h"
 #include "opencv2\opencv.hpp"
 #include "cinder/gl/gl.h"
 #include "cinder/gl/Texture.h"
+#include "TextureStream.h"
+#include "KCDImagePublisher.h"
 
 namespace kcd
 {
-	class MaskStage : public IStage, public ITextureOutput //, public IMaskBufferSource
+	class MaskStage : public IStage, public ITextureOutput, public IDistanceFieldOutput, public ISilhouetteOutput, public IRegisteredDepthOutput, public IMaskBufferSource, public IImageOutput
 	{
 	public:
 		MaskStage();
 		virtual ~MaskStage();
 
 		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		// frame buffers, shared with the other stages; before setup()
+		void setBufferPool(BufferPoolRef pool) { mBufferPool = pool; }
 		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
 
+		/*
+		* Coordinate field settings, call before the pipeline is started
+		* Sparse mode maps every step-th color pixel (4 or 8) and interpolates the rest
+		* A validation interval > 0 runs the full mapping every that many frames to measure the error
+		*/
+		void setCoordinateFieldMode(CoordinateFieldMode mode, int sparseStep = 4);
+		void setCoordinateFieldValidationInterval(UINT frames);
+		CoordinateFieldStats getCoordinateFieldStats();
+
+		/*
+		* Hole filling on the depth and body index planes, call before the pipeline is started
+		* With holes filled the full resolution clean-up can be much lighter, see setMaskMorphology
+		*/
+		void setHoleFilling(bool enabled, int iterations = 4);
+
+		// open radius and blur size of the release build clean-up, 0 disables either
+		void setMaskMorphology(int openRadius, int blurSize);
+
 		virtual ci::gl::TextureRef getTextureReference();
-		//virtual MaskData getLatestMaskBuffer();
-		//virtual void invalidateLatestMaskBuffer();
+
+		// texture upload counters and timings
+		TextureStreamStats getTextureStreamStats() { return mMaskStream.getStats(); }
+
+		/*
+		* Signed distance to the silhouette, call before the pipeline is started
+		* Computed on the mask downsampled by the given factor (4 gives 480x270, about the depth frame size)
+		*/
+		void setDistanceField(bool enabled, int downsample = 4, float maxDistance = 32.0f, bool useRoi = true);
+		virtual DistanceFieldData getLatestDistanceField();
+		virtual ci::gl::TextureRef getDistanceTextureReference();
+
+		/*
+		* Outline of the active user as simplified polylines, call before the pipeline is started
+		* Traced on the mask downsampled by the given factor, tolerance is in downsampled pixels,
+		* borders shorter than minBorderLength downsampled pixels are dropped
+		*/
+		void setSilhouette(bool enabled, int downsample = 4, float tolerance = 1.5f, UINT minBorderLength = 16);
+		virtual const SilhouetteData& getLatestSilhouette();
+
+		/*
+		* Depth registered to the color frame, call before the pipeline is started
+		* Sampled in the mask pass from the same coordinate field, so the mapping is paid once; with it
+		* enabled the pass also runs without an active user. downsample > 1 publishes a reduced buffer and texture
+		*/
+		void setRegisteredDepth(bool enabled, int downsample = 1);
+		virtual RegisteredDepthData getLatestRegisteredDepth();
+		virtual ci::gl::TextureRef getRegisteredDepthTextureReference();
+
+		// the mask of the iteration being processed, pipeline thread only
+		virtual MaskData getLatestMaskBuffer();
+		virtual void invalidateLatestMaskBuffer();
+
+		// refined masks, published while a user is active
+		virtual ImageViewRef tryGetLatestImage();
+		virtual ImageViewRef waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds);
+		ImagePublisherStats getImageStats() { return mMaskImages.getStats(); }
 
 		virtual void setup();
 		//virtual HRESULT thread_setup();
@@ -42,16 +103,86 @@ namespace kcd
 		IDepthFrameReference* depthFrameRef;
 		IBodyIndexFrameReference* bodyIndexFrameRef;
 
-		DepthSpacePoint* mDepthCoordinates;
-		BYTE* mMaskBuffer;
-		std::mutex mMaskDataMutex;
+		BufferPoolRef mBufferPool;
+		BufferLease mDepthCoordinatesLease;
+		DepthSpacePoint* mDepthCoordinates; // held by mDepthCoordinatesLease
+		CoordinateFieldMode mFieldMode;
+		int mFieldStep;
+		SparseCoordinateField mSparseField;
+		UINT mFieldValidationInterval;
+		UINT mFramesSinceValidation;
+		CoordinateFieldStats mFieldStats;
+		std::mutex mFieldStatsMutex;
+
+		bool mHoleFillingEnabled;
+		DepthHoleFiller mHoleFiller;
+		int mMorphologyOpenRadius;
+		int mMorphologyBlurSize;
+
+		bool mDistanceFieldEnabled;
+		int mDistanceFieldDownsample;
+		int mDistanceFieldWidth;
+		int mDistanceFieldHeight;
+		DistanceTransform mDistanceTransform;
+		BYTE* mDistanceFieldMask;
+		// triple buffered: written by the thread, latest complete, read by the app
+		float* mDistanceBuffers[3];
+		BYTE* mClampedDistanceBuffers[3];
+		int mDistanceBack;
+		int mDistancePending;
+		int mDistanceFront;
+		std::mutex mDistanceFieldMutex;
+		std::atomic<bool> mHasNewDistanceField;
+		std::atomic<bool> mHasDistanceField;
+		GLuint distanceTextureName;
+		ci::gl::TextureRef mDistanceTextureRef;
+
+		bool mSilhouetteEnabled;
+		int mSilhouetteDownsample;
+		int mSilhouetteWidth;
+		int mSilhouetteHeight;
+		ContourTracer mContourTracer;
+		BYTE* mSilhouetteMask;
+		// triple buffered like the distance field
+		SilhouetteData mSilhouettes[3];
+		int mSilhouetteBack;
+		int mSilhouettePending;
+		int mSilhouetteFront;
+		std::mutex mSilhouetteMutex;
+		std::atomic<bool> mHasNewSilhouette;
+		bool mHasPublishedSilhouette; // pipeline thread only
+		double mPerformanceFrequency; // counts per millisecond
 
-		GLuint maskTextureName;
-		ci::gl::TextureRef mMaskTextureRef;
-		std::atomic<bool> mHasMaskData;
+		bool mRegisteredDepthEnabled;
+		int mRegisteredDepthDownsample;
+		int mRegisteredDepthWidth;
+		int mRegisteredDepthHeight;
+		UINT16* mRegisteredDepthFull; // full resolution pass output, downsampled only
+		// triple buffered like the distance field
+		UINT16* mRegisteredDepthBuffers[3];
+		UINT64 mRegisteredDepthFrameIds[3];
+		int mRegisteredDepthBack;
+		int mRegisteredDepthPending;
+		int mRegisteredDepthFront;
+		std::mutex mRegisteredDepthMutex;
+		std::atomic<bool> mHasNewRegisteredDepth;
+		std::atomic<bool> mHasRegisteredDepth;
+		GLuint registeredDepthTextureName;
+		ci::gl::TextureRef mRegisteredDepthTextureRef;
+
+		ImagePublisher mMaskImages;
+		BYTE* mMaskBuffer; // buffer of mMaskImages written this iteration, read by the distance field, silhouette and composite
+
+		TextureStream mMaskStream;
 		std::atomic<bool> mHasMaskTextureRef; //Depends on active user!
 
-		//MaskData mLatestMaskData;
+		MaskData mLatestMaskData;
+
+		void computeDistanceField();
+		void traceSilhouette(UINT64 frameId, bool hasUser);
+		void publishRegisteredDepth(UINT64 frameId);
+		void downsampleMask(BYTE* dst, int downsample, int width, int height);
+		HRESULT mapCoordinateField(ICoordinateMapper* coordinateMapper, const UINT16* depthBuffer);
 		
 	};
 
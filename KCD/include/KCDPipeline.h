@@ -3,11 +3,13 @@
 
 #include <vector>
 #include "Process.h"
-#include "cinder\app\App.h"
+#include "cinder/app/App.h"
 #include "cinder/gl/gl.h"
 #include "cinder/gl/Texture.h"
 #include <Kinect.h>
-#include "Subject.h"
+#include "EventBus.h"
+#include "KCDJointStore.h"
+#include "SoftwareMapper.h"
 #include <map>
 
 #define THREAD_SLEEP_DURATION 30L
@@ -31,9 +33,86 @@ namespace kcd
 	{
 		bool hasActiveUser;
 		IBody* body;
+		IBody* bodies[BODY_COUNT]; // all bodies of the frame, tracked or not, valid until post_thread_process
 		UINT activeBodyIndex;
 		UINT64 activeUserTrackingId;
-		float latestUserDistance;
+		float latestUserDistance; // squared, meters^2
+		INT64 relativeTime; // body frame time, 100 ns units
+		UINT engagedUserCount;
+		int engagedBodyIndex[BODY_COUNT]; // per engagement slot, -1 when free
+		UINT64 engagedTrackingId[BODY_COUNT];
+		Vector4 floorClipPlane; // body frame floor, normal up and sensor height; all 0 when the runtime has none
+	};
+
+	/*
+	* Per body index pixel statistics of one body index frame, depth pixel coordinates
+	* A body absent from the frame has pixelCount 0 and its other fields are undefined
+	*/
+	struct BodyIndexStats
+	{
+		UINT64 frameId;
+		UINT pixelCount[BODY_COUNT];
+		float centroidX[BODY_COUNT];
+		float centroidY[BODY_COUNT];
+		int minX[BODY_COUNT]; // bounding box, inclusive
+		int minY[BODY_COUNT];
+		int maxX[BODY_COUNT];
+		int maxY[BODY_COUNT];
+		float meanDepth[BODY_COUNT]; // meters, pixels with a depth reading only
+		bool valid; // false until the first frame
+	};
+
+	typedef enum FloorPlaneSource
+	{
+		FLOOR_PLANE_NONE,
+		FLOOR_PLANE_CLIP_PLANE, // from the body frame
+		FLOOR_PLANE_ESTIMATED // fitted to the depth frame
+	};
+
+	// height of a tracked body above the floor, meters
+	struct FloorUserMetrics
+	{
+		bool tracked;
+		UINT64 trackingId;
+		float height; // head joint, about a tenth of a meter under the top of the head
+		bool hasHeight; // false while the head joint isn't tracked
+		float floorDistance; // lowest foot joint, 0 standing, above 0 in a jump
+		bool hasFloorDistance; // false while no foot or ankle joint is tracked
+	};
+
+	/*
+	* Floor plane in camera space, x y z the unit normal pointing up and w the sensor height:
+	* a point is x * X + y * Y + z * Z + w above the floor
+	*/
+	struct FloorData
+	{
+		UINT64 frameId;
+		Vector4 plane;
+		FloorPlaneSource source;
+		float inlierRatio; // of the depth samples, estimated planes only
+		double estimateAge; // seconds since the depth frame of the estimate
+		FloorUserMetrics users[BODY_COUNT]; // per body index
+		bool hasFloor;
+	};
+
+	// interleaved for a single vertex buffer upload: position at offset 0, RGBA bytes at offset 12
+	struct PointCloudVertex
+	{
+		float x; // camera space, meters
+		float y;
+		float z;
+		BYTE r;
+		BYTE g;
+		BYTE b;
+		BYTE a;
+	};
+
+	struct PointCloudData
+	{
+		UINT64 frameId;
+		const PointCloudVertex* vertices; // valid until unlockLatestPointCloud()
+		UINT count;
+		bool hasPointCloud;
 	};
 
 	struct MaskData
@@ -42,6 +121,72 @@ namespace kcd
 		bool hasMask;
 	};
 
+	struct DistanceFieldData
+	{
+		const float* distance; // signed, in field pixels, negative inside the user
+		const BYTE* clampedDistance; // 128 on the silhouette, 128 +/- 127 at maxDistance
+		int width;
+		int height;
+		int downsample; // color pixels per field pixel
+		float maxDistance;
+		bool hasDistanceField;
+	};
+
+	/*
+	* Depth frame resampled to the color frame, millimeters, 0 where no depth pixel lands
+	* downsample > 1: point sampled every downsample-th color pixel, for a lighter upload
+	*/
+	struct RegisteredDepthData
+	{
+		UINT64 frameId;
+		const UINT16* depth;
+		int width;
+		int height;
+		int downsample; // color pixels per registered depth pixel
+		bool hasRegisteredDepth;
+	};
+
+	typedef enum ImageFormat
+	{
+		IMAGE_FORMAT_BGRA, // color frame, 4 bytes per pixel
+		IMAGE_FORMAT_GRAY, // mask, 1 byte per pixel
+		IMAGE_FORMAT_DEPTH, // millimeters, UINT16 per pixel
+		IMAGE_FORMAT_DEPTH_POINT // DepthSpacePoint per pixel, color to depth mapping
+	};
+
+	/*
+	* One published frame of an image output, immutable
+	* The pixels are the stage's own buffer: it isn't written again while any view of it is held,
+	* and stays allocated past the stage's teardown until the last view is dropped
+	*/
+	struct ImageView
+	{
+		UINT64 frameId; // device frame the image was built from
+		const BYTE* data;
+		int width;
+		int height;
+		int stride; // bytes per row
+		ImageFormat format;
+	};
+
+	typedef std::shared_ptr<const ImageView> ImageViewRef;
+
+	struct SilhouetteContour
+	{
+		UINT start; // first point in SilhouetteData::points
+		UINT count;
+		bool isHole;
+	};
+
+	struct SilhouetteData
+	{
+		UINT64 frameId; // device frame the mask was built from
+		std::vector<ci::Vec2f> points; // color frame pixels
+		std::vector<SilhouetteContour> contours;
+		double traceMilliseconds;
+		bool hasSilhouette;
+	};
+
 	struct PerformanceQueryData
 	{
 		double fps;
@@ -54,6 +199,21 @@ namespace kcd
 		ACTIVE_USER_LOST
 	};
 
+	typedef enum EngagedUserEventType
+	{
+		ENGAGED_USER_NEW,
+		ENGAGED_USER_LOST
+	};
+
+	// slots are stable: a user keeps its slot until lost, a freed slot is reused
+	struct EngagedUserEvent
+	{
+		EngagedUserEventType eventType;
+		int slot;
+		int bodyIndex;
+		UINT64 trackingId;
+	};
+
 	typedef enum BodyJointEventType
 	{
 		BODY_JOINT_APPEAR,
@@ -64,20 +224,59 @@ namespace kcd
 	struct BodyJointEvent
 	{
 	public:
-		BodyJointEvent() {}
+		BodyJointEvent() : frameId(0) {}
 		BodyJointEvent(BodyJointEventType _eventType,
 			JointType _jointType,
-			ci::Vec2f _screenSpacePosition) :
+			ci::Vec2f _screenSpacePosition,
+			UINT64 _frameId = 0) :
 			eventType(_eventType),
 			jointId(_jointType),
-			screenSpacePosition(_screenSpacePosition){}
+			screenSpacePosition(_screenSpacePosition),
+			frameId(_frameId){}
 		BodyJointEventType eventType;
 		JointType jointId;
 		ci::Vec2f screenSpacePosition;
+		UINT64 frameId;
 	};
 
+	/*
+	* All joint events of one device frame, contiguous, sharing a frameId
+	* events is only valid during the call
+	*/
+	typedef EventBatch<BodyJointEvent> BodyJointEventBatch;
+
 	typedef std::pair<JointType, BodyJointEvent> BodyJointEventPair;
 
+	typedef enum PoseEventType
+	{
+		POSE_BEGIN,
+		POSE_END
+	};
+
+	// a body started or stopped holding a pose of the library
+	struct PoseEvent
+	{
+		PoseEventType eventType;
+		int poseId;
+		int bodyIndex;
+		UINT64 trackingId;
+		float confidence;
+		UINT64 frameId;
+	};
+
+	/*
+	* A recognized gesture, reported once at its best alignment
+	* distance: mean squared distance per frame to the template, in torso lengths^2
+	*/
+	struct GestureEvent
+	{
+		int gestureId;
+		int bodyIndex;
+		UINT64 trackingId;
+		float distance;
+		UINT64 frameId;
+	};
+
 	class IStage
 	{
 	public:
@@ -131,6 +330,10 @@ namespace kcd
 	public:
 		virtual IMultiSourceFrame* getLatestFrame() = 0;
 		virtual ICoordinateMapper* getCoordinateMapper() = 0;
+		virtual UINT64 getLatestFrameId() = 0;
+
+		// mapping without the sensor runtime, NULL until a calibration is loaded or exported
+		virtual const SoftwareMapper* getSoftwareMapper() = 0;
 	};
 	
 	class IBodyDataSource
@@ -139,6 +342,27 @@ namespace kcd
 		virtual BodyData getLatestBodyData() = 0;
 	};
 
+	class IJointStoreSource
+	{
+	public:
+		// joints of the frame being processed, pipeline thread only
+		virtual const JointStore& getLatestJoints() = 0;
+	};
+
+	class IBodyIndexStatsSource
+	{
+	public:
+		// statistics of the frame being processed, pipeline thread only
+		virtual const BodyIndexStats& getLatestBodyIndexStats() = 0;
+	};
+
+	class IColorBufferSource
+	{
+	public:
+		// BGRA color frame of the iteration being processed, NULL without one, pipeline thread only
+		virtual const BYTE* getLatestColorBuffer() = 0;
+	};
+
 	class ITimeSource
 	{
 	public:
@@ -171,6 +395,73 @@ namespace kcd
 		virtual ci::gl::TextureRef getTextureReference() = 0;
 	};
 
+	class IDistanceFieldOutput
+	{
+	public:
+		virtual DistanceFieldData getLatestDistanceField() = 0;
+		virtual ci::gl::TextureRef getDistanceTextureReference() = 0;
+	};
+
+	class IRegisteredDepthOutput
+	{
+	public:
+		// valid on the app thread until the next update
+		virtual RegisteredDepthData getLatestRegisteredDepth() = 0;
+
+		// GL_R16, normalized: millimeters / 65535
+		virtual ci::gl::TextureRef getRegisteredDepthTextureReference() = 0;
+	};
+
+	class ISilhouetteOutput
+	{
+	public:
+		// valid on the app thread until the next update
+		virtual const SilhouetteData& getLatestSilhouette() = 0;
+	};
+
+	class IImageOutput
+	{
+	public:
+		// latest published frame, NULL before the first; any thread, never waits on the pipeline
+		virtual ImageViewRef tryGetLatestImage() = 0;
+
+		// blocks until a frame newer than frameId is published, NULL on timeout
+		virtual ImageViewRef waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds) = 0;
+	};
+
+	class IJointStoreOutput
+	{
+	public:
+		// copies the joints of the latest processed frame
+		virtual void copyLatestJoints(JointStore& joints) = 0;
+	};
+
+	class IBodyIndexStatsOutput
+	{
+	public:
+		// latest complete statistics, any thread
+		virtual BodyIndexStats copyLatestBodyIndexStats() = 0;
+	};
+
+	class IFloorOutput
+	{
+	public:
+		// latest plane and user metrics, any thread
+		virtual FloorData copyLatestFloor() = 0;
+	};
+
+	class IPointCloudOutput
+	{
+	public:
+		// the latest complete cloud, kept from being replaced until unlocked; keep the lock short
+		virtual PointCloudData lockLatestPointCloud() = 0;
+		virtual void unlockLatestPointCloud() = 0;
+
+		// GL_ARRAY_BUFFER holding the latest cloud, uploaded in update() once asked for, 0 before
+		virtual GLuint getPointCloudBuffer() = 0;
+		virtual UINT getPointCloudBufferCount() = 0;
+	};
+
 	class IPerformanceOutput
 	{
 	public:
@@ -180,17 +471,41 @@ namespace kcd
 	typedef std::shared_ptr<Pipeline> PipelineRef;
 	typedef std::shared_ptr<IBodyDataSource> IBodyDataSourceRef;
 	typedef std::shared_ptr<IDeviceSource> IDeviceSourceRef;
+	typedef std::shared_ptr<IJointStoreSource> IJointStoreSourceRef;
+	typedef std::shared_ptr<IBodyIndexStatsSource> IBodyIndexStatsSourceRef;
+	typedef std::shared_ptr<IColorBufferSource> IColorBufferSourceRef;
 	typedef std::shared_ptr<ITimeSource> ITimeSourceRef;
 	typedef std::shared_ptr<IActiveUserDistanceSource> IActiveUserDistanceSourceRef;
 	typedef std::shared_ptr<IMaskBufferSource> IMaskBufferSourceRef;
 	typedef std::shared_ptr<ITextureOutput> ITextureOutputRef;
+	typedef std::shared_ptr<IDistanceFieldOutput> IDistanceFieldOutputRef;
+	typedef std::shared_ptr<IRegisteredDepthOutput> IRegisteredDepthOutputRef;
+	typedef std::shared_ptr<ISilhouetteOutput> ISilhouetteOutputRef;
+	typedef std::shared_ptr<IImageOutput> IImageOutputRef;
+	typedef std::shared_ptr<IJointStoreOutput> IJointStoreOutputRef;
+	typedef std::shared_ptr<IBodyIndexStatsOutput> IBodyIndexStatsOutputRef;
+	typedef std::shared_ptr<IFloorOutput> IFloorOutputRef;
+	typedef std::shared_ptr<IPointCloudOutput> IPointCloudOutputRef;
 	typedef std::shared_ptr<IPerformanceOutput> IPerformanceOutputRef;
 
-	typedef Subject<ActiveUserEvent> IActiveUserOutput;
+	// queued deliveries are dispatched in the stage's update()
+	typedef EventBus<ActiveUserEvent> IActiveUserOutput;
 	typedef std::shared_ptr<IActiveUserOutput> IActiveUserOutputRef;
 
-	typedef Subject<BodyJointEvent> IBodyJointOutput;
+	typedef EventBus<EngagedUserEvent> IEngagedUserOutput;
+	typedef std::shared_ptr<IEngagedUserOutput> IEngagedUserOutputRef;
+
+	typedef EventBus<BodyJointEvent> IBodyJointOutput;
 	typedef std::shared_ptr<IBodyJointOutput> IBodyJointOutputRef;
+
+	typedef EventBus<BodyJointEvent> IBodyJointBatchOutput; // one batch per device frame
+	typedef std::shared_ptr<IBodyJointBatchOutput> IBodyJointBatchOutputRef;
+
+	typedef EventBus<GestureEvent> IGestureOutput;
+	typedef std::shared_ptr<IGestureOutput> IGestureOutputRef;
+
+	typedef EventBus<PoseEvent> IPoseOutput;
+	typedef std::shared_ptr<IPoseOutput> IPoseOutputRef;
 };
 
 
@@ -0,0 +1,122 @@
+#ifndef __KCD_POINT_CLOUD_STAGE_H__
+#define __KCD_POINT_CLOUD_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+
+/*
+* Camera space point cloud of the depth frame, colored from the color frame, for particle rendering
+* Depth pixels go through the software mapper's cached ray and color tables four at a time with SSE2;
+* the body index filter and the depth range are applied in the same pass. An optional voxel grid averages
+* the points falling into each cell. The cloud is written to the back buffer of two and swapped in when complete,
+* the app thread reads the front one or has it uploaded as one vertex buffer in update().
+*/
+
+#define POINT_CLOUD_HASH_BITS 19 // voxel hash slots, twice the depth frame area
+
+namespace kcd
+{
+	typedef enum PointCloudFilter
+	{
+		POINT_CLOUD_ALL,
+		POINT_CLOUD_BODIES,
+		POINT_CLOUD_ACTIVE_USER
+	};
+
+	struct PointCloudParams
+	{
+		PointCloudParams() : filter(POINT_CLOUD_ALL), voxelSize(0), minDepth(0.5f), maxDepth(4.5f) {}
+
+		PointCloudFilter filter;
+		float voxelSize; // meters, 0 keeps every pixel
+		float minDepth; // meters
+		float maxDepth;
+	};
+
+	class PointCloudStage : public IStage, public IPointCloudOutput
+	{
+	public:
+		PointCloudStage();
+		virtual ~PointCloudStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+
+		// optional, points are white without it
+		void setColorBufferSource(IColorBufferSourceRef colorBufferSrc);
+
+		void setParams(const PointCloudParams& params);
+		PointCloudParams getParams();
+
+		// time of the latest cloud, extraction and downsampling
+		float getProcessMicroseconds() const { return mProcessMicroseconds; }
+
+		virtual PointCloudData lockLatestPointCloud();
+		virtual void unlockLatestPointCloud();
+		virtual GLuint getPointCloudBuffer();
+		virtual UINT getPointCloudBufferCount();
+
+		virtual HRESULT thread_process();
+		virtual HRESULT post_thread_process();
+		virtual void update();
+		virtual void teardown();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+		IColorBufferSourceRef mColorBufferSrc;
+
+		IDepthFrameReference* mDepthFrameRef;
+		IDepthFrame* mDepthFrame;
+		IBodyIndexFrameReference* mBodyIndexFrameRef;
+		IBodyIndexFrame* mBodyIndexFrame;
+
+		PointCloudParams mParams;
+		std::mutex mParamsMutex;
+
+		// double buffer, the pipeline fills the back one and swaps it to the front under mFrontMutex
+		std::vector<PointCloudVertex> mBuffers[2];
+		UINT mCounts[2];
+		UINT64 mFrameIds[2];
+		int mFront;
+		bool mHasPointCloud;
+		std::atomic<bool> mHasNewPointCloud;
+		std::mutex mFrontMutex;
+
+		// voxel grid: open addressing hash of cell keys, slots cleared lazily by stamp
+		struct VoxelSum
+		{
+			float x;
+			float y;
+			float z;
+			UINT r;
+			UINT g;
+			UINT b;
+			UINT count;
+		};
+
+		std::vector<UINT64> mVoxelKeys;
+		std::vector<UINT> mVoxelStamps;
+		std::vector<UINT> mVoxelIndices;
+		std::vector<VoxelSum> mVoxelSums;
+		UINT mVoxelStamp;
+
+		GLuint mVertexBuffer;
+		UINT mVertexBufferCount;
+		std::atomic<bool> mVertexBufferRequested;
+
+		double mPerformanceFrequency; // counts per second
+		std::atomic<float> mProcessMicroseconds;
+
+		UINT extract(const UINT16* depthBuffer, const BYTE* bodyIndexBuffer, const BYTE* colorBuffer, const PointCloudParams& params, int activeBody, PointCloudVertex* vertices);
+		UINT downsample(PointCloudVertex* vertices, UINT count, float voxelSize);
+	};
+
+	typedef std::shared_ptr<PointCloudStage> PointCloudStageRef;
+};
+
+#endif //__KCD_POINT_CLOUD_STAGE_H__
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef __KCD_POSE_CLASSIFIER_H__
+#define __KCD_POSE_CLASSIFIER_H__
+
+#include <Kinect.h>
+#include <vector>
+#include "KCDUtils.h"
+#include "KCDJointStore.h"
+#include "KCDPoseLibrary.h"
+
+/*
+* Held pose detection for every tracked body
+* The skeleton feature vector is compared to every library sample with SSE, four samples at a time,
+* the k nearest vote weighted by inverse distance. A pose begins once it wins with enterConfidence
+* for holdSeconds and ends when its share of the vote drops under exitConfidence.
+*/
+
+#define POSE_MAX_K 16
+
+namespace kcd
+{
+	typedef enum PoseTransitionType
+	{
+		POSE_TRANSITION_BEGIN,
+		POSE_TRANSITION_END
+	};
+
+	struct PoseClassifierParams
+	{
+		PoseClassifierParams() : k(5), maxDistance(0.04f), enterConfidence(0.7f), exitConfidence(0.4f), holdSeconds(0.5f) {}
+
+		UINT k;
+		float maxDistance; // nearest sample, mean squared distance per joint in torso lengths^2, farther is no pose
+		float enterConfidence;
+		float exitConfidence;
+		float holdSeconds;
+	};
+
+	struct PoseResult
+	{
+		int label; // -1 when nothing is close enough
+		float confidence; // vote share of label
+		float distance; // nearest sample, per joint
+	};
+
+	struct PoseTransition
+	{
+		PoseTransitionType type;
+		int pose;
+		int body;
+		UINT64 trackingId;
+		float confidence;
+	};
+
+	class PoseClassifier
+	{
+	public:
+		PoseClassifier();
+		virtual ~PoseClassifier();
+
+		void setLibrary(const PoseLibrary& library);
+		const PoseLibrary& getLibrary() const { return mLibrary; }
+
+		void setParams(const PoseClassifierParams& params);
+		const PoseClassifierParams& getParams() const { return mParams; }
+
+		void reset();
+
+		/*
+		* k nearest samples of a feature vector (getLibrary().getDimensions() floats)
+		* heldLabel: the share of the vote of this label is returned, -1 for none
+		*/
+		float classify(const float* features, int heldLabel, PoseResult& result);
+
+		// one body frame, time in seconds, transitions are appended, returns the bodies classified
+		UINT process(const JointStore& joints, double time, std::vector<PoseTransition>& transitions);
+
+		// the pose each body holds, -1 for none
+		int getPose(int body) const { return mBodies[body].pose; }
+
+	private:
+		struct BodyState
+		{
+			UINT64 trackingId;
+			int pose;
+			int candidate;
+			double candidateSince;
+			float confidence;
+		};
+
+		PoseLibrary mLibrary;
+		PoseClassifierParams mParams;
+		BodyState mBodies[BODY_COUNT];
+		UINT mFeatureJointCount;
+
+		std::vector<float> mFeatures;
+		std::vector<float> mVotes; // per label
+
+		// k nearest, sorted by distance
+		float mNearestDistance[POSE_MAX_K];
+		int mNearestLabel[POSE_MAX_K];
+
+		void insertNearest(float distance, int label, UINT k);
+		void endPose(int body, std::vector<PoseTransition>& transitions);
+	};
+};
+
+#endif //__KCD_POSE_CLASSIFIER_H__
\ No newline at end of file
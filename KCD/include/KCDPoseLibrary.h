@@ -0,0 +1,84 @@
+#ifndef __KCD_POSE_LIBRARY_H__
+#define __KCD_POSE_LIBRARY_H__
+
+#include <Kinect.h>
+#include <vector>
+#include <string>
+#include "KCDUtils.h"
+#include "KCDJointStore.h"
+
+/*
+* Labeled pose samples for nearest neighbor classification
+* A sample is the feature vector of one skeleton: the positions of the feature joints relative to SpineBase,
+* turned to face the sensor (hips along +X) and scaled by the torso length, x y z per joint in JointType order,
+* zero padded to a multiple of four floats.
+*
+* Binary file, little endian:
+*   header (32 bytes): magic "KPOS", version, joint mask, dimensions, sample count, label count, label bytes, reserved
+*   label names, zero terminated, padded to 4 bytes
+*   sample labels, one USHORT each, padded to 4 bytes
+*   sample features, count x dimensions floats
+* Loading is three reads straight into the final buffers.
+*/
+
+#define POSE_LIBRARY_MAGIC 0x534F504B // "KPOS"
+#define POSE_LIBRARY_VERSION 1
+#define POSE_MAX_LABELS 0xFFFF
+
+#define POSE_JOINT_MASK_DEFAULT (JOINT_BIT(JointType_SpineMid) | JOINT_BIT(JointType_SpineShoulder) | JOINT_BIT(JointType_Neck) | JOINT_BIT(JointType_Head) | \
+	JOINT_BIT(JointType_ShoulderLeft) | JOINT_BIT(JointType_ElbowLeft) | JOINT_BIT(JointType_WristLeft) | JOINT_BIT(JointType_HandLeft) | \
+	JOINT_BIT(JointType_ShoulderRight) | JOINT_BIT(JointType_ElbowRight) | JOINT_BIT(JointType_WristRight) | JOINT_BIT(JointType_HandRight))
+
+#define POSE_MIN_TORSO 0.1f // meters
+
+namespace kcd
+{
+	class PoseLibrary
+	{
+	public:
+		PoseLibrary(JointMask featureJoints = POSE_JOINT_MASK_DEFAULT);
+		virtual ~PoseLibrary();
+
+		void clear(JointMask featureJoints);
+
+		JointMask getFeatureJoints() const { return mFeatureJoints; }
+		UINT getDimensions() const { return mDimensions; }
+		UINT getCount() const { return static_cast<UINT>(mLabels.size()); }
+		UINT getLabelCount() const { return static_cast<UINT>(mLabelNames.size()); }
+
+		// index of the label, added if new, -1 when full
+		int addLabel(const std::string& name);
+		int findLabel(const std::string& name) const;
+		const std::string& getLabelName(int label) const { return mLabelNames[label]; }
+
+		// features: getDimensions() floats, see extractFeatures
+		bool addSample(int label, const float* features);
+
+		const float* getFeatures() const { return mFeatures.empty() ? NULL : &mFeatures[0]; }
+		const USHORT* getLabels() const { return mLabels.empty() ? NULL : &mLabels[0]; }
+
+		bool load(const std::string& path);
+		bool save(const std::string& path) const;
+
+		// ArmsDown, TPose, ArmsUp, RightHandUp and LeftHandUp, synthetic and jittered, default feature joints only
+		void addDefaultPoses(UINT samplesPerPose = 16);
+
+		// feature joints x 3, rounded up to a multiple of 4
+		static UINT dimensionsFor(JointMask featureJoints);
+
+		// joints that must be seen to extract features: the feature joints plus root, torso and hips
+		static JointMask requiredJoints(JointMask featureJoints);
+
+		// false when a required joint is missing or the torso is degenerate
+		static bool extractFeatures(const JointStore& joints, int body, JointMask featureJoints, float* features);
+
+	private:
+		JointMask mFeatureJoints;
+		UINT mDimensions;
+		std::vector<std::string> mLabelNames;
+		std::vector<USHORT> mLabels;
+		std::vector<float> mFeatures; // count x dimensions
+	};
+};
+
+#endif //__KCD_POSE_LIBRARY_H__
\ No newline at end of file
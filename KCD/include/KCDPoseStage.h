@@ -0,0 +1,86 @@
+#ifndef __KCD_POSE_STAGE_H__
+#define __KCD_POSE_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <vector>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "KCDPoseClassifier.h"
+#include "KCDBodyStage.h"
+
+#define POSE_EVENT_QUEUE_SIZE 64
+
+/*
+* Classifies the skeleton of every tracked body against a pose library once per body frame
+* Pose begin / end events are published on the pipeline thread once per body frame;
+* main thread subscribers get them in update()
+*/
+
+namespace kcd
+{
+	struct PoseStats
+	{
+		UINT librarySize; // samples
+		UINT classified; // bodies classified in the latest body frame
+		float processMicroseconds;
+	};
+
+	class PoseStage : public IStage, public IPoseOutput
+	{
+	public:
+		PoseStage();
+		virtual ~PoseStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+		void setJointStoreSource(IJointStoreSourceRef jointStoreSrc);
+
+		// stores the joints of the current library, updated on every library change
+		void setStoredJointsTarget(BodyStageRef body);
+
+		// app thread, poses held under the previous library are dropped without POSE_END
+		void setLibrary(const PoseLibrary& library);
+		bool loadLibrary(const std::string& path);
+
+		// empty for an unknown pose id
+		std::string getPoseName(int poseId);
+
+		// joints the library needs from the joint store
+		JointMask getRequiredJoints();
+
+		void setParams(const PoseClassifierParams& params);
+
+		PoseStats getStats();
+
+		// events lost because the app thread or a dispatcher fell behind
+		UINT64 getDroppedEventCount() const { return this->getDroppedCount(); }
+
+		virtual HRESULT thread_setup();
+		virtual HRESULT thread_process();
+		virtual void update();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+		IJointStoreSourceRef mJointStoreSrc;
+		BodyStageRef mStoredJointsTarget;
+
+		PoseClassifier mClassifier;
+		std::mutex mClassifierMutex;
+		PoseStats mStats;
+
+		// label names, guarded by mClassifierMutex
+		std::vector<std::string> mPoseNames;
+
+		INT64 mLastRelativeTime;
+		double mPerformanceFrequency; // counts per second
+
+		std::vector<PoseTransition> mTransitions;
+		std::vector<PoseEvent> mEvents; // of the current body frame
+	};
+
+	typedef std::shared_ptr<PoseStage> PoseStageRef;
+};
+
+#endif //__KCD_POSE_STAGE_H__
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef __KCD_SHARED_FRAME_STAGE_H__
+#define __KCD_SHARED_FRAME_STAGE_H__
+
+#include <Kinect.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include "KCDUtils.h"
+#include "KCDPipeline.h"
+#include "SharedFrame.h"
+
+/*
+* Publishes the processed frame to other processes on the machine: BGRA color, the active user's mask,
+* the joints of every tracked body and the frame context, into a SharedFrameWriter ring
+* Other apps open it with SharedFrameSubscriber and read in place, without touching the sensor or redoing
+* the conversion, mask and body work. Disabled by default: a full color frame is copied into the ring
+* for every new device frame that has color. The ring is created on the pipeline thread when first enabled.
+*/
+
+namespace kcd
+{
+	class SharedFrameStage : public IStage
+	{
+	public:
+		SharedFrameStage();
+		virtual ~SharedFrameStage();
+
+		void setDeviceSource(IDeviceSourceRef deviceSrc);
+		void setBodyDataSource(IBodyDataSourceRef bodyDataSrc);
+		void setJointStoreSource(IJointStoreSourceRef jointStoreSrc);
+		void setColorBufferSource(IColorBufferSourceRef colorBufferSrc);
+		void setMaskBufferSource(IMaskBufferSourceRef maskBufferSrc);
+
+		// before enabling
+		void setName(const std::string& name);
+		void setEnabled(bool enabled) { mEnabled = enabled; }
+		bool isEnabled() const { return mEnabled; }
+
+		// false when the ring couldn't be created
+		bool isPublishing() const { return mIsPublishing; }
+
+		// time of the latest publication
+		float getPublishMicroseconds() const { return mPublishMicroseconds; }
+
+		virtual HRESULT thread_process();
+		virtual void teardown();
+
+	private:
+		IDeviceSourceRef mDeviceSrc;
+		IBodyDataSourceRef mBodyDataSrc;
+		IJointStoreSourceRef mJointStoreSrc;
+		IColorBufferSourceRef mColorBufferSrc;
+		IMaskBufferSourceRef mMaskBufferSrc;
+
+		std::string mName;
+		std::mutex mNameMutex;
+		std::atomic<bool> mEnabled;
+		std::atomic<bool> mIsPublishing;
+
+		SharedFrameWriter mWriter;
+
+		double mPerformanceFrequency; // counts per second
+		std::atomic<float> mPublishMicroseconds;
+
+		UINT64 mLastFrameId;
+
+		void writeJoints(SharedFrameSlotHeader* slot);
+	};
+
+	typedef std::shared_ptr<SharedFrameStage> SharedFrameStageRef;
+};
+
+#endif //__KCD_SHARED_FRAME_STAGE_H__
\ No newline at end of file
@@ -4,11 +4,46 @@
 #include "KCDPipeline.h"
 #include "KCDDeviceStage.h"
 #include "KCDColorStage.h"
+#include "KCDDepthStage.h"
 #include "KCDActiveUserStage.h"
+#include "KCDBodyIndexStatsStage.h"
+#include "KCDFloorStage.h"
 #include "KCDBodyStage.h"
+#include "KCDJointFilterStage.h"
+#include "KCDGestureStage.h"
+#include "KCDPoseStage.h"
 #include "KCDMaskStage.h"
+#include "KCDCompositeStage.h"
+#include "KCDPointCloudStage.h"
+#include "KCDSharedFrameStage.h"
+#include "KCDEventRecorderStage.h"
 #include "KCDPerformanceQueryStage.h"
 
+// stages that only run when the app asks for them, their outputs stay empty otherwise
+typedef enum NUIOptionalStage
+{
+	NUI_STAGE_DEPTH = 1 << 0,
+	NUI_STAGE_POINT_CLOUD = 1 << 1,
+	NUI_STAGE_FLOOR = 1 << 2,
+	NUI_STAGE_JOINT_FILTER = 1 << 3,
+	NUI_STAGE_GESTURE = 1 << 4,
+	NUI_STAGE_POSE = 1 << 5,
+	NUI_STAGE_EVENT_RECORDER = 1 << 6
+};
+
+// read once in NUIManager::setup, the pipeline is started with it
+struct NUISettings
+{
+	NUISettings() : stages(0), holeFilling(false), maskOpenRadius(3), maskBlurSize(11) {}
+
+	UINT stages; // NUIOptionalStage bits
+
+	// depth hole filling before the mask; with holes filled the clean-up can be much lighter, e.g. 1 and 5
+	bool holeFilling;
+	int maskOpenRadius;
+	int maskBlurSize;
+};
+
 class NUIManager
 {
 public:
@@ -23,23 +58,62 @@ public:
 
 	virtual ~NUIManager();
 
-	void setup();
+	void setup(const NUISettings& settings = NUISettings());
 	void teardown();
 	//void debugDraw();
 
 	kcd::ITextureOutputRef getColorTextureOutput();
+	kcd::ITextureOutputRef getDepthTextureOutput();
 	kcd::ITextureOutputRef getMaskTextureOutput();
+	kcd::ITextureOutputRef getCompositeTextureOutput();
+	kcd::IImageOutputRef getColorImageOutput();
+	kcd::IImageOutputRef getDepthImageOutput();
+	kcd::IImageOutputRef getMaskImageOutput();
+	kcd::IDistanceFieldOutputRef getDistanceFieldOutput();
+	kcd::IRegisteredDepthOutputRef getRegisteredDepthOutput();
+	kcd::ISilhouetteOutputRef getSilhouetteOutput();
 	kcd::IPerformanceOutputRef getPerformaceOutput();
 	kcd::IActiveUserOutputRef getActiveUserOutput();
+	kcd::IEngagedUserOutputRef getEngagedUserOutput();
+	kcd::IBodyIndexStatsOutputRef getBodyIndexStatsOutput();
+	kcd::IFloorOutputRef getFloorOutput();
 	kcd::IBodyJointOutputRef getBodyJointOutput();
+	kcd::IPointCloudOutputRef getPointCloudOutput();
+	kcd::IBodyJointBatchOutputRef getBodyJointBatchOutput();
+	kcd::IJointStoreOutputRef getJointStoreOutput();
+	kcd::IJointStoreOutputRef getPredictedJointOutput();
+	const kcd::JointHistory& getJointHistory();
+	kcd::BodyStageRef getBodyStage();
+	kcd::GestureStageRef getGestureStage();
+	kcd::PoseStageRef getPoseStage();
+	kcd::PointCloudStageRef getPointCloudStage();
+	kcd::FloorStageRef getFloorStage();
+	kcd::DepthStageRef getDepthStage();
+	kcd::CompositeStageRef getCompositeStage();
+	kcd::BufferPoolRef getBufferPool();
+	kcd::SharedFrameStageRef getSharedFrameStage();
+	kcd::EventRecorderStageRef getEventRecorderStage();
+
+	// of the settings given to setup
+	bool isStageEnabled(NUIOptionalStage stage) const;
 
 public:
 	/* A number of static convenience methods */
 	static ci::gl::TextureRef GetColorTextureRef();
+	static ci::gl::TextureRef GetDepthTextureRef();
 	static ci::gl::TextureRef GetMaskTextureRef();
+	static ci::gl::TextureRef GetCompositeTextureRef();
+	static ci::gl::TextureRef GetDistanceTextureRef();
+	static ci::gl::TextureRef GetRegisteredDepthTextureRef();
+	static const kcd::SilhouetteData& GetSilhouetteData();
 	static const kcd::PerformanceQueryData& GetPerformaceQueryData();
-	static void AttachActiveUserObserver(Observer<kcd::ActiveUserEvent>& observer);
-	static void AttachBodyJointObserver(Observer<kcd::BodyJointEvent>& observer);
+	// the subscription lasts as long as the returned handle
+	static EventSubscriptionRef SubscribeActiveUser(const kcd::IActiveUserOutput::Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD);
+	static EventSubscriptionRef SubscribeEngagedUser(const kcd::IEngagedUserOutput::Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD);
+	static EventSubscriptionRef SubscribeBodyJoint(const kcd::IBodyJointOutput::Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD);
+	static EventSubscriptionRef SubscribeBodyJointBatch(const kcd::IBodyJointBatchOutput::Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD);
+	static EventSubscriptionRef SubscribeGesture(const kcd::IGestureOutput::Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD);
+	static EventSubscriptionRef SubscribePose(const kcd::IPoseOutput::Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD);
 
 private:
 	NUIManager();
@@ -47,17 +121,31 @@ private:
 	void operator=(NUIManager const&);
 
 	void update();
+	void addOptionalStage(kcd::IStageRef stage, UINT enabled);
 
 	boost::signals2::connection mUpdateConnection;
 
 	kcd::PipelineRef mPipeline;
+	kcd::BufferPoolRef mBufferPool;
 	kcd::DeviceStageRef mDevice;
+	kcd::BodyIndexStatsStageRef mBodyIndexStats;
 	kcd::ActiveUserStageRef mActiveUser;
+	kcd::FloorStageRef mFloor;
 	kcd::BodyStageRef mBody;
+	kcd::JointFilterStageRef mJointFilter;
+	kcd::GestureStageRef mGesture;
+	kcd::PoseStageRef mPose;
 	kcd::MaskStageRef mMask;
 	kcd::ColorStageRef mColor;
+	kcd::DepthStageRef mDepth;
+	kcd::CompositeStageRef mComposite;
+	kcd::PointCloudStageRef mPointCloud;
+	kcd::SharedFrameStageRef mSharedFrame;
+	kcd::EventRecorderStageRef mEventRecorder;
 	kcd::PerformanceQueryStageRef mPerf;
 
+	UINT mStages; // NUIOptionalStage bits
+
 };
 
 #endif //__NUI_MANAGER_HEADER_H__
\ No newline at end of file
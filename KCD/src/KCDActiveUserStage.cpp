@@ -1,17 +1,15 @@
 #include "KCDActiveUserStage.h"
 #include <exception>
 #include <algorithm>
+#include <string.h>
 
 using namespace kcd;
 
 ActiveUserStage::ActiveUserStage() :
 mDeviceSrc(NULL),
-mDistanceSrc(NULL),
 mBodyFrame(NULL),
 bodyFrameRef(NULL),
-mHasNewActiveUserData(false),
-mUserEngagedThreshold(6.25f),
-mUserLostThreshold(6.25f)
+mEngagedUserOutput(new IEngagedUserOutput())
 {
 	for (int i = 0; i < _countof(bodies); ++i)
 	{
@@ -23,32 +21,32 @@ mUserLostThreshold(6.25f)
 	mLatestBodyData.activeUserTrackingId = 0;
 	mLatestBodyData.latestUserDistance = std::numeric_limits<float>::max();
 	mLatestBodyData.body = NULL;
+	mLatestBodyData.relativeTime = 0;
+	mLatestBodyData.engagedUserCount = 0;
+	mLatestBodyData.floorClipPlane.x = 0;
+	mLatestBodyData.floorClipPlane.y = 0;
+	mLatestBodyData.floorClipPlane.z = 0;
+	mLatestBodyData.floorClipPlane.w = 0;
+
+	for (int i = 0; i < BODY_COUNT; ++i)
+	{
+		mLatestBodyData.bodies[i] = NULL;
+		mLatestBodyData.engagedBodyIndex[i] = -1;
+		mLatestBodyData.engagedTrackingId[i] = 0;
+	}
+
+	mEngagementTransitions.reserve(2 * BODY_COUNT);
+	mEngagedUserEvents.reserve(2 * BODY_COUNT);
+	mActiveUserEvents.reserve(2);
 }
 
 ActiveUserStage::~ActiveUserStage() { }
 
 void ActiveUserStage::update()
 {
-	/*
-	* make a copy: yes, waste memory and time,
-	* but I don't know what the hell is the app going to do in notify
-	*/
-
-	if (mHasNewActiveUserData)
-	{
-		mActiveUserEventBufferMutex.lock();
-		std::vector<ActiveUserEvent> eventsCopy = std::vector<ActiveUserEvent>(mActiveUserEventBuffer);
-		mActiveUserEventBuffer.clear();
-		mActiveUserEventBufferMutex.unlock();
-
-		mHasNewActiveUserData = false;
-
-		std::vector<ActiveUserEvent>::iterator it;
-		for (it = eventsCopy.begin(); it != eventsCopy.end(); ++it)
-		{
-			this->notify((*it));
-		}
-	}
+	// engaged users first, an active user change is one of them
+	mEngagedUserOutput->dispatchMain();
+	this->dispatchMain();
 }
 
 //HRESULT ActiveUserStage::thread_setup()
@@ -57,14 +55,6 @@ void ActiveUserStage::update()
 //	return hr;
 //}
 
-HRESULT ActiveUserStage::thread_teardown()
-{
-	mActiveUserEventBufferMutex.lock();
-	mActiveUserEventBuffer.clear();
-	mActiveUserEventBufferMutex.unlock();
-	return S_OK;
-}
-
 HRESULT ActiveUserStage::thread_process()
 {
 	HRESULT hr = S_OK;
@@ -98,103 +88,58 @@ HRESULT ActiveUserStage::thread_process()
 			bodies[i] = NULL;
 		}
 
+		if (SUCCEEDED(hr))
+		{
+			hr = mBodyFrame->get_RelativeTime(&mLatestBodyData.relativeTime);
+		}
+
+		// the runtime only knows the floor once it has seen it, all zeros until then
+		if (SUCCEEDED(hr) && FAILED(mBodyFrame->get_FloorClipPlane(&mLatestBodyData.floorClipPlane)))
+		{
+			memset(&mLatestBodyData.floorClipPlane, 0, sizeof(mLatestBodyData.floorClipPlane));
+		}
+
 		if (SUCCEEDED(hr))
 		{
 			hr = mBodyFrame->GetAndRefreshBodyData(_countof(bodies), bodies);
 		}
 
+		for (int i = 0; i < _countof(bodies); ++i)
+		{
+			mLatestBodyData.bodies[i] = SUCCEEDED(hr) ? bodies[i] : NULL;
+		}
+
+		// all bodies scored in one pass, from this frame's joints
 		if (SUCCEEDED(hr))
 		{
-			bool seen = false;
+			mEngagementTransitions.clear();
+
+			// pixel counts only when the statistics are of this frame
+			const UINT* pixelCounts = NULL;
+			if (mBodyIndexStatsSrc)
+			{
+				const BodyIndexStats& stats = mBodyIndexStatsSrc->getLatestBodyIndexStats();
+				pixelCounts = (stats.valid && stats.frameId == mDeviceSrc->getLatestFrameId()) ? stats.pixelCount : NULL;
+			}
 
-			for (register int i = 0; i < BODY_COUNT; ++i)
+			mEngagedUserEvents.clear();
+			mActiveUserEvents.clear();
+
+			mEngagementMutex.lock();
+			mEngagement.update(bodies, static_cast<double>(mLatestBodyData.relativeTime) * 1e-7, mEngagementTransitions, pixelCounts);
+			this->updateEngagedUsers();
+			this->updateActiveUser();
+			mEngagementMutex.unlock();
+
+			// publisher thread subscribers may query the stage
+			if (!mEngagedUserEvents.empty())
 			{
-				IBody* body = bodies[i];
-				if (body)
-				{
-					BOOLEAN tracked = false;
-					hr = body->get_IsTracked(&tracked);
-
-					if (tracked)
-					{
-						UINT64 trackingId = 0;
-						hr = body->get_TrackingId(&trackingId);
-
-						if (SUCCEEDED(hr))
-						{
-							if (mLatestBodyData.hasActiveUser)
-							{
-								if (trackingId == mLatestBodyData.activeUserTrackingId)
-								{
-									mLatestBodyData.activeBodyIndex = i;
-									mLatestBodyData.latestUserDistance = mDistanceSrc->getLatestDistance();
-									mLatestBodyData.body = body;
-
-									if (mLatestBodyData.latestUserDistance <= mUserLostThreshold)
-									{
-										seen = true;
-										break;
-									}
-								}
-							}
-							else
-							{
-								Joint joints[JointType_Count];
-								hr = body->GetJoints(_countof(joints), joints);
-
-								if (SUCCEEDED(hr))
-								{
-									for (int j = 0; j < _countof(joints); ++j)
-									{
-										if (joints[j].JointType == JointType_SpineBase && joints[j].TrackingState == TrackingState_Tracked)
-										{
-											CameraSpacePoint pSpineBase = joints[j].Position;
-											float distance = ci::Vec3f(pSpineBase.X, pSpineBase.Y, pSpineBase.Z).distanceSquared(ci::Vec3f::zero());
-
-											if (distance <= mUserEngagedThreshold)
-											{
-												mLatestBodyData.activeUserTrackingId = trackingId;
-												mLatestBodyData.activeBodyIndex = i;
-												mLatestBodyData.hasActiveUser = true;
-												mLatestBodyData.latestUserDistance = distance;
-												mLatestBodyData.body = body;
-
-												//mObservationMutex.lock();
-												//mObservations.clear(); // new user, clear old observations if any
-												//mObservationMutex.unlock();
-
-												mActiveUserEventBufferMutex.lock();
-												mActiveUserEventBuffer.push_back(ActiveUserEvent::ACTIVE_USER_NEW);
-												mActiveUserEventBufferMutex.unlock();
-												mHasNewActiveUserData = true;
-												seen = true;
-												break;
-											}
-										}
-									}
-								}
-							}
-						}
-					}
-				}
+				mEngagedUserOutput->publish(&mEngagedUserEvents[0], mEngagedUserEvents.size());
 			}
 
-			// check active user not seen
-			if (mLatestBodyData.hasActiveUser && !seen)
+			if (!mActiveUserEvents.empty())
 			{
-				mLatestBodyData.hasActiveUser = false;
-				mLatestBodyData.activeBodyIndex = 0;
-				mLatestBodyData.activeUserTrackingId = 0;
-				mLatestBodyData.body = NULL;
-
-				//mObservationMutex.lock();
-				//mObservations.clear(); // assume that if a user is lost, observations are not valid anymore
-				//mObservationMutex.unlock();
-
-				mActiveUserEventBufferMutex.lock();
-				mActiveUserEventBuffer.push_back(ActiveUserEvent::ACTIVE_USER_LOST);
-				mActiveUserEventBufferMutex.unlock();
-				mHasNewActiveUserData = true;
+				this->publish(&mActiveUserEvents[0], mActiveUserEvents.size());
 			}
 		}
 	}
@@ -202,6 +147,83 @@ HRESULT ActiveUserStage::thread_process()
 	return hr;
 }
 
+// slots to BodyData, transitions to events
+void ActiveUserStage::updateEngagedUsers()
+{
+	mLatestBodyData.engagedUserCount = mEngagement.getEngagedCount();
+
+	for (int s = 0; s < BODY_COUNT; ++s)
+	{
+		const EngagementSlot& slot = mEngagement.getSlot(s);
+		mLatestBodyData.engagedBodyIndex[s] = slot.engaged ? slot.bodyIndex : -1;
+		mLatestBodyData.engagedTrackingId[s] = slot.engaged ? slot.trackingId : 0;
+	}
+
+	if (mEngagementTransitions.empty())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < mEngagementTransitions.size(); ++i)
+	{
+		const EngagementTransition& transition = mEngagementTransitions[i];
+		EngagedUserEvent evt = { transition.engaged ? ENGAGED_USER_NEW : ENGAGED_USER_LOST, transition.slot, transition.bodyIndex, transition.trackingId };
+		mEngagedUserEvents.push_back(evt);
+	}
+}
+
+// the active user stays while engaged, then the user engaged longest takes over
+void ActiveUserStage::updateActiveUser()
+{
+	int activeSlot = -1;
+
+	if (mLatestBodyData.hasActiveUser)
+	{
+		for (int s = 0; s < BODY_COUNT; ++s)
+		{
+			const EngagementSlot& slot = mEngagement.getSlot(s);
+			if (slot.engaged && slot.trackingId == mLatestBodyData.activeUserTrackingId)
+			{
+				activeSlot = s;
+				break;
+			}
+		}
+
+		if (activeSlot < 0)
+		{
+			mLatestBodyData.hasActiveUser = false;
+			mLatestBodyData.activeBodyIndex = 0;
+			mLatestBodyData.activeUserTrackingId = 0;
+			mLatestBodyData.latestUserDistance = std::numeric_limits<float>::max();
+
+			mActiveUserEvents.push_back(ActiveUserEvent::ACTIVE_USER_LOST);
+		}
+	}
+
+	if (activeSlot < 0)
+	{
+		activeSlot = mEngagement.getLongestEngagedSlot();
+
+		if (activeSlot >= 0)
+		{
+			mLatestBodyData.hasActiveUser = true;
+			mLatestBodyData.activeUserTrackingId = mEngagement.getSlot(activeSlot).trackingId;
+
+			mActiveUserEvents.push_back(ActiveUserEvent::ACTIVE_USER_NEW);
+		}
+	}
+
+	if (activeSlot >= 0)
+	{
+		int index = mEngagement.getSlot(activeSlot).bodyIndex;
+		float distance = mEngagement.getBody(index).distance;
+
+		mLatestBodyData.activeBodyIndex = index;
+		mLatestBodyData.body = bodies[index];
+		mLatestBodyData.latestUserDistance = distance * distance;
+	}
+}
+
 HRESULT ActiveUserStage::post_thread_process()
 {
 	__safe_release(mBodyFrame);
@@ -210,6 +232,7 @@ HRESULT ActiveUserStage::post_thread_process()
 	for (int i = 0; i < _countof(bodies); ++i)
 	{
 		__safe_release(bodies[i]);
+		mLatestBodyData.bodies[i] = NULL;
 	}
 
 	return S_OK;
@@ -220,9 +243,24 @@ void ActiveUserStage::setDeviceSource(IDeviceSourceRef deviceSrc)
 	mDeviceSrc = deviceSrc;
 }
 
-void ActiveUserStage::setActiveUserDistanceSource(IActiveUserDistanceSourceRef distanceSrc)
+void ActiveUserStage::setBodyIndexStatsSource(IBodyIndexStatsSourceRef bodyIndexStatsSrc)
+{
+	mBodyIndexStatsSrc = bodyIndexStatsSrc;
+}
+
+void ActiveUserStage::setEngagementParams(const EngagementParams& params)
+{
+	mEngagementMutex.lock();
+	mEngagement.setParams(params);
+	mEngagementMutex.unlock();
+}
+
+EngagementParams ActiveUserStage::getEngagementParams()
 {
-	mDistanceSrc = distanceSrc;
+	mEngagementMutex.lock();
+	EngagementParams params = mEngagement.getParams();
+	mEngagementMutex.unlock();
+	return params;
 }
 
 BodyData ActiveUserStage::getLatestBodyData()
@@ -0,0 +1,310 @@
+#include "KCDBodyIndexStatsStage.h"
+#include "KCDDeviceStage.h"
+#include <string.h>
+
+using namespace kcd;
+
+#define BODY_INDEX_NONE 0xFF
+
+static inline int horizontalSum(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+BodyIndexStatsStage::BodyIndexStatsStage() :
+mDeviceSrc(NULL),
+mDepthFrameRef(NULL),
+mDepthFrame(NULL),
+mBodyIndexFrameRef(NULL),
+mBodyIndexFrame(NULL),
+mPerformanceFrequency(0),
+mScanMicroseconds(0),
+mColumnHits(NULL)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	memset(&mLatestStats, 0, sizeof(mLatestStats));
+
+	mColumnHits = static_cast<__m128i*>(_aligned_malloc(BODY_COUNT * BODY_INDEX_STATS_BLOCKS * sizeof(__m128i), 16));
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+BodyIndexStatsStage::~BodyIndexStatsStage()
+{
+	if (mColumnHits)
+	{
+		_aligned_free(mColumnHits);
+		mColumnHits = NULL;
+	}
+}
+
+HRESULT BodyIndexStatsStage::thread_process()
+{
+	HRESULT hr = S_OK;
+
+	IMultiSourceFrame* multiSourceFrame = mDeviceSrc->getLatestFrame();
+
+	if (multiSourceFrame == NULL)
+	{
+		hr = E_FAIL;
+	}
+
+	mDepthFrameRef = NULL;
+	mDepthFrame = NULL;
+	mBodyIndexFrameRef = NULL;
+	mBodyIndexFrame = NULL;
+
+	if (SUCCEEDED(hr))
+	{
+		hr = multiSourceFrame->get_DepthFrameReference(&mDepthFrameRef);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mDepthFrameRef->AcquireFrame(&mDepthFrame);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = multiSourceFrame->get_BodyIndexFrameReference(&mBodyIndexFrameRef);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mBodyIndexFrameRef->AcquireFrame(&mBodyIndexFrame);
+	}
+
+	UINT depthBufferSize = 0;
+	UINT16* depthBuffer = NULL;
+	UINT bodyIndexBufferSize = 0;
+	BYTE* bodyIndexBuffer = NULL;
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mDepthFrame->AccessUnderlyingBuffer(&depthBufferSize, &depthBuffer);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mBodyIndexFrame->AccessUnderlyingBuffer(&bodyIndexBufferSize, &bodyIndexBuffer);
+	}
+
+	const UINT depthFrameArea = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
+
+	if (SUCCEEDED(hr) && (depthBufferSize < depthFrameArea || bodyIndexBufferSize < depthFrameArea))
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		LARGE_INTEGER start = { 0 };
+		LARGE_INTEGER end = { 0 };
+		QueryPerformanceCounter(&start);
+
+		this->scan(bodyIndexBuffer, depthBuffer, mStats);
+		mStats.frameId = mDeviceSrc->getLatestFrameId();
+		mStats.valid = true;
+
+		QueryPerformanceCounter(&end);
+		mScanMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+
+		mLatestStatsMutex.lock();
+		mLatestStats = mStats;
+		mLatestStatsMutex.unlock();
+	}
+
+	return hr;
+}
+
+HRESULT BodyIndexStatsStage::post_thread_process()
+{
+	__safe_release(mDepthFrame);
+	__safe_release(mBodyIndexFrame);
+	__safe_release(mDepthFrameRef);
+	__safe_release(mBodyIndexFrameRef);
+
+	return S_OK;
+}
+
+/*
+* Depth readings are below 32768 mm, so they can be summed with the signed multiply-add
+* Per lane the sums stay far under 2^31 for a 512x424 frame
+*/
+void BodyIndexStatsStage::scan(const BYTE* bodyIndexBuffer, const UINT16* depthBuffer, BodyIndexStats& stats)
+{
+	const int width = DeviceStage::DepthFrameWidth;
+	const int height = DeviceStage::DepthFrameHeight;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i none = _mm_set1_epi8(static_cast<char>(BODY_INDEX_NONE));
+	const __m128i ones8 = _mm_set1_epi8(1);
+	const __m128i ones16 = _mm_set1_epi16(1);
+	const __m128i rampLow = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m128i rampHigh = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+
+	__m128i sumX[BODY_COUNT];
+	__m128i sumDepth[BODY_COUNT];
+	__m128i depthCount[BODY_COUNT];
+	UINT64 sumY[BODY_COUNT];
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		sumX[b] = zero;
+		sumDepth[b] = zero;
+		depthCount[b] = zero;
+		sumY[b] = 0;
+
+		stats.pixelCount[b] = 0;
+		stats.minY[b] = height;
+		stats.maxY[b] = -1;
+	}
+
+	memset(mColumnHits, 0, BODY_COUNT * BODY_INDEX_STATS_BLOCKS * sizeof(__m128i));
+
+	for (int y = 0; y < height; ++y)
+	{
+		const BYTE* indexRow = bodyIndexBuffer + y * width;
+		const UINT16* depthRow = depthBuffer + y * width;
+
+		__m128i rowCount[BODY_COUNT];
+		int rowBodies = 0;
+
+		for (int b = 0; b < BODY_COUNT; ++b)
+		{
+			rowCount[b] = zero;
+		}
+
+		for (int block = 0; block < BODY_INDEX_STATS_BLOCKS; ++block)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indexRow + block * 16));
+
+			// background, most of the frame
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, none)) == 0xFFFF)
+			{
+				continue;
+			}
+
+			__m128i depthLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depthRow + block * 16));
+			__m128i depthHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depthRow + block * 16 + 8));
+			__m128i noDepthLow = _mm_cmpeq_epi16(depthLow, zero);
+			__m128i noDepthHigh = _mm_cmpeq_epi16(depthHigh, zero);
+
+			__m128i x0 = _mm_set1_epi16(static_cast<short>(block * 16));
+			__m128i xLow = _mm_add_epi16(rampLow, x0);
+			__m128i xHigh = _mm_add_epi16(rampHigh, x0);
+
+			for (int b = 0; b < BODY_COUNT; ++b)
+			{
+				__m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(b)));
+				if (_mm_movemask_epi8(m) == 0)
+				{
+					continue;
+				}
+
+				rowBodies |= 1 << b;
+				rowCount[b] = _mm_add_epi64(rowCount[b], _mm_sad_epu8(_mm_and_si128(m, ones8), zero));
+				mColumnHits[b * BODY_INDEX_STATS_BLOCKS + block] = _mm_or_si128(mColumnHits[b * BODY_INDEX_STATS_BLOCKS + block], m);
+
+				// byte masks widened to the 16 bit lanes of x and depth
+				__m128i mLow = _mm_unpacklo_epi8(m, m);
+				__m128i mHigh = _mm_unpackhi_epi8(m, m);
+
+				sumX[b] = _mm_add_epi32(sumX[b], _mm_madd_epi16(_mm_and_si128(xLow, mLow), ones16));
+				sumX[b] = _mm_add_epi32(sumX[b], _mm_madd_epi16(_mm_and_si128(xHigh, mHigh), ones16));
+
+				sumDepth[b] = _mm_add_epi32(sumDepth[b], _mm_madd_epi16(_mm_and_si128(depthLow, mLow), ones16));
+				sumDepth[b] = _mm_add_epi32(sumDepth[b], _mm_madd_epi16(_mm_and_si128(depthHigh, mHigh), ones16));
+
+				// valid lanes are -1, the multiply-add gives minus the count
+				depthCount[b] = _mm_sub_epi32(depthCount[b], _mm_madd_epi16(_mm_andnot_si128(noDepthLow, mLow), ones16));
+				depthCount[b] = _mm_sub_epi32(depthCount[b], _mm_madd_epi16(_mm_andnot_si128(noDepthHigh, mHigh), ones16));
+			}
+		}
+
+		for (int b = 0; rowBodies != 0; ++b, rowBodies >>= 1)
+		{
+			if (rowBodies & 1)
+			{
+				UINT count = static_cast<UINT>(_mm_cvtsi128_si32(rowCount[b]) + _mm_cvtsi128_si32(_mm_srli_si128(rowCount[b], 8)));
+				stats.pixelCount[b] += count;
+				sumY[b] += static_cast<UINT64>(count) * y;
+				stats.minY[b] = std::min(stats.minY[b], y);
+				stats.maxY[b] = y;
+			}
+		}
+	}
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		UINT count = stats.pixelCount[b];
+		stats.minX[b] = width;
+		stats.maxX[b] = -1;
+
+		if (count == 0)
+		{
+			stats.centroidX[b] = 0;
+			stats.centroidY[b] = 0;
+			stats.meanDepth[b] = 0;
+			continue;
+		}
+
+		stats.centroidX[b] = static_cast<float>(horizontalSum(sumX[b])) / count;
+		stats.centroidY[b] = static_cast<float>(static_cast<double>(sumY[b]) / count);
+
+		int depthPixels = horizontalSum(depthCount[b]);
+		stats.meanDepth[b] = (depthPixels > 0) ? static_cast<float>(horizontalSum(sumDepth[b])) / depthPixels * 0.001f : 0;
+
+		const __m128i* hits = mColumnHits + b * BODY_INDEX_STATS_BLOCKS;
+
+		for (int block = 0; block < BODY_INDEX_STATS_BLOCKS && stats.minX[b] == width; ++block)
+		{
+			int bits = _mm_movemask_epi8(hits[block]);
+			for (int i = 0; i < 16 && bits; ++i)
+			{
+				if (bits & (1 << i))
+				{
+					stats.minX[b] = block * 16 + i;
+					break;
+				}
+			}
+		}
+
+		for (int block = BODY_INDEX_STATS_BLOCKS - 1; block >= 0 && stats.maxX[b] < 0; --block)
+		{
+			int bits = _mm_movemask_epi8(hits[block]);
+			for (int i = 15; i >= 0 && bits; --i)
+			{
+				if (bits & (1 << i))
+				{
+					stats.maxX[b] = block * 16 + i;
+					break;
+				}
+			}
+		}
+	}
+}
+
+const BodyIndexStats& BodyIndexStatsStage::getLatestBodyIndexStats()
+{
+	return mStats;
+}
+
+BodyIndexStats BodyIndexStatsStage::copyLatestBodyIndexStats()
+{
+	mLatestStatsMutex.lock();
+	BodyIndexStats stats = mLatestStats;
+	mLatestStatsMutex.unlock();
+	return stats;
+}
+
+void BodyIndexStatsStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
\ No newline at end of file
@@ -1,87 +1,137 @@
 #include "KCDBodyStage.h"
+#include "KCDDeviceStage.h"
 #include <exception>
 #include <algorithm>
+#include <string.h>
 
 using namespace kcd;
 
 BodyStage::BodyStage() :
 mDeviceSrc(NULL),
 mBodyDataSrc(NULL),
+mSubscription(JOINT_MASK_DEFAULT),
+mStoredJoints(0),
+mLatestActiveJoints(0),
+mScreenWidth(static_cast<float>(DeviceStage::DepthFrameWidth)),
+mScreenHeight(static_cast<float>(DeviceStage::DepthFrameHeight)),
+mMapperCalls(0),
+mLastRelativeTime(0),
+mActiveJoints(0),
+mActiveBody(0),
+mBatchOutput(new IBodyJointBatchOutput(BODY_JOINT_EVENT_QUEUE_SIZE)),
+mEventQueue(BODY_JOINT_EVENT_QUEUE_SIZE),
+mDroppedEvents(0),
+mEventQueueOverflow(false),
+mFrameId(0),
+mPolledJoints(0),
 mLatestUserDistance(0),
 trackIfInferred(true)
 {
-	mObservations[JointType_HandLeft] = Observation(JointType_HandLeft);
-	mObservations[JointType_HandRight] = Observation(JointType_HandRight);
-	mObservations[JointType_Head] = Observation(JointType_Head);
-	mObservations[JointType_SpineBase] = Observation(JointType_SpineBase);
+	memset(mClientStoredJoints, 0, sizeof(mClientStoredJoints));
+	mFrameEvents.reserve(2 * JointType_Count);
+	mBodyJointEventDispatch.resize(mEventQueue.capacity());
+	mCompatEvents.reserve(mEventQueue.capacity() + JointType_Count);
 }
 
 BodyStage::~BodyStage() { }
 
 void BodyStage::update()
 {
-	
-	if (mHasNewBodyJointEvents)
+	mBatchOutput->dispatchMain();
+
+	size_t count = mEventQueue.popBatch(&mBodyJointEventDispatch[0], mBodyJointEventDispatch.size());
+
+	// compatibility stream: per event, polled joints repeated every update
+	bool publishEvents = this->subscriberCount() > 0;
+	mCompatEvents.clear();
+
+	for (size_t i = 0; i < count; ++i)
 	{
-		std::vector<BodyJointEvent> temp;
-		mBodyJointEventBufferMutex.lock();
-		temp = std::vector<BodyJointEvent>(mBodyJointEventBuffer);
-		mBodyJointEventBuffer.clear();
-		mBodyJointEventBufferMutex.unlock();
-		mHasNewBodyJointEvents = false;
-
-		std::vector<BodyJointEvent>::iterator it;
-		for (it = temp.begin(); it != temp.end(); ++it)
+		const BodyJointEvent& evt = mBodyJointEventDispatch[i];
+		JointMask bit = JOINT_BIT(evt.jointId);
+
+		if (evt.eventType == BODY_JOINT_DISAPPEAR)
 		{
-			if (it->eventType == BODY_JOINT_DISAPPEAR)
+			if (publishEvents)
 			{
-				this->notify(*it);
-				if (mBodyJointEventPolling.find(it->jointId) != mBodyJointEventPolling.end())
-				{
-					mBodyJointEventPolling.erase(it->jointId);
-				}
+				mCompatEvents.push_back(evt);
 			}
-			else if (it->eventType == BODY_JOINT_APPEAR)
+
+			mPolledJoints &= ~bit;
+		}
+		else
+		{
+			BodyJointEvent& polled = mBodyJointEventPolling[evt.jointId];
+			polled = evt;
+
+			// a joint is always announced before it moves
+			if (!(mPolledJoints & bit))
 			{
-				if (mBodyJointEventPolling.find(it->jointId) == mBodyJointEventPolling.end())
-				{
-					mBodyJointEventPolling.insert(BodyJointEventPair(it->jointId, *it));
-				}
-				else
-				{
-					mBodyJointEventPolling[it->jointId].eventType = BODY_JOINT_APPEAR;
-					mBodyJointEventPolling[it->jointId].screenSpacePosition = it->screenSpacePosition;
-				}
+				polled.eventType = BODY_JOINT_APPEAR;
 			}
-			else if (it->eventType == BODY_JOINT_MOVE)
+
+			mPolledJoints |= bit;
+		}
+	}
+
+	// a dropped DISAPPEAR would keep its joint polled forever
+	if (mEventQueueOverflow.exchange(false))
+	{
+		this->reconcilePolledJoints(publishEvents);
+	}
+
+	if (publishEvents)
+	{
+		JointMask polled = mPolledJoints;
+		for (int jt = 0; polled != 0; ++jt, polled >>= 1)
+		{
+			if (polled & 1u)
 			{
-				if (mBodyJointEventPolling.find(it->jointId) == mBodyJointEventPolling.end())
-				{
-					BodyJointEvent evt = *it;
-					evt.eventType = BODY_JOINT_APPEAR;
-					mBodyJointEventPolling.insert(BodyJointEventPair(it->jointId, evt));
-				}
-				else
-				{
-					mBodyJointEventPolling[it->jointId].eventType = BODY_JOINT_MOVE;
-					mBodyJointEventPolling[it->jointId].screenSpacePosition = it->screenSpacePosition;
-				}
+				mCompatEvents.push_back(mBodyJointEventPolling[jt]);
 			}
 		}
 
+		if (!mCompatEvents.empty())
+		{
+			this->publish(&mCompatEvents[0], mCompatEvents.size());
+		}
+
+		this->dispatchMain();
 	}
-	
-	std::map<JointType, BodyJointEvent>::iterator itmap;
-	for (itmap = mBodyJointEventPolling.begin(); itmap != mBodyJointEventPolling.end(); ++itmap)
+}
+
+/*
+* After events were dropped, polled joints that are not outstanding on the pipeline thread anymore disappear
+*/
+void BodyStage::reconcilePolledJoints(bool publishEvents)
+{
+	mLatestJointsMutex.lock();
+	JointMask lost = mPolledJoints & ~mLatestActiveJoints;
+	mLatestJointsMutex.unlock();
+
+	for (int jt = 0; lost != 0; ++jt, lost >>= 1)
 	{
-		this->notify(itmap->second);
-	}
+		if (lost & 1u)
+		{
+			BodyJointEvent evt = mBodyJointEventPolling[jt];
+			evt.eventType = BODY_JOINT_DISAPPEAR;
 
+			if (publishEvents)
+			{
+				mCompatEvents.push_back(evt);
+			}
+
+			mPolledJoints &= ~JOINT_BIT(jt);
+		}
+	}
 }
 
 HRESULT BodyStage::thread_setup()
 {
 	HRESULT hr = S_OK;
+	mJoints.clear();
+	mMapper.invalidate();
+	mActiveJoints = 0;
 	return hr;
 }
 
@@ -93,112 +143,147 @@ HRESULT BodyStage::thread_teardown()
 HRESULT BodyStage::thread_process()
 {
 	HRESULT hr = S_OK;
-	
+
 	IMultiSourceFrame* multiSourceFrame = mDeviceSrc->getLatestFrame();
 	ICoordinateMapper* coordinateMapper = mDeviceSrc->getCoordinateMapper();
 	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
 
-	if (!bodyData.hasActiveUser)
+	JointMask subscription = mSubscription;
+	JointMask stored = subscription | mStoredJoints | JOINT_BIT(JointType_SpineBase);
+	mFrameId = mDeviceSrc->getLatestFrameId();
+	JointMask activeSeen = 0;
+
+	// the bodies are only set on iterations that acquired a body frame
+	bool hasBodyFrame = false;
+	for (int b = 0; b < BODY_COUNT; ++b)
 	{
-		hr = E_FAIL;
-		this->markObservationsUnseen();
+		hasBodyFrame = hasBodyFrame || bodyData.bodies[b] != NULL;
 	}
 
-	if (bodyData.body == NULL || multiSourceFrame == NULL || coordinateMapper == NULL)
+	if (multiSourceFrame == NULL || coordinateMapper == NULL || !hasBodyFrame)
 	{
-		hr = E_FAIL;
+		// the pipeline spins between frames: the store, the latest joints and the outstanding joints stay
+		if (!bodyData.hasActiveUser && mActiveJoints != 0)
+		{
+			mFrameEvents.clear();
+			this->pushEvents(BODY_JOINT_DISAPPEAR, mActiveJoints, mActiveBody);
+			mActiveJoints = 0;
+
+			mLatestJointsMutex.lock();
+			mLatestActiveJoints = 0;
+			mLatestJointsMutex.unlock();
+
+			this->publishFrameEvents();
+		}
+
+		return E_FAIL;
 	}
 
-	Joint joints[JointType_Count];
+	mJoints.beginFrame();
+	mFrameEvents.clear();
 
-	if (SUCCEEDED(hr))
+	for (int b = 0; b < BODY_COUNT; ++b)
 	{
-		hr = bodyData.body->GetJoints(_countof(joints), joints);
+		if (bodyData.bodies[b])
+		{
+			mJoints.updateBody(b, bodyData.bodies[b], stored, trackIfInferred);
+		}
 	}
 
-	if (SUCCEEDED(hr))
+	// every joint of every body in one batch
+	mMapper.setScreenSize(mScreenWidth, mScreenHeight);
+	mMapper.map(coordinateMapper, mJoints);
+	mMapperCalls = mMapper.getMapperCalls();
+
+	if (bodyData.relativeTime != 0 && bodyData.relativeTime != mLastRelativeTime)
 	{
-		TrackingState ts = TrackingState_NotTracked;
-		JointType jt = JointType_Count;
+		mHistory.push(mJoints, bodyData.relativeTime);
+		mLastRelativeTime = bodyData.relativeTime;
+	}
 
-		this->markObservationsUnseen();
+	if (!bodyData.hasActiveUser || bodyData.activeBodyIndex >= BODY_COUNT)
+	{
+		hr = E_FAIL;
+	}
 
-		for (int j = 0; j < _countof(joints); ++j)
+	if (SUCCEEDED(hr))
+	{
+		int active = static_cast<int>(bodyData.activeBodyIndex);
+		activeSeen = mJoints.seen[active] & subscription;
+
+		if (mJoints.seen[active] & JOINT_BIT(JointType_SpineBase))
 		{
-			ts = joints[j].TrackingState;
+			int i = JointStore::index(active, JointType_SpineBase);
+			mLatestUserDistance = ci::Vec3f(mJoints.positionX[i], mJoints.positionY[i], mJoints.positionZ[i]).distanceSquared(ci::Vec3f::zero());
+		}
 
-			if (ts == TrackingState_Tracked || (ts == TrackingState_Inferred && trackIfInferred))
-			{
-				jt = joints[j].JointType;
-
-				if (jt == JointType_HandLeft ||
-					jt == JointType_HandRight ||
-					jt == JointType_Head ||
-					jt == JointType_SpineBase)
-				{
-					Observation* obs = &mObservations[jt];
-					CameraSpacePoint csp = joints[j].Position;
-
-					coordinateMapper->MapCameraPointToColorSpace(csp, &(obs->xy));
-
-					mBodyJointEventBufferMutex.lock();
-					if (!obs->seen)
-					{
-						mBodyJointEventBuffer.push_back(eventFromObservation(BODY_JOINT_APPEAR, *obs));
-					}
-					else
-					{
-						mBodyJointEventBuffer.push_back(eventFromObservation(BODY_JOINT_MOVE, *obs));
-					}
-					mBodyJointEventBufferMutex.unlock();
-
-					obs->isValid = true;
-					obs->seen = true;
-
-					mHasNewBodyJointEvents = true;
-
-					if (jt == JointType_SpineBase)
-					{
-						mLatestUserDistance = ci::Vec3f(csp.X, csp.Y, csp.Z).distanceSquared(ci::Vec3f::zero());
-					}
-				}
-			}
+		if (active != mActiveBody)
+		{
+			// same user, new body slot: what was not seen anymore disappears from the old one
+			this->pushEvents(BODY_JOINT_DISAPPEAR, mActiveJoints & ~activeSeen, mActiveBody);
+			mActiveJoints &= activeSeen;
+			mActiveBody = active;
 		}
+
+		this->pushEvents(BODY_JOINT_APPEAR, activeSeen & ~mActiveJoints, active);
+		this->pushEvents(BODY_JOINT_MOVE, activeSeen & mActiveJoints, active);
 	}
 
-	this->processObservationsUnseen();
+	this->pushEvents(BODY_JOINT_DISAPPEAR, mActiveJoints & ~activeSeen, mActiveBody);
+	mActiveJoints = activeSeen;
+
+	mLatestJointsMutex.lock();
+	mLatestJoints = mJoints;
+	mLatestActiveJoints = mActiveJoints;
+	mLatestJointsMutex.unlock();
+
+	this->publishFrameEvents();
 
 	return hr;
 }
 
-void BodyStage::markObservationsUnseen()
+/*
+* Adds one event per joint in the mask to the frame batch, at the joint color space position on the given body
+*/
+void BodyStage::pushEvents(BodyJointEventType eventType, JointMask joints, int body)
 {
-	ObservationIt it;
-	for (it = mObservations.begin(); it != mObservations.end(); ++it)
+	if (joints == 0)
 	{
-		(*it).second.seen = false;
+		return;
 	}
-}
 
-void BodyStage::processObservationsUnseen()
-{
-	ObservationIt it;
-	for (it = mObservations.begin(); it != mObservations.end(); ++it)
+	for (int jt = 0; joints != 0; ++jt, joints >>= 1)
 	{
-		if (!(*it).second.seen && (*it).second.isValid)
+		if (joints & 1u)
 		{
-			mBodyJointEventBufferMutex.lock();
-			mBodyJointEventBuffer.push_back(eventFromObservation(BODY_JOINT_DISAPPEAR, (*it).second));
-			mBodyJointEventBufferMutex.unlock();
-			mHasNewBodyJointEvents = true;
-			(*it).second.isValid = false;
+			int i = JointStore::index(body, jt);
+			mFrameEvents.push_back(BodyJointEvent(eventType, static_cast<JointType>(jt), ci::Vec2f(mJoints.colorX[i], mJoints.colorY[i]), mFrameId));
 		}
 	}
 }
 
-BodyJointEvent BodyStage::eventFromObservation(BodyJointEventType eventType, const Observation& obs)
+/*
+* The frame batch goes to the bus, the events also to the compatibility queue
+* Neither blocks the pipeline thread: when the app thread falls behind, events are dropped and counted,
+* and the next update reconciles the polled joints
+*/
+void BodyStage::publishFrameEvents()
 {
-	return BodyJointEvent(eventType, obs.id, ci::Vec2f(obs.xy.X, obs.xy.Y));
+	if (mFrameEvents.empty())
+	{
+		return;
+	}
+
+	mBatchOutput->publish(&mFrameEvents[0], mFrameEvents.size());
+
+	for (size_t i = 0; i < mFrameEvents.size(); ++i)
+	{
+		if (!mEventQueue.push(mFrameEvents[i]))
+		{
+			mDroppedEvents++;
+			mEventQueueOverflow = true;
+		}
+	}
 }
 
 //HRESULT BodyStage::post_thread_process()
@@ -216,7 +301,44 @@ void BodyStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
 	mBodyDataSrc = bodyDataSrc;
 }
 
+void BodyStage::setJointSubscription(JointMask subscription)
+{
+	mSubscription = subscription & JOINT_MASK_ALL;
+}
+
+void BodyStage::setScreenSize(float width, float height)
+{
+	mScreenWidth = width;
+	mScreenHeight = height;
+}
+
+void BodyStage::setStoredJoints(JointMask joints, StoredJointsClient client)
+{
+	mStoredJointsMutex.lock();
+	mClientStoredJoints[client] = joints & JOINT_MASK_ALL;
+
+	JointMask stored = 0;
+	for (int i = 0; i < STORED_JOINTS_CLIENT_COUNT; ++i)
+	{
+		stored |= mClientStoredJoints[i];
+	}
+	mStoredJoints = stored;
+	mStoredJointsMutex.unlock();
+}
+
 float BodyStage::getLatestDistance()
 {
 	return mLatestUserDistance;
+}
+
+const JointStore& BodyStage::getLatestJoints()
+{
+	return mJoints;
+}
+
+void BodyStage::copyLatestJoints(JointStore& joints)
+{
+	mLatestJointsMutex.lock();
+	joints = mLatestJoints;
+	mLatestJointsMutex.unlock();
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "KCDBufferPool.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace kcd;
+
+BufferPool::BufferPool(int maxBuffersPerKey) :
+mMaxBuffersPerKey(maxBuffersPerKey)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+BufferPool::~BufferPool() { }
+
+BufferPool::Slot::~Slot()
+{
+	_aligned_free(const_cast<BYTE*>(buffer.view.data));
+}
+
+int BufferPool::getBytesPerPixel(ImageFormat format)
+{
+	switch (format)
+	{
+	case IMAGE_FORMAT_BGRA:
+		return 4;
+	case IMAGE_FORMAT_GRAY:
+		return 1;
+	case IMAGE_FORMAT_DEPTH:
+		return sizeof(UINT16);
+	case IMAGE_FORMAT_DEPTH_POINT:
+		return sizeof(DepthSpacePoint);
+	default:
+		return 0;
+	}
+}
+
+void BufferPool::reserve(ImageFormat format, int width, int height, int count)
+{
+	mShelvesMutex.lock();
+
+	Shelf& shelf = this->findShelf(format, width, height);
+
+	while (static_cast<int>(shelf.buffers.size()) < std::min(count, mMaxBuffersPerKey))
+	{
+		shelf.buffers.push_back(this->allocateBuffer(shelf));
+	}
+
+	mShelvesMutex.unlock();
+}
+
+BufferLease BufferPool::acquire(ImageFormat format, int width, int height)
+{
+	BufferLease lease;
+
+	mShelvesMutex.lock();
+
+	Shelf& shelf = this->findShelf(format, width, height);
+
+	// leases are only made here, under the lock: a free buffer can't be taken behind our back
+	for (size_t i = 0; i < shelf.buffers.size(); ++i)
+	{
+		if (!shelf.buffers[i]->leased.load(std::memory_order_acquire))
+		{
+			lease = BufferPool::lease(shelf.buffers[i]);
+			mStats.reuses++;
+			break;
+		}
+	}
+
+	if (!lease)
+	{
+		if (static_cast<int>(shelf.buffers.size()) < mMaxBuffersPerKey)
+		{
+			shelf.buffers.push_back(this->allocateBuffer(shelf));
+			lease = BufferPool::lease(shelf.buffers.back());
+		}
+		else
+		{
+			mStats.exhausted++;
+		}
+	}
+
+	mShelvesMutex.unlock();
+
+	return lease;
+}
+
+BufferPoolStats BufferPool::getStats()
+{
+	mShelvesMutex.lock();
+
+	BufferPoolStats stats = mStats;
+	stats.buffers = 0;
+	stats.leased = 0;
+	stats.bytes = 0;
+
+	for (size_t i = 0; i < mShelves.size(); ++i)
+	{
+		const Shelf& shelf = mShelves[i];
+
+		for (size_t j = 0; j < shelf.buffers.size(); ++j)
+		{
+			stats.buffers++;
+			stats.bytes += shelf.buffers[j]->buffer.size;
+
+			if (shelf.buffers[j]->leased.load(std::memory_order_acquire))
+			{
+				stats.leased++;
+			}
+		}
+	}
+
+	mShelvesMutex.unlock();
+
+	return stats;
+}
+
+BufferPool::Shelf& BufferPool::findShelf(ImageFormat format, int width, int height)
+{
+	for (size_t i = 0; i < mShelves.size(); ++i)
+	{
+		if (mShelves[i].format == format && mShelves[i].width == width && mShelves[i].height == height)
+		{
+			return mShelves[i];
+		}
+	}
+
+	Shelf shelf;
+	shelf.format = format;
+	shelf.width = width;
+	shelf.height = height;
+	mShelves.push_back(shelf);
+
+	return mShelves.back();
+}
+
+BufferPool::SlotRef BufferPool::allocateBuffer(const Shelf& shelf)
+{
+	int bytesPerPixel = BufferPool::getBytesPerPixel(shelf.format);
+
+	SlotRef slot(new Slot());
+	PooledBuffer* buffer = &slot->buffer;
+	buffer->size = static_cast<size_t>(shelf.width) * shelf.height * bytesPerPixel;
+
+	BYTE* data = static_cast<BYTE*>(_aligned_malloc(buffer->size, 16));
+	memset(data, 0, buffer->size);
+
+	buffer->view.frameId = 0;
+	buffer->view.data = data;
+	buffer->view.width = shelf.width;
+	buffer->view.height = shelf.height;
+	buffer->view.stride = shelf.width * bytesPerPixel;
+	buffer->view.format = shelf.format;
+
+	mStats.allocations++;
+
+	return slot;
+}
+
+// under the pool lock
+BufferLease BufferPool::lease(const SlotRef& slot)
+{
+	slot->leased.store(true, std::memory_order_relaxed);
+	return BufferLease(&slot->buffer, KeepBuffer(), SlotAllocator<PooledBuffer>(slot));
+}
\ No newline at end of file
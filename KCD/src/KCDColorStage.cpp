@@ -10,10 +10,9 @@ mDeviceSrc(NULL),
 mMaskSrc(NULL),
 mColorFrame(NULL),
 mColorFrameRef(NULL),
-mColorBuffer(NULL),
+mLatestColorBuffer(NULL),
 mColorTime(0),
-colorTextureName(0),
-mHasNewColorData(false)
+mHasColorTime(false)
 {
 
 }
@@ -22,62 +21,20 @@ ColorStage::~ColorStage() { }
 
 void ColorStage::setup()
 {
-	int colorFrameArea = DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight;
-	mColorBuffer = new BYTE[colorFrameArea * BGRA_SIZE];
-	memset(mColorBuffer, 255, colorFrameArea * BGRA_SIZE);
-
-	glGenTextures(1, &colorTextureName);
-	glBindTexture(GL_TEXTURE_2D, colorTextureName);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, DeviceStage::ColorFrameWidth);
-
-	if (mColorBuffer)
-	{
-		mColorDataMutex.lock();
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, mColorBuffer);
-		mColorDataMutex.unlock();
-	}
-	else
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, 0);
-	}
-	
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	mColorImages.allocate(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, IMAGE_FORMAT_BGRA);
+
+	mColorStream.allocate(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, GL_RGBA, GL_BGRA, GL_UNSIGNED_BYTE, BGRA_SIZE);
 }
 
 void ColorStage::teardown()
 {
-	glDeleteTextures(1, &colorTextureName);
-
-	if (mColorBuffer)
-	{
-		delete[] mColorBuffer;
-		mColorBuffer = NULL;
-	}
+	mColorStream.release();
+	mColorImages.release();
 }
 
 void ColorStage::update()
 {
-	if (mHasNewColorData)
-	{
-		if (glIsTexture(colorTextureName))
-		{
-			glBindTexture(GL_TEXTURE_2D, colorTextureName);
-			mColorDataMutex.lock();
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, GL_BGRA, GL_UNSIGNED_BYTE, mColorBuffer);
-			mColorDataMutex.unlock();
-			mHasNewColorData = false;
-			glBindTexture(GL_TEXTURE_2D, 0);
-
-			mColorTextureRef = ci::gl::Texture::create(GL_TEXTURE_2D, colorTextureName, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, true);
-
-		}
-	}
+	mColorStream.update();
 }
 
 //HRESULT ColorStage::thread_setup()
@@ -105,6 +62,7 @@ HRESULT ColorStage::thread_process()
 
 	mColorFrame = NULL;
 	mColorFrameRef = NULL;
+	mLatestColorBuffer = NULL;
 	
 	if (SUCCEEDED(hr))
 	{
@@ -135,19 +93,22 @@ HRESULT ColorStage::thread_process()
 			hr = mColorFrame->get_RawColorImageFormat(&imageFormat);
 		}
 
-		mColorDataMutex.lock();
+		if (SUCCEEDED(hr))
+		{
+			colorBuffer = mColorImages.acquireBuffer();
+		}
 
 		if (SUCCEEDED(hr))
 		{
-			if (imageFormat == ColorImageFormat_Bgra)
+			// the frame's own buffer is released after this iteration, images are kept in ours
+			if (colorBuffer && imageFormat == ColorImageFormat_Bgra)
 			{
-				hr = mColorFrame->AccessRawUnderlyingBuffer(&colorBufferSize, &colorBuffer);
-				mHasNewColorData = true;
+				colorBufferSize = DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight * BGRA_SIZE;
+				hr = mColorFrame->CopyRawFrameDataToArray(colorBufferSize, colorBuffer);
 			}
-			else if (mColorBuffer)
+			else if (colorBuffer)
 			{
 				colorBufferSize = DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight * BGRA_SIZE;
-				colorBuffer = mColorBuffer;
 
 				hr = mColorFrame->CopyConvertedFrameDataToArray(colorBufferSize, colorBuffer, ColorImageFormat_Bgra);
 
@@ -170,8 +131,6 @@ HRESULT ColorStage::thread_process()
 
 				//	//mMaskSrc->invalidateLatestMaskBuffer();
 				//}
-
-				mHasNewColorData = true;
 			}
 			else
 			{
@@ -179,7 +138,19 @@ HRESULT ColorStage::thread_process()
 			}
 		}
 
-		mColorDataMutex.unlock();
+		if (SUCCEEDED(hr) && colorBufferSize >= static_cast<UINT>(DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight * BGRA_SIZE))
+		{
+			mLatestColorBuffer = colorBuffer;
+			mColorImages.publish(mDeviceSrc->getLatestFrameId());
+
+			// one sequential copy into a mapped upload buffer, skipped while the app thread is behind
+			void* uploadBuffer = mColorStream.beginWrite();
+			if (uploadBuffer)
+			{
+				memcpy(uploadBuffer, colorBuffer, mColorStream.getFrameSize());
+				mColorStream.endWrite();
+			}
+		}
 	}
 
 	return hr;
@@ -187,6 +158,7 @@ HRESULT ColorStage::thread_process()
 
 HRESULT ColorStage::post_thread_process()
 {
+	mLatestColorBuffer = NULL;
 	__safe_release(mColorFrame);
 	__safe_release(mColorFrameRef);
 	return S_OK;
@@ -197,6 +169,21 @@ void ColorStage::setDeviceSource(IDeviceSourceRef deviceSrc)
 	mDeviceSrc = deviceSrc;
 }
 
+const BYTE* ColorStage::getLatestColorBuffer()
+{
+	return mLatestColorBuffer;
+}
+
+ImageViewRef ColorStage::tryGetLatestImage()
+{
+	return mColorImages.tryGetLatest();
+}
+
+ImageViewRef ColorStage::waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds)
+{
+	return mColorImages.waitForNewer(frameId, timeoutMilliseconds);
+}
+
 INT64 ColorStage::getLatestTime()
 {
 	return mColorTime;
@@ -204,7 +191,10 @@ INT64 ColorStage::getLatestTime()
 
 ci::gl::TextureRef ColorStage::getTextureReference()
 {
-	return mColorTextureRef;
+	if (mColorStream.hasFrame())
+		return mColorStream.getTextureReference();
+	else
+		return NULL;
 }
 
 void ColorStage::setMaskSource(IMaskBufferSourceRef maskSrc)
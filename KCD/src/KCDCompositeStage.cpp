@@ -0,0 +1,149 @@
+#include "KCDCompositeStage.h"
+#include "KCDDeviceStage.h"
+#include <emmintrin.h>
+#include <string.h>
+
+using namespace kcd;
+
+CompositeStage::CompositeStage() :
+mColorBufferSrc(NULL),
+mMaskBufferSrc(NULL),
+mEnabled(false),
+mPremultiplied(false),
+mPerformanceFrequency(0),
+mCompositeMicroseconds(0)
+{
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+CompositeStage::~CompositeStage() { }
+
+void CompositeStage::setup()
+{
+	mCompositeStream.allocate(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, GL_RGBA, GL_BGRA, GL_UNSIGNED_BYTE, BGRA_SIZE);
+}
+
+void CompositeStage::teardown()
+{
+	mCompositeStream.release();
+}
+
+void CompositeStage::update()
+{
+	mCompositeStream.update();
+}
+
+HRESULT CompositeStage::thread_process()
+{
+	if (!mEnabled)
+	{
+		return S_OK;
+	}
+
+	const BYTE* colorBuffer = mColorBufferSrc ? mColorBufferSrc->getLatestColorBuffer() : NULL;
+
+	if (colorBuffer == NULL)
+	{
+		return E_FAIL;
+	}
+
+	// no free upload buffer: the app thread is behind, this frame is skipped
+	BYTE* dst = static_cast<BYTE*>(mCompositeStream.beginWrite());
+
+	if (dst == NULL)
+	{
+		return S_OK;
+	}
+
+	MaskData maskData = { NULL, false };
+	if (mMaskBufferSrc)
+	{
+		maskData = mMaskBufferSrc->getLatestMaskBuffer();
+	}
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER end = { 0 };
+	QueryPerformanceCounter(&start);
+
+	this->composite(colorBuffer, (maskData.hasMask ? maskData.maskBuffer : NULL), mPremultiplied, dst);
+	mCompositeStream.endWrite();
+
+	QueryPerformanceCounter(&end);
+	mCompositeMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+
+	return S_OK;
+}
+
+/*
+* Four BGRA pixels and four mask bytes per step: the mask is spread to the alpha bytes,
+* premultiplying widens to 16 bits with alpha as the factor of B G R and 255 as its own
+*/
+void CompositeStage::composite(const BYTE* colorBuffer, const BYTE* maskBuffer, bool premultiplied, BYTE* dst)
+{
+	const int area = DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+	const __m128i alphaFactor = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+	const __m128i colorLanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i round = _mm_set1_epi16(128);
+
+	for (int i = 0; i < area; i += 4)
+	{
+		__m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colorBuffer + i * BGRA_SIZE));
+
+		// no user: opaque
+		__m128i alpha = alphaMask;
+
+		if (maskBuffer)
+		{
+			int packed = 0;
+			memcpy(&packed, maskBuffer + i, sizeof(packed));
+
+			// m0 m1 m2 m3 -> m0 m0 m0 m0 m1 m1 m1 m1 ...
+			__m128i m = _mm_cvtsi32_si128(packed);
+			m = _mm_unpacklo_epi8(m, m);
+			m = _mm_unpacklo_epi16(m, m);
+			alpha = _mm_and_si128(m, alphaMask);
+
+			if (premultiplied)
+			{
+				__m128i lo = _mm_unpacklo_epi8(color, zero);
+				__m128i hi = _mm_unpackhi_epi8(color, zero);
+				__m128i factorLo = _mm_or_si128(_mm_and_si128(_mm_unpacklo_epi8(m, zero), colorLanes), alphaFactor);
+				__m128i factorHi = _mm_or_si128(_mm_and_si128(_mm_unpackhi_epi8(m, zero), colorLanes), alphaFactor);
+
+				// x * a / 255 rounded: t = x * a + 128, (t + (t >> 8)) >> 8
+				lo = _mm_add_epi16(_mm_mullo_epi16(lo, factorLo), round);
+				hi = _mm_add_epi16(_mm_mullo_epi16(hi, factorHi), round);
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+				color = _mm_packus_epi16(lo, hi);
+			}
+		}
+
+		color = _mm_or_si128(_mm_andnot_si128(alphaMask, color), alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * BGRA_SIZE), color);
+	}
+}
+
+void CompositeStage::setColorBufferSource(IColorBufferSourceRef colorBufferSrc)
+{
+	mColorBufferSrc = colorBufferSrc;
+}
+
+void CompositeStage::setMaskBufferSource(IMaskBufferSourceRef maskBufferSrc)
+{
+	mMaskBufferSrc = maskBufferSrc;
+}
+
+ci::gl::TextureRef CompositeStage::getTextureReference()
+{
+	if (mCompositeStream.hasFrame())
+		return mCompositeStream.getTextureReference();
+	else
+		return NULL;
+}
\ No newline at end of file
@@ -0,0 +1,305 @@
+#include "KCDContours.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+using namespace kcd;
+
+ContourTracer::ContourTracer() :
+mWidth(0),
+mHeight(0),
+mStride(0),
+mLabels(NULL),
+mTolerance(1.5f),
+mMinimumBorderLength(8)
+{
+	for (int i = 0; i < 8; ++i)
+	{
+		mOffsets[i] = 0;
+	}
+}
+
+ContourTracer::~ContourTracer()
+{
+	this->release();
+}
+
+void ContourTracer::allocate(int width, int height)
+{
+	this->release();
+
+	mWidth = width;
+	mHeight = height;
+	mStride = width + 2;
+
+	mLabels = new int[mStride * (height + 2)];
+	memset(mLabels, 0, mStride * (height + 2) * sizeof(int));
+
+	// counterclockwise, starting east (y points down)
+	mOffsets[0] = 1;
+	mOffsets[1] = -mStride + 1;
+	mOffsets[2] = -mStride;
+	mOffsets[3] = -mStride - 1;
+	mOffsets[4] = -1;
+	mOffsets[5] = mStride - 1;
+	mOffsets[6] = mStride;
+	mOffsets[7] = mStride + 1;
+
+	mBorder.reserve(4 * (width + height));
+	mKeep.reserve(4 * (width + height));
+	mStack.reserve(256);
+}
+
+void ContourTracer::release()
+{
+	if (mLabels)
+	{
+		delete[] mLabels;
+		mLabels = NULL;
+	}
+}
+
+void ContourTracer::trace(const BYTE* mask, float scale, float offset, std::vector<ci::Vec2f>& points, std::vector<SilhouetteContour>& contours)
+{
+	if (!mLabels || !mask)
+	{
+		return;
+	}
+
+	for (int y = 0; y < mHeight; ++y)
+	{
+		const BYTE* src = mask + y * mWidth;
+		int* dst = mLabels + (y + 1) * mStride + 1;
+
+		for (int x = 0; x < mWidth; ++x)
+		{
+			dst[x] = src[x] ? 1 : 0;
+		}
+	}
+
+	int nbd = 1;
+
+	for (int y = 1; y <= mHeight; ++y)
+	{
+		for (int x = 1; x <= mWidth; ++x)
+		{
+			int p = y * mStride + x;
+			int value = mLabels[p];
+			bool isHole = false;
+
+			if (value == 1 && mLabels[p - 1] == 0)
+			{
+				isHole = false;
+				this->followBorder(p, p - 1, ++nbd);
+			}
+			else if (value >= 1 && mLabels[p + 1] == 0)
+			{
+				isHole = true;
+				this->followBorder(p, p + 1, ++nbd);
+			}
+			else
+			{
+				continue;
+			}
+
+			UINT n = static_cast<UINT>(mBorder.size());
+			if (n < mMinimumBorderLength)
+			{
+				continue;
+			}
+
+			// close the loop, anchor it at the start and at the farthest point, simplify both halves
+			mBorder.push_back(mBorder[0]);
+			mKeep.assign(n + 1, 0);
+
+			int sx = mBorder[0] % mStride;
+			int sy = mBorder[0] / mStride;
+			UINT farthest = 0;
+			int farthestDistance = -1;
+
+			for (UINT i = 1; i < n; ++i)
+			{
+				int dx = mBorder[i] % mStride - sx;
+				int dy = mBorder[i] / mStride - sy;
+				if (dx * dx + dy * dy > farthestDistance)
+				{
+					farthestDistance = dx * dx + dy * dy;
+					farthest = i;
+				}
+			}
+
+			mKeep[0] = 1;
+			mKeep[farthest] = 1;
+			mKeep[n] = 1;
+			this->simplify(0, farthest);
+			this->simplify(farthest, n);
+
+			SilhouetteContour contour;
+			contour.start = static_cast<UINT>(points.size());
+			contour.isHole = isHole;
+
+			for (UINT i = 0; i < n; ++i)
+			{
+				if (mKeep[i])
+				{
+					float px = static_cast<float>(mBorder[i] % mStride - 1);
+					float py = static_cast<float>(mBorder[i] / mStride - 1);
+					points.push_back(ci::Vec2f(px * scale + offset, py * scale + offset));
+				}
+			}
+
+			contour.count = static_cast<UINT>(points.size()) - contour.start;
+			contours.push_back(contour);
+		}
+	}
+}
+
+/*
+* Follows one border from start, the first neighbour examined being from
+* Pixels on the border get +/-nbd, negative when their east neighbour is background,
+* so that a border is never started twice
+*/
+void ContourTracer::followBorder(int start, int from, int nbd)
+{
+	mBorder.clear();
+
+	int direction = 0;
+	while (mOffsets[direction] != from - start)
+	{
+		direction++;
+	}
+
+	// clockwise, for the last pixel of the border
+	int p1 = -1;
+	for (int k = 0; k < 8; ++k)
+	{
+		int q = start + mOffsets[(direction - k + 8) & 7];
+		if (mLabels[q] != 0)
+		{
+			p1 = q;
+			break;
+		}
+	}
+
+	if (p1 < 0)
+	{
+		// isolated pixel
+		mLabels[start] = -nbd;
+		mBorder.push_back(start);
+		return;
+	}
+
+	int p2 = p1;
+	int p3 = start;
+
+	while (true)
+	{
+		direction = 0;
+		while (mOffsets[direction] != p2 - p3)
+		{
+			direction++;
+		}
+
+		// counterclockwise from the element after p2
+		int p4 = p2;
+		bool eastIsBackground = false;
+
+		for (int k = 1; k <= 8; ++k)
+		{
+			int d = (direction + k) & 7;
+			int q = p3 + mOffsets[d];
+
+			if (mLabels[q] != 0)
+			{
+				p4 = q;
+				break;
+			}
+
+			if (d == 0)
+			{
+				eastIsBackground = true;
+			}
+		}
+
+		if (eastIsBackground)
+		{
+			mLabels[p3] = -nbd;
+		}
+		else if (mLabels[p3] == 1)
+		{
+			mLabels[p3] = nbd;
+		}
+
+		mBorder.push_back(p3);
+
+		if (p4 == start && p3 == p1)
+		{
+			break;
+		}
+
+		p2 = p3;
+		p3 = p4;
+	}
+}
+
+/*
+* Ramer-Douglas-Peucker on mBorder[first..last], with an explicit stack
+*/
+void ContourTracer::simplify(UINT first, UINT last)
+{
+	const float toleranceSq = mTolerance * mTolerance;
+
+	mStack.clear();
+	mStack.push_back(std::make_pair(first, last));
+
+	while (!mStack.empty())
+	{
+		UINT a = mStack.back().first;
+		UINT b = mStack.back().second;
+		mStack.pop_back();
+
+		if (b <= a + 1)
+		{
+			continue;
+		}
+
+		float ax = static_cast<float>(mBorder[a] % mStride);
+		float ay = static_cast<float>(mBorder[a] / mStride);
+		float dx = static_cast<float>(mBorder[b] % mStride) - ax;
+		float dy = static_cast<float>(mBorder[b] / mStride) - ay;
+		float lengthSq = dx * dx + dy * dy;
+
+		float maxDistanceSq = -1.0f;
+		UINT index = a;
+
+		for (UINT i = a + 1; i < b; ++i)
+		{
+			float px = static_cast<float>(mBorder[i] % mStride) - ax;
+			float py = static_cast<float>(mBorder[i] / mStride) - ay;
+			float distanceSq = 0;
+
+			if (lengthSq > 0)
+			{
+				float cross = px * dy - py * dx;
+				distanceSq = cross * cross / lengthSq;
+			}
+			else
+			{
+				distanceSq = px * px + py * py;
+			}
+
+			if (distanceSq > maxDistanceSq)
+			{
+				maxDistanceSq = distanceSq;
+				index = i;
+			}
+		}
+
+		if (maxDistanceSq > toleranceSq)
+		{
+			mKeep[index] = 1;
+			mStack.push_back(std::make_pair(a, index));
+			mStack.push_back(std::make_pair(index, b));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,546 @@
+#include "KCDCoordinateField.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace kcd;
+
+#define DEFAULT_FOCAL_RATIO 2.9f // color fx / depth fx, used until the first estimate
+
+SparseCoordinateField::SparseCoordinateField() :
+mColorWidth(0),
+mColorHeight(0),
+mDepthWidth(0),
+mDepthHeight(0),
+mDepthArea(0),
+mStep(4),
+mNodesX(0),
+mNodesY(0),
+mCellsX(0),
+mCellsY(0),
+mColorPoints(NULL),
+mNodes(NULL),
+mNodeDepth(NULL),
+mNodeDistance(NULL),
+mScaleX(DEFAULT_FOCAL_RATIO),
+mScaleY(DEFAULT_FOCAL_RATIO),
+mEdgeTolerance(0.5f),
+mDepthTolerance(50),
+mRefinedCells(0),
+mCellSlot(NULL)
+{
+
+}
+
+SparseCoordinateField::~SparseCoordinateField()
+{
+	this->release();
+}
+
+void SparseCoordinateField::allocate(int colorWidth, int colorHeight, int depthWidth, int depthHeight, int step)
+{
+	this->release();
+
+	// resolve() works on runs of four pixels
+	mStep = (step >= 8) ? 8 : 4;
+
+	mColorWidth = colorWidth;
+	mColorHeight = colorHeight;
+	mDepthWidth = depthWidth;
+	mDepthHeight = depthHeight;
+	mDepthArea = depthWidth * depthHeight;
+
+	mCellsX = colorWidth / mStep;
+	mCellsY = colorHeight / mStep;
+	mNodesX = mCellsX + 1;
+	mNodesY = mCellsY + 1;
+
+	int nodeCount = mNodesX * mNodesY;
+
+	mColorPoints = new ColorSpacePoint[mDepthArea];
+	mNodes = new DepthSpacePoint[nodeCount];
+	mNodeDepth = new UINT16[nodeCount];
+	mNodeDistance = new float[nodeCount];
+	mCellSlot = new int[mCellsX * mCellsY];
+	mRefinedCells = 0;
+}
+
+void SparseCoordinateField::release()
+{
+	if (mColorPoints)
+	{
+		delete[] mColorPoints;
+		mColorPoints = NULL;
+	}
+
+	if (mNodes)
+	{
+		delete[] mNodes;
+		mNodes = NULL;
+	}
+
+	if (mNodeDepth)
+	{
+		delete[] mNodeDepth;
+		mNodeDepth = NULL;
+	}
+
+	if (mNodeDistance)
+	{
+		delete[] mNodeDistance;
+		mNodeDistance = NULL;
+	}
+
+	if (mCellSlot)
+	{
+		delete[] mCellSlot;
+		mCellSlot = NULL;
+	}
+}
+
+HRESULT SparseCoordinateField::build(ICoordinateMapper* coordinateMapper, const UINT16* depthBuffer)
+{
+	if (!coordinateMapper || !depthBuffer || !mColorPoints || !mNodes)
+	{
+		return E_FAIL;
+	}
+
+	HRESULT hr = coordinateMapper->MapDepthFrameToColorSpace(mDepthArea, depthBuffer, mDepthArea, mColorPoints);
+
+	if (SUCCEEDED(hr))
+	{
+		this->estimateScale(depthBuffer);
+		this->splat(depthBuffer);
+		this->remapRefinedCells(depthBuffer);
+	}
+
+	return hr;
+}
+
+/*
+* The color/depth pixel ratio is the ratio of the two focal lengths,
+* measured from horizontally and vertically adjacent samples on the same surface
+*/
+void SparseCoordinateField::estimateScale(const UINT16* depthBuffer)
+{
+	double sumX = 0;
+	double sumY = 0;
+	UINT countX = 0;
+	UINT countY = 0;
+
+	// a few rows and columns are plenty
+	for (int y = 0; y < mDepthHeight - 1; y += 8)
+	{
+		for (int x = 0; x < mDepthWidth - 1; x += 2)
+		{
+			int i = y * mDepthWidth + x;
+			UINT16 d = depthBuffer[i];
+
+			if (d == 0 || mColorPoints[i].X == -std::numeric_limits<float>::infinity())
+			{
+				continue;
+			}
+
+			int right = i + 1;
+			if (depthBuffer[right] && abs(depthBuffer[right] - d) < mDepthTolerance && mColorPoints[right].X != -std::numeric_limits<float>::infinity())
+			{
+				sumX += mColorPoints[right].X - mColorPoints[i].X;
+				countX++;
+			}
+
+			int below = i + mDepthWidth;
+			if (depthBuffer[below] && abs(depthBuffer[below] - d) < mDepthTolerance && mColorPoints[below].Y != -std::numeric_limits<float>::infinity())
+			{
+				sumY += mColorPoints[below].Y - mColorPoints[i].Y;
+				countY++;
+			}
+		}
+	}
+
+	if (countX > 0)
+	{
+		float scale = static_cast<float>(sumX / countX);
+		if (fabs(scale) > 0.5f)
+		{
+			mScaleX = scale;
+		}
+	}
+
+	if (countY > 0)
+	{
+		float scale = static_cast<float>(sumY / countY);
+		if (fabs(scale) > 0.5f)
+		{
+			mScaleY = scale;
+		}
+	}
+}
+
+/*
+* Each depth sample lands on the four grid nodes around its color projection.
+* A node keeps the front-most sample (that is what the color camera sees),
+* nearest one on ties, corrected to the exact node position with the focal ratio.
+* Samples further than one depth pixel away are ignored, bounding edge dilation,
+* and a node is never corrected into a depth pixel of another surface (or without depth).
+*/
+void SparseCoordinateField::splat(const UINT16* depthBuffer)
+{
+	int nodeCount = mNodesX * mNodesY;
+	const float invStep = 1.0f / static_cast<float>(mStep);
+	const float maxDistance = std::max(mScaleX * mScaleX, mScaleY * mScaleY);
+
+	for (int n = 0; n < nodeCount; ++n)
+	{
+		mNodes[n].X = -std::numeric_limits<float>::infinity();
+		mNodes[n].Y = -std::numeric_limits<float>::infinity();
+		mNodeDepth[n] = 0xFFFF;
+		mNodeDistance[n] = maxDistance;
+	}
+
+	for (int y = 0; y < mDepthHeight; ++y)
+	{
+		for (int x = 0; x < mDepthWidth; ++x)
+		{
+			int i = y * mDepthWidth + x;
+			UINT16 d = depthBuffer[i];
+			ColorSpacePoint c = mColorPoints[i];
+
+			if (d == 0 || c.X == -std::numeric_limits<float>::infinity() || c.Y == -std::numeric_limits<float>::infinity())
+			{
+				continue;
+			}
+
+			int gx0 = static_cast<int>(floor(c.X * invStep));
+			int gy0 = static_cast<int>(floor(c.Y * invStep));
+
+			for (int gy = gy0; gy <= gy0 + 1; ++gy)
+			{
+				if (gy < 0 || gy >= mNodesY)
+				{
+					continue;
+				}
+
+				for (int gx = gx0; gx <= gx0 + 1; ++gx)
+				{
+					if (gx < 0 || gx >= mNodesX)
+					{
+						continue;
+					}
+
+					int n = gy * mNodesX + gx;
+					float ox = static_cast<float>(gx * mStep) - c.X;
+					float oy = static_cast<float>(gy * mStep) - c.Y;
+					float distance = ox * ox + oy * oy;
+
+					bool take = false;
+					UINT16 nodeDepth = mNodeDepth[n];
+
+					if (distance >= maxDistance)
+					{
+						take = false;
+					}
+					else if (nodeDepth == 0xFFFF || d + mDepthTolerance < nodeDepth)
+					{
+						take = true;
+					}
+					else if (d <= nodeDepth + mDepthTolerance)
+					{
+						take = (distance < mNodeDistance[n]);
+					}
+
+					float depthX = static_cast<float>(x) + ox / mScaleX;
+					float depthY = static_cast<float>(y) + oy / mScaleY;
+
+					if (take && this->isSameSurface(depthBuffer, x, y, depthX, depthY))
+					{
+						mNodes[n].X = depthX;
+						mNodes[n].Y = depthY;
+						mNodeDepth[n] = d;
+						mNodeDistance[n] = distance;
+					}
+				}
+			}
+		}
+	}
+}
+
+void SparseCoordinateField::clearRefinedSlot(int slot, float distance)
+{
+	size_t cellArea = static_cast<size_t>(mStep * mStep);
+	size_t begin = slot * cellArea;
+
+	// grown, never shrunk: the edge count changes every frame
+	if (mRefinedX.size() < begin + cellArea)
+	{
+		size_t size = std::max(begin + cellArea, 2 * mRefinedX.size());
+		mRefinedX.resize(size);
+		mRefinedY.resize(size);
+		mRefinedDepth.resize(size);
+		mRefinedDistance.resize(size);
+	}
+
+	// uncovered distances rank after covered ones, see remapRefinedCells()
+	std::fill(mRefinedX.begin() + begin, mRefinedX.begin() + begin + cellArea, -std::numeric_limits<float>::infinity());
+	std::fill(mRefinedY.begin() + begin, mRefinedY.begin() + begin + cellArea, -std::numeric_limits<float>::infinity());
+	std::fill(mRefinedDepth.begin() + begin, mRefinedDepth.begin() + begin + cellArea, static_cast<UINT16>(0xFFFF));
+	std::fill(mRefinedDistance.begin() + begin, mRefinedDistance.begin() + begin + cellArea, distance);
+}
+
+/*
+* Sample (x, y) corrected by a fraction of a pixel may land in the neighbouring depth pixel;
+* it still maps there only if that pixel is on its surface
+*/
+bool SparseCoordinateField::isSameSurface(const UINT16* depthBuffer, int x, int y, float depthX, float depthY) const
+{
+	int qx = static_cast<int>(floor(depthX + 0.5f));
+	int qy = static_cast<int>(floor(depthY + 0.5f));
+
+	if (qx == x && qy == y)
+	{
+		return true;
+	}
+
+	if (qx < 0 || qx >= mDepthWidth || qy < 0 || qy >= mDepthHeight)
+	{
+		return false;
+	}
+
+	UINT16 d = depthBuffer[qy * mDepthWidth + qx];
+	return d != 0 && abs(d - depthBuffer[y * mDepthWidth + x]) <= mDepthTolerance;
+}
+
+/*
+* In a smooth cell every corner predicts the same parallax offset,
+* i.e. the same depth coordinate for the cell origin
+*/
+bool SparseCoordinateField::isSmoothCell(int cx, int cy) const
+{
+	float minX = std::numeric_limits<float>::max();
+	float maxX = -std::numeric_limits<float>::max();
+	float minY = std::numeric_limits<float>::max();
+	float maxY = -std::numeric_limits<float>::max();
+
+	for (int j = 0; j <= 1; ++j)
+	{
+		for (int i = 0; i <= 1; ++i)
+		{
+			const DepthSpacePoint& n = mNodes[(cy + j) * mNodesX + cx + i];
+
+			if (!isValidDepthSpacePoint(n))
+			{
+				return false;
+			}
+
+			float originX = n.X - static_cast<float>(i * mStep) / mScaleX;
+			float originY = n.Y - static_cast<float>(j * mStep) / mScaleY;
+
+			minX = std::min(minX, originX);
+			maxX = std::max(maxX, originX);
+			minY = std::min(minY, originY);
+			maxY = std::max(maxY, originY);
+		}
+	}
+
+	return (maxX - minX) <= mEdgeTolerance && (maxY - minY) <= mEdgeTolerance;
+}
+
+/*
+* Cells whose corners disagree get every pixel from the depth samples themselves.
+* A sample covers the color pixels inside its own depth pixel's footprint, front-most
+* one wins there; samples up to one depth pixel away only fill what nothing covers
+* (a surface stretched by parallax), nearest one first, the way splat() fills the nodes.
+* Only samples reaching a refined cell are looked at twice.
+*/
+void SparseCoordinateField::remapRefinedCells(const UINT16* depthBuffer)
+{
+	const int cellArea = mStep * mStep;
+	const float maxDistance = std::max(mScaleX * mScaleX, mScaleY * mScaleY);
+	const float radius = sqrt(maxDistance);
+	// a little over half a depth pixel: pixels on a footprint border must not fall between two
+	const float halfX = 0.55f * fabs(mScaleX);
+	const float halfY = 0.55f * fabs(mScaleY);
+
+	mRefinedCells = 0;
+
+	for (int cy = 0; cy < mCellsY; ++cy)
+	{
+		for (int cx = 0; cx < mCellsX; ++cx)
+		{
+			bool smooth = isSmoothCell(cx, cy);
+			mCellSlot[cy * mCellsX + cx] = smooth ? COORDINATE_FIELD_SMOOTH_CELL : COORDINATE_FIELD_EMPTY_CELL;
+			mRefinedCells += smooth ? 0 : 1;
+		}
+	}
+
+	if (mRefinedCells == 0)
+	{
+		return;
+	}
+
+	// slots are handed out to the refined cells some sample reaches, outside the depth view there are none
+	int slots = 0;
+
+	const int width = mCellsX * mStep;
+	const int height = mCellsY * mStep;
+
+	for (int y = 0; y < mDepthHeight; ++y)
+	{
+		for (int x = 0; x < mDepthWidth; ++x)
+		{
+			int i = y * mDepthWidth + x;
+			UINT16 d = depthBuffer[i];
+			ColorSpacePoint c = mColorPoints[i];
+
+			if (d == 0 || c.X == -std::numeric_limits<float>::infinity() || c.Y == -std::numeric_limits<float>::infinity())
+			{
+				continue;
+			}
+
+			// color pixels this sample can reach
+			int px0 = std::max(0, static_cast<int>(ceil(c.X - radius)));
+			int px1 = std::min(width - 1, static_cast<int>(floor(c.X + radius)));
+			int py0 = std::max(0, static_cast<int>(ceil(c.Y - radius)));
+			int py1 = std::min(height - 1, static_cast<int>(floor(c.Y + radius)));
+
+			if (px0 > px1 || py0 > py1)
+			{
+				continue;
+			}
+
+			bool reachesRefined = false;
+			for (int cy = py0 / mStep; cy <= py1 / mStep && !reachesRefined; ++cy)
+			{
+				for (int cx = px0 / mStep; cx <= px1 / mStep; ++cx)
+				{
+					if (mCellSlot[cy * mCellsX + cx] != COORDINATE_FIELD_SMOOTH_CELL)
+					{
+						reachesRefined = true;
+						break;
+					}
+				}
+			}
+
+			if (!reachesRefined)
+			{
+				continue;
+			}
+
+			for (int py = py0; py <= py1; ++py)
+			{
+				for (int px = px0; px <= px1; ++px)
+				{
+					int& slot = mCellSlot[(py / mStep) * mCellsX + px / mStep];
+					float ox = static_cast<float>(px) - c.X;
+					float oy = static_cast<float>(py) - c.Y;
+					float distance = ox * ox + oy * oy;
+
+					if (slot == COORDINATE_FIELD_SMOOTH_CELL || distance >= maxDistance)
+					{
+						continue;
+					}
+
+					if (slot == COORDINATE_FIELD_EMPTY_CELL)
+					{
+						slot = slots++;
+						this->clearRefinedSlot(slot, 2 * maxDistance);
+					}
+
+					int r = slot * cellArea + (py % mStep) * mStep + (px % mStep);
+
+					bool covers = fabs(ox) <= halfX && fabs(oy) <= halfY;
+					bool covered = mRefinedDistance[r] < maxDistance;
+					distance = covers ? distance : distance + maxDistance;
+
+					bool take = false;
+					UINT16 pixelDepth = mRefinedDepth[r];
+
+					if (covers != covered)
+					{
+						take = covers;
+					}
+					else if (pixelDepth == 0xFFFF || d + mDepthTolerance < pixelDepth)
+					{
+						take = true;
+					}
+					else if (d <= pixelDepth + mDepthTolerance)
+					{
+						take = (distance < mRefinedDistance[r]);
+					}
+
+					float depthX = static_cast<float>(x) + ox / mScaleX;
+					float depthY = static_cast<float>(y) + oy / mScaleY;
+
+					if (take && this->isSameSurface(depthBuffer, x, y, depthX, depthY))
+					{
+						mRefinedX[r] = depthX;
+						mRefinedY[r] = depthY;
+						mRefinedDepth[r] = d;
+						mRefinedDistance[r] = distance;
+					}
+				}
+			}
+		}
+	}
+}
+
+namespace kcd
+{
+	struct CoordinateFieldErrorSink
+	{
+		const DepthSpacePoint* fullField;
+		double errorSum;
+		float errorMax;
+		UINT compared;
+		UINT mismatched;
+
+		void operator()(int colorIndex, const __m128& depthX, const __m128& depthY)
+		{
+			__declspec(align(16)) float x[4];
+			__declspec(align(16)) float y[4];
+			_mm_store_ps(x, depthX);
+			_mm_store_ps(y, depthY);
+
+			for (int k = 0; k < 4; ++k)
+			{
+				const DepthSpacePoint& reference = fullField[colorIndex + k];
+				bool referenceValid = isValidDepthSpacePoint(reference);
+				bool approximateValid = (x[k] != -std::numeric_limits<float>::infinity() && y[k] != -std::numeric_limits<float>::infinity());
+
+				if (referenceValid && approximateValid)
+				{
+					float dx = x[k] - reference.X;
+					float dy = y[k] - reference.Y;
+					float error = sqrt(dx * dx + dy * dy);
+					errorSum += error;
+					errorMax = std::max(errorMax, error);
+					compared++;
+				}
+				else if (referenceValid != approximateValid)
+				{
+					mismatched++;
+				}
+			}
+		}
+	};
+};
+
+void SparseCoordinateField::measureError(const DepthSpacePoint* fullField, CoordinateFieldStats& stats)
+{
+	if (!fullField)
+	{
+		return;
+	}
+
+	CoordinateFieldErrorSink sink;
+	sink.fullField = fullField;
+	sink.errorSum = 0;
+	sink.errorMax = 0;
+	sink.compared = 0;
+	sink.mismatched = 0;
+
+	this->resolve(sink);
+
+	stats.meanError = sink.compared ? static_cast<float>(sink.errorSum / sink.compared) : 0.0f;
+	stats.maxError = sink.errorMax;
+	stats.validityMismatch = static_cast<float>(sink.mismatched) / static_cast<float>(mColorWidth * mColorHeight);
+	stats.validatedFrames++;
+}
\ No newline at end of file
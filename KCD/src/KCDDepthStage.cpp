@@ -0,0 +1,237 @@
+#include "KCDDepthStage.h"
+#include "KCDDeviceStage.h"
+#include <emmintrin.h>
+#include <algorithm>
+
+using namespace kcd;
+
+static inline UINT packBgra(float r, float g, float b)
+{
+	UINT ri = static_cast<UINT>(std::min(255.0f, std::max(0.0f, r * 255.0f + 0.5f)));
+	UINT gi = static_cast<UINT>(std::min(255.0f, std::max(0.0f, g * 255.0f + 0.5f)));
+	UINT bi = static_cast<UINT>(std::min(255.0f, std::max(0.0f, b * 255.0f + 0.5f)));
+	return bi | (gi << 8) | (ri << 16) | (0xFFu << 24);
+}
+
+DepthStage::DepthStage() :
+mDeviceSrc(NULL),
+mDepthFrameRef(NULL),
+mDepthFrame(NULL),
+mParamsChanged(true),
+mLut(NULL),
+mPerformanceFrequency(0),
+mColorizeMicroseconds(0)
+{
+	mLut = static_cast<UINT*>(_aligned_malloc(DEPTH_LUT_SIZE * sizeof(UINT), 16));
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+DepthStage::~DepthStage()
+{
+	if (mLut)
+	{
+		_aligned_free(mLut);
+		mLut = NULL;
+	}
+}
+
+void DepthStage::setup()
+{
+	mDepthImages.allocate(DeviceStage::DepthFrameWidth, DeviceStage::DepthFrameHeight, IMAGE_FORMAT_DEPTH);
+	mDepthStream.allocate(DeviceStage::DepthFrameWidth, DeviceStage::DepthFrameHeight, GL_RGBA, GL_BGRA, GL_UNSIGNED_BYTE, BGRA_SIZE);
+}
+
+void DepthStage::teardown()
+{
+	mDepthStream.release();
+	mDepthImages.release();
+}
+
+void DepthStage::update()
+{
+	mDepthStream.update();
+}
+
+HRESULT DepthStage::thread_process()
+{
+	HRESULT hr = S_OK;
+
+	IMultiSourceFrame* multiSourceFrame = mDeviceSrc->getLatestFrame();
+
+	if (multiSourceFrame == NULL || mLut == NULL)
+	{
+		hr = E_FAIL;
+	}
+
+	mDepthFrameRef = NULL;
+	mDepthFrame = NULL;
+
+	if (SUCCEEDED(hr))
+	{
+		hr = multiSourceFrame->get_DepthFrameReference(&mDepthFrameRef);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mDepthFrameRef->AcquireFrame(&mDepthFrame);
+	}
+
+	// the frame's buffer is released after this iteration: depth is copied once into a buffer
+	// consumers can hold, and colorized from there
+	UINT16* depthBuffer = reinterpret_cast<UINT16*>(mDepthImages.acquireBuffer());
+
+	if (SUCCEEDED(hr) && depthBuffer == NULL)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mDepthFrame->CopyFrameDataToArray(DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight, depthBuffer);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		mDepthImages.publish(mDeviceSrc->getLatestFrameId());
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (mParamsChanged.exchange(false))
+		{
+			mParamsMutex.lock();
+			DepthColorParams params = mParams;
+			mParamsMutex.unlock();
+
+			this->buildLut(params);
+		}
+
+		// no free upload buffer: the app thread is behind, this frame is skipped
+		UINT* dst = static_cast<UINT*>(mDepthStream.beginWrite());
+
+		if (dst)
+		{
+			LARGE_INTEGER start = { 0 };
+			LARGE_INTEGER end = { 0 };
+			QueryPerformanceCounter(&start);
+
+			this->colorize(depthBuffer, dst);
+			mDepthStream.endWrite();
+
+			QueryPerformanceCounter(&end);
+			mColorizeMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+		}
+	}
+
+	return hr;
+}
+
+HRESULT DepthStage::post_thread_process()
+{
+	__safe_release(mDepthFrame);
+	__safe_release(mDepthFrameRef);
+	return S_OK;
+}
+
+/*
+* One color per millimeter: the range is mapped to t in [0, 1], near to far, and clamped outside it
+*/
+void DepthStage::buildLut(const DepthColorParams& params)
+{
+	const float minDepth = static_cast<float>(params.minDepth);
+	const float range = std::max(1.0f, static_cast<float>(params.maxDepth) - minDepth);
+
+	// heat map stops, near to far
+	const float stops[][3] = { { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+	const int segments = _countof(stops) - 1;
+
+	mLut[0] = packBgra(0, 0, 0);
+
+	for (int d = 1; d < DEPTH_LUT_SIZE; ++d)
+	{
+		float t = std::min(1.0f, std::max(0.0f, (d - minDepth) / range));
+
+		if (params.colorMap == DEPTH_COLOR_MAP_GRAY)
+		{
+			float value = 1.0f - 0.875f * t;
+			mLut[d] = packBgra(value, value, value);
+			continue;
+		}
+
+		float position = t * segments;
+		int segment = std::min(segments - 1, static_cast<int>(position));
+		float f = position - segment;
+		const float* a = stops[segment];
+		const float* b = stops[segment + 1];
+		mLut[d] = packBgra(a[0] + (b[0] - a[0]) * f, a[1] + (b[1] - a[1]) * f, a[2] + (b[2] - a[2]) * f);
+	}
+}
+
+/*
+* Eight depth pixels per step: clamped to the table with an unsigned saturating subtract,
+* then one table load per pixel; dst is write combined memory, so whole 16 byte stores only
+*/
+void DepthStage::colorize(const UINT16* depthBuffer, UINT* dst)
+{
+	const int area = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
+	const __m128i limit = _mm_set1_epi16(DEPTH_LUT_SIZE - 1);
+	const UINT* lut = mLut;
+
+	for (int i = 0; i < area; i += 8)
+	{
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depthBuffer + i));
+
+		// min(d, limit) for unsigned 16 bit: d - max(d - limit, 0)
+		d = _mm_sub_epi16(d, _mm_subs_epu16(d, limit));
+
+		__m128i lo = _mm_set_epi32(lut[_mm_extract_epi16(d, 3)], lut[_mm_extract_epi16(d, 2)], lut[_mm_extract_epi16(d, 1)], lut[_mm_extract_epi16(d, 0)]);
+		__m128i hi = _mm_set_epi32(lut[_mm_extract_epi16(d, 7)], lut[_mm_extract_epi16(d, 6)], lut[_mm_extract_epi16(d, 5)], lut[_mm_extract_epi16(d, 4)]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), hi);
+	}
+}
+
+ImageViewRef DepthStage::tryGetLatestImage()
+{
+	return mDepthImages.tryGetLatest();
+}
+
+ImageViewRef DepthStage::waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds)
+{
+	return mDepthImages.waitForNewer(frameId, timeoutMilliseconds);
+}
+
+void DepthStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void DepthStage::setParams(const DepthColorParams& params)
+{
+	mParamsMutex.lock();
+	mParams = params;
+	mParams.maxDepth = std::min(static_cast<UINT16>(DEPTH_LUT_SIZE - 1), std::max(params.minDepth, params.maxDepth));
+	mParamsMutex.unlock();
+	mParamsChanged = true;
+}
+
+DepthColorParams DepthStage::getParams()
+{
+	mParamsMutex.lock();
+	DepthColorParams params = mParams;
+	mParamsMutex.unlock();
+	return params;
+}
+
+ci::gl::TextureRef DepthStage::getTextureReference()
+{
+	if (mDepthStream.hasFrame())
+		return mDepthStream.getTextureReference();
+	else
+		return NULL;
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "KCDDeviceStage.h"
+#include "KCDMapperCalibration.h"
 #include <exception>
 #include <algorithm>
+#include <string.h>
 
 using namespace kcd;
 
@@ -8,9 +10,11 @@ DeviceStage::DeviceStage() :
 	mKinectSensor(NULL),
 	mCoordinateMapper(NULL),
 	mFrameReader(NULL),
-	multiSourceFrame(NULL)
+	multiSourceFrame(NULL),
+	mFrameId(0),
+	mCalibrationFailed(false)
 {
-
+	memset(&mValidation, 0, sizeof(mValidation));
 }
 
 DeviceStage::~DeviceStage()
@@ -54,6 +58,13 @@ HRESULT DeviceStage::thread_setup()
 		return E_FAIL;
 	}
 
+	// a file that doesn't hold up is exported again from the sensor
+	MapperCalibration calibration;
+	if (!mCalibrationPath.empty() && calibration.load(mCalibrationPath) && mSoftwareMapper.setCalibration(calibration))
+	{
+		this->validateCalibration();
+	}
+
 	return hr;
 }
 
@@ -83,6 +94,17 @@ HRESULT DeviceStage::thread_process()
 
 	multiSourceFrame = NULL;
 	hr = mFrameReader->AcquireLatestFrame(&multiSourceFrame);
+
+	if (SUCCEEDED(hr))
+	{
+		mFrameId++;
+
+		if (!mSoftwareMapper.isValid() && !mCalibrationFailed)
+		{
+			this->calibrate();
+		}
+	}
+
 	return hr;
 }
 
@@ -107,23 +129,109 @@ ICoordinateMapper* DeviceStage::getCoordinateMapper()
 	return mCoordinateMapper;
 }
 
-/*
-* these two methods are not "secure" as they do not check whether mCoordinateMapper is not NULL
-* they are also not thread safe
-*/
+UINT64 DeviceStage::getLatestFrameId()
+{
+	return mFrameId;
+}
+
+const SoftwareMapper* DeviceStage::getSoftwareMapper()
+{
+	return mSoftwareMapper.isValid() ? &mSoftwareMapper : NULL;
+}
+
+void DeviceStage::setCalibrationFile(const std::string& path)
+{
+	mCalibrationPath = path;
+}
+
+// retried every frame while the sensor has no intrinsics yet, given up on any other failure
+void DeviceStage::calibrate()
+{
+	MapperCalibration calibration;
+	HRESULT hr = exportMapperCalibration(mCoordinateMapper, calibration);
+
+	if (hr == E_PENDING)
+	{
+		return;
+	}
+
+	if (FAILED(hr) || !mSoftwareMapper.setCalibration(calibration) || FAILED(this->validateCalibration()))
+	{
+		mCalibrationFailed = true;
+		return;
+	}
+
+	if (!mCalibrationPath.empty())
+	{
+		calibration.save(mCalibrationPath);
+	}
+}
+
+// the software mapper is cleared when it is off the held out samples
+HRESULT DeviceStage::validateCalibration()
+{
+	MapperValidation validation;
+	HRESULT hr = validateMapperCalibration(mSoftwareMapper, validation);
+
+	if (FAILED(hr))
+	{
+		mSoftwareMapper.clearCalibration();
+	}
+
+	mValidationMutex.lock();
+	mValidation = validation;
+	mValidationMutex.unlock();
+
+	return hr;
+}
+
+MapperValidation DeviceStage::getCalibrationValidation()
+{
+	mValidationMutex.lock();
+	MapperValidation validation = mValidation;
+	mValidationMutex.unlock();
+	return validation;
+}
 
 ci::Vec2f DeviceStage::CameraSpaceToScreenSpace(const CameraSpacePoint& csp, const ci::Vec2f& scale)
 {
 	DepthSpacePoint dp = { 0 };
-	mCoordinateMapper->MapCameraPointToDepthSpace(csp, &dp);
+	if (mCoordinateMapper != NULL)
+	{
+		mCoordinateMapper->MapCameraPointToDepthSpace(csp, &dp);
+	}
 	return (ci::Vec2f(dp.X, dp.Y) * scale);
 }
 
 ci::Vec2f DeviceStage::CameraSpaceToScreenSpace(const CameraSpacePoint& csp, const int screenwidth, const int screenheight)
 {
-	DepthSpacePoint dp = { 0 };
-	mCoordinateMapper->MapCameraPointToDepthSpace(csp, &dp);
-	float x = static_cast<float>(dp.X * screenwidth) / DepthFrameWidth;
-	float y = static_cast<float>(dp.Y * screenheight) / DepthFrameHeight;
-	return ci::Vec2f(x, y);
+	return this->CameraSpaceToScreenSpace(csp, ci::Vec2f(static_cast<float>(screenwidth) / DepthFrameWidth, static_cast<float>(screenheight) / DepthFrameHeight));
+}
+
+HRESULT DeviceStage::CameraSpaceToScreenSpace(UINT count, const CameraSpacePoint* cameraPoints, DepthSpacePoint* depthPoints, ci::Vec2f* screenPoints, const ci::Vec2f& screenSize)
+{
+	if (mCoordinateMapper == NULL || cameraPoints == NULL || depthPoints == NULL || screenPoints == NULL)
+	{
+		return E_FAIL;
+	}
+
+	if (count == 0)
+	{
+		return S_OK;
+	}
+
+	HRESULT hr = mCoordinateMapper->MapCameraPointsToDepthSpace(count, cameraPoints, count, depthPoints);
+
+	if (SUCCEEDED(hr))
+	{
+		const float scaleX = screenSize.x / DepthFrameWidth;
+		const float scaleY = screenSize.y / DepthFrameHeight;
+
+		for (UINT i = 0; i < count; ++i)
+		{
+			screenPoints[i] = ci::Vec2f(depthPoints[i].X * scaleX, depthPoints[i].Y * scaleY);
+		}
+	}
+
+	return hr;
 }
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "KCDDistanceTransform.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+using namespace kcd;
+
+#define DT_INFINITY 1e20f
+
+DistanceTransform::DistanceTransform() :
+mWidth(0),
+mHeight(0),
+mMaxDistance(32.0f),
+mUseRoi(true),
+mOutsideSq(NULL),
+mInsideSq(NULL)
+{
+
+}
+
+DistanceTransform::~DistanceTransform()
+{
+	this->release();
+}
+
+void DistanceTransform::allocate(int width, int height)
+{
+	this->release();
+
+	mWidth = std::min(width, DISTANCE_TRANSFORM_MAX_DIMENSION);
+	mHeight = std::min(height, DISTANCE_TRANSFORM_MAX_DIMENSION);
+
+	mOutsideSq = new float[mWidth * mHeight];
+	mInsideSq = new float[mWidth * mHeight];
+}
+
+void DistanceTransform::release()
+{
+	if (mOutsideSq)
+	{
+		delete[] mOutsideSq;
+		mOutsideSq = NULL;
+	}
+
+	if (mInsideSq)
+	{
+		delete[] mInsideSq;
+		mInsideSq = NULL;
+	}
+}
+
+/*
+* Lower envelope of the parabolas rooted at (q, f(q)), sampled at every q
+* v: parabola roots, z: envelope breakpoints, both sized n + 1
+*/
+void DistanceTransform::transform1D(const float* f, int n, float* d, int* v, float* z)
+{
+	int k = 0;
+	v[0] = 0;
+	z[0] = -DT_INFINITY;
+	z[1] = DT_INFINITY;
+
+	for (int q = 1; q < n; ++q)
+	{
+		float fq = f[q] + static_cast<float>(q * q);
+		float s = (fq - (f[v[k]] + static_cast<float>(v[k] * v[k]))) / static_cast<float>(2 * q - 2 * v[k]);
+
+		while (s <= z[k])
+		{
+			k--;
+			s = (fq - (f[v[k]] + static_cast<float>(v[k] * v[k]))) / static_cast<float>(2 * q - 2 * v[k]);
+		}
+
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = DT_INFINITY;
+	}
+
+	k = 0;
+	for (int q = 0; q < n; ++q)
+	{
+		while (z[k + 1] < static_cast<float>(q))
+		{
+			k++;
+		}
+
+		float dq = static_cast<float>(q - v[k]);
+		d[q] = dq * dq + f[v[k]];
+	}
+}
+
+void DistanceTransform::compute(const BYTE* mask, float* distance, BYTE* clamped)
+{
+	if (!mOutsideSq || !mask || !distance || !clamped)
+	{
+		return;
+	}
+
+	const int width = mWidth;
+	const int height = mHeight;
+	const float maxDistance = mMaxDistance;
+	const float scale = 127.0f / maxDistance;
+
+	// region of interest: mask bounding box, grown by the clamp distance
+	int x0 = 0;
+	int y0 = 0;
+	int x1 = width;
+	int y1 = height;
+
+	if (mUseRoi)
+	{
+		int minX = width;
+		int minY = height;
+		int maxX = -1;
+		int maxY = -1;
+
+		for (int y = 0; y < height; ++y)
+		{
+			const BYTE* row = mask + y * width;
+
+			for (int x = 0; x < width; ++x)
+			{
+				if (row[x])
+				{
+					minX = std::min(minX, x);
+					maxX = std::max(maxX, x);
+					minY = std::min(minY, y);
+					maxY = y;
+				}
+			}
+		}
+
+		if (maxX < 0)
+		{
+			// nothing inside: everything is far away
+			std::fill(distance, distance + width * height, maxDistance);
+			memset(clamped, 255, width * height);
+			return;
+		}
+
+		int margin = static_cast<int>(ceil(maxDistance)) + 1;
+		x0 = std::max(0, minX - margin);
+		y0 = std::max(0, minY - margin);
+		x1 = std::min(width, maxX + margin + 1);
+		y1 = std::min(height, maxY + margin + 1);
+
+		for (int y = 0; y < height; ++y)
+		{
+			if (y < y0 || y >= y1)
+			{
+				std::fill(distance + y * width, distance + (y + 1) * width, maxDistance);
+				memset(clamped + y * width, 255, width);
+			}
+			else
+			{
+				std::fill(distance + y * width, distance + y * width + x0, maxDistance);
+				std::fill(distance + y * width + x1, distance + (y + 1) * width, maxDistance);
+				memset(clamped + y * width, 255, x0);
+				memset(clamped + y * width + x1, 255, width - x1);
+			}
+		}
+	}
+
+	const int roiWidth = x1 - x0;
+	const int roiHeight = y1 - y0;
+	float* outsideSq = mOutsideSq;
+	float* insideSq = mInsideSq;
+
+	// columns
+	WorkerPool::DefaultPool().parallelFor(roiWidth, [=](int begin, int end)
+	{
+		float f[DISTANCE_TRANSFORM_MAX_DIMENSION];
+		float g[DISTANCE_TRANSFORM_MAX_DIMENSION];
+		float d[DISTANCE_TRANSFORM_MAX_DIMENSION];
+		float z[DISTANCE_TRANSFORM_MAX_DIMENSION + 1];
+		int v[DISTANCE_TRANSFORM_MAX_DIMENSION + 1];
+
+		for (int x = x0 + begin; x < x0 + end; ++x)
+		{
+			for (int y = 0; y < roiHeight; ++y)
+			{
+				bool inside = mask[(y0 + y) * width + x] != 0;
+				f[y] = inside ? 0.0f : DT_INFINITY;
+				g[y] = inside ? DT_INFINITY : 0.0f;
+			}
+
+			transform1D(f, roiHeight, d, v, z);
+			for (int y = 0; y < roiHeight; ++y)
+			{
+				outsideSq[(y0 + y) * width + x] = d[y];
+			}
+
+			transform1D(g, roiHeight, d, v, z);
+			for (int y = 0; y < roiHeight; ++y)
+			{
+				insideSq[(y0 + y) * width + x] = d[y];
+			}
+		}
+	});
+
+	// rows, then sign, clamp and quantize
+	WorkerPool::DefaultPool().parallelFor(roiHeight, [=](int begin, int end)
+	{
+		float dOut[DISTANCE_TRANSFORM_MAX_DIMENSION];
+		float dIn[DISTANCE_TRANSFORM_MAX_DIMENSION];
+		float z[DISTANCE_TRANSFORM_MAX_DIMENSION + 1];
+		int v[DISTANCE_TRANSFORM_MAX_DIMENSION + 1];
+
+		for (int y = y0 + begin; y < y0 + end; ++y)
+		{
+			int offset = y * width + x0;
+
+			transform1D(outsideSq + offset, roiWidth, dOut, v, z);
+			transform1D(insideSq + offset, roiWidth, dIn, v, z);
+
+			for (int x = 0; x < roiWidth; ++x)
+			{
+				float signedDistance = sqrt(dOut[x]) - sqrt(dIn[x]);
+				signedDistance = std::max(-maxDistance, std::min(maxDistance, signedDistance));
+
+				distance[offset + x] = signedDistance;
+				clamped[offset + x] = static_cast<BYTE>(std::max(0.0f, std::min(255.0f, 128.0f + signedDistance * scale)));
+			}
+		}
+	});
+}
\ No newline at end of file
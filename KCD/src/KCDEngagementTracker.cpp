@@ -0,0 +1,229 @@
+#include "KCDEngagementTracker.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace kcd;
+
+#define ENGAGEMENT_PRESENCE_RAMP 1.0f // seconds until presence stops adding to the score
+
+EngagementTracker::EngagementTracker()
+{
+	this->reset();
+}
+
+EngagementTracker::~EngagementTracker() { }
+
+void EngagementTracker::setParams(const EngagementParams& params)
+{
+	mParams = params;
+	mParams.maxUsers = std::min(static_cast<UINT>(BODY_COUNT), params.maxUsers);
+	mParams.releaseDistance = std::max(params.engageDistance, params.releaseDistance);
+	mParams.releaseFacing = std::min(params.engageFacing, params.releaseFacing);
+}
+
+void EngagementTracker::reset()
+{
+	for (int i = 0; i < BODY_COUNT; ++i)
+	{
+		BodyEngagement& body = mBodies[i];
+		body.tracked = false;
+		body.trackingId = 0;
+		body.distance = std::numeric_limits<float>::max();
+		body.facing = 0;
+		body.presence = 0;
+		body.visiblePixels = 0;
+		body.score = 0;
+		body.slot = -1;
+
+		EngagementSlot& slot = mSlots[i];
+		slot.engaged = false;
+		slot.bodyIndex = -1;
+		slot.trackingId = 0;
+		slot.since = 0;
+
+		mFirstSeen[i] = 0;
+	}
+}
+
+// distance, facing and presence of one body, all joints in one call
+void EngagementTracker::observe(int index, IBody* pBody, double time)
+{
+	BodyEngagement& body = mBodies[index];
+	UINT64 previousId = body.trackingId;
+
+	BOOLEAN tracked = false;
+	UINT64 trackingId = 0;
+	Joint joints[JointType_Count];
+
+	HRESULT hr = (pBody != NULL) ? pBody->get_IsTracked(&tracked) : E_FAIL;
+
+	if (SUCCEEDED(hr) && tracked)
+	{
+		hr = pBody->get_TrackingId(&trackingId);
+	}
+
+	if (SUCCEEDED(hr) && tracked)
+	{
+		hr = pBody->GetJoints(_countof(joints), joints);
+	}
+
+	body.tracked = SUCCEEDED(hr) && tracked && trackingId != 0;
+	body.trackingId = body.tracked ? trackingId : 0;
+	body.distance = std::numeric_limits<float>::max();
+	body.facing = 0;
+	body.presence = 0;
+	body.score = 0;
+	body.slot = -1;
+
+	if (!body.tracked)
+	{
+		return;
+	}
+
+	if (body.trackingId != previousId)
+	{
+		mFirstSeen[index] = time;
+	}
+	body.presence = static_cast<float>(time - mFirstSeen[index]);
+
+	const Joint& spineBase = joints[JointType_SpineBase];
+	if (spineBase.TrackingState != TrackingState_NotTracked)
+	{
+		const CameraSpacePoint& p = spineBase.Position;
+		body.distance = sqrtf(p.X * p.X + p.Y * p.Y + p.Z * p.Z);
+	}
+
+	// shoulder line parallel to the sensor X axis: facing (or turned away, the sensor can't tell)
+	const Joint& left = joints[JointType_ShoulderLeft];
+	const Joint& right = joints[JointType_ShoulderRight];
+	if (left.TrackingState != TrackingState_NotTracked && right.TrackingState != TrackingState_NotTracked)
+	{
+		float dx = right.Position.X - left.Position.X;
+		float dz = right.Position.Z - left.Position.Z;
+		float length = sqrtf(dx * dx + dz * dz);
+		body.facing = (length > 0) ? fabsf(dx) / length : 0;
+	}
+
+	float closeness = std::max(0.0f, 1.0f - body.distance / mParams.releaseDistance);
+	float presence = std::min(1.0f, body.presence / ENGAGEMENT_PRESENCE_RAMP);
+	body.score = body.facing * closeness * (0.5f + 0.5f * presence);
+}
+
+void EngagementTracker::update(IBody** bodies, double time, std::vector<EngagementTransition>& transitions, const UINT* pixelCounts)
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		this->observe(b, bodies[b], time);
+		mBodies[b].visiblePixels = (pixelCounts != NULL && mBodies[b].tracked) ? pixelCounts[b] : 0;
+	}
+
+	// engaged users: stay inside the release limits or lose the slot
+	for (int s = 0; s < BODY_COUNT; ++s)
+	{
+		EngagementSlot& slot = mSlots[s];
+		if (!slot.engaged)
+		{
+			continue;
+		}
+
+		int found = -1;
+		for (int b = 0; b < BODY_COUNT; ++b)
+		{
+			if (mBodies[b].tracked && mBodies[b].trackingId == slot.trackingId)
+			{
+				found = b;
+				break;
+			}
+		}
+
+		bool keep = found >= 0 && static_cast<UINT>(s) < mParams.maxUsers &&
+			mBodies[found].distance <= mParams.releaseDistance && mBodies[found].facing >= mParams.releaseFacing;
+
+		if (keep)
+		{
+			slot.bodyIndex = found;
+			mBodies[found].slot = s;
+			continue;
+		}
+
+		EngagementTransition transition = { false, s, slot.bodyIndex, slot.trackingId };
+		transitions.push_back(transition);
+
+		slot.engaged = false;
+		slot.bodyIndex = -1;
+		slot.trackingId = 0;
+	}
+
+	// free slots, lowest first, to the best scoring bodies inside the engage limits
+	for (UINT s = 0; s < mParams.maxUsers; ++s)
+	{
+		EngagementSlot& slot = mSlots[s];
+		if (slot.engaged)
+		{
+			continue;
+		}
+
+		int best = -1;
+		for (int b = 0; b < BODY_COUNT; ++b)
+		{
+			const BodyEngagement& body = mBodies[b];
+
+			if (!body.tracked || body.slot >= 0 || body.distance > mParams.engageDistance ||
+				body.facing < mParams.engageFacing || body.presence < mParams.minPresenceSeconds)
+			{
+				continue;
+			}
+
+			// mostly occluded or at the edge of the view
+			if (pixelCounts != NULL && body.visiblePixels < mParams.minVisiblePixels)
+			{
+				continue;
+			}
+
+			if (best < 0 || body.score > mBodies[best].score)
+			{
+				best = b;
+			}
+		}
+
+		if (best < 0)
+		{
+			break;
+		}
+
+		slot.engaged = true;
+		slot.bodyIndex = best;
+		slot.trackingId = mBodies[best].trackingId;
+		slot.since = time;
+		mBodies[best].slot = s;
+
+		EngagementTransition transition = { true, static_cast<int>(s), best, slot.trackingId };
+		transitions.push_back(transition);
+	}
+}
+
+UINT EngagementTracker::getEngagedCount() const
+{
+	UINT count = 0;
+	for (int s = 0; s < BODY_COUNT; ++s)
+	{
+		count += mSlots[s].engaged ? 1 : 0;
+	}
+
+	return count;
+}
+
+int EngagementTracker::getLongestEngagedSlot() const
+{
+	int longest = -1;
+	for (int s = 0; s < BODY_COUNT; ++s)
+	{
+		if (mSlots[s].engaged && (longest < 0 || mSlots[s].since < mSlots[longest].since))
+		{
+			longest = s;
+		}
+	}
+
+	return longest;
+}
\ No newline at end of file
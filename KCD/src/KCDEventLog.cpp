@@ -0,0 +1,510 @@
+#include "KCDEventLog.h"
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <limits>
+
+using namespace kcd;
+
+struct EventLogHeader
+{
+	UINT magic;
+	UINT version;
+	UINT reserved[2];
+};
+
+static inline void putVarint(std::vector<BYTE>& out, UINT64 value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<BYTE>(value | 0x80));
+		value >>= 7;
+	}
+
+	out.push_back(static_cast<BYTE>(value));
+}
+
+// zigzag: small magnitudes of either sign stay small
+static inline void putSigned(std::vector<BYTE>& out, INT64 value)
+{
+	putVarint(out, (static_cast<UINT64>(value) << 1) ^ static_cast<UINT64>(value >> 63));
+}
+
+static inline int quantizePosition(float value)
+{
+	// infinite or NaN
+	if (!(fabsf(value) <= std::numeric_limits<float>::max()))
+	{
+		return EVENT_LOG_POSITION_INVALID;
+	}
+
+	float scaled = value * EVENT_LOG_POSITION_SCALE;
+	const float limit = static_cast<float>(-(EVENT_LOG_POSITION_INVALID + 1));
+	scaled = (scaled > limit) ? limit : ((scaled < -limit) ? -limit : scaled);
+	return static_cast<int>(floorf(scaled + 0.5f));
+}
+
+static inline float dequantizePosition(int value)
+{
+	return (value == EVENT_LOG_POSITION_INVALID) ? -std::numeric_limits<float>::infinity() : static_cast<float>(value) / EVENT_LOG_POSITION_SCALE;
+}
+
+EventLogWriter::EventLogWriter() :
+mIsOpen(false),
+mHasFailed(false),
+mLastJointFrameId(0),
+mRecords(0),
+mEvents(0),
+mBytesWritten(0),
+mDroppedRecords(0)
+{
+	this->resetEncoder();
+	mWriter.mThreadCallback = [this]() { this->writerLoop(); };
+}
+
+EventLogWriter::~EventLogWriter()
+{
+	this->close();
+}
+
+void EventLogWriter::resetEncoder()
+{
+	mLastTime = std::chrono::steady_clock::now();
+
+	memset(&mLastContext, 0, sizeof(mLastContext));
+	mLastJointFrameId = 0;
+	memset(mLastJointX, 0, sizeof(mLastJointX));
+	memset(mLastJointY, 0, sizeof(mLastJointY));
+}
+
+bool EventLogWriter::open(const std::string& path)
+{
+	this->close();
+
+	mFile.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!mFile)
+	{
+		mFile.clear();
+		return false;
+	}
+
+	EventLogHeader header = { 0 };
+	header.magic = EVENT_LOG_MAGIC;
+	header.version = EVENT_LOG_VERSION;
+	if (!mFile.write(reinterpret_cast<const char*>(&header), sizeof(header)) || !mFile.flush())
+	{
+		mFile.close();
+		mFile.clear();
+		return false;
+	}
+
+	mHasFailed = false;
+	mRecords = 0;
+	mEvents = 0;
+	mBytesWritten = sizeof(header);
+	mDroppedRecords = 0;
+
+	mPendingMutex.lock();
+	mPending.clear();
+	mPending.reserve(2 * EVENT_LOG_FLUSH_BYTES);
+	mWriting.reserve(2 * EVENT_LOG_FLUSH_BYTES);
+	this->resetEncoder();
+	mIsOpen = true;
+	mPendingMutex.unlock();
+
+	mWriter.start();
+	return true;
+}
+
+void EventLogWriter::close()
+{
+	// no record starts after this, the writer thread takes what is pending on its way out
+	mPendingMutex.lock();
+	bool wasOpen = mIsOpen;
+	mIsOpen = false;
+	mWriter.mRunning = false;
+	mPendingMutex.unlock();
+	mPendingReady.notify_all();
+
+	mWriter.stop();
+
+	// also after a failed write, which closed the log but left the file to this
+	if (wasOpen || mFile.is_open())
+	{
+		mFile.close();
+		mFile.clear();
+	}
+}
+
+/*
+* Caller holds mPendingMutex. Checks room for the record, then writes its type and time
+* A record that doesn't fit is dropped whole, the deltas stay consistent
+*/
+bool EventLogWriter::beginRecord(EventLogRecordType type, size_t maxBytes)
+{
+	if (!mIsOpen)
+	{
+		return false;
+	}
+
+	if (mPending.size() + maxBytes > EVENT_LOG_MAX_PENDING)
+	{
+		mDroppedRecords++;
+		return false;
+	}
+
+	std::chrono::microseconds elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mLastTime);
+
+	// the remainder carries over to the next record, times don't drift
+	mLastTime += elapsed;
+
+	mPending.push_back(static_cast<BYTE>(type));
+	putVarint(mPending, static_cast<UINT64>(elapsed.count()));
+	return true;
+}
+
+void EventLogWriter::endRecord(size_t events)
+{
+	mRecords++;
+	mEvents += events;
+
+	if (mPending.size() >= EVENT_LOG_FLUSH_BYTES)
+	{
+		mPendingReady.notify_one();
+	}
+}
+
+void EventLogWriter::writeFrameContext(const EventFrameContext& context)
+{
+	std::lock_guard<std::mutex> lock(mPendingMutex);
+
+	if (!this->beginRecord(EVENT_LOG_FRAME_CONTEXT, 64))
+	{
+		return;
+	}
+
+	putSigned(mPending, static_cast<INT64>(context.frameId - mLastContext.frameId));
+	putSigned(mPending, context.relativeTime - mLastContext.relativeTime);
+	putVarint(mPending, context.hasActiveUser ? 1 : 0);
+	putVarint(mPending, context.activeBodyIndex);
+	putSigned(mPending, static_cast<INT64>(context.activeTrackingId - mLastContext.activeTrackingId));
+	putVarint(mPending, context.engagedUserCount);
+
+	mLastContext = context;
+	this->endRecord(0);
+}
+
+void EventLogWriter::writeActiveUserEvents(const EventBatch<ActiveUserEvent>& events)
+{
+	std::lock_guard<std::mutex> lock(mPendingMutex);
+
+	if (events.size() == 0 || !this->beginRecord(EVENT_LOG_ACTIVE_USER, 16 + events.size()))
+	{
+		return;
+	}
+
+	putVarint(mPending, events.size());
+
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		mPending.push_back(static_cast<BYTE>(events[i]));
+	}
+
+	this->endRecord(events.size());
+}
+
+void EventLogWriter::writeBodyJointEvents(const EventBatch<BodyJointEvent>& events)
+{
+	std::lock_guard<std::mutex> lock(mPendingMutex);
+
+	// type byte, 3 varints of up to 10 and 5 bytes
+	if (events.size() == 0 || !this->beginRecord(EVENT_LOG_BODY_JOINT, 16 + 21 * events.size()))
+	{
+		return;
+	}
+
+	putVarint(mPending, events.size());
+
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const BodyJointEvent& evt = events[i];
+		int joint = static_cast<int>(evt.jointId);
+		int x = quantizePosition(evt.screenSpacePosition.x);
+		int y = quantizePosition(evt.screenSpacePosition.y);
+
+		mPending.push_back(static_cast<BYTE>((evt.eventType << 5) | joint));
+		putSigned(mPending, static_cast<INT64>(evt.frameId - mLastJointFrameId));
+		putSigned(mPending, static_cast<INT64>(x) - mLastJointX[joint]);
+		putSigned(mPending, static_cast<INT64>(y) - mLastJointY[joint]);
+
+		mLastJointFrameId = evt.frameId;
+		mLastJointX[joint] = x;
+		mLastJointY[joint] = y;
+	}
+
+	this->endRecord(events.size());
+}
+
+// writer thread: swaps the pending bytes out and writes them without the lock
+void EventLogWriter::writerLoop()
+{
+	bool running = true;
+
+	while (running)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mPendingMutex);
+			mPendingReady.wait_for(lock, std::chrono::milliseconds(EVENT_LOG_FLUSH_MILLISECONDS), [this]() { return mPending.size() >= EVENT_LOG_FLUSH_BYTES || !mWriter.mRunning; });
+			running = mWriter.mRunning;
+			mPending.swap(mWriting);
+		}
+
+		if (!mWriting.empty())
+		{
+			// flushed so that a full disk shows up here, not in a buffer
+			if (mFile.write(reinterpret_cast<const char*>(&mWriting[0]), mWriting.size()) && mFile.flush())
+			{
+				mBytesWritten += mWriting.size();
+			}
+			else
+			{
+				this->stopOnError();
+				running = false;
+			}
+
+			mWriting.clear();
+		}
+	}
+}
+
+// writer thread: closes the log to new records and drops the pending ones
+void EventLogWriter::stopOnError()
+{
+	mPendingMutex.lock();
+	mHasFailed = true;
+	mIsOpen = false;
+	mPending.clear();
+	mPendingMutex.unlock();
+}
+
+EventLogReader::EventLogReader() :
+mOffset(0),
+mIsDamaged(false)
+{
+	this->rewind();
+}
+
+EventLogReader::~EventLogReader() { }
+
+bool EventLogReader::open(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::streamoff size = file.tellg();
+	if (size < static_cast<std::streamoff>(sizeof(EventLogHeader)))
+	{
+		return false;
+	}
+
+	std::vector<BYTE> data(static_cast<size_t>(size));
+	file.seekg(0, std::ios::beg);
+
+	if (!file.read(reinterpret_cast<char*>(&data[0]), data.size()))
+	{
+		return false;
+	}
+
+	return this->open(&data[0], data.size());
+}
+
+bool EventLogReader::open(const BYTE* data, size_t size)
+{
+	if (data == NULL || size < sizeof(EventLogHeader))
+	{
+		return false;
+	}
+
+	EventLogHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != EVENT_LOG_MAGIC || header.version != EVENT_LOG_VERSION)
+	{
+		return false;
+	}
+
+	mData.assign(data, data + size);
+	this->rewind();
+	return true;
+}
+
+void EventLogReader::rewind()
+{
+	mOffset = sizeof(EventLogHeader);
+	mIsDamaged = false;
+	mTime = 0;
+	memset(&mLastContext, 0, sizeof(mLastContext));
+	mLastJointFrameId = 0;
+	memset(mLastJointX, 0, sizeof(mLastJointX));
+	memset(mLastJointY, 0, sizeof(mLastJointY));
+}
+
+inline bool EventLogReader::readVarint(UINT64& value)
+{
+	value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (mOffset >= mData.size())
+		{
+			return false;
+		}
+
+		BYTE b = mData[mOffset++];
+		value |= static_cast<UINT64>(b & 0x7F) << shift;
+
+		if (!(b & 0x80))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline bool EventLogReader::readSigned(INT64& value)
+{
+	UINT64 encoded = 0;
+
+	if (!this->readVarint(encoded))
+	{
+		return false;
+	}
+
+	value = static_cast<INT64>(encoded >> 1) ^ -static_cast<INT64>(encoded & 1);
+	return true;
+}
+
+bool EventLogReader::next(EventLogRecord& record)
+{
+	if (mIsDamaged || mOffset >= mData.size())
+	{
+		return false;
+	}
+
+	BYTE type = mData[mOffset++];
+	UINT64 elapsed = 0;
+
+	if (!this->readVarint(elapsed))
+	{
+		mIsDamaged = true;
+		return false;
+	}
+
+	mTime += elapsed;
+
+	record.type = static_cast<EventLogRecordType>(type);
+	record.time = mTime;
+	record.activeUserEvents = NULL;
+	record.bodyJointEvents = NULL;
+	record.count = 0;
+
+	bool valid = true;
+	UINT64 count = 0;
+
+	switch (type)
+	{
+	case EVENT_LOG_FRAME_CONTEXT:
+	{
+		INT64 frameDelta = 0, timeDelta = 0, trackingDelta = 0;
+		UINT64 hasActiveUser = 0, activeBody = 0, engaged = 0;
+
+		valid = this->readSigned(frameDelta) && this->readSigned(timeDelta) && this->readVarint(hasActiveUser) &&
+			this->readVarint(activeBody) && this->readSigned(trackingDelta) && this->readVarint(engaged);
+
+		if (valid)
+		{
+			mLastContext.frameId += static_cast<UINT64>(frameDelta);
+			mLastContext.relativeTime += timeDelta;
+			mLastContext.hasActiveUser = hasActiveUser != 0;
+			mLastContext.activeBodyIndex = static_cast<UINT>(activeBody);
+			mLastContext.activeTrackingId += static_cast<UINT64>(trackingDelta);
+			mLastContext.engagedUserCount = static_cast<UINT>(engaged);
+		}
+
+		record.context = mLastContext;
+		break;
+	}
+
+	case EVENT_LOG_ACTIVE_USER:
+		// one byte per event
+		valid = this->readVarint(count) && count <= mData.size() - mOffset;
+
+		if (valid)
+		{
+			mActiveUserEvents.resize(static_cast<size_t>(count));
+
+			for (size_t i = 0; i < mActiveUserEvents.size(); ++i)
+			{
+				mActiveUserEvents[i] = static_cast<ActiveUserEvent>(mData[mOffset++]);
+			}
+
+			record.activeUserEvents = mActiveUserEvents.empty() ? NULL : &mActiveUserEvents[0];
+			record.count = mActiveUserEvents.size();
+		}
+		break;
+
+	case EVENT_LOG_BODY_JOINT:
+		// at least four bytes per event
+		valid = this->readVarint(count) && count <= (mData.size() - mOffset) / 4;
+
+		if (valid)
+		{
+			mBodyJointEvents.resize(static_cast<size_t>(count));
+
+			for (size_t i = 0; valid && i < mBodyJointEvents.size(); ++i)
+			{
+				BYTE header = (mOffset < mData.size()) ? mData[mOffset++] : 0xFF;
+				int eventType = header >> 5;
+				int joint = header & 0x1F;
+				INT64 frameDelta = 0, dx = 0, dy = 0;
+
+				valid = eventType <= BODY_JOINT_DISAPPEAR && joint < JointType_Count &&
+					this->readSigned(frameDelta) && this->readSigned(dx) && this->readSigned(dy);
+
+				if (valid)
+				{
+					mLastJointFrameId += static_cast<UINT64>(frameDelta);
+					mLastJointX[joint] += static_cast<int>(dx);
+					mLastJointY[joint] += static_cast<int>(dy);
+
+					BodyJointEvent& evt = mBodyJointEvents[i];
+					evt.eventType = static_cast<BodyJointEventType>(eventType);
+					evt.jointId = static_cast<JointType>(joint);
+					evt.screenSpacePosition.x = dequantizePosition(mLastJointX[joint]);
+					evt.screenSpacePosition.y = dequantizePosition(mLastJointY[joint]);
+					evt.frameId = mLastJointFrameId;
+				}
+			}
+
+			record.bodyJointEvents = mBodyJointEvents.empty() ? NULL : &mBodyJointEvents[0];
+			record.count = mBodyJointEvents.size();
+		}
+		break;
+
+	default:
+		valid = false;
+		break;
+	}
+
+	if (!valid)
+	{
+		mIsDamaged = true;
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "KCDEventRecorderStage.h"
+
+using namespace kcd;
+
+EventRecorderStage::EventRecorderStage() :
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mActiveUserOutput(NULL),
+mBodyJointOutput(NULL),
+mLastFrameId(0)
+{
+
+}
+
+EventRecorderStage::~EventRecorderStage()
+{
+	this->stopRecording();
+}
+
+bool EventRecorderStage::startRecording(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mRecordingMutex);
+
+	mActiveUserSubscription.reset();
+	mBodyJointSubscription.reset();
+
+	if (!mWriter.open(path))
+	{
+		return false;
+	}
+
+	// on the pipeline thread, encoding a batch is cheaper than queueing it
+	if (mActiveUserOutput)
+	{
+		mActiveUserSubscription = mActiveUserOutput->subscribe([this](const EventBatch<ActiveUserEvent>& events) { mWriter.writeActiveUserEvents(events); }, EVENT_DELIVERY_PUBLISHER_THREAD);
+	}
+
+	if (mBodyJointOutput)
+	{
+		mBodyJointSubscription = mBodyJointOutput->subscribe([this](const EventBatch<BodyJointEvent>& events) { mWriter.writeBodyJointEvents(events); }, EVENT_DELIVERY_PUBLISHER_THREAD);
+	}
+
+	return true;
+}
+
+void EventRecorderStage::stopRecording()
+{
+	std::lock_guard<std::mutex> lock(mRecordingMutex);
+
+	// waits for a batch being written
+	mActiveUserSubscription.reset();
+	mBodyJointSubscription.reset();
+	mWriter.close();
+}
+
+void EventRecorderStage::teardown()
+{
+	this->stopRecording();
+}
+
+HRESULT EventRecorderStage::thread_process()
+{
+	if (!mWriter.isOpen() || !mDeviceSrc || !mBodyDataSrc)
+	{
+		return S_OK;
+	}
+
+	// once per device frame
+	UINT64 frameId = mDeviceSrc->getLatestFrameId();
+	if (frameId == mLastFrameId)
+	{
+		return S_OK;
+	}
+	mLastFrameId = frameId;
+
+	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+
+	EventFrameContext context;
+	context.frameId = frameId;
+	context.relativeTime = bodyData.relativeTime;
+	context.hasActiveUser = bodyData.hasActiveUser;
+	context.activeBodyIndex = bodyData.activeBodyIndex;
+	context.activeTrackingId = bodyData.activeUserTrackingId;
+	context.engagedUserCount = bodyData.engagedUserCount;
+
+	// dropped by the writer when closed in between
+	mWriter.writeFrameContext(context);
+
+	return S_OK;
+}
+
+void EventRecorderStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void EventRecorderStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void EventRecorderStage::setActiveUserOutput(IActiveUserOutputRef activeUserOutput)
+{
+	mActiveUserOutput = activeUserOutput;
+}
+
+void EventRecorderStage::setBodyJointBatchOutput(IBodyJointBatchOutputRef bodyJointOutput)
+{
+	mBodyJointOutput = bodyJointOutput;
+}
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "KCDEventReplayer.h"
+#include <string.h>
+#include <thread>
+#include <chrono>
+
+using namespace kcd;
+
+EventReplayer::EventReplayer() :
+mActiveUserOutput(new IActiveUserOutput(EVENT_REPLAY_QUEUE_SIZE)),
+mBodyJointOutput(new IBodyJointBatchOutput(EVENT_REPLAY_QUEUE_SIZE)),
+mFrameContextOutput(new IFrameContextOutput(EVENT_REPLAY_QUEUE_SIZE)),
+mIsPlaying(false),
+mPerformanceFrequency(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+EventReplayer::~EventReplayer()
+{
+	this->stop();
+}
+
+bool EventReplayer::open(const std::string& path)
+{
+	this->stop();
+
+	std::lock_guard<std::mutex> lock(mReaderMutex);
+	return mReader.open(path);
+}
+
+bool EventReplayer::open(const BYTE* data, size_t size)
+{
+	this->stop();
+
+	std::lock_guard<std::mutex> lock(mReaderMutex);
+	return mReader.open(data, size);
+}
+
+EventReplayStats EventReplayer::play(EventReplayTiming timing, bool dispatchMain, UINT loops)
+{
+	this->stop();
+	this->replay(timing, dispatchMain, loops, NULL);
+	return this->getStats();
+}
+
+void EventReplayer::start(EventReplayTiming timing, bool loop)
+{
+	this->stop();
+
+	mPlayer.mThreadCallback = [this, timing, loop]()
+	{
+		do
+		{
+			this->replay(timing, false, 1, &mPlayer.mRunning);
+		} while (loop && mPlayer.mRunning);
+	};
+
+	mIsPlaying = true;
+	mPlayer.start();
+}
+
+void EventReplayer::stop()
+{
+	mPlayer.stop();
+}
+
+/*
+* Records are published in order, each as one batch; with the original timing the replay sleeps until
+* a record is due, yielding through the last two milliseconds
+*/
+void EventReplayer::replay(EventReplayTiming timing, bool dispatchMain, UINT loops, const std::atomic_bool* running)
+{
+	std::lock_guard<std::mutex> lock(mReaderMutex);
+
+	mIsPlaying = true;
+
+	EventReplayStats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	mStatsMutex.lock();
+	mStats = stats;
+	mStatsMutex.unlock();
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER now = { 0 };
+	QueryPerformanceCounter(&start);
+
+	IActiveUserOutputRef activeUserOutput = mActiveUserOutput;
+	IBodyJointBatchOutputRef bodyJointOutput = mBodyJointOutput;
+	IFrameContextOutputRef frameContextOutput = mFrameContextOutput;
+
+	EventLogRecord record;
+
+	for (UINT loop = 0; loop < loops; ++loop)
+	{
+		mReader.rewind();
+
+		// each loop keeps the original pace from its own start
+		LARGE_INTEGER loopStart = { 0 };
+		QueryPerformanceCounter(&loopStart);
+
+		while ((running == NULL || *running) && mReader.next(record))
+		{
+			if (timing == EVENT_REPLAY_ORIGINAL_TIMING && mPerformanceFrequency > 0)
+			{
+				INT64 due = loopStart.QuadPart + static_cast<INT64>(double(record.time) * mPerformanceFrequency / 1e6);
+
+				for (QueryPerformanceCounter(&now); now.QuadPart < due && (running == NULL || *running); QueryPerformanceCounter(&now))
+				{
+					double remaining = double(due - now.QuadPart) * 1e3 / mPerformanceFrequency;
+
+					if (remaining > 2)
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long long>(remaining) - 1));
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			}
+
+			switch (record.type)
+			{
+			case EVENT_LOG_FRAME_CONTEXT:
+				frameContextOutput->publish(record.context);
+				break;
+			case EVENT_LOG_ACTIVE_USER:
+				activeUserOutput->publish(record.activeUserEvents, record.count);
+				break;
+			case EVENT_LOG_BODY_JOINT:
+				bodyJointOutput->publish(record.bodyJointEvents, record.count);
+				break;
+			}
+
+			if (dispatchMain)
+			{
+				this->dispatchMain();
+			}
+
+			stats.records++;
+			stats.events += record.count;
+		}
+
+		stats.damaged = mReader.isDamaged();
+
+		if (running != NULL && !*running)
+		{
+			break;
+		}
+	}
+
+	QueryPerformanceCounter(&now);
+	stats.seconds = (mPerformanceFrequency > 0) ? double(now.QuadPart - start.QuadPart) / mPerformanceFrequency : 0;
+	stats.eventsPerSecond = (stats.seconds > 0) ? double(stats.events) / stats.seconds : 0;
+
+	mStatsMutex.lock();
+	mStats = stats;
+	mStatsMutex.unlock();
+
+	mIsPlaying = false;
+}
+
+void EventReplayer::dispatchMain()
+{
+	mActiveUserOutput->dispatchMain();
+	mBodyJointOutput->dispatchMain();
+	mFrameContextOutput->dispatchMain();
+}
+
+void EventReplayer::update()
+{
+	this->dispatchMain();
+}
+
+EventReplayStats EventReplayer::getStats()
+{
+	mStatsMutex.lock();
+	EventReplayStats stats = mStats;
+	mStatsMutex.unlock();
+	return stats;
+}
+
+void EventReplayer::setActiveUserOutput(IActiveUserOutputRef activeUserOutput)
+{
+	mActiveUserOutput = activeUserOutput;
+}
+
+void EventReplayer::setBodyJointBatchOutput(IBodyJointBatchOutputRef bodyJointOutput)
+{
+	mBodyJointOutput = bodyJointOutput;
+}
+
+void EventReplayer::setFrameContextOutput(IFrameContextOutputRef frameContextOutput)
+{
+	mFrameContextOutput = frameContextOutput;
+}
\ No newline at end of file
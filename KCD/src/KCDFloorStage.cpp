@@ -0,0 +1,586 @@
+#include "KCDFloorStage.h"
+#include "KCDDeviceStage.h"
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+using namespace kcd;
+
+static inline float dot3(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void cross3(const float* a, const float* b, float* out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline bool normalize3(float* v)
+{
+	float length = sqrtf(dot3(v, v));
+	if (length < 1e-6f)
+	{
+		return false;
+	}
+
+	v[0] /= length;
+	v[1] /= length;
+	v[2] /= length;
+	return true;
+}
+
+FloorStage::FloorStage() :
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mDepthFrameRef(NULL),
+mDepthFrame(NULL),
+mJobPending(false),
+mWorkerBusy(false),
+mLastJobTime(0),
+mLastMeasureTime(0),
+mRandom(0x9E3779B9u),
+mPerformanceFrequency(0),
+mFitMicroseconds(0)
+{
+	memset(&mEstimate, 0, sizeof(mEstimate));
+	memset(&mLatestFloor, 0, sizeof(mLatestFloor));
+	memset(mUsers, 0, sizeof(mUsers));
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+FloorStage::~FloorStage()
+{
+	this->stopWorker();
+}
+
+HRESULT FloorStage::thread_setup()
+{
+	mEstimateMutex.lock();
+	mEstimate.valid = false;
+	mEstimateMutex.unlock();
+
+	mLastJobTime = 0;
+	mLastMeasureTime = 0;
+	memset(mUsers, 0, sizeof(mUsers));
+	mJobPending = false;
+	mWorkerBusy = false;
+
+	mWorker.mThreadCallback = [this]() { this->workerLoop(); };
+	mWorker.start();
+
+	return S_OK;
+}
+
+HRESULT FloorStage::thread_teardown()
+{
+	this->stopWorker();
+	return S_OK;
+}
+
+// the worker waits on mJobReady, it has to be woken before the join
+void FloorStage::stopWorker()
+{
+	mJobMutex.lock();
+	mWorker.mRunning = false;
+	mJobMutex.unlock();
+
+	mJobReady.notify_all();
+	mWorker.stop();
+}
+
+HRESULT FloorStage::thread_process()
+{
+	HRESULT hr = S_OK;
+
+	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+
+	mParamsMutex.lock();
+	FloorParams params = mParams;
+	mParamsMutex.unlock();
+
+	mDepthFrameRef = NULL;
+	mDepthFrame = NULL;
+
+	// a new fit once the interval has passed and the previous one is done
+	bool due = !mWorkerBusy && bodyData.relativeTime != 0 &&
+		(mLastJobTime == 0 || double(bodyData.relativeTime - mLastJobTime) * 1e-7 >= params.interval);
+
+	IMultiSourceFrame* multiSourceFrame = mDeviceSrc->getLatestFrame();
+	const SoftwareMapper* mapper = mDeviceSrc->getSoftwareMapper();
+
+	if (due && multiSourceFrame != NULL && mapper != NULL)
+	{
+		UINT depthBufferSize = 0;
+		UINT16* depthBuffer = NULL;
+
+		hr = multiSourceFrame->get_DepthFrameReference(&mDepthFrameRef);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = mDepthFrameRef->AcquireFrame(&mDepthFrame);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = mDepthFrame->AccessUnderlyingBuffer(&depthBufferSize, &depthBuffer);
+		}
+
+		if (SUCCEEDED(hr) && depthBufferSize >= DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight &&
+			mapper->getCalibration().depthWidth == DeviceStage::DepthFrameWidth && mapper->getCalibration().depthHeight == DeviceStage::DepthFrameHeight)
+		{
+			this->postJob(depthBuffer, mapper, bodyData, params);
+			mLastJobTime = bodyData.relativeTime;
+		}
+	}
+
+	mEstimateMutex.lock();
+	FloorEstimate estimate = mEstimate;
+	mEstimateMutex.unlock();
+
+	FloorData floor;
+	memset(&floor, 0, sizeof(floor));
+	floor.frameId = mDeviceSrc->getLatestFrameId();
+	floor.source = FLOOR_PLANE_NONE;
+
+	const Vector4& clipPlane = bodyData.floorClipPlane;
+	bool hasClipPlane = clipPlane.x != 0 || clipPlane.y != 0 || clipPlane.z != 0;
+	double age = double(bodyData.relativeTime - estimate.time) * 1e-7;
+
+	if (estimate.valid && age <= params.staleSeconds)
+	{
+		floor.plane = estimate.plane;
+		floor.source = FLOOR_PLANE_ESTIMATED;
+		floor.inlierRatio = estimate.inlierRatio;
+		floor.estimateAge = std::max(0.0, age);
+	}
+	else if (hasClipPlane)
+	{
+		floor.plane = clipPlane;
+		floor.source = FLOOR_PLANE_CLIP_PLANE;
+	}
+
+	floor.hasFloor = floor.source != FLOOR_PLANE_NONE;
+
+	if (floor.hasFloor)
+	{
+		// the bodies are only set on iterations with a new body frame, the metrics of the last one stay in between
+		if (bodyData.relativeTime != 0 && bodyData.relativeTime != mLastMeasureTime)
+		{
+			this->measureUsers(bodyData, floor.plane, params);
+			mLastMeasureTime = bodyData.relativeTime;
+		}
+
+		memcpy(floor.users, mUsers, sizeof(floor.users));
+	}
+	else
+	{
+		mLastMeasureTime = 0;
+		memset(mUsers, 0, sizeof(mUsers));
+	}
+
+	mLatestFloorMutex.lock();
+	mLatestFloor = floor;
+	mLatestFloorMutex.unlock();
+
+	return hr;
+}
+
+HRESULT FloorStage::post_thread_process()
+{
+	__safe_release(mDepthFrame);
+	__safe_release(mDepthFrameRef);
+
+	return S_OK;
+}
+
+/*
+* Depth samples on a regular grid, coarse enough for maxSamples, to camera space with the ray table
+* The prior is the clip plane, else the last estimate, else straight up
+*/
+void FloorStage::postJob(const UINT16* depthBuffer, const SoftwareMapper* mapper, const BodyData& bodyData, const FloorParams& params)
+{
+	const int width = DeviceStage::DepthFrameWidth;
+	const int height = DeviceStage::DepthFrameHeight;
+	const UINT maxSamples = std::max(16u, params.maxSamples);
+	const float* rayX = mapper->getRayX();
+	const float* rayY = mapper->getRayY();
+
+	int stride = 1;
+	while (static_cast<UINT>((width / stride) * (height / stride)) > maxSamples)
+	{
+		++stride;
+	}
+
+	Vector4 prior = { 0, 1, 0, 0 };
+	const Vector4& clipPlane = bodyData.floorClipPlane;
+
+	if (clipPlane.x != 0 || clipPlane.y != 0 || clipPlane.z != 0)
+	{
+		prior = clipPlane;
+	}
+	else
+	{
+		mEstimateMutex.lock();
+		if (mEstimate.valid)
+		{
+			prior = mEstimate.plane;
+		}
+		mEstimateMutex.unlock();
+	}
+
+	// the worker is idle, the lock is only taken for the hand over
+	mJobMutex.lock();
+	mJob.points.clear();
+	mJob.points.reserve(3 * maxSamples);
+
+	for (int y = stride / 2; y < height; y += stride)
+	{
+		for (int x = stride / 2; x < width; x += stride)
+		{
+			int i = y * width + x;
+			if (depthBuffer[i] == 0)
+			{
+				continue;
+			}
+
+			float z = depthBuffer[i] * 0.001f;
+			mJob.points.push_back(rayX[i] * z);
+			mJob.points.push_back(rayY[i] * z);
+			mJob.points.push_back(z);
+		}
+	}
+
+	mJob.prior = prior;
+	mJob.time = bodyData.relativeTime;
+	mJobPending = true;
+	mWorkerBusy = true;
+	mJobMutex.unlock();
+
+	mJobReady.notify_one();
+}
+
+void FloorStage::workerLoop()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(mJobMutex);
+		mJobReady.wait(lock, [this]() { return mJobPending || !mWorker.mRunning; });
+
+		if (!mWorker.mRunning)
+		{
+			break;
+		}
+
+		mWorkerJob.points.swap(mJob.points);
+		mWorkerJob.prior = mJob.prior;
+		mWorkerJob.time = mJob.time;
+		mJobPending = false;
+		lock.unlock();
+
+		mParamsMutex.lock();
+		FloorParams params = mParams;
+		mParamsMutex.unlock();
+
+		LARGE_INTEGER start = { 0 };
+		LARGE_INTEGER end = { 0 };
+		QueryPerformanceCounter(&start);
+
+		FloorEstimate estimate;
+		if (this->fit(mWorkerJob, params, estimate))
+		{
+			mEstimateMutex.lock();
+			mEstimate = estimate;
+			mEstimateMutex.unlock();
+		}
+
+		QueryPerformanceCounter(&end);
+		mFitMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+
+		mWorkerBusy = false;
+	}
+}
+
+/*
+* RANSAC, then least squares on the inliers of the best hypothesis: offsets along its normal are fitted
+* as a linear function of the two in-plane coordinates, which tilts the normal by the fitted slopes
+*/
+bool FloorStage::fit(const FloorJob& job, const FloorParams& params, FloorEstimate& estimate)
+{
+	estimate.valid = false;
+
+	const float* points = job.points.empty() ? NULL : &job.points[0];
+	const UINT count = static_cast<UINT>(job.points.size() / 3);
+
+	if (count < 3)
+	{
+		return false;
+	}
+
+	float prior[3] = { job.prior.x, job.prior.y, job.prior.z };
+	if (!normalize3(prior))
+	{
+		return false;
+	}
+
+	float bestNormal[3] = { 0, 0, 0 };
+	float bestOffset = 0;
+	UINT bestInliers = 0;
+
+	for (UINT it = 0; it < params.iterations; ++it)
+	{
+		const float* p0 = points + 3 * (this->nextRandom() % count);
+		const float* p1 = points + 3 * (this->nextRandom() % count);
+		const float* p2 = points + 3 * (this->nextRandom() % count);
+
+		float a[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float b[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float normal[3];
+		cross3(a, b, normal);
+
+		if (!normalize3(normal))
+		{
+			continue;
+		}
+
+		float facing = dot3(normal, prior);
+		if (facing < 0)
+		{
+			normal[0] = -normal[0];
+			normal[1] = -normal[1];
+			normal[2] = -normal[2];
+			facing = -facing;
+		}
+
+		if (facing < params.maxTilt)
+		{
+			continue;
+		}
+
+		float offset = -dot3(normal, p0);
+		UINT inliers = 0;
+
+		for (UINT i = 0; i < count; ++i)
+		{
+			inliers += (fabsf(dot3(normal, points + 3 * i) + offset) < params.inlierThreshold) ? 1 : 0;
+		}
+
+		if (inliers > bestInliers)
+		{
+			bestInliers = inliers;
+			bestOffset = offset;
+			memcpy(bestNormal, normal, sizeof(bestNormal));
+		}
+	}
+
+	if (bestInliers < 3 || bestInliers < params.minInlierRatio * count)
+	{
+		return false;
+	}
+
+	// in-plane axes of the best hypothesis
+	float axis[3] = { 0, 0, 0 };
+	axis[(fabsf(bestNormal[0]) < 0.9f) ? 0 : 1] = 1;
+
+	float u[3];
+	float v[3];
+	cross3(bestNormal, axis, u);
+	normalize3(u);
+	cross3(bestNormal, u, v);
+
+	double sumU = 0, sumV = 0, sumH = 0;
+	UINT inliers = 0;
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		const float* p = points + 3 * i;
+		float h = dot3(bestNormal, p);
+
+		if (fabsf(h + bestOffset) < params.inlierThreshold)
+		{
+			sumU += dot3(u, p);
+			sumV += dot3(v, p);
+			sumH += h;
+			++inliers;
+		}
+	}
+
+	double meanU = sumU / inliers;
+	double meanV = sumV / inliers;
+	double meanH = sumH / inliers;
+	double suu = 0, suv = 0, svv = 0, suh = 0, svh = 0;
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		const float* p = points + 3 * i;
+		float h = dot3(bestNormal, p);
+
+		if (fabsf(h + bestOffset) < params.inlierThreshold)
+		{
+			double du = dot3(u, p) - meanU;
+			double dv = dot3(v, p) - meanV;
+			double dh = h - meanH;
+			suu += du * du;
+			suv += du * dv;
+			svv += dv * dv;
+			suh += du * dh;
+			svh += dv * dh;
+		}
+	}
+
+	// h = a * u + b * v + c, the plane (n - a * u - b * v) . p = c
+	double determinant = suu * svv - suv * suv;
+	double slopeU = 0;
+	double slopeV = 0;
+
+	if (fabs(determinant) > 1e-12)
+	{
+		slopeU = (suh * svv - svh * suv) / determinant;
+		slopeV = (svh * suu - suh * suv) / determinant;
+	}
+
+	double c = meanH - slopeU * meanU - slopeV * meanV;
+
+	float normal[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		normal[k] = static_cast<float>(bestNormal[k] - slopeU * u[k] - slopeV * v[k]);
+	}
+
+	float length = sqrtf(dot3(normal, normal));
+	if (length < 1e-6f || dot3(normal, prior) < params.maxTilt * length)
+	{
+		return false;
+	}
+
+	estimate.plane.x = normal[0] / length;
+	estimate.plane.y = normal[1] / length;
+	estimate.plane.z = normal[2] / length;
+	estimate.plane.w = static_cast<float>(-c / length);
+	estimate.inlierRatio = float(inliers) / count;
+	estimate.time = job.time;
+	estimate.valid = true;
+
+	return true;
+}
+
+// head and feet of every tracked body, against the plane of this frame
+void FloorStage::measureUsers(const BodyData& bodyData, const Vector4& plane, const FloorParams& params)
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		FloorUserMetrics& user = mUsers[b];
+		IBody* pBody = bodyData.bodies[b];
+
+		BOOLEAN tracked = false;
+		Joint joints[JointType_Count];
+
+		HRESULT hr = (pBody != NULL) ? pBody->get_IsTracked(&tracked) : E_FAIL;
+
+		if (SUCCEEDED(hr) && tracked)
+		{
+			hr = pBody->get_TrackingId(&user.trackingId);
+		}
+
+		if (SUCCEEDED(hr) && tracked)
+		{
+			hr = pBody->GetJoints(_countof(joints), joints);
+		}
+
+		user.tracked = SUCCEEDED(hr) && tracked;
+		if (!user.tracked)
+		{
+			user.trackingId = 0;
+			user.hasHeight = false;
+			user.height = 0;
+			user.hasFloorDistance = false;
+			user.floorDistance = 0;
+			continue;
+		}
+
+		TrackingState headState = joints[JointType_Head].TrackingState;
+		user.hasHeight = headState == TrackingState_Tracked || (headState == TrackingState_Inferred && params.trackIfInferred);
+
+		if (user.hasHeight)
+		{
+			const CameraSpacePoint& head = joints[JointType_Head].Position;
+			user.height = plane.x * head.X + plane.y * head.Y + plane.z * head.Z + plane.w;
+		}
+		else
+		{
+			user.height = 0;
+		}
+
+		const JointType feet[] = { JointType_FootLeft, JointType_FootRight, JointType_AnkleLeft, JointType_AnkleRight };
+		bool hasFoot = false;
+
+		// feet first, ankles only when neither foot is seen
+		for (int f = 0; f < _countof(feet); ++f)
+		{
+			if (joints[feet[f]].TrackingState == TrackingState_NotTracked || (hasFoot && f >= 2))
+			{
+				continue;
+			}
+
+			const CameraSpacePoint& p = joints[feet[f]].Position;
+			float distance = plane.x * p.X + plane.y * p.Y + plane.z * p.Z + plane.w;
+
+			user.floorDistance = hasFoot ? std::min(user.floorDistance, distance) : distance;
+			hasFoot = true;
+		}
+
+		user.hasFloorDistance = hasFoot;
+		if (!hasFoot)
+		{
+			user.floorDistance = 0;
+		}
+	}
+}
+
+UINT FloorStage::nextRandom()
+{
+	mRandom ^= mRandom << 13;
+	mRandom ^= mRandom >> 17;
+	mRandom ^= mRandom << 5;
+	return mRandom;
+}
+
+FloorData FloorStage::copyLatestFloor()
+{
+	mLatestFloorMutex.lock();
+	FloorData floor = mLatestFloor;
+	mLatestFloorMutex.unlock();
+	return floor;
+}
+
+void FloorStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void FloorStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void FloorStage::setParams(const FloorParams& params)
+{
+	mParamsMutex.lock();
+	mParams = params;
+	mParamsMutex.unlock();
+}
+
+FloorParams FloorStage::getParams()
+{
+	mParamsMutex.lock();
+	FloorParams params = mParams;
+	mParamsMutex.unlock();
+	return params;
+}
\ No newline at end of file
@@ -0,0 +1,478 @@
+#include "KCDGestureRecognizer.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+
+using namespace kcd;
+
+#define GESTURE_MIN_LENGTH 4
+#define GESTURE_MIN_TORSO 0.1f // meters, below that SpineShoulder / SpineBase are not usable
+#define GESTURE_TORSO_SMOOTHING 0.8f
+
+static inline float horizontalSum(__m128 v)
+{
+	__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+static inline float squaredDistance(const float* a, const float* b)
+{
+	__m128 d = _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+	return horizontalSum(_mm_mul_ps(d, d));
+}
+
+GestureRecognizer::GestureRecognizer() :
+mHistory(NULL),
+mBudget(GESTURE_DEFAULT_BUDGET),
+mNextPair(0)
+{
+	mHistory = new BodyHistory[BODY_COUNT];
+	this->reset();
+}
+
+GestureRecognizer::~GestureRecognizer()
+{
+	if (mHistory)
+	{
+		delete[] mHistory;
+		mHistory = NULL;
+	}
+}
+
+// templates are not guarded, add them before the pipeline starts
+int GestureRecognizer::addTemplate(const std::string& name, JointType joint, JointType reference, const std::vector<ci::Vec3f>& trajectory, float threshold, float bandFraction)
+{
+	int length = static_cast<int>(trajectory.size());
+	if (length < GESTURE_MIN_LENGTH || length > GESTURE_MAX_LENGTH)
+	{
+		return -1;
+	}
+
+	GestureTemplate gesture;
+	gesture.name = name;
+	gesture.joint = joint;
+	gesture.reference = reference;
+	gesture.length = length;
+	gesture.band = std::max(1, static_cast<int>(bandFraction * length + 0.5f));
+	gesture.threshold = threshold;
+	gesture.frames.assign(length * 4, 0.0f);
+	gesture.upper.assign(length * 4, 0.0f);
+	gesture.lower.assign(length * 4, 0.0f);
+
+	ci::Vec3f mean = ci::Vec3f::zero();
+	for (int k = 0; k < length; ++k)
+	{
+		mean += trajectory[k];
+	}
+	mean /= static_cast<float>(length);
+
+	for (int k = 0; k < length; ++k)
+	{
+		ci::Vec3f p = trajectory[k] - mean;
+		gesture.frames[k * 4 + 0] = p.x;
+		gesture.frames[k * 4 + 1] = p.y;
+		gesture.frames[k * 4 + 2] = p.z;
+	}
+
+	// envelope over the warping band
+	for (int k = 0; k < length; ++k)
+	{
+		int first = std::max(0, k - gesture.band);
+		int last = std::min(length - 1, k + gesture.band);
+
+		for (int a = 0; a < 4; ++a)
+		{
+			float upper = gesture.frames[first * 4 + a];
+			float lower = upper;
+
+			for (int i = first + 1; i <= last; ++i)
+			{
+				upper = std::max(upper, gesture.frames[i * 4 + a]);
+				lower = std::min(lower, gesture.frames[i * 4 + a]);
+			}
+
+			gesture.upper[k * 4 + a] = upper;
+			gesture.lower[k * 4 + a] = lower;
+		}
+	}
+
+	mTemplates.push_back(gesture);
+	this->reset();
+
+	return static_cast<int>(mTemplates.size()) - 1;
+}
+
+/*
+* Minimal motions, in torso lengths relative to SpineShoulder, at 30 Hz
+* Real recordings make better templates, these only cover the obvious cases
+*/
+void GestureRecognizer::addDefaultTemplates(float threshold)
+{
+	const JointType hands[2] = { JointType_HandRight, JointType_HandLeft };
+	const char* handNames[2] = { "RightHand", "LeftHand" };
+	const float pi = 3.14159265f;
+
+	for (int h = 0; h < 2; ++h)
+	{
+		std::vector<ci::Vec3f> swipe(15);
+		for (int k = 0; k < 15; ++k)
+		{
+			float u = k / 14.0f;
+			u = u * u * (3.0f - 2.0f * u);
+			swipe[k] = ci::Vec3f(-0.6f + 1.2f * u, 0, 0);
+		}
+		this->addTemplate(std::string(handNames[h]) + "SwipeRight", hands[h], JointType_SpineShoulder, swipe, threshold);
+
+		std::reverse(swipe.begin(), swipe.end());
+		this->addTemplate(std::string(handNames[h]) + "SwipeLeft", hands[h], JointType_SpineShoulder, swipe, threshold);
+
+		std::vector<ci::Vec3f> push(12);
+		for (int k = 0; k < 12; ++k)
+		{
+			float u = k / 11.0f;
+			u = u * u * (3.0f - 2.0f * u);
+			push[k] = ci::Vec3f(0, 0, -0.8f * u);
+		}
+		this->addTemplate(std::string(handNames[h]) + "Push", hands[h], JointType_SpineShoulder, push, threshold);
+
+		std::vector<ci::Vec3f> wave(30);
+		for (int k = 0; k < 30; ++k)
+		{
+			wave[k] = ci::Vec3f(0.3f * sinf(4.0f * pi * k / 30.0f), 0, 0);
+		}
+		this->addTemplate(std::string(handNames[h]) + "Wave", hands[h], JointType_SpineShoulder, wave, threshold);
+	}
+}
+
+JointMask GestureRecognizer::getRequiredJoints() const
+{
+	JointMask joints = JOINT_BIT(JointType_SpineBase) | JOINT_BIT(JointType_SpineShoulder);
+
+	for (size_t t = 0; t < mTemplates.size(); ++t)
+	{
+		joints |= JOINT_BIT(mTemplates[t].joint) | JOINT_BIT(mTemplates[t].reference);
+	}
+
+	return joints;
+}
+
+void GestureRecognizer::reset()
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		BodyHistory& history = mHistory[b];
+		history.trackingId = 0;
+		history.frameCount = 0;
+		history.torso = 0;
+		memset(history.seenCount, 0, sizeof(history.seenCount));
+	}
+
+	MatchState idle = { false, 0, 0 };
+	mMatchStates.assign(BODY_COUNT * mTemplates.size(), idle);
+
+	mNextPair = 0;
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+void GestureRecognizer::process(const JointStore& joints, std::vector<GestureMatch>& matches)
+{
+	const int templateCount = static_cast<int>(mTemplates.size());
+
+	memset(&mStats, 0, sizeof(mStats));
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		BodyHistory& history = mHistory[b];
+
+		if (!joints.isTracked[b] || joints.trackingId[b] != history.trackingId)
+		{
+			// a new or lost body: nothing in flight belongs to it anymore
+			history.trackingId = joints.isTracked[b] ? joints.trackingId[b] : 0;
+			history.frameCount = 0;
+			history.torso = 0;
+			memset(history.seenCount, 0, sizeof(history.seenCount));
+
+			for (int t = 0; t < templateCount; ++t)
+			{
+				MatchState& state = mMatchStates[b * templateCount + t];
+				state.pending = false;
+				state.cooldown = 0;
+			}
+		}
+
+		if (!joints.isTracked[b])
+		{
+			continue;
+		}
+
+		this->appendFrame(b, joints);
+
+		for (int t = 0; t < templateCount; ++t)
+		{
+			MatchState& state = mMatchStates[b * templateCount + t];
+			if (state.cooldown)
+			{
+				state.cooldown--;
+			}
+		}
+	}
+
+	const UINT pairCount = static_cast<UINT>(BODY_COUNT * templateCount);
+	if (pairCount == 0)
+	{
+		return;
+	}
+
+	UINT evaluations = 0;
+	UINT nextPair = mNextPair % pairCount;
+	bool deferred = false;
+
+	for (UINT step = 0; step < pairCount; ++step)
+	{
+		UINT pair = (mNextPair + step) % pairCount;
+		int b = pair / templateCount;
+		int t = pair % templateCount;
+
+		const BodyHistory& history = mHistory[b];
+		const GestureTemplate& gesture = mTemplates[t];
+		MatchState& state = mMatchStates[pair];
+		const UINT length = static_cast<UINT>(gesture.length);
+
+		if (!joints.isTracked[b] || state.cooldown)
+		{
+			continue;
+		}
+
+		if (history.frameCount < length || history.seenCount[gesture.joint] < length || history.seenCount[gesture.reference] < length)
+		{
+			this->updateMatch(b, t, 0, false, matches);
+			continue;
+		}
+
+		mStats.windows++;
+
+		if (evaluations >= mBudget)
+		{
+			// pending matches stay pending until the pair is evaluated again
+			if (!deferred)
+			{
+				nextPair = pair;
+				deferred = true;
+			}
+
+			mStats.deferred++;
+			continue;
+		}
+
+		this->extractWindow(b, gesture);
+
+		// costs are sums over the template, thresholds are per frame
+		float limit = gesture.threshold * gesture.length;
+
+		if (this->lowerBound(gesture, limit) > limit)
+		{
+			mStats.pruned++;
+			this->updateMatch(b, t, 0, false, matches);
+			continue;
+		}
+
+		evaluations++;
+
+		float cost = this->dtw(gesture, limit);
+		if (cost > limit)
+		{
+			mStats.abandoned++;
+			this->updateMatch(b, t, 0, false, matches);
+			continue;
+		}
+
+		mStats.evaluated++;
+		this->updateMatch(b, t, cost / gesture.length, true, matches);
+	}
+
+	if (deferred)
+	{
+		mNextPair = nextPair;
+	}
+}
+
+// all joints relative to SpineBase in torso lengths, differences against any reference joint stay valid
+void GestureRecognizer::appendFrame(int body, const JointStore& joints)
+{
+	BodyHistory& history = mHistory[body];
+	const JointMask seen = joints.seen[body];
+
+	const int base = JointStore::index(body, JointType_SpineBase);
+	const int shoulder = JointStore::index(body, JointType_SpineShoulder);
+
+	if ((seen & JOINT_BIT(JointType_SpineBase)) && (seen & JOINT_BIT(JointType_SpineShoulder)))
+	{
+		float dx = joints.positionX[shoulder] - joints.positionX[base];
+		float dy = joints.positionY[shoulder] - joints.positionY[base];
+		float dz = joints.positionZ[shoulder] - joints.positionZ[base];
+		float torso = sqrtf(dx * dx + dy * dy + dz * dz);
+
+		if (torso > GESTURE_MIN_TORSO)
+		{
+			history.torso = (history.torso > 0) ? GESTURE_TORSO_SMOOTHING * history.torso + (1.0f - GESTURE_TORSO_SMOOTHING) * torso : torso;
+		}
+	}
+
+	if (history.torso <= 0 || !(seen & JOINT_BIT(JointType_SpineBase)))
+	{
+		memset(history.seenCount, 0, sizeof(history.seenCount));
+		return;
+	}
+
+	const float scale = 1.0f / history.torso;
+	float (*frame)[4] = history.frames[history.frameCount % GESTURE_MAX_LENGTH];
+
+	for (int jt = 0; jt < JointType_Count; ++jt)
+	{
+		if (seen & JOINT_BIT(jt))
+		{
+			int i = JointStore::index(body, jt);
+			frame[jt][0] = (joints.positionX[i] - joints.positionX[base]) * scale;
+			frame[jt][1] = (joints.positionY[i] - joints.positionY[base]) * scale;
+			frame[jt][2] = (joints.positionZ[i] - joints.positionZ[base]) * scale;
+			frame[jt][3] = 0;
+			history.seenCount[jt]++;
+		}
+		else
+		{
+			history.seenCount[jt] = 0;
+		}
+	}
+
+	history.frameCount++;
+}
+
+// last template length frames of joint - reference, mean centered
+void GestureRecognizer::extractWindow(int body, const GestureTemplate& gesture)
+{
+	const BodyHistory& history = mHistory[body];
+	const UINT first = history.frameCount - gesture.length;
+
+	__m128 sum = _mm_setzero_ps();
+
+	for (int k = 0; k < gesture.length; ++k)
+	{
+		const float (*frame)[4] = history.frames[(first + k) % GESTURE_MAX_LENGTH];
+		__m128 p = _mm_sub_ps(_mm_loadu_ps(frame[gesture.joint]), _mm_loadu_ps(frame[gesture.reference]));
+		_mm_storeu_ps(&mWindow[k * 4], p);
+		sum = _mm_add_ps(sum, p);
+	}
+
+	__m128 mean = _mm_mul_ps(sum, _mm_set1_ps(1.0f / gesture.length));
+
+	for (int k = 0; k < gesture.length; ++k)
+	{
+		_mm_storeu_ps(&mWindow[k * 4], _mm_sub_ps(_mm_loadu_ps(&mWindow[k * 4]), mean));
+	}
+}
+
+// LB_Keogh: distance from each window frame to the template envelope, stops once over the limit
+float GestureRecognizer::lowerBound(const GestureTemplate& gesture, float limit) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	const float* upper = &gesture.upper[0];
+	const float* lower = &gesture.lower[0];
+
+	float bound = 0;
+	int k = 0;
+
+	while (k < gesture.length)
+	{
+		__m128 acc = _mm_setzero_ps();
+		int end = std::min(gesture.length, k + 8);
+
+		for (; k < end; ++k)
+		{
+			__m128 c = _mm_loadu_ps(&mWindow[k * 4]);
+			__m128 above = _mm_max_ps(_mm_sub_ps(c, _mm_loadu_ps(&upper[k * 4])), zero);
+			__m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&lower[k * 4]), c), zero);
+			acc = _mm_add_ps(acc, _mm_add_ps(_mm_mul_ps(above, above), _mm_mul_ps(below, below)));
+		}
+
+		bound += horizontalSum(acc);
+		if (bound > limit)
+		{
+			break;
+		}
+	}
+
+	return bound;
+}
+
+// Sakoe-Chiba banded DTW on two rows, FLT_MAX once every cell of a row is over the limit
+float GestureRecognizer::dtw(const GestureTemplate& gesture, float limit)
+{
+	const int m = gesture.length;
+	const int r = gesture.band;
+	const float* frames = &gesture.frames[0];
+
+	for (int j = 0; j <= m; ++j)
+	{
+		mRows[0][j] = FLT_MAX;
+		mRows[1][j] = FLT_MAX;
+	}
+	mRows[0][0] = 0;
+
+	for (int i = 1; i <= m; ++i)
+	{
+		const float* prev = mRows[(i - 1) & 1];
+		float* cur = mRows[i & 1];
+
+		int first = std::max(1, i - r);
+		int last = std::min(m, i + r);
+
+		// left of the band, the cells still hold an older row
+		cur[first - 1] = FLT_MAX;
+
+		const float* c = &mWindow[(i - 1) * 4];
+		float rowMin = FLT_MAX;
+
+		for (int j = first; j <= last; ++j)
+		{
+			float best = std::min(prev[j - 1], std::min(prev[j], cur[j - 1]));
+			float value = (best == FLT_MAX) ? FLT_MAX : best + squaredDistance(c, &frames[(j - 1) * 4]);
+			cur[j] = value;
+			rowMin = std::min(rowMin, value);
+		}
+
+		if (rowMin > limit)
+		{
+			return FLT_MAX;
+		}
+	}
+
+	return mRows[m & 1][m];
+}
+
+/*
+* A gesture is reported once, at its best alignment: while the distance keeps dropping the match stays pending,
+* the first frame it rises or goes over the threshold reports it, then the pair rests for a template length
+*/
+void GestureRecognizer::updateMatch(int body, int gestureId, float distance, bool matched, std::vector<GestureMatch>& matches)
+{
+	MatchState& state = mMatchStates[body * mTemplates.size() + gestureId];
+
+	if (matched && (!state.pending || distance < state.pendingDistance))
+	{
+		state.pending = true;
+		state.pendingDistance = distance;
+		return;
+	}
+
+	if (state.pending)
+	{
+		GestureMatch match = { gestureId, body, mHistory[body].trackingId, state.pendingDistance };
+		matches.push_back(match);
+
+		state.pending = false;
+		state.cooldown = mTemplates[gestureId].length;
+	}
+}
\ No newline at end of file
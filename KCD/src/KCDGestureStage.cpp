@@ -0,0 +1,147 @@
+#include "KCDGestureStage.h"
+#include <string.h>
+
+using namespace kcd;
+
+GestureStage::GestureStage() :
+IGestureOutput(GESTURE_EVENT_QUEUE_SIZE),
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mJointStoreSrc(NULL),
+mLastRelativeTime(0),
+mPerformanceFrequency(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	mMatches.reserve(GESTURE_EVENT_QUEUE_SIZE);
+	mEvents.reserve(GESTURE_EVENT_QUEUE_SIZE);
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+GestureStage::~GestureStage() { }
+
+HRESULT GestureStage::thread_setup()
+{
+	mRecognizerMutex.lock();
+	mRecognizer.reset();
+	mRecognizerMutex.unlock();
+
+	mLastRelativeTime = 0;
+	return S_OK;
+}
+
+HRESULT GestureStage::thread_process()
+{
+	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+
+	// once per body frame
+	if (bodyData.relativeTime == 0 || bodyData.relativeTime == mLastRelativeTime)
+	{
+		return E_FAIL;
+	}
+	mLastRelativeTime = bodyData.relativeTime;
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER end = { 0 };
+	QueryPerformanceCounter(&start);
+
+	const JointStore& joints = mJointStoreSrc->getLatestJoints();
+	const UINT64 frameId = mDeviceSrc->getLatestFrameId();
+
+	mMatches.clear();
+	mEvents.clear();
+
+	mRecognizerMutex.lock();
+	mRecognizer.process(joints, mMatches);
+	GestureStats stats = mRecognizer.getStats();
+	mRecognizerMutex.unlock();
+
+	for (size_t i = 0; i < mMatches.size(); ++i)
+	{
+		const GestureMatch& match = mMatches[i];
+		GestureEvent evt = { match.gestureId, match.body, match.trackingId, match.distance, frameId };
+		mEvents.push_back(evt);
+	}
+
+	QueryPerformanceCounter(&end);
+	stats.processMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+
+	mRecognizerMutex.lock();
+	mStats = stats;
+	mRecognizerMutex.unlock();
+
+	// after the timing: publisher thread subscribers run here
+	if (!mEvents.empty())
+	{
+		this->publish(&mEvents[0], mEvents.size());
+	}
+
+	return S_OK;
+}
+
+void GestureStage::update()
+{
+	this->dispatchMain();
+}
+
+void GestureStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void GestureStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void GestureStage::setJointStoreSource(IJointStoreSourceRef jointStoreSrc)
+{
+	mJointStoreSrc = jointStoreSrc;
+}
+
+int GestureStage::addTemplate(const std::string& name, JointType joint, JointType reference, const std::vector<ci::Vec3f>& trajectory, float threshold, float bandFraction)
+{
+	mRecognizerMutex.lock();
+	int gestureId = mRecognizer.addTemplate(name, joint, reference, trajectory, threshold, bandFraction);
+	mRecognizerMutex.unlock();
+	return gestureId;
+}
+
+void GestureStage::addDefaultTemplates(float threshold)
+{
+	mRecognizerMutex.lock();
+	mRecognizer.addDefaultTemplates(threshold);
+	mRecognizerMutex.unlock();
+}
+
+const std::string& GestureStage::getGestureName(int gestureId) const
+{
+	return mRecognizer.getTemplate(gestureId).name;
+}
+
+JointMask GestureStage::getRequiredJoints()
+{
+	mRecognizerMutex.lock();
+	JointMask joints = mRecognizer.getRequiredJoints();
+	mRecognizerMutex.unlock();
+	return joints;
+}
+
+void GestureStage::setMaxEvaluationsPerFrame(UINT evaluations)
+{
+	mRecognizerMutex.lock();
+	mRecognizer.setMaxEvaluationsPerFrame(evaluations);
+	mRecognizerMutex.unlock();
+}
+
+GestureStats GestureStage::getStats()
+{
+	mRecognizerMutex.lock();
+	GestureStats stats = mStats;
+	mRecognizerMutex.unlock();
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "KCDHoleFilling.h"
+#include <emmintrin.h>
+#include <malloc.h>
+#include <string.h>
+
+using namespace kcd;
+
+#define PLANE_PADDING 8 // pixels before each row, keeps rows 16-byte aligned
+
+DepthHoleFiller::DepthHoleFiller() :
+mWidth(0),
+mHeight(0),
+mStride(0),
+mIterations(4),
+mMaxRunLength(16),
+mDepthOut(NULL),
+mBodyIndexOut(NULL)
+{
+	mDepthPlanes[0] = mDepthPlanes[1] = NULL;
+	mBodyPlanes[0] = mBodyPlanes[1] = NULL;
+}
+
+DepthHoleFiller::~DepthHoleFiller()
+{
+	this->release();
+}
+
+void DepthHoleFiller::allocate(int width, int height)
+{
+	this->release();
+
+	// rows are processed eight pixels at a time
+	mWidth = width;
+	mHeight = height;
+	mStride = ((width + 7) & ~7) + 2 * PLANE_PADDING;
+
+	size_t planeSize = mStride * mHeight * sizeof(UINT16);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		mDepthPlanes[i] = static_cast<UINT16*>(_aligned_malloc(planeSize, 16));
+		mBodyPlanes[i] = static_cast<UINT16*>(_aligned_malloc(planeSize, 16));
+		memset(mDepthPlanes[i], 0, planeSize);
+
+		for (int p = 0; p < mStride * mHeight; ++p)
+		{
+			mBodyPlanes[i][p] = 0xFF;
+		}
+	}
+
+	mDepthOut = new UINT16[mWidth * mHeight];
+	mBodyIndexOut = new BYTE[mWidth * mHeight];
+}
+
+void DepthHoleFiller::release()
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		if (mDepthPlanes[i])
+		{
+			_aligned_free(mDepthPlanes[i]);
+			mDepthPlanes[i] = NULL;
+		}
+
+		if (mBodyPlanes[i])
+		{
+			_aligned_free(mBodyPlanes[i]);
+			mBodyPlanes[i] = NULL;
+		}
+	}
+
+	if (mDepthOut)
+	{
+		delete[] mDepthOut;
+		mDepthOut = NULL;
+	}
+
+	if (mBodyIndexOut)
+	{
+		delete[] mBodyIndexOut;
+		mBodyIndexOut = NULL;
+	}
+}
+
+void DepthHoleFiller::fill(const UINT16* depthBuffer, const BYTE* bodyIndexBuffer)
+{
+	if (!mDepthOut || !depthBuffer || !bodyIndexBuffer)
+	{
+		return;
+	}
+
+	// widen body indices to 16 bit so they can be blended along with depth
+	const __m128i zero = _mm_setzero_si128();
+
+	for (int y = 0; y < mHeight; ++y)
+	{
+		UINT16* depthRow = mDepthPlanes[0] + y * mStride + PLANE_PADDING;
+		UINT16* bodyRow = mBodyPlanes[0] + y * mStride + PLANE_PADDING;
+		const BYTE* bodySrc = bodyIndexBuffer + y * mWidth;
+
+		memcpy(depthRow, depthBuffer + y * mWidth, mWidth * sizeof(UINT16));
+
+		int x = 0;
+		for (; x + 16 <= mWidth; x += 16)
+		{
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bodySrc + x));
+			_mm_store_si128(reinterpret_cast<__m128i*>(bodyRow + x), _mm_unpacklo_epi8(b, zero));
+			_mm_store_si128(reinterpret_cast<__m128i*>(bodyRow + x + 8), _mm_unpackhi_epi8(b, zero));
+		}
+
+		for (; x < mWidth; ++x)
+		{
+			bodyRow[x] = bodySrc[x];
+		}
+
+		this->fillRowRuns(depthRow, bodyRow);
+	}
+
+	int src = 0;
+	for (int i = 0; i < mIterations; ++i)
+	{
+		this->iterate(mDepthPlanes[src], mBodyPlanes[src], mDepthPlanes[1 - src], mBodyPlanes[1 - src]);
+		src = 1 - src;
+	}
+
+	for (int y = 0; y < mHeight; ++y)
+	{
+		const UINT16* depthRow = mDepthPlanes[src] + y * mStride + PLANE_PADDING;
+		const UINT16* bodyRow = mBodyPlanes[src] + y * mStride + PLANE_PADDING;
+		BYTE* bodyDst = mBodyIndexOut + y * mWidth;
+
+		memcpy(mDepthOut + y * mWidth, depthRow, mWidth * sizeof(UINT16));
+
+		int x = 0;
+		for (; x + 16 <= mWidth; x += 16)
+		{
+			__m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(bodyRow + x));
+			__m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(bodyRow + x + 8));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(bodyDst + x), _mm_packus_epi16(lo, hi));
+		}
+
+		for (; x < mWidth; ++x)
+		{
+			bodyDst[x] = static_cast<BYTE>(bodyRow[x]);
+		}
+	}
+}
+
+/*
+* The IR emitter and the cameras sit side by side, so parallax shadows are horizontal runs:
+* fill each short run with whichever end is farther
+*/
+void DepthHoleFiller::fillRowRuns(UINT16* depthRow, UINT16* bodyRow)
+{
+	int x = 0;
+
+	while (x < mWidth)
+	{
+		if (depthRow[x] != 0)
+		{
+			x++;
+			continue;
+		}
+
+		int start = x;
+		while (x < mWidth && depthRow[x] == 0)
+		{
+			x++;
+		}
+
+		if (x - start > mMaxRunLength)
+		{
+			continue;
+		}
+
+		int left = start - 1;
+		int right = x;
+		int source = -1;
+
+		if (left >= 0 && right < mWidth)
+		{
+			source = (depthRow[left] >= depthRow[right]) ? left : right;
+		}
+		else if (left >= 0)
+		{
+			source = left;
+		}
+		else if (right < mWidth)
+		{
+			source = right;
+		}
+
+		if (source >= 0)
+		{
+			for (int i = start; i < x; ++i)
+			{
+				depthRow[i] = depthRow[source];
+				bodyRow[i] = bodyRow[source];
+			}
+		}
+	}
+}
+
+/*
+* Depth is in millimeters and stays below 32768, so signed 16 bit max is safe (no SSE4.1 needed)
+* Padding columns and the replicated first/last rows are invalid or the pixel itself, never a candidate
+*/
+void DepthHoleFiller::iterate(const UINT16* depthSrc, const UINT16* bodySrc, UINT16* depthDst, UINT16* bodyDst)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	for (int y = 0; y < mHeight; ++y)
+	{
+		int offset = y * mStride + PLANE_PADDING;
+		int up = (y > 0) ? -mStride : 0;
+		int down = (y < mHeight - 1) ? mStride : 0;
+
+		const UINT16* d = depthSrc + offset;
+		const UINT16* b = bodySrc + offset;
+		UINT16* dOut = depthDst + offset;
+		UINT16* bOut = bodyDst + offset;
+
+		for (int x = 0; x < mWidth; x += 8)
+		{
+			__m128i center = _mm_load_si128(reinterpret_cast<const __m128i*>(d + x));
+			__m128i centerBody = _mm_load_si128(reinterpret_cast<const __m128i*>(b + x));
+			__m128i hole = _mm_cmpeq_epi16(center, zero);
+
+			if (_mm_movemask_epi8(hole) == 0)
+			{
+				_mm_store_si128(reinterpret_cast<__m128i*>(dOut + x), center);
+				_mm_store_si128(reinterpret_cast<__m128i*>(bOut + x), centerBody);
+				continue;
+			}
+
+			__m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + x - 1));
+			__m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + x + 1));
+			__m128i top = _mm_load_si128(reinterpret_cast<const __m128i*>(d + x + up));
+			__m128i bottom = _mm_load_si128(reinterpret_cast<const __m128i*>(d + x + down));
+
+			__m128i best = _mm_max_epi16(_mm_max_epi16(left, right), _mm_max_epi16(top, bottom));
+
+			// body index of the neighbour that won, in reverse priority order
+			__m128i body = _mm_load_si128(reinterpret_cast<const __m128i*>(b + x + down));
+			__m128i mask = _mm_cmpeq_epi16(top, best);
+			body = _mm_or_si128(_mm_and_si128(mask, _mm_load_si128(reinterpret_cast<const __m128i*>(b + x + up))), _mm_andnot_si128(mask, body));
+			mask = _mm_cmpeq_epi16(right, best);
+			body = _mm_or_si128(_mm_and_si128(mask, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x + 1))), _mm_andnot_si128(mask, body));
+			mask = _mm_cmpeq_epi16(left, best);
+			body = _mm_or_si128(_mm_and_si128(mask, _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x - 1))), _mm_andnot_si128(mask, body));
+
+			// holes without any valid neighbour yet keep their own body index
+			__m128i filled = _mm_andnot_si128(_mm_cmpeq_epi16(best, zero), hole);
+			__m128i outDepth = _mm_or_si128(_mm_and_si128(filled, best), _mm_andnot_si128(filled, center));
+			__m128i outBody = _mm_or_si128(_mm_and_si128(filled, body), _mm_andnot_si128(filled, centerBody));
+
+			_mm_store_si128(reinterpret_cast<__m128i*>(dOut + x), outDepth);
+			_mm_store_si128(reinterpret_cast<__m128i*>(bOut + x), outBody);
+		}
+	}
+}
\ No newline at end of file
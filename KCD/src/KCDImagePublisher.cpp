@@ -0,0 +1,128 @@
+#include "KCDImagePublisher.h"
+#include <string.h>
+#include <chrono>
+
+using namespace kcd;
+
+ImagePublisher::ImagePublisher() :
+mPool(NULL),
+mFormat(IMAGE_FORMAT_BGRA),
+mWidth(0),
+mHeight(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+ImagePublisher::~ImagePublisher()
+{
+	this->release();
+}
+
+void ImagePublisher::allocate(int width, int height, ImageFormat format, int buffers)
+{
+	this->release();
+
+	if (!mPool)
+	{
+		mPool = BufferPoolRef(new BufferPool());
+	}
+
+	std::lock_guard<std::mutex> lock(mLeasesMutex);
+
+	mFormat = format;
+	mWidth = width;
+	mHeight = height;
+
+	// the scratch buffer is one of them, out for good
+	mPool->reserve(format, width, height, buffers + 1);
+	mScratch = mPool->acquire(format, width, height);
+}
+
+void ImagePublisher::release()
+{
+	std::lock_guard<std::mutex> lock(mLeasesMutex);
+
+	mAcquired.reset();
+	mLatest.reset();
+	mScratch.reset();
+}
+
+BYTE* ImagePublisher::acquireBuffer()
+{
+	std::lock_guard<std::mutex> lock(mLeasesMutex);
+
+	if (!mPool)
+	{
+		return NULL;
+	}
+
+	// the latest buffer is leased here, never handed out again until replaced
+	mAcquired = mPool->acquire(mFormat, mWidth, mHeight);
+
+	if (mAcquired)
+	{
+		return mAcquired->as<BYTE>();
+	}
+
+	return mScratch ? mScratch->as<BYTE>() : NULL;
+}
+
+void ImagePublisher::publish(UINT64 frameId)
+{
+	{
+		std::lock_guard<std::mutex> lock(mLeasesMutex);
+
+		if (!mAcquired)
+		{
+			if (mScratch)
+			{
+				mStats.heldBack++;
+			}
+			return;
+		}
+
+		// nobody else holds the acquired buffer, its view can still change
+		mAcquired->view.frameId = frameId;
+		mLatest = mAcquired;
+		mAcquired.reset();
+		mStats.published++;
+	}
+
+	mPublished.notify_all();
+}
+
+ImageViewRef ImagePublisher::tryGetLatest()
+{
+	std::lock_guard<std::mutex> lock(mLeasesMutex);
+
+	if (!mLatest)
+	{
+		return NULL;
+	}
+
+	// shares the lease, no allocation
+	return ImageViewRef(mLatest, &mLatest->view);
+}
+
+ImageViewRef ImagePublisher::waitForNewer(UINT64 frameId, DWORD timeoutMilliseconds)
+{
+	std::unique_lock<std::mutex> lock(mLeasesMutex);
+
+	bool published = mPublished.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this, frameId]()
+	{
+		return mLatest && mLatest->view.frameId > frameId;
+	});
+
+	if (!published)
+	{
+		return NULL;
+	}
+
+	return ImageViewRef(mLatest, &mLatest->view);
+}
+
+ImagePublisherStats ImagePublisher::getStats()
+{
+	std::lock_guard<std::mutex> lock(mLeasesMutex);
+	return mStats;
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "KCDJointFilter.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+using namespace kcd;
+
+#define TWO_PI 6.28318530718f
+
+JointFilter::JointFilter() :
+mErrorSum(0)
+{
+	// strong smoothing at rest, the cutoff opens up quickly with speed so moving hands don't lag
+	JointFilterParams params;
+	params.minCutoff = 1.0f;
+	params.beta = 20.0f;
+	params.derivativeCutoff = 1.0f;
+	params.levelSmoothing = 0.9f;
+	params.trendSmoothing = 0.8f;
+
+	// padding channels stay at zero
+	memset(mMinCutoff, 0, sizeof(mMinCutoff));
+	memset(mBeta, 0, sizeof(mBeta));
+	memset(mDerivativeCutoff, 0, sizeof(mDerivativeCutoff));
+	memset(mLevelSmoothing, 0, sizeof(mLevelSmoothing));
+	memset(mTrendSmoothing, 0, sizeof(mTrendSmoothing));
+
+	this->setParams(params);
+	this->reset();
+}
+
+JointFilter::~JointFilter() { }
+
+void JointFilter::setParams(const JointFilterParams& params)
+{
+	for (int jt = 0; jt < JointType_Count; ++jt)
+	{
+		mParams[jt] = params;
+		this->expandParams(jt);
+	}
+}
+
+void JointFilter::setParams(JointType jointType, const JointFilterParams& params)
+{
+	if (jointType >= 0 && jointType < JointType_Count)
+	{
+		mParams[jointType] = params;
+		this->expandParams(jointType);
+	}
+}
+
+void JointFilter::expandParams(int jointType)
+{
+	const JointFilterParams& params = mParams[jointType];
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			int c = a * JOINT_FILTER_STRIDE + JointStore::index(b, jointType);
+			mMinCutoff[c] = params.minCutoff;
+			mBeta[c] = params.beta;
+			mDerivativeCutoff[c] = params.derivativeCutoff;
+			mLevelSmoothing[c] = params.levelSmoothing;
+			mTrendSmoothing[c] = params.trendSmoothing;
+		}
+	}
+}
+
+void JointFilter::reset()
+{
+	memset(mRaw, 0, sizeof(mRaw));
+	memset(mSmoothed, 0, sizeof(mSmoothed));
+	memset(mDerivative, 0, sizeof(mDerivative));
+	memset(mLevel, 0, sizeof(mLevel));
+	memset(mTrend, 0, sizeof(mTrend));
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		mInitialized[b] = 0;
+		mTrackingId[b] = 0;
+	}
+
+	this->resetStats();
+}
+
+void JointFilter::resetStats()
+{
+	mStats.samples = 0;
+	mStats.meanError = 0;
+	mStats.maxError = 0;
+	mStats.processMicroseconds = 0;
+	mErrorSum = 0;
+}
+
+void JointFilter::filter(const JointStore& raw, float dt)
+{
+	const int stride = JOINT_FILTER_STRIDE;
+
+	memcpy(mRaw, raw.positionX, sizeof(raw.positionX));
+	memcpy(mRaw + stride, raw.positionY, sizeof(raw.positionY));
+	memcpy(mRaw + 2 * stride, raw.positionZ, sizeof(raw.positionZ));
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		JointMask seen = raw.seen[b];
+
+		if (raw.trackingId[b] != mTrackingId[b])
+		{
+			mTrackingId[b] = raw.trackingId[b];
+			mInitialized[b] = 0;
+		}
+
+		for (int jt = 0; seen != 0; ++jt, seen >>= 1)
+		{
+			if (!(seen & 1u))
+			{
+				continue;
+			}
+
+			int i = JointStore::index(b, jt);
+
+			if (mInitialized[b] & JOINT_BIT(jt))
+			{
+				// the prediction made at the previous frame, checked against this one
+				float errorSq = 0;
+				for (int a = 0; a < 3; ++a)
+				{
+					int c = a * stride + i;
+					float e = mLevel[c] + mTrend[c] * dt - mRaw[c];
+					errorSq += e * e;
+				}
+
+				float error = sqrt(errorSq);
+				mErrorSum += error;
+				mStats.samples++;
+				mStats.maxError = std::max(mStats.maxError, error);
+			}
+			else
+			{
+				for (int a = 0; a < 3; ++a)
+				{
+					int c = a * stride + i;
+					mSmoothed[c] = mRaw[c];
+					mLevel[c] = mRaw[c];
+					mDerivative[c] = 0;
+					mTrend[c] = 0;
+				}
+			}
+		}
+
+		mInitialized[b] = raw.seen[b];
+	}
+
+	if (mStats.samples > 0)
+	{
+		mStats.meanError = static_cast<float>(mErrorSum / mStats.samples);
+	}
+
+	// unseen channels are updated too, with their last raw value: cheaper than masking, they are reset on reappearance
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 dtv = _mm_set1_ps(dt);
+	const __m128 invDt = _mm_set1_ps(1.0f / dt);
+	const __m128 twoPiDt = _mm_set1_ps(TWO_PI * dt);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for (int c = 0; c < JOINT_FILTER_CHANNELS; c += 4)
+	{
+		__m128 x = _mm_loadu_ps(mRaw + c);
+		__m128 previous = _mm_loadu_ps(mSmoothed + c);
+
+		// One Euro: smoothed speed drives the cutoff, alpha = r / (1 + r), r = 2 pi fc dt
+		__m128 rd = _mm_mul_ps(twoPiDt, _mm_loadu_ps(mDerivativeCutoff + c));
+		__m128 alphaD = _mm_div_ps(rd, _mm_add_ps(one, rd));
+		__m128 dx = _mm_loadu_ps(mDerivative + c);
+		dx = _mm_add_ps(dx, _mm_mul_ps(alphaD, _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(x, previous), invDt), dx)));
+
+		__m128 cutoff = _mm_add_ps(_mm_loadu_ps(mMinCutoff + c), _mm_mul_ps(_mm_loadu_ps(mBeta + c), _mm_and_ps(dx, absMask)));
+		__m128 r = _mm_mul_ps(twoPiDt, cutoff);
+		__m128 alpha = _mm_div_ps(r, _mm_add_ps(one, r));
+		__m128 smoothed = _mm_add_ps(previous, _mm_mul_ps(alpha, _mm_sub_ps(x, previous)));
+
+		// Holt: level follows the smoothed value from the prediction, trend follows the level change
+		__m128 level = _mm_loadu_ps(mLevel + c);
+		__m128 trend = _mm_loadu_ps(mTrend + c);
+		__m128 predicted = _mm_add_ps(level, _mm_mul_ps(trend, dtv));
+		__m128 newLevel = _mm_add_ps(predicted, _mm_mul_ps(_mm_loadu_ps(mLevelSmoothing + c), _mm_sub_ps(smoothed, predicted)));
+		__m128 slope = _mm_mul_ps(_mm_sub_ps(newLevel, level), invDt);
+		trend = _mm_add_ps(trend, _mm_mul_ps(_mm_loadu_ps(mTrendSmoothing + c), _mm_sub_ps(slope, trend)));
+
+		_mm_storeu_ps(mDerivative + c, dx);
+		_mm_storeu_ps(mSmoothed + c, smoothed);
+		_mm_storeu_ps(mLevel + c, newLevel);
+		_mm_storeu_ps(mTrend + c, trend);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "KCDJointFilterStage.h"
+#include "GlobalTime.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+using namespace kcd;
+
+JointFilterStage::JointFilterStage() :
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mJointStoreSrc(NULL),
+mLastRelativeTime(0),
+mPerformanceFrequency(0),
+mSensorLatency(0),
+mFilteredBack(0),
+mFilteredPending(1),
+mFilteredFront(2),
+mHasNewFilteredJoints(false)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	memset(mFiltered, 0, sizeof(mFiltered));
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+JointFilterStage::~JointFilterStage() { }
+
+HRESULT JointFilterStage::thread_setup()
+{
+	mFilterMutex.lock();
+	mFilter.reset();
+	mFilterMutex.unlock();
+
+	mLastRelativeTime = 0;
+	return S_OK;
+}
+
+HRESULT JointFilterStage::thread_process()
+{
+	HRESULT hr = S_OK;
+
+	ICoordinateMapper* coordinateMapper = mDeviceSrc->getCoordinateMapper();
+	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+
+	// once per body frame
+	if (coordinateMapper == NULL || bodyData.relativeTime == 0 || bodyData.relativeTime == mLastRelativeTime)
+	{
+		return E_FAIL;
+	}
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER end = { 0 };
+	QueryPerformanceCounter(&start);
+
+	float dt = 1.0f / 30.0f;
+	if (mLastRelativeTime)
+	{
+		dt = static_cast<float>(bodyData.relativeTime - mLastRelativeTime) * 1e-7f;
+		dt = std::max(JOINT_FILTER_MIN_DT, std::min(JOINT_FILTER_MAX_DT, dt));
+	}
+	mLastRelativeTime = bodyData.relativeTime;
+
+	const JointStore& raw = mJointStoreSrc->getLatestJoints();
+	FilteredJoints& filtered = mFiltered[mFilteredBack];
+
+	mFilterMutex.lock();
+	mFilter.filter(raw, dt);
+	mFilterMutex.unlock();
+
+	// masks and tracking state as measured, positions and velocities as filtered
+	filtered.joints = raw;
+
+	const float* level = mFilter.getLevel();
+	const float* trend = mFilter.getTrend();
+	const int stride = JOINT_FILTER_STRIDE;
+
+	for (int i = 0; i < JointStore::Size; ++i)
+	{
+		filtered.joints.positionX[i] = level[i];
+		filtered.joints.positionY[i] = level[stride + i];
+		filtered.joints.positionZ[i] = level[2 * stride + i];
+		filtered.velocityX[i] = trend[i];
+		filtered.velocityY[i] = trend[stride + i];
+		filtered.velocityZ[i] = trend[2 * stride + i];
+	}
+
+	hr = this->mapToColorSpace(coordinateMapper, filtered);
+
+	QueryPerformanceCounter(&end);
+
+	filtered.relativeTime = bodyData.relativeTime;
+	filtered.filteredCounter = end.QuadPart;
+
+	mLatestJointsMutex.lock();
+	mLatestJoints = filtered.joints;
+	mLatestJointsMutex.unlock();
+
+	mFilteredMutex.lock();
+	std::swap(mFilteredBack, mFilteredPending);
+	mHasNewFilteredJoints = true;
+	mFilteredMutex.unlock();
+
+	mFilterMutex.lock();
+	mStats = mFilter.getStats();
+	mStats.processMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+	mFilterMutex.unlock();
+
+	return hr;
+}
+
+/*
+* One mapper call for every seen joint: its filtered position and its position one velocity step ahead,
+* the difference gives the color space velocity
+*/
+HRESULT JointFilterStage::mapToColorSpace(ICoordinateMapper* coordinateMapper, FilteredJoints& filtered)
+{
+	UINT count = 0;
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		JointMask seen = filtered.joints.seen[b];
+
+		for (int jt = 0; seen != 0; ++jt, seen >>= 1)
+		{
+			if (seen & 1u)
+			{
+				mMappedJoints[count++] = JointStore::index(b, jt);
+			}
+		}
+	}
+
+	if (count == 0)
+	{
+		return S_OK;
+	}
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		int i = mMappedJoints[k];
+		CameraSpacePoint& p = mCameraPoints[k];
+		CameraSpacePoint& q = mCameraPoints[count + k];
+
+		p.X = filtered.joints.positionX[i];
+		p.Y = filtered.joints.positionY[i];
+		p.Z = filtered.joints.positionZ[i];
+		q.X = p.X + filtered.velocityX[i] * JOINT_FILTER_VELOCITY_STEP;
+		q.Y = p.Y + filtered.velocityY[i] * JOINT_FILTER_VELOCITY_STEP;
+		q.Z = p.Z + filtered.velocityZ[i] * JOINT_FILTER_VELOCITY_STEP;
+	}
+
+	HRESULT hr = coordinateMapper->MapCameraPointsToColorSpace(2 * count, mCameraPoints, 2 * count, mColorPoints);
+
+	if (SUCCEEDED(hr))
+	{
+		for (UINT k = 0; k < count; ++k)
+		{
+			int i = mMappedJoints[k];
+			const ColorSpacePoint& p = mColorPoints[k];
+			const ColorSpacePoint& q = mColorPoints[count + k];
+
+			filtered.joints.colorX[i] = p.X;
+			filtered.joints.colorY[i] = p.Y;
+
+			// points behind the camera map to -infinity
+			float vx = (q.X - p.X) / JOINT_FILTER_VELOCITY_STEP;
+			float vy = (q.Y - p.Y) / JOINT_FILTER_VELOCITY_STEP;
+			bool finite = (vx - vx == 0) && (vy - vy == 0);
+			filtered.colorVelocityX[i] = finite ? vx : 0;
+			filtered.colorVelocityY[i] = finite ? vy : 0;
+		}
+	}
+
+	return hr;
+}
+
+void JointFilterStage::update()
+{
+	if (mHasNewFilteredJoints)
+	{
+		mFilteredMutex.lock();
+		std::swap(mFilteredPending, mFilteredFront);
+		mHasNewFilteredJoints = false;
+		mFilteredMutex.unlock();
+	}
+
+	const FilteredJoints& filtered = mFiltered[mFilteredFront];
+	mPredicted = filtered.joints;
+
+	if (filtered.relativeTime == 0)
+	{
+		return;
+	}
+
+	LARGE_INTEGER now = { 0 };
+	QueryPerformanceCounter(&now);
+
+	float age = (mPerformanceFrequency > 0) ? static_cast<float>(double(now.QuadPart - filtered.filteredCounter) / mPerformanceFrequency) : 0;
+	float horizon = mSensorLatency + age + static_cast<float>(GlobalTime::DeltaSeconds());
+	horizon = std::max(0.0f, std::min(JOINT_FILTER_MAX_HORIZON, horizon));
+
+	for (int i = 0; i < JointStore::Size; ++i)
+	{
+		mPredicted.positionX[i] += filtered.velocityX[i] * horizon;
+		mPredicted.positionY[i] += filtered.velocityY[i] * horizon;
+		mPredicted.positionZ[i] += filtered.velocityZ[i] * horizon;
+		mPredicted.colorX[i] += filtered.colorVelocityX[i] * horizon;
+		mPredicted.colorY[i] += filtered.colorVelocityY[i] * horizon;
+	}
+}
+
+void JointFilterStage::copyLatestJoints(JointStore& joints)
+{
+	mLatestJointsMutex.lock();
+	joints = mLatestJoints;
+	mLatestJointsMutex.unlock();
+}
+
+void JointFilterStage::copyPredictedJoints(JointStore& joints)
+{
+	joints = mPredicted;
+}
+
+void JointFilterStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void JointFilterStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void JointFilterStage::setJointStoreSource(IJointStoreSourceRef jointStoreSrc)
+{
+	mJointStoreSrc = jointStoreSrc;
+}
+
+void JointFilterStage::setFilterParams(const JointFilterParams& params)
+{
+	mFilterMutex.lock();
+	mFilter.setParams(params);
+	mFilterMutex.unlock();
+}
+
+void JointFilterStage::setFilterParams(JointType jointType, const JointFilterParams& params)
+{
+	mFilterMutex.lock();
+	mFilter.setParams(jointType, params);
+	mFilterMutex.unlock();
+}
+
+JointFilterStats JointFilterStage::getFilterStats()
+{
+	mFilterMutex.lock();
+	JointFilterStats stats = mStats;
+	mFilterMutex.unlock();
+	return stats;
+}
+
+void JointFilterStage::resetFilterStats()
+{
+	mFilterMutex.lock();
+	mFilter.resetStats();
+	mStats = mFilter.getStats();
+	mFilterMutex.unlock();
+}
\ No newline at end of file
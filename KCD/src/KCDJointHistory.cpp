@@ -0,0 +1,262 @@
+#include "KCDJointHistory.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <string.h>
+
+using namespace kcd;
+
+JointHistory::JointHistory(UINT capacity) :
+mSlots(NULL),
+mCapacity(std::max(capacity, 8u)),
+mCount(0)
+{
+	mSlots = new Slot[mCapacity];
+	this->clear();
+}
+
+JointHistory::~JointHistory()
+{
+	if (mSlots)
+	{
+		delete[] mSlots;
+		mSlots = NULL;
+	}
+}
+
+// not safe against concurrent readers, call while the pipeline is stopped
+void JointHistory::clear()
+{
+	for (UINT i = 0; i < mCapacity; ++i)
+	{
+		Slot& slot = mSlots[i];
+		slot.sequence.store(0);
+		slot.index = 0;
+		slot.time = 0;
+		memset(slot.trackingId, 0, sizeof(slot.trackingId));
+		memset(slot.seen, 0, sizeof(slot.seen));
+		memset(slot.position, 0, sizeof(slot.position));
+	}
+
+	mCount.store(0);
+}
+
+void JointHistory::push(const JointStore& joints, INT64 relativeTime)
+{
+	UINT64 index = mCount.load(std::memory_order_relaxed);
+	Slot& slot = mSlots[index % mCapacity];
+
+	UINT sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.index = index;
+	slot.time = static_cast<double>(relativeTime) * 1e-7;
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		slot.trackingId[b] = joints.trackingId[b];
+		slot.seen[b] = joints.seen[b];
+
+		memcpy(slot.position[b][0], joints.positionX + JointStore::index(b, 0), JointType_Count * sizeof(float));
+		memcpy(slot.position[b][1], joints.positionY + JointStore::index(b, 0), JointType_Count * sizeof(float));
+		memcpy(slot.position[b][2], joints.positionZ + JointStore::index(b, 0), JointType_Count * sizeof(float));
+	}
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	mCount.store(index + 1, std::memory_order_release);
+}
+
+bool JointHistory::readTime(UINT64 index, double& time) const
+{
+	const Slot& slot = mSlots[index % mCapacity];
+
+	UINT sequence = slot.sequence.load(std::memory_order_acquire);
+	if (sequence & 1)
+	{
+		return false;
+	}
+
+	UINT64 held = slot.index;
+	time = slot.time;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return held == index && slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+bool JointHistory::readSample(UINT64 index, int body, Sample& sample) const
+{
+	const Slot& slot = mSlots[index % mCapacity];
+
+	UINT sequence = slot.sequence.load(std::memory_order_acquire);
+	if (sequence & 1)
+	{
+		return false;
+	}
+
+	UINT64 held = slot.index;
+	sample.time = slot.time;
+	sample.trackingId = slot.trackingId[body];
+	sample.seen = slot.seen[body];
+	memcpy(sample.position, slot.position[body], sizeof(sample.position));
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return held == index && slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+bool JointHistory::getTimeRange(double& oldest, double& newest) const
+{
+	for (int attempt = 0; attempt < JOINT_HISTORY_RETRIES; ++attempt)
+	{
+		UINT64 count = mCount.load(std::memory_order_acquire);
+		if (count < 4)
+		{
+			return false;
+		}
+
+		// the oldest slot is the next one to be overwritten, leave it out
+		UINT64 first = (count > mCapacity - 1) ? count - (mCapacity - 1) : 0;
+
+		if (this->readTime(first, oldest) && this->readTime(count - 1, newest))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool JointHistory::query(int body, double time, JointKinematics& kinematics) const
+{
+	if (body < 0 || body >= BODY_COUNT)
+	{
+		return false;
+	}
+
+	Sample window[4];
+	bool ok = false;
+
+	for (int attempt = 0; attempt < JOINT_HISTORY_RETRIES && !ok; ++attempt)
+	{
+		UINT64 count = mCount.load(std::memory_order_acquire);
+		if (count < 4)
+		{
+			return false;
+		}
+
+		UINT64 first = (count > mCapacity - 1) ? count - (mCapacity - 1) : 0;
+		UINT64 last = count - 1;
+
+		// newest sample not after the requested time, most queries are close to now
+		UINT64 k = last;
+		double sampleTime = 0;
+		ok = true;
+
+		while (k > first)
+		{
+			if (!this->readTime(k, sampleTime))
+			{
+				ok = false;
+				break;
+			}
+
+			if (sampleTime <= time)
+			{
+				break;
+			}
+
+			k--;
+		}
+
+		if (!ok)
+		{
+			continue;
+		}
+
+		// four samples k-1 .. k+2, shifted to stay inside the held range
+		UINT64 base = (k > first) ? k - 1 : first;
+		base = std::min(base, last - 3);
+
+		for (int w = 0; w < 4 && ok; ++w)
+		{
+			ok = this->readSample(base + w, body, window[w]);
+		}
+	}
+
+	if (!ok)
+	{
+		return false;
+	}
+
+	UINT64 trackingId = window[0].trackingId;
+	JointMask valid = window[0].seen;
+
+	for (int w = 1; w < 4; ++w)
+	{
+		if (window[w].trackingId != trackingId)
+		{
+			return false;
+		}
+
+		valid &= window[w].seen;
+	}
+
+	double t0 = window[0].time;
+	double t1 = window[1].time;
+	double t2 = window[2].time;
+	double t3 = window[3].time;
+
+	if (!(t0 < t1 && t1 < t2 && t2 < t3))
+	{
+		return false;
+	}
+
+	time = std::max(t0, std::min(t3, time));
+
+	// position: the bracketing pair
+	int j = (time < t1) ? 0 : ((time < t2) ? 1 : 2);
+	float u = static_cast<float>((time - window[j].time) / (window[j + 1].time - window[j].time));
+
+	// velocity and acceleration at the inner samples, interpolated (or extrapolated at the ends) between them
+	float v = static_cast<float>((time - t1) / (t2 - t1));
+
+	const __m128 uv = _mm_set1_ps(u);
+	const __m128 vv = _mm_set1_ps(v);
+	const __m128 inv02 = _mm_set1_ps(static_cast<float>(1.0 / (t2 - t0)));
+	const __m128 inv13 = _mm_set1_ps(static_cast<float>(1.0 / (t3 - t1)));
+	const __m128 inv01 = _mm_set1_ps(static_cast<float>(1.0 / (t1 - t0)));
+	const __m128 inv12 = _mm_set1_ps(static_cast<float>(1.0 / (t2 - t1)));
+	const __m128 inv23 = _mm_set1_ps(static_cast<float>(1.0 / (t3 - t2)));
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	for (int a = 0; a < 3; ++a)
+	{
+		for (int i = 0; i < JOINT_HISTORY_STRIDE; i += 4)
+		{
+			__m128 p0 = _mm_loadu_ps(&window[0].position[a][i]);
+			__m128 p1 = _mm_loadu_ps(&window[1].position[a][i]);
+			__m128 p2 = _mm_loadu_ps(&window[2].position[a][i]);
+			__m128 p3 = _mm_loadu_ps(&window[3].position[a][i]);
+
+			__m128 pa = _mm_loadu_ps(&window[j].position[a][i]);
+			__m128 pb = _mm_loadu_ps(&window[j + 1].position[a][i]);
+			_mm_storeu_ps(&kinematics.position[a][i], _mm_add_ps(pa, _mm_mul_ps(uv, _mm_sub_ps(pb, pa))));
+
+			__m128 s01 = _mm_mul_ps(_mm_sub_ps(p1, p0), inv01);
+			__m128 s12 = _mm_mul_ps(_mm_sub_ps(p2, p1), inv12);
+			__m128 s23 = _mm_mul_ps(_mm_sub_ps(p3, p2), inv23);
+
+			__m128 vel1 = _mm_mul_ps(_mm_sub_ps(p2, p0), inv02);
+			__m128 vel2 = _mm_mul_ps(_mm_sub_ps(p3, p1), inv13);
+			_mm_storeu_ps(&kinematics.velocity[a][i], _mm_add_ps(vel1, _mm_mul_ps(vv, _mm_sub_ps(vel2, vel1))));
+
+			__m128 acc1 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(s12, s01)), inv02);
+			__m128 acc2 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(s23, s12)), inv13);
+			_mm_storeu_ps(&kinematics.acceleration[a][i], _mm_add_ps(acc1, _mm_mul_ps(vv, _mm_sub_ps(acc2, acc1))));
+		}
+	}
+
+	kinematics.time = time;
+	kinematics.valid = valid;
+	kinematics.trackingId = trackingId;
+	return true;
+}
\ No newline at end of file
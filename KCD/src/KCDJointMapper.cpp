@@ -0,0 +1,127 @@
+#include "KCDJointMapper.h"
+#include "KCDDeviceStage.h"
+
+using namespace kcd;
+
+JointMapper::JointMapper() :
+mScreenScaleX(1.0f),
+mScreenScaleY(1.0f),
+mMapperCalls(0),
+mMappedCount(0),
+mCachedCount(0)
+{
+	this->invalidate();
+}
+
+JointMapper::~JointMapper() { }
+
+void JointMapper::setScreenSize(float width, float height)
+{
+	mScreenScaleX = width / DeviceStage::DepthFrameWidth;
+	mScreenScaleY = height / DeviceStage::DepthFrameHeight;
+}
+
+void JointMapper::invalidate()
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		mCached[b] = 0;
+	}
+}
+
+HRESULT JointMapper::map(ICoordinateMapper* coordinateMapper, JointStore& joints)
+{
+	UINT count = 0;
+	mMapperCalls = 0;
+	mCachedCount = 0;
+	mMappedCount = 0;
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		JointMask seen = joints.seen[b];
+		JointMask cached = 0;
+
+		for (int jt = 0; seen != 0; ++jt, seen >>= 1)
+		{
+			if (!(seen & 1u))
+			{
+				continue;
+			}
+
+			int i = JointStore::index(b, jt);
+
+			// the store still holds the results mapped from this position
+			if ((mCached[b] & JOINT_BIT(jt)) && mCachedX[i] == joints.positionX[i] &&
+				mCachedY[i] == joints.positionY[i] && mCachedZ[i] == joints.positionZ[i])
+			{
+				cached |= JOINT_BIT(jt);
+				mCachedCount++;
+				continue;
+			}
+
+			CameraSpacePoint& p = mCameraPoints[count];
+			p.X = joints.positionX[i];
+			p.Y = joints.positionY[i];
+			p.Z = joints.positionZ[i];
+			mMappedJoints[count++] = i;
+		}
+
+		mCached[b] = cached;
+	}
+
+	HRESULT hr = (coordinateMapper != NULL) ? S_OK : E_FAIL;
+
+	if (SUCCEEDED(hr) && count > 0)
+	{
+		hr = coordinateMapper->MapCameraPointsToColorSpace(count, mCameraPoints, count, mColorPoints);
+		mMapperCalls++;
+
+		if (SUCCEEDED(hr))
+		{
+			hr = coordinateMapper->MapCameraPointsToDepthSpace(count, mCameraPoints, count, mDepthPoints);
+			mMapperCalls++;
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		this->invalidate();
+		return hr;
+	}
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		int i = mMappedJoints[k];
+		int b = i / JointType_Count;
+
+		joints.colorX[i] = mColorPoints[k].X;
+		joints.colorY[i] = mColorPoints[k].Y;
+		joints.depthX[i] = mDepthPoints[k].X;
+		joints.depthY[i] = mDepthPoints[k].Y;
+
+		mCachedX[i] = mCameraPoints[k].X;
+		mCachedY[i] = mCameraPoints[k].Y;
+		mCachedZ[i] = mCameraPoints[k].Z;
+		mCached[b] |= JOINT_BIT(i - b * JointType_Count);
+	}
+
+	mMappedCount = count;
+
+	// screen space of every seen joint, the screen size may have changed
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		JointMask seen = joints.seen[b];
+
+		for (int jt = 0; seen != 0; ++jt, seen >>= 1)
+		{
+			if (seen & 1u)
+			{
+				int i = JointStore::index(b, jt);
+				joints.screenX[i] = joints.depthX[i] * mScreenScaleX;
+				joints.screenY[i] = joints.depthY[i] * mScreenScaleY;
+			}
+		}
+	}
+
+	return hr;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "KCDJointStore.h"
+#include <string.h>
+
+using namespace kcd;
+
+JointStore::JointStore()
+{
+	this->clear();
+}
+
+void JointStore::clear()
+{
+	memset(positionX, 0, sizeof(positionX));
+	memset(positionY, 0, sizeof(positionY));
+	memset(positionZ, 0, sizeof(positionZ));
+	memset(colorX, 0, sizeof(colorX));
+	memset(colorY, 0, sizeof(colorY));
+	memset(depthX, 0, sizeof(depthX));
+	memset(depthY, 0, sizeof(depthY));
+	memset(screenX, 0, sizeof(screenX));
+	memset(screenY, 0, sizeof(screenY));
+	memset(trackingState, TrackingState_NotTracked, sizeof(trackingState));
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		seen[b] = 0;
+		previous[b] = 0;
+		trackingId[b] = 0;
+		isTracked[b] = false;
+	}
+}
+
+void JointStore::beginFrame()
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		previous[b] = seen[b];
+		seen[b] = 0;
+		isTracked[b] = false;
+	}
+}
+
+HRESULT JointStore::updateBody(int body, IBody* pBody, JointMask subscription, bool trackInferred)
+{
+	HRESULT hr = S_OK;
+
+	if (pBody == NULL || body < 0 || body >= BODY_COUNT)
+	{
+		return E_FAIL;
+	}
+
+	BOOLEAN tracked = false;
+	hr = pBody->get_IsTracked(&tracked);
+
+	if (SUCCEEDED(hr) && tracked)
+	{
+		hr = pBody->get_TrackingId(&trackingId[body]);
+	}
+
+	if (FAILED(hr) || !tracked)
+	{
+		return hr;
+	}
+
+	isTracked[body] = true;
+
+	Joint joints[JointType_Count];
+	hr = pBody->GetJoints(_countof(joints), joints);
+
+	if (SUCCEEDED(hr))
+	{
+		JointMask mask = 0;
+		float* px = positionX + index(body, 0);
+		float* py = positionY + index(body, 0);
+		float* pz = positionZ + index(body, 0);
+		BYTE* ts = trackingState + index(body, 0);
+
+		for (int j = 0; j < _countof(joints); ++j)
+		{
+			int jt = joints[j].JointType;
+			TrackingState state = joints[j].TrackingState;
+			ts[jt] = static_cast<BYTE>(state);
+
+			if (!(subscription & JOINT_BIT(jt)))
+			{
+				continue;
+			}
+
+			if (state == TrackingState_Tracked || (state == TrackingState_Inferred && trackInferred))
+			{
+				px[jt] = joints[j].Position.X;
+				py[jt] = joints[j].Position.Y;
+				pz[jt] = joints[j].Position.Z;
+				mask |= JOINT_BIT(jt);
+			}
+		}
+
+		seen[body] = mask;
+	}
+
+	return hr;
+}
\ No newline at end of file
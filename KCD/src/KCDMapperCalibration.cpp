@@ -0,0 +1,155 @@
+#include "KCDMapperCalibration.h"
+#include "KCDDeviceStage.h"
+#include <vector>
+
+// rays on a grid from the first pixel, at every depth, to color and depth space, one batch per space
+static HRESULT mapSamples(ICoordinateMapper* coordinateMapper, const std::vector<float>& rays, int first, const float* depths, int depthCount, std::vector<MapperSample>& samples)
+{
+	const int width = kcd::DeviceStage::DepthFrameWidth;
+	const int height = kcd::DeviceStage::DepthFrameHeight;
+
+	std::vector<CameraSpacePoint> cameraPoints;
+	std::vector<ColorSpacePoint> colorPoints;
+	std::vector<DepthSpacePoint> depthPoints;
+
+	for (int y = first; y < height; y += MAPPER_CALIBRATION_GRID)
+	{
+		for (int x = first; x < width; x += MAPPER_CALIBRATION_GRID)
+		{
+			const size_t i = static_cast<size_t>(y) * width + x;
+
+			for (int d = 0; d < depthCount; ++d)
+			{
+				CameraSpacePoint p = { rays[2 * i] * depths[d], rays[2 * i + 1] * depths[d], depths[d] };
+				cameraPoints.push_back(p);
+			}
+		}
+	}
+
+	colorPoints.resize(cameraPoints.size());
+	depthPoints.resize(cameraPoints.size());
+
+	UINT count = static_cast<UINT>(cameraPoints.size());
+	HRESULT hr = coordinateMapper->MapCameraPointsToColorSpace(count, &cameraPoints[0], count, &colorPoints[0]);
+
+	if (SUCCEEDED(hr))
+	{
+		hr = coordinateMapper->MapCameraPointsToDepthSpace(count, &cameraPoints[0], count, &depthPoints[0]);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		samples.resize(cameraPoints.size());
+
+		for (size_t s = 0; s < cameraPoints.size(); ++s)
+		{
+			MapperSample& sample = samples[s];
+			sample.camera.X = cameraPoints[s].X;
+			sample.camera.Y = cameraPoints[s].Y;
+			sample.camera.Z = cameraPoints[s].Z;
+			sample.color.X = colorPoints[s].X;
+			sample.color.Y = colorPoints[s].Y;
+			sample.depth.X = depthPoints[s].X;
+			sample.depth.Y = depthPoints[s].Y;
+		}
+	}
+
+	return hr;
+}
+
+HRESULT kcd::exportMapperCalibration(ICoordinateMapper* coordinateMapper, MapperCalibration& calibration)
+{
+	if (coordinateMapper == NULL)
+	{
+		return E_FAIL;
+	}
+
+	CameraIntrinsics intrinsics = { 0 };
+	HRESULT hr = coordinateMapper->GetDepthCameraIntrinsics(&intrinsics);
+
+	if (SUCCEEDED(hr) && intrinsics.FocalLengthX <= 0)
+	{
+		hr = E_PENDING;
+	}
+
+	UINT32 tableSize = 0;
+	PointF* table = NULL;
+
+	if (SUCCEEDED(hr))
+	{
+		hr = coordinateMapper->GetDepthFrameToCameraSpaceTable(&tableSize, &table);
+	}
+
+	const int width = DeviceStage::DepthFrameWidth;
+	const int height = DeviceStage::DepthFrameHeight;
+
+	if (SUCCEEDED(hr) && tableSize != static_cast<UINT32>(width * height))
+	{
+		hr = E_FAIL;
+	}
+
+	MapperCalibration result;
+
+	if (SUCCEEDED(hr))
+	{
+		result.depthWidth = width;
+		result.depthHeight = height;
+		result.colorWidth = DeviceStage::ColorFrameWidth;
+		result.colorHeight = DeviceStage::ColorFrameHeight;
+		result.depthFocalX = intrinsics.FocalLengthX;
+		result.depthFocalY = intrinsics.FocalLengthY;
+		result.depthPrincipalX = intrinsics.PrincipalPointX;
+		result.depthPrincipalY = intrinsics.PrincipalPointY;
+		result.depthRadial[0] = intrinsics.RadialDistortionSecondOrder;
+		result.depthRadial[1] = intrinsics.RadialDistortionFourthOrder;
+		result.depthRadial[2] = intrinsics.RadialDistortionSixthOrder;
+
+		result.depthRays.resize(2 * tableSize);
+		for (UINT32 i = 0; i < tableSize; ++i)
+		{
+			result.depthRays[2 * i] = table[i].X;
+			result.depthRays[2 * i + 1] = table[i].Y;
+		}
+	}
+
+	if (table)
+	{
+		CoTaskMemFree(table);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		const float depths[MAPPER_CALIBRATION_DEPTHS] = { 0.75f, 1.5f, 2.5f, 3.5f, 4.5f };
+		hr = mapSamples(coordinateMapper, result.depthRays, MAPPER_CALIBRATION_GRID / 2, depths, MAPPER_CALIBRATION_DEPTHS, result.samples);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		const float depths[MAPPER_VALIDATION_DEPTHS] = { 1.0f, 2.0f, 3.0f, 4.0f };
+		hr = mapSamples(coordinateMapper, result.depthRays, MAPPER_CALIBRATION_GRID, depths, MAPPER_VALIDATION_DEPTHS, result.validationSamples);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = result.fitColorProjection() ? S_OK : E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		calibration = result;
+	}
+
+	return hr;
+}
+
+HRESULT kcd::validateMapperCalibration(const SoftwareMapper& mapper, MapperValidation& validation)
+{
+	mapper.validate(mapper.getCalibration().validationSamples, validation);
+
+	if (validation.sampleCount == 0 || !(validation.meanColorError <= MAPPER_MAX_COLOR_ERROR) || !(validation.meanDepthError <= MAPPER_MAX_DEPTH_ERROR))
+	{
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
\ No newline at end of file
@@ -6,6 +6,81 @@
 using namespace kcd;
 using namespace cv;
 
+namespace kcd
+{
+	/*
+	* Writes 255 for every color pixel whose depth coordinate hits the active body, and the depth it hits
+	* Rounding and bounds checks are done four pixels at a time, the body index and depth lookups are scalar
+	* Either output may be NULL: no active user, registered depth disabled
+	*/
+	struct MaskSink
+	{
+		const BYTE* bodyIndexBuffer;
+		const UINT16* depthBuffer;
+		BYTE* maskBuffer;
+		UINT16* registeredDepth;
+		BYTE activeBodyIndex;
+
+		void operator()(int colorIndex, const __m128& depthX, const __m128& depthY)
+		{
+			__declspec(align(16)) int x[4];
+			__declspec(align(16)) int y[4];
+
+			const __m128 half = _mm_set1_ps(0.5f);
+			__m128i xi = _mm_cvttps_epi32(_mm_add_ps(depthX, half));
+			__m128i yi = _mm_cvttps_epi32(_mm_add_ps(depthY, half));
+
+			// -inf converts to INT_MIN and fails the bounds check
+			__m128i inX = _mm_and_si128(_mm_cmpgt_epi32(xi, _mm_set1_epi32(-1)), _mm_cmplt_epi32(xi, _mm_set1_epi32(DeviceStage::DepthFrameWidth)));
+			__m128i inY = _mm_and_si128(_mm_cmpgt_epi32(yi, _mm_set1_epi32(-1)), _mm_cmplt_epi32(yi, _mm_set1_epi32(DeviceStage::DepthFrameHeight)));
+			int valid = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(inX, inY)));
+
+			_mm_store_si128(reinterpret_cast<__m128i*>(x), xi);
+			_mm_store_si128(reinterpret_cast<__m128i*>(y), yi);
+
+			BYTE* dst = maskBuffer ? maskBuffer + colorIndex : NULL;
+			UINT16* depthDst = registeredDepth ? registeredDepth + colorIndex : NULL;
+
+			for (int k = 0; k < 4; ++k)
+			{
+				BYTE mask = 0;
+				UINT16 depth = 0;
+
+				if (valid & (1 << k))
+				{
+					int depthIndex = x[k] + y[k] * DeviceStage::DepthFrameWidth;
+					mask = (bodyIndexBuffer[depthIndex] == activeBodyIndex) ? 255 : 0;
+					depth = depthBuffer[depthIndex];
+				}
+
+				if (dst)
+				{
+					dst[k] = mask;
+				}
+
+				if (depthDst)
+				{
+					depthDst[k] = depth;
+				}
+			}
+		}
+	};
+
+	template <class Sink>
+	void resolveFullField(const DepthSpacePoint* depthCoordinates, int count, Sink& sink)
+	{
+		const float* src = reinterpret_cast<const float*>(depthCoordinates);
+
+		for (int i = 0; i < count; i += 4)
+		{
+			// X0 Y0 X1 Y1 | X2 Y2 X3 Y3
+			__m128 a = _mm_loadu_ps(src + 2 * i);
+			__m128 b = _mm_loadu_ps(src + 2 * i + 4);
+			sink(i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+	}
+};
+
 MaskStage::MaskStage() :
 mDeviceSrc(NULL),
 mBodyDataSrc(NULL),
@@ -13,13 +88,72 @@ depthFrame(NULL),
 bodyIndexFrame(NULL),
 depthFrameRef(NULL),
 bodyIndexFrameRef(NULL),
+mBufferPool(NULL),
 mDepthCoordinates(NULL),
-mMaskBuffer(NULL),
-maskTextureName(0),
-mHasMaskData(false)
+mFieldMode(COORDINATE_FIELD_FULL),
+mFieldStep(4),
+mFieldValidationInterval(0),
+mFramesSinceValidation(0),
+mHoleFillingEnabled(false),
+mMorphologyOpenRadius(3),
+mMorphologyBlurSize(11),
+mDistanceFieldEnabled(false),
+mDistanceFieldDownsample(4),
+mDistanceFieldWidth(0),
+mDistanceFieldHeight(0),
+mDistanceFieldMask(NULL),
+mDistanceBack(0),
+mDistancePending(1),
+mDistanceFront(2),
+mHasNewDistanceField(false),
+mHasDistanceField(false),
+distanceTextureName(0),
+mSilhouetteEnabled(false),
+mSilhouetteDownsample(4),
+mSilhouetteWidth(0),
+mSilhouetteHeight(0),
+mSilhouetteMask(NULL),
+mSilhouetteBack(0),
+mSilhouettePending(1),
+mSilhouetteFront(2),
+mHasNewSilhouette(false),
+mHasPublishedSilhouette(false),
+mPerformanceFrequency(0),
+mRegisteredDepthEnabled(false),
+mRegisteredDepthDownsample(1),
+mRegisteredDepthWidth(0),
+mRegisteredDepthHeight(0),
+mRegisteredDepthFull(NULL),
+mRegisteredDepthBack(0),
+mRegisteredDepthPending(1),
+mRegisteredDepthFront(2),
+mHasNewRegisteredDepth(false),
+mHasRegisteredDepth(false),
+registeredDepthTextureName(0),
+mMaskBuffer(NULL)
 {
-	//mLatestMaskData.hasMask = false;
-	//mLatestMaskData.maskBuffer = NULL;
+	mLatestMaskData.hasMask = false;
+	mLatestMaskData.maskBuffer = NULL;
+	memset(&mFieldStats, 0, sizeof(mFieldStats));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		mDistanceBuffers[i] = NULL;
+		mClampedDistanceBuffers[i] = NULL;
+
+		mSilhouettes[i].frameId = 0;
+		mSilhouettes[i].traceMilliseconds = 0;
+		mSilhouettes[i].hasSilhouette = false;
+
+		mRegisteredDepthBuffers[i] = NULL;
+		mRegisteredDepthFrameIds[i] = 0;
+	}
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart) / 1000.0;
+	}
 }
 
 MaskStage::~MaskStage() { }
@@ -29,67 +163,231 @@ void MaskStage::setup()
 	int depthFrameArea = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
 	int colorFrameArea = DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight;
 
-	mDepthCoordinates = new DepthSpacePoint[colorFrameArea];
+	if (!mBufferPool)
+	{
+		mBufferPool = BufferPoolRef(new BufferPool());
+	}
 
-	mMaskBuffer = new BYTE[colorFrameArea * MASK_SIZE ];
-	memset(mMaskBuffer, 0, colorFrameArea * MASK_SIZE);
+	// the full field is only needed in full mode, or to validate the sparse one
+	if (mFieldMode == COORDINATE_FIELD_FULL || mFieldValidationInterval > 0)
+	{
+		mDepthCoordinatesLease = mBufferPool->acquire(IMAGE_FORMAT_DEPTH_POINT, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight);
+		mDepthCoordinates = mDepthCoordinatesLease ? mDepthCoordinatesLease->as<DepthSpacePoint>() : NULL;
+	}
 
-	glGenTextures(1, &maskTextureName);
-	glBindTexture(GL_TEXTURE_2D, maskTextureName);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, DeviceStage::ColorFrameWidth);
+	if (mFieldMode == COORDINATE_FIELD_SPARSE)
+	{
+		mSparseField.allocate(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, DeviceStage::DepthFrameWidth, DeviceStage::DepthFrameHeight, mFieldStep);
+	}
 
-	if (mMaskBuffer)
+	if (mHoleFillingEnabled)
 	{
-		mMaskDataMutex.lock();
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, 0, GL_RED, GL_UNSIGNED_BYTE, mMaskBuffer);
-		mMaskDataMutex.unlock();
+		mHoleFiller.allocate(DeviceStage::DepthFrameWidth, DeviceStage::DepthFrameHeight);
 	}
-	else
+
+	mMaskImages.setBufferPool(mBufferPool);
+	mMaskImages.allocate(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, IMAGE_FORMAT_GRAY);
+	mMaskBuffer = mMaskImages.acquireBuffer();
+
+	mMaskStream.allocate(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, GL_R8, GL_RED, GL_UNSIGNED_BYTE, MASK_SIZE);
+
+	if (mDistanceFieldEnabled)
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+		mDistanceFieldWidth = DeviceStage::ColorFrameWidth / mDistanceFieldDownsample;
+		mDistanceFieldHeight = DeviceStage::ColorFrameHeight / mDistanceFieldDownsample;
+		int distanceFieldArea = mDistanceFieldWidth * mDistanceFieldHeight;
+
+		mDistanceTransform.allocate(mDistanceFieldWidth, mDistanceFieldHeight);
+		mDistanceFieldMask = new BYTE[distanceFieldArea];
+
+		for (int i = 0; i < 3; ++i)
+		{
+			mDistanceBuffers[i] = new float[distanceFieldArea];
+			mClampedDistanceBuffers[i] = new BYTE[distanceFieldArea];
+			memset(mClampedDistanceBuffers[i], 255, distanceFieldArea);
+		}
+
+		glGenTextures(1, &distanceTextureName);
+		glBindTexture(GL_TEXTURE_2D, distanceTextureName);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, mDistanceFieldWidth, mDistanceFieldHeight, 0, GL_RED, GL_UNSIGNED_BYTE, mClampedDistanceBuffers[mDistanceFront]);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		mDistanceTextureRef = ci::gl::Texture::create(GL_TEXTURE_2D, distanceTextureName, mDistanceFieldWidth, mDistanceFieldHeight, true);
+	}
+
+	if (mSilhouetteEnabled)
+	{
+		mSilhouetteWidth = DeviceStage::ColorFrameWidth / mSilhouetteDownsample;
+		mSilhouetteHeight = DeviceStage::ColorFrameHeight / mSilhouetteDownsample;
+
+		mContourTracer.allocate(mSilhouetteWidth, mSilhouetteHeight);
+		mSilhouetteMask = new BYTE[mSilhouetteWidth * mSilhouetteHeight];
+
+		for (int i = 0; i < 3; ++i)
+		{
+			mSilhouettes[i].points.reserve(2048);
+			mSilhouettes[i].contours.reserve(64);
+		}
 	}
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	if (mRegisteredDepthEnabled)
+	{
+		mRegisteredDepthWidth = DeviceStage::ColorFrameWidth / mRegisteredDepthDownsample;
+		mRegisteredDepthHeight = DeviceStage::ColorFrameHeight / mRegisteredDepthDownsample;
+		int registeredDepthArea = mRegisteredDepthWidth * mRegisteredDepthHeight;
+
+		if (mRegisteredDepthDownsample > 1)
+		{
+			mRegisteredDepthFull = new UINT16[colorFrameArea];
+		}
+
+		for (int i = 0; i < 3; ++i)
+		{
+			mRegisteredDepthBuffers[i] = new UINT16[registeredDepthArea];
+			memset(mRegisteredDepthBuffers[i], 0, registeredDepthArea * sizeof(UINT16));
+		}
+
+		glGenTextures(1, &registeredDepthTextureName);
+		glBindTexture(GL_TEXTURE_2D, registeredDepthTextureName);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, mRegisteredDepthWidth, mRegisteredDepthHeight, 0, GL_RED, GL_UNSIGNED_SHORT, mRegisteredDepthBuffers[mRegisteredDepthFront]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		mRegisteredDepthTextureRef = ci::gl::Texture::create(GL_TEXTURE_2D, registeredDepthTextureName, mRegisteredDepthWidth, mRegisteredDepthHeight, true);
+	}
 }
 
 void MaskStage::teardown()
 {
-	if (mMaskBuffer)
+	mMaskBuffer = NULL;
+	mMaskImages.release();
+
+	mDepthCoordinates = NULL;
+	mDepthCoordinatesLease.reset();
+
+	mSparseField.release();
+	mHoleFiller.release();
+	mDistanceTransform.release();
+
+	if (mDistanceFieldMask)
 	{
-		delete[] mMaskBuffer;
-		mMaskBuffer = NULL;
+		delete[] mDistanceFieldMask;
+		mDistanceFieldMask = NULL;
 	}
 
-	if (mDepthCoordinates)
+	for (int i = 0; i < 3; ++i)
 	{
-		delete[] mDepthCoordinates;
-		mDepthCoordinates = NULL;
+		if (mDistanceBuffers[i])
+		{
+			delete[] mDistanceBuffers[i];
+			mDistanceBuffers[i] = NULL;
+		}
+
+		if (mClampedDistanceBuffers[i])
+		{
+			delete[] mClampedDistanceBuffers[i];
+			mClampedDistanceBuffers[i] = NULL;
+		}
+	}
+
+	mDistanceTextureRef.reset();
+
+	mContourTracer.release();
+
+	if (mSilhouetteMask)
+	{
+		delete[] mSilhouetteMask;
+		mSilhouetteMask = NULL;
+	}
+
+	if (mRegisteredDepthFull)
+	{
+		delete[] mRegisteredDepthFull;
+		mRegisteredDepthFull = NULL;
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		if (mRegisteredDepthBuffers[i])
+		{
+			delete[] mRegisteredDepthBuffers[i];
+			mRegisteredDepthBuffers[i] = NULL;
+		}
+	}
+
+	mRegisteredDepthTextureRef.reset();
+
+	if (registeredDepthTextureName)
+	{
+		glDeleteTextures(1, &registeredDepthTextureName);
+		registeredDepthTextureName = 0;
 	}
 
-	glDeleteTextures(1, &maskTextureName);
+	if (distanceTextureName)
+	{
+		glDeleteTextures(1, &distanceTextureName);
+		distanceTextureName = 0;
+	}
+
+	mMaskStream.release();
 }
 
 void MaskStage::update()
 {
-	if (mHasMaskData)
+	mMaskStream.update();
+
+	if (mHasNewDistanceField)
 	{
-		if (glIsTexture(maskTextureName))
+		mDistanceFieldMutex.lock();
+		std::swap(mDistancePending, mDistanceFront);
+		mHasNewDistanceField = false;
+		mDistanceFieldMutex.unlock();
+
+		mHasDistanceField = true;
+
+		if (glIsTexture(distanceTextureName))
 		{
-			glBindTexture(GL_TEXTURE_2D, maskTextureName);
-			mMaskDataMutex.lock();
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, GL_RED, GL_UNSIGNED_BYTE, mMaskBuffer);
-			mMaskDataMutex.unlock();
-			mHasMaskData = false;
+			glBindTexture(GL_TEXTURE_2D, distanceTextureName);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mDistanceFieldWidth, mDistanceFieldHeight, GL_RED, GL_UNSIGNED_BYTE, mClampedDistanceBuffers[mDistanceFront]);
 			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
 
-			mMaskTextureRef = ci::gl::Texture::create(GL_TEXTURE_2D, maskTextureName, DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, true);
+	if (mHasNewSilhouette)
+	{
+		mSilhouetteMutex.lock();
+		std::swap(mSilhouettePending, mSilhouetteFront);
+		mHasNewSilhouette = false;
+		mSilhouetteMutex.unlock();
+	}
+
+	if (mHasNewRegisteredDepth)
+	{
+		mRegisteredDepthMutex.lock();
+		std::swap(mRegisteredDepthPending, mRegisteredDepthFront);
+		mHasNewRegisteredDepth = false;
+		mRegisteredDepthMutex.unlock();
+
+		mHasRegisteredDepth = true;
 
+		if (glIsTexture(registeredDepthTextureName))
+		{
+			glBindTexture(GL_TEXTURE_2D, registeredDepthTextureName);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mRegisteredDepthWidth, mRegisteredDepthHeight, GL_RED, GL_UNSIGNED_SHORT, mRegisteredDepthBuffers[mRegisteredDepthFront]);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glBindTexture(GL_TEXTURE_2D, 0);
 		}
 	}
 	
@@ -109,19 +407,30 @@ void MaskStage::update()
 HRESULT MaskStage::thread_process()
 {
 	HRESULT hr = S_OK;
-	//mLatestMaskData.hasMask = false;
-	//mLatestMaskData.maskBuffer = NULL;
+	mLatestMaskData.hasMask = false;
+	mLatestMaskData.maskBuffer = NULL;
 	
 	IMultiSourceFrame* multiSourceFrame = mDeviceSrc->getLatestFrame();
 	ICoordinateMapper* coordinateMapper = mDeviceSrc->getCoordinateMapper();
 	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+	bool hasUser = bodyData.hasActiveUser;
 
-	if (!bodyData.hasActiveUser)
+	if (!hasUser)
 	{
-		hr = E_FAIL;
-		//mLatestMaskData.hasMask = false;
-		//mLatestMaskData.maskBuffer = NULL;
+		// registered depth doesn't depend on the user, the pass still runs for it
+		if (!mRegisteredDepthEnabled)
+		{
+			hr = E_FAIL;
+		}
+
 		mHasMaskTextureRef = false;
+		mHasDistanceField = false;
+
+		if (mSilhouetteEnabled)
+		{
+			// publish an empty outline once, so consumers see the user leave
+			this->traceSilhouette(mDeviceSrc->getLatestFrameId(), false);
+		}
 	}
 
 	if (multiSourceFrame == NULL || coordinateMapper == NULL)
@@ -155,18 +464,28 @@ HRESULT MaskStage::thread_process()
 	if (SUCCEEDED(hr))
 	{
 		UINT depthBufferSize = 0;
-		UINT16* depthBuffer = NULL;
+		UINT16* rawDepthBuffer = NULL;
 		UINT bodyIndexBufferSize = 0;
-		BYTE* bodyIndexBuffer = NULL;
+		BYTE* rawBodyIndexBuffer = NULL;
 
 		if (SUCCEEDED(hr))
 		{
-			hr = depthFrame->AccessUnderlyingBuffer(&depthBufferSize, &depthBuffer);
+			hr = depthFrame->AccessUnderlyingBuffer(&depthBufferSize, &rawDepthBuffer);
 		}
 
 		if (SUCCEEDED(hr))
 		{
-			hr = bodyIndexFrame->AccessUnderlyingBuffer(&bodyIndexBufferSize, &bodyIndexBuffer);
+			hr = bodyIndexFrame->AccessUnderlyingBuffer(&bodyIndexBufferSize, &rawBodyIndexBuffer);
+		}
+
+		const UINT16* depthBuffer = rawDepthBuffer;
+		const BYTE* bodyIndexBuffer = rawBodyIndexBuffer;
+
+		if (SUCCEEDED(hr) && mHoleFillingEnabled)
+		{
+			mHoleFiller.fill(rawDepthBuffer, rawBodyIndexBuffer);
+			depthBuffer = mHoleFiller.getDepthBuffer();
+			bodyIndexBuffer = mHoleFiller.getBodyIndexBuffer();
 		}
 
 		if (SUCCEEDED(hr))
@@ -181,62 +500,89 @@ HRESULT MaskStage::thread_process()
 			// look into OpenCV API: surely non-contiguous processing is expensive
 			// but looping for channel ricombination? is there a faster way?
 
-			int depthX = 0;
-			int depthY = 0;
-			BYTE player = 0;
-			BYTE* src = NULL;
-			BYTE* src1 = NULL;
-			BYTE* src2 = NULL;
-			BYTE* src3 = NULL;
-
-			if (coordinateMapper && mDepthCoordinates && depthBuffer && mMaskBuffer && bodyIndexBuffer)
+			if (coordinateMapper && depthBuffer && mMaskBuffer && bodyIndexBuffer)
 			{
-				hr = coordinateMapper->MapColorFrameToDepthSpace(DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight, depthBuffer, DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight, mDepthCoordinates);
+				hr = this->mapCoordinateField(coordinateMapper, depthBuffer);
 
 				if (SUCCEEDED(hr))
 				{
-					mMaskDataMutex.lock();
-
-					for (register int i = 0; i < (DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight); ++i)
+					// a buffer no consumer holds a view of, written in full by the resolve
+					if (hasUser)
 					{
-						src = mMaskBuffer + i;
+						mMaskBuffer = mMaskImages.acquireBuffer();
+					}
 
-						*src = 0;
+					MaskSink sink;
+					sink.bodyIndexBuffer = bodyIndexBuffer;
+					sink.depthBuffer = depthBuffer;
+					sink.maskBuffer = hasUser ? mMaskBuffer : NULL;
+					sink.registeredDepth = NULL;
+					sink.activeBodyIndex = static_cast<BYTE>(bodyData.activeBodyIndex);
 
-						DepthSpacePoint p = mDepthCoordinates[i];
+					if (mRegisteredDepthEnabled)
+					{
+						sink.registeredDepth = mRegisteredDepthFull ? mRegisteredDepthFull : mRegisteredDepthBuffers[mRegisteredDepthBack];
+					}
 
-						if (p.X != -std::numeric_limits<float>::infinity() && p.Y != -std::numeric_limits<float>::infinity())
-						{
-							depthX = static_cast<int>(p.X + 0.5f);
-							depthY = static_cast<int>(p.Y + 0.5f);
-
-							if ((depthX >= 0 && depthX < DeviceStage::DepthFrameWidth) && (depthY >= 0 && depthY < DeviceStage::DepthFrameHeight))
-							{
-								player = bodyIndexBuffer[depthX + (depthY * DeviceStage::DepthFrameWidth)];
-
-								if (player == bodyData.activeBodyIndex)
-								{
-									*src = 255;
-								}
-							}
-						}
+					if (mFieldMode == COORDINATE_FIELD_SPARSE)
+					{
+						mSparseField.resolve(sink);
+					}
+					else
+					{
+						resolveFullField(mDepthCoordinates, DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight, sink);
 					}
 
 #ifdef NDEBUG
-					Mat maskMat;
-					maskMat = Mat(Size(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight), CV_8UC1, mMaskBuffer);
-					Mat element = getStructuringElement(MORPH_RECT, Size(3 * 2 + 1, 3 * 2 + 1), Point(-1, 1));
-					morphologyEx(maskMat, maskMat, MORPH_OPEN, element);
-					//morphologyEx(src, dst, MORPH_CLOSE, element);
-					blur(maskMat, maskMat, Size(11, 11));
+					if (hasUser)
+					{
+						Mat maskMat;
+						maskMat = Mat(Size(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight), CV_8UC1, mMaskBuffer);
+						if (mMorphologyOpenRadius > 0)
+						{
+							Mat element = getStructuringElement(MORPH_RECT, Size(mMorphologyOpenRadius * 2 + 1, mMorphologyOpenRadius * 2 + 1), Point(-1, 1));
+							morphologyEx(maskMat, maskMat, MORPH_OPEN, element);
+						}
+						//morphologyEx(src, dst, MORPH_CLOSE, element);
+						if (mMorphologyBlurSize > 1)
+						{
+							blur(maskMat, maskMat, Size(mMorphologyBlurSize, mMorphologyBlurSize));
+						}
+					}
 #endif
 
-					//mLatestMaskData.hasMask = true;
-					//mLatestMaskData.maskBuffer = mMaskBuffer;
+					if (mRegisteredDepthEnabled)
+					{
+						this->publishRegisteredDepth(mDeviceSrc->getLatestFrameId());
+					}
+
+					if (hasUser)
+					{
+						mMaskImages.publish(mDeviceSrc->getLatestFrameId());
+
+						// copied once into a mapped upload buffer, skipped while the app thread is behind
+						void* uploadBuffer = mMaskStream.beginWrite();
+						if (uploadBuffer)
+						{
+							memcpy(uploadBuffer, mMaskBuffer, mMaskStream.getFrameSize());
+							mMaskStream.endWrite();
+						}
+
+						mHasMaskTextureRef = true;
+						mLatestMaskData.hasMask = true;
+						mLatestMaskData.maskBuffer = mMaskBuffer;
+
+						// only this thread writes the mask, reading it unlocked is fine
+						if (mDistanceFieldEnabled)
+						{
+							this->computeDistanceField();
+						}
 
-					mMaskDataMutex.unlock();
-					mHasMaskData = true;
-					mHasMaskTextureRef = true;
+						if (mSilhouetteEnabled)
+						{
+							this->traceSilhouette(mDeviceSrc->getLatestFrameId(), true);
+						}
+					}
 				}
 			}
 
@@ -246,14 +592,203 @@ HRESULT MaskStage::thread_process()
 	return hr;
 }
 
-//void MaskStage::invalidateLatestMaskBuffer()
-//{
-//	mLatestMaskData.hasMask = false;
-//	mLatestMaskData.maskBuffer = NULL;
-//}
+ImageViewRef MaskStage::tryGetLatestImage()
+{
+	return mMaskImages.tryGetLatest();
+}
+
+ImageViewRef MaskStage::waitForNewerImage(UINT64 frameId, DWORD timeoutMilliseconds)
+{
+	return mMaskImages.waitForNewer(frameId, timeoutMilliseconds);
+}
+
+void MaskStage::invalidateLatestMaskBuffer()
+{
+	mLatestMaskData.hasMask = false;
+	mLatestMaskData.maskBuffer = NULL;
+}
+
+/*
+* Point samples the (refined) color mask down to the field resolution,
+* transforms it and publishes the result to the app thread
+*/
+void MaskStage::computeDistanceField()
+{
+	if (!mDistanceFieldMask || !mDistanceBuffers[mDistanceBack])
+	{
+		return;
+	}
+
+	this->downsampleMask(mDistanceFieldMask, mDistanceFieldDownsample, mDistanceFieldWidth, mDistanceFieldHeight);
+	mDistanceTransform.compute(mDistanceFieldMask, mDistanceBuffers[mDistanceBack], mClampedDistanceBuffers[mDistanceBack]);
+
+	mDistanceFieldMutex.lock();
+	std::swap(mDistanceBack, mDistancePending);
+	mHasNewDistanceField = true;
+	mDistanceFieldMutex.unlock();
+}
+
+/*
+* Traces the outline of the downsampled mask, in color frame pixels
+* Without an active user an empty silhouette is published, but only once
+*/
+void MaskStage::traceSilhouette(UINT64 frameId, bool hasUser)
+{
+	if (!mSilhouetteMask)
+	{
+		return;
+	}
+
+	if (!hasUser && !mHasPublishedSilhouette)
+	{
+		return;
+	}
+
+	SilhouetteData& silhouette = mSilhouettes[mSilhouetteBack];
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER end = { 0 };
+	QueryPerformanceCounter(&start);
+
+	silhouette.points.clear();
+	silhouette.contours.clear();
+
+	if (hasUser)
+	{
+		this->downsampleMask(mSilhouetteMask, mSilhouetteDownsample, mSilhouetteWidth, mSilhouetteHeight);
+		float scale = static_cast<float>(mSilhouetteDownsample);
+		mContourTracer.trace(mSilhouetteMask, scale, scale * 0.5f, silhouette.points, silhouette.contours);
+	}
+
+	QueryPerformanceCounter(&end);
+
+	silhouette.frameId = frameId;
+	silhouette.hasSilhouette = hasUser;
+	mHasPublishedSilhouette = hasUser;
+	silhouette.traceMilliseconds = (mPerformanceFrequency > 0) ? double(end.QuadPart - start.QuadPart) / mPerformanceFrequency : 0;
+
+	mSilhouetteMutex.lock();
+	std::swap(mSilhouetteBack, mSilhouettePending);
+	mHasNewSilhouette = true;
+	mSilhouetteMutex.unlock();
+}
+
+/*
+* Point samples the full resolution pass output into the back buffer when downsampling,
+* then hands the back buffer to the app thread
+*/
+void MaskStage::publishRegisteredDepth(UINT64 frameId)
+{
+	UINT16* dst = mRegisteredDepthBuffers[mRegisteredDepthBack];
+
+	if (!dst)
+	{
+		return;
+	}
+
+	if (mRegisteredDepthFull)
+	{
+		int downsample = mRegisteredDepthDownsample;
+		int offset = downsample / 2;
+
+		for (int y = 0; y < mRegisteredDepthHeight; ++y)
+		{
+			const UINT16* src = mRegisteredDepthFull + (y * downsample + offset) * DeviceStage::ColorFrameWidth + offset;
+			UINT16* row = dst + y * mRegisteredDepthWidth;
+
+			for (int x = 0; x < mRegisteredDepthWidth; ++x)
+			{
+				row[x] = src[x * downsample];
+			}
+		}
+	}
+
+	mRegisteredDepthFrameIds[mRegisteredDepthBack] = frameId;
+
+	mRegisteredDepthMutex.lock();
+	std::swap(mRegisteredDepthBack, mRegisteredDepthPending);
+	mHasNewRegisteredDepth = true;
+	mRegisteredDepthMutex.unlock();
+}
+
+/*
+* Point samples the (refined) color mask, thresholded at 128, to a width x height plane
+*/
+void MaskStage::downsampleMask(BYTE* dst, int downsample, int width, int height)
+{
+	int offset = downsample / 2;
+
+	for (int y = 0; y < height; ++y)
+	{
+		const BYTE* src = mMaskBuffer + (y * downsample + offset) * DeviceStage::ColorFrameWidth + offset;
+		BYTE* row = dst + y * width;
+
+		for (int x = 0; x < width; ++x)
+		{
+			row[x] = (src[x * downsample] >= 128) ? 1 : 0;
+		}
+	}
+}
+
+HRESULT MaskStage::mapCoordinateField(ICoordinateMapper* coordinateMapper, const UINT16* depthBuffer)
+{
+	HRESULT hr = S_OK;
+	const UINT depthFrameArea = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
+	const UINT colorFrameArea = DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight;
+
+	if (mFieldMode == COORDINATE_FIELD_FULL)
+	{
+		if (!mDepthCoordinates)
+		{
+			return E_FAIL;
+		}
+
+		hr = coordinateMapper->MapColorFrameToDepthSpace(depthFrameArea, depthBuffer, colorFrameArea, mDepthCoordinates);
+
+		if (SUCCEEDED(hr))
+		{
+			mFieldStatsMutex.lock();
+			mFieldStats.mappedPoints = colorFrameArea;
+			mFieldStatsMutex.unlock();
+		}
+
+		return hr;
+	}
+
+	hr = mSparseField.build(coordinateMapper, depthBuffer);
+
+	if (SUCCEEDED(hr))
+	{
+		CoordinateFieldStats stats;
+		mFieldStatsMutex.lock();
+		stats = mFieldStats;
+		mFieldStatsMutex.unlock();
+
+		stats.mappedPoints = mSparseField.getMappedPoints();
+
+		if (mFieldValidationInterval > 0 && mDepthCoordinates && ++mFramesSinceValidation >= mFieldValidationInterval)
+		{
+			mFramesSinceValidation = 0;
+
+			if (SUCCEEDED(coordinateMapper->MapColorFrameToDepthSpace(depthFrameArea, depthBuffer, colorFrameArea, mDepthCoordinates)))
+			{
+				mSparseField.measureError(mDepthCoordinates, stats);
+				stats.mappedPoints += colorFrameArea;
+			}
+		}
+
+		mFieldStatsMutex.lock();
+		mFieldStats = stats;
+		mFieldStatsMutex.unlock();
+	}
+
+	return hr;
+}
 
 HRESULT MaskStage::post_thread_process()
 {
+	this->invalidateLatestMaskBuffer();
+
 	__safe_release(depthFrame);
 	__safe_release(bodyIndexFrame);
 	__safe_release(depthFrameRef);
@@ -272,15 +807,121 @@ void MaskStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
 	mBodyDataSrc = bodyDataSrc;
 }
 
-//MaskData MaskStage::getLatestMaskBuffer()
-//{
-//	return mLatestMaskData;
-//}
+MaskData MaskStage::getLatestMaskBuffer()
+{
+	return mLatestMaskData;
+}
+
+void MaskStage::setCoordinateFieldMode(CoordinateFieldMode mode, int sparseStep)
+{
+	mFieldMode = mode;
+	mFieldStep = sparseStep;
+}
+
+void MaskStage::setCoordinateFieldValidationInterval(UINT frames)
+{
+	mFieldValidationInterval = frames;
+}
+
+void MaskStage::setHoleFilling(bool enabled, int iterations)
+{
+	mHoleFillingEnabled = enabled;
+	mHoleFiller.setIterations(iterations);
+}
+
+void MaskStage::setMaskMorphology(int openRadius, int blurSize)
+{
+	mMorphologyOpenRadius = openRadius;
+	mMorphologyBlurSize = blurSize;
+}
+
+void MaskStage::setDistanceField(bool enabled, int downsample, float maxDistance, bool useRoi)
+{
+	mDistanceFieldEnabled = enabled;
+	mDistanceFieldDownsample = std::max(1, downsample);
+	mDistanceTransform.setMaxDistance(maxDistance);
+	mDistanceTransform.setUseRegionOfInterest(useRoi);
+}
+
+DistanceFieldData MaskStage::getLatestDistanceField()
+{
+	DistanceFieldData data;
+	data.distance = mDistanceBuffers[mDistanceFront];
+	data.clampedDistance = mClampedDistanceBuffers[mDistanceFront];
+	data.width = mDistanceFieldWidth;
+	data.height = mDistanceFieldHeight;
+	data.downsample = mDistanceFieldDownsample;
+	data.maxDistance = mDistanceTransform.getMaxDistance();
+	data.hasDistanceField = mHasDistanceField && mDistanceFieldEnabled;
+	return data;
+}
+
+ci::gl::TextureRef MaskStage::getDistanceTextureReference()
+{
+	if (mHasDistanceField)
+		return mDistanceTextureRef;
+	else
+		return NULL;
+}
+
+void MaskStage::setSilhouette(bool enabled, int downsample, float tolerance, UINT minBorderLength)
+{
+	mSilhouetteEnabled = enabled;
+	mSilhouetteDownsample = std::max(1, downsample);
+	mContourTracer.setTolerance(tolerance);
+	mContourTracer.setMinimumBorderLength(minBorderLength);
+}
+
+const SilhouetteData& MaskStage::getLatestSilhouette()
+{
+	return mSilhouettes[mSilhouetteFront];
+}
+
+void MaskStage::setRegisteredDepth(bool enabled, int downsample)
+{
+	mRegisteredDepthEnabled = enabled;
+	mRegisteredDepthDownsample = std::max(1, downsample);
+}
+
+RegisteredDepthData MaskStage::getLatestRegisteredDepth()
+{
+	RegisteredDepthData data;
+	data.frameId = mRegisteredDepthFrameIds[mRegisteredDepthFront];
+	data.depth = mRegisteredDepthBuffers[mRegisteredDepthFront];
+	data.width = mRegisteredDepthWidth;
+	data.height = mRegisteredDepthHeight;
+	data.downsample = mRegisteredDepthDownsample;
+	data.hasRegisteredDepth = mHasRegisteredDepth && mRegisteredDepthEnabled;
+	return data;
+}
+
+ci::gl::TextureRef MaskStage::getRegisteredDepthTextureReference()
+{
+	if (mHasRegisteredDepth)
+		return mRegisteredDepthTextureRef;
+	else
+		return NULL;
+}
+
+CoordinateFieldStats MaskStage::getCoordinateFieldStats()
+{
+	mFieldStatsMutex.lock();
+	CoordinateFieldStats stats = mFieldStats;
+	mFieldStatsMutex.unlock();
+
+	if (mFieldMode == COORDINATE_FIELD_SPARSE)
+	{
+		stats.totalCells = mSparseField.getTotalCells();
+		stats.refinedCells = mSparseField.getRefinedCells();
+	}
+
+	return stats;
+}
 
 ci::gl::TextureRef MaskStage::getTextureReference()
 {
-	if (mHasMaskTextureRef)
-		return mMaskTextureRef;
+	if (mHasMaskTextureRef && mMaskStream.hasFrame())
+		return mMaskStream.getTextureReference();
 	else
 		return NULL;
 }
\ No newline at end of file
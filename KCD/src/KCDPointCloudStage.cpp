@@ -0,0 +1,437 @@
+#include "KCDPointCloudStage.h"
+#include "KCDDeviceStage.h"
+#include <emmintrin.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace kcd;
+
+#define POINT_CLOUD_VOXEL_OFFSET (1 << 20) // cells, keeps voxel coordinates positive so truncation floors
+#define POINT_CLOUD_VOXEL_MASK 0x1FFFFFu
+
+PointCloudStage::PointCloudStage() :
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mColorBufferSrc(NULL),
+mDepthFrameRef(NULL),
+mDepthFrame(NULL),
+mBodyIndexFrameRef(NULL),
+mBodyIndexFrame(NULL),
+mFront(0),
+mHasPointCloud(false),
+mHasNewPointCloud(false),
+mVoxelStamp(0),
+mVertexBuffer(0),
+mVertexBufferCount(0),
+mVertexBufferRequested(false),
+mPerformanceFrequency(0),
+mProcessMicroseconds(0)
+{
+	const int depthFrameArea = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		mBuffers[i].resize(depthFrameArea);
+		mCounts[i] = 0;
+		mFrameIds[i] = 0;
+	}
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+PointCloudStage::~PointCloudStage() { }
+
+void PointCloudStage::teardown()
+{
+	if (mVertexBuffer)
+	{
+		glDeleteBuffers(1, &mVertexBuffer);
+		mVertexBuffer = 0;
+	}
+}
+
+void PointCloudStage::update()
+{
+	if (!mVertexBufferRequested || !mHasNewPointCloud)
+	{
+		return;
+	}
+
+	if (mVertexBuffer == 0)
+	{
+		glGenBuffers(1, &mVertexBuffer);
+	}
+
+	// one upload of the whole front buffer, the previous storage is orphaned
+	mFrontMutex.lock();
+	glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mCounts[mFront] * sizeof(PointCloudVertex), mCounts[mFront] ? &mBuffers[mFront][0] : NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mVertexBufferCount = mCounts[mFront];
+	mHasNewPointCloud = false;
+	mFrontMutex.unlock();
+}
+
+HRESULT PointCloudStage::thread_process()
+{
+	HRESULT hr = S_OK;
+
+	IMultiSourceFrame* multiSourceFrame = mDeviceSrc->getLatestFrame();
+	const SoftwareMapper* mapper = mDeviceSrc->getSoftwareMapper();
+
+	mParamsMutex.lock();
+	PointCloudParams params = mParams;
+	mParamsMutex.unlock();
+
+	if (multiSourceFrame == NULL || mapper == NULL)
+	{
+		hr = E_FAIL;
+	}
+
+	mDepthFrameRef = NULL;
+	mDepthFrame = NULL;
+	mBodyIndexFrameRef = NULL;
+	mBodyIndexFrame = NULL;
+
+	int activeBody = -1;
+
+	if (SUCCEEDED(hr) && params.filter == POINT_CLOUD_ACTIVE_USER)
+	{
+		BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+		activeBody = (bodyData.hasActiveUser && bodyData.activeBodyIndex < BODY_COUNT) ? static_cast<int>(bodyData.activeBodyIndex) : BODY_COUNT;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = multiSourceFrame->get_DepthFrameReference(&mDepthFrameRef);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mDepthFrameRef->AcquireFrame(&mDepthFrame);
+	}
+
+	// the body index frame only when filtering
+	if (SUCCEEDED(hr) && params.filter != POINT_CLOUD_ALL)
+	{
+		hr = multiSourceFrame->get_BodyIndexFrameReference(&mBodyIndexFrameRef);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = mBodyIndexFrameRef->AcquireFrame(&mBodyIndexFrame);
+		}
+	}
+
+	UINT depthBufferSize = 0;
+	UINT16* depthBuffer = NULL;
+	UINT bodyIndexBufferSize = 0;
+	BYTE* bodyIndexBuffer = NULL;
+
+	if (SUCCEEDED(hr))
+	{
+		hr = mDepthFrame->AccessUnderlyingBuffer(&depthBufferSize, &depthBuffer);
+	}
+
+	if (SUCCEEDED(hr) && mBodyIndexFrame)
+	{
+		hr = mBodyIndexFrame->AccessUnderlyingBuffer(&bodyIndexBufferSize, &bodyIndexBuffer);
+	}
+
+	const UINT depthFrameArea = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
+
+	if (SUCCEEDED(hr) && (depthBufferSize < depthFrameArea || (bodyIndexBuffer && bodyIndexBufferSize < depthFrameArea)))
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr) && (mapper->getCalibration().depthWidth != DeviceStage::DepthFrameWidth || mapper->getCalibration().depthHeight != DeviceStage::DepthFrameHeight))
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		LARGE_INTEGER start = { 0 };
+		LARGE_INTEGER end = { 0 };
+		QueryPerformanceCounter(&start);
+
+		const BYTE* colorBuffer = mColorBufferSrc ? mColorBufferSrc->getLatestColorBuffer() : NULL;
+		int back = 1 - mFront;
+		PointCloudVertex* vertices = &mBuffers[back][0];
+
+		// the back buffer is only touched here, the app thread reads the front one
+		UINT count = this->extract(depthBuffer, bodyIndexBuffer, colorBuffer, params, activeBody, vertices);
+
+		if (params.voxelSize > 0)
+		{
+			count = this->downsample(vertices, count, params.voxelSize);
+		}
+
+		mCounts[back] = count;
+		mFrameIds[back] = mDeviceSrc->getLatestFrameId();
+
+		mFrontMutex.lock();
+		mFront = back;
+		mHasPointCloud = true;
+		mHasNewPointCloud = true;
+		mFrontMutex.unlock();
+
+		QueryPerformanceCounter(&end);
+		mProcessMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+	}
+
+	return hr;
+}
+
+HRESULT PointCloudStage::post_thread_process()
+{
+	__safe_release(mDepthFrame);
+	__safe_release(mBodyIndexFrame);
+	__safe_release(mDepthFrameRef);
+	__safe_release(mBodyIndexFrameRef);
+
+	return S_OK;
+}
+
+/*
+* Four depth pixels per step: depth range and body index tested as one lane mask, camera and color space
+* positions from the mapper tables, then the surviving lanes are written out packed
+*/
+UINT PointCloudStage::extract(const UINT16* depthBuffer, const BYTE* bodyIndexBuffer, const BYTE* colorBuffer, const PointCloudParams& params, int activeBody, PointCloudVertex* vertices)
+{
+	const SoftwareMapper* mapper = mDeviceSrc->getSoftwareMapper();
+	const float* rayX = mapper->getRayX();
+	const float* rayY = mapper->getRayY();
+	const float* colorU = mapper->getColorU();
+	const float* colorV = mapper->getColorV();
+	const float* colorW = mapper->getColorW();
+	const float* projection = mapper->getCalibration().colorProjection;
+
+	const int area = DeviceStage::DepthFrameWidth * DeviceStage::DepthFrameHeight;
+	const int colorWidth = DeviceStage::ColorFrameWidth;
+	const int colorHeight = DeviceStage::ColorFrameHeight;
+
+	const __m128 minDepth = _mm_set1_ps(params.minDepth);
+	const __m128 maxDepth = _mm_set1_ps(params.maxDepth);
+	const __m128 scale = _mm_set1_ps(0.001f);
+	const __m128 p3 = _mm_set1_ps(projection[3]);
+	const __m128 p7 = _mm_set1_ps(projection[7]);
+	const __m128 p11 = _mm_set1_ps(projection[11]);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i noBody = _mm_set1_epi32(0xFF);
+	const __m128i active = _mm_set1_epi32(activeBody);
+
+	UINT count = 0;
+
+	for (int i = 0; i < area; i += 4)
+	{
+		__m128i d = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depthBuffer + i)), zero);
+		__m128 z = _mm_mul_ps(_mm_cvtepi32_ps(d), scale);
+		__m128 keep = _mm_and_ps(_mm_cmpge_ps(z, minDepth), _mm_cmple_ps(z, maxDepth));
+
+		if (bodyIndexBuffer)
+		{
+			int packed = 0;
+			memcpy(&packed, bodyIndexBuffer + i, sizeof(packed));
+			__m128i index = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+			__m128i body = (params.filter == POINT_CLOUD_ACTIVE_USER) ? _mm_cmpeq_epi32(index, active) :
+				_mm_xor_si128(_mm_cmpeq_epi32(index, noBody), _mm_set1_epi32(-1));
+			keep = _mm_and_ps(keep, _mm_castsi128_ps(body));
+		}
+
+		int lanes = _mm_movemask_ps(keep);
+		if (lanes == 0)
+		{
+			continue;
+		}
+
+		float xs[4];
+		float ys[4];
+		float zs[4];
+		float us[4];
+		float vs[4];
+
+		__m128 w = _mm_add_ps(_mm_mul_ps(z, _mm_load_ps(colorW + i)), p11);
+		_mm_storeu_ps(xs, _mm_mul_ps(_mm_load_ps(rayX + i), z));
+		_mm_storeu_ps(ys, _mm_mul_ps(_mm_load_ps(rayY + i), z));
+		_mm_storeu_ps(zs, z);
+		_mm_storeu_ps(us, _mm_div_ps(_mm_add_ps(_mm_mul_ps(z, _mm_load_ps(colorU + i)), p3), w));
+		_mm_storeu_ps(vs, _mm_div_ps(_mm_add_ps(_mm_mul_ps(z, _mm_load_ps(colorV + i)), p7), w));
+
+		for (int k = 0; k < 4; ++k)
+		{
+			if (!(lanes & (1 << k)))
+			{
+				continue;
+			}
+
+			PointCloudVertex& vertex = vertices[count++];
+			vertex.x = xs[k];
+			vertex.y = ys[k];
+			vertex.z = zs[k];
+			vertex.r = 255;
+			vertex.g = 255;
+			vertex.b = 255;
+			vertex.a = 255;
+
+			// nearest color pixel, the color frame is BGRA
+			int u = static_cast<int>(us[k] + 0.5f);
+			int v = static_cast<int>(vs[k] + 0.5f);
+
+			if (colorBuffer && us[k] >= 0 && vs[k] >= 0 && u < colorWidth && v < colorHeight)
+			{
+				const BYTE* bgra = colorBuffer + (v * colorWidth + u) * BGRA_SIZE;
+				vertex.r = bgra[2];
+				vertex.g = bgra[1];
+				vertex.b = bgra[0];
+			}
+		}
+	}
+
+	return count;
+}
+
+/*
+* Points averaged per voxel, written back in place in the order the voxels were first hit
+*/
+UINT PointCloudStage::downsample(PointCloudVertex* vertices, UINT count, float voxelSize)
+{
+	const UINT slots = 1u << POINT_CLOUD_HASH_BITS;
+
+	if (mVoxelKeys.size() != slots)
+	{
+		mVoxelKeys.assign(slots, 0);
+		mVoxelStamps.assign(slots, 0);
+		mVoxelIndices.assign(slots, 0);
+		mVoxelSums.resize(mBuffers[0].size());
+		mVoxelStamp = 0;
+	}
+
+	// stamps wrap once every 2^32 frames, then everything is cleared
+	if (++mVoxelStamp == 0)
+	{
+		std::fill(mVoxelStamps.begin(), mVoxelStamps.end(), 0u);
+		mVoxelStamp = 1;
+	}
+
+	const float inverse = 1.0f / voxelSize;
+	UINT voxels = 0;
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		const PointCloudVertex& vertex = vertices[i];
+
+		UINT64 ix = static_cast<UINT64>(static_cast<int>(vertex.x * inverse + POINT_CLOUD_VOXEL_OFFSET)) & POINT_CLOUD_VOXEL_MASK;
+		UINT64 iy = static_cast<UINT64>(static_cast<int>(vertex.y * inverse + POINT_CLOUD_VOXEL_OFFSET)) & POINT_CLOUD_VOXEL_MASK;
+		UINT64 iz = static_cast<UINT64>(static_cast<int>(vertex.z * inverse + POINT_CLOUD_VOXEL_OFFSET)) & POINT_CLOUD_VOXEL_MASK;
+		UINT64 key = (ix << 42) | (iy << 21) | iz;
+
+		// fibonacci hashing, linear probing; never full, the table has twice the slots of a frame
+		UINT slot = static_cast<UINT>((key * 0x9E3779B97F4A7C15ull) >> (64 - POINT_CLOUD_HASH_BITS));
+
+		while (mVoxelStamps[slot] == mVoxelStamp && mVoxelKeys[slot] != key)
+		{
+			slot = (slot + 1) & (slots - 1);
+		}
+
+		if (mVoxelStamps[slot] != mVoxelStamp)
+		{
+			mVoxelStamps[slot] = mVoxelStamp;
+			mVoxelKeys[slot] = key;
+			mVoxelIndices[slot] = voxels;
+
+			VoxelSum& sum = mVoxelSums[voxels++];
+			memset(&sum, 0, sizeof(sum));
+		}
+
+		VoxelSum& sum = mVoxelSums[mVoxelIndices[slot]];
+		sum.x += vertex.x;
+		sum.y += vertex.y;
+		sum.z += vertex.z;
+		sum.r += vertex.r;
+		sum.g += vertex.g;
+		sum.b += vertex.b;
+		sum.count++;
+	}
+
+	for (UINT v = 0; v < voxels; ++v)
+	{
+		const VoxelSum& sum = mVoxelSums[v];
+		const float inverseCount = 1.0f / sum.count;
+
+		PointCloudVertex& vertex = vertices[v];
+		vertex.x = sum.x * inverseCount;
+		vertex.y = sum.y * inverseCount;
+		vertex.z = sum.z * inverseCount;
+		vertex.r = static_cast<BYTE>(sum.r / sum.count);
+		vertex.g = static_cast<BYTE>(sum.g / sum.count);
+		vertex.b = static_cast<BYTE>(sum.b / sum.count);
+		vertex.a = 255;
+	}
+
+	return voxels;
+}
+
+PointCloudData PointCloudStage::lockLatestPointCloud()
+{
+	mFrontMutex.lock();
+
+	PointCloudData data;
+	data.frameId = mFrameIds[mFront];
+	data.vertices = mCounts[mFront] ? &mBuffers[mFront][0] : NULL;
+	data.count = mCounts[mFront];
+	data.hasPointCloud = mHasPointCloud;
+	return data;
+}
+
+void PointCloudStage::unlockLatestPointCloud()
+{
+	mFrontMutex.unlock();
+}
+
+GLuint PointCloudStage::getPointCloudBuffer()
+{
+	mVertexBufferRequested = true;
+	return mVertexBuffer;
+}
+
+UINT PointCloudStage::getPointCloudBufferCount()
+{
+	return mVertexBufferCount;
+}
+
+void PointCloudStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void PointCloudStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void PointCloudStage::setColorBufferSource(IColorBufferSourceRef colorBufferSrc)
+{
+	mColorBufferSrc = colorBufferSrc;
+}
+
+void PointCloudStage::setParams(const PointCloudParams& params)
+{
+	mParamsMutex.lock();
+	mParams = params;
+	mParams.voxelSize = std::max(0.0f, params.voxelSize);
+	mParamsMutex.unlock();
+}
+
+PointCloudParams PointCloudStage::getParams()
+{
+	mParamsMutex.lock();
+	PointCloudParams params = mParams;
+	mParamsMutex.unlock();
+	return params;
+}
\ No newline at end of file
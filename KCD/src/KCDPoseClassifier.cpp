@@ -0,0 +1,263 @@
+#include "KCDPoseClassifier.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cfloat>
+
+using namespace kcd;
+
+#define POSE_VOTE_EPSILON 1e-3f
+
+PoseClassifier::PoseClassifier() :
+mFeatureJointCount(1)
+{
+	this->setLibrary(PoseLibrary());
+}
+
+PoseClassifier::~PoseClassifier() { }
+
+// not guarded, the owner serializes library changes with process()
+void PoseClassifier::setLibrary(const PoseLibrary& library)
+{
+	mLibrary = library;
+
+	mFeatureJointCount = 0;
+	for (JointMask bits = mLibrary.getFeatureJoints(); bits != 0; bits &= bits - 1)
+	{
+		mFeatureJointCount++;
+	}
+	mFeatureJointCount = std::max(mFeatureJointCount, 1u);
+
+	mFeatures.assign(mLibrary.getDimensions(), 0.0f);
+	mVotes.assign(mLibrary.getLabelCount(), 0.0f);
+
+	this->reset();
+}
+
+void PoseClassifier::setParams(const PoseClassifierParams& params)
+{
+	mParams = params;
+	mParams.k = std::max(1u, std::min(static_cast<UINT>(POSE_MAX_K), params.k));
+}
+
+void PoseClassifier::reset()
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		BodyState& state = mBodies[b];
+		state.trackingId = 0;
+		state.pose = -1;
+		state.candidate = -1;
+		state.candidateSince = 0;
+		state.confidence = 0;
+	}
+}
+
+float PoseClassifier::classify(const float* features, int heldLabel, PoseResult& result)
+{
+	const UINT dimensions = mLibrary.getDimensions();
+	const UINT count = mLibrary.getCount();
+	const UINT k = std::min(mParams.k, count);
+	const float* samples = mLibrary.getFeatures();
+	const USHORT* labels = mLibrary.getLabels();
+
+	result.label = -1;
+	result.confidence = 0;
+	result.distance = FLT_MAX;
+
+	if (k == 0 || dimensions == 0)
+	{
+		return 0;
+	}
+
+	for (UINT i = 0; i < k; ++i)
+	{
+		mNearestDistance[i] = FLT_MAX;
+		mNearestLabel[i] = -1;
+	}
+
+	UINT s = 0;
+
+	// four samples per pass, the sums transposed into one vector of four distances
+	for (; s + 4 <= count; s += 4)
+	{
+		const float* base = samples + s * dimensions;
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		__m128 acc2 = _mm_setzero_ps();
+		__m128 acc3 = _mm_setzero_ps();
+
+		for (UINT d = 0; d < dimensions; d += 4)
+		{
+			__m128 q = _mm_loadu_ps(features + d);
+			__m128 d0 = _mm_sub_ps(_mm_loadu_ps(base + d), q);
+			__m128 d1 = _mm_sub_ps(_mm_loadu_ps(base + dimensions + d), q);
+			__m128 d2 = _mm_sub_ps(_mm_loadu_ps(base + 2 * dimensions + d), q);
+			__m128 d3 = _mm_sub_ps(_mm_loadu_ps(base + 3 * dimensions + d), q);
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+			acc2 = _mm_add_ps(acc2, _mm_mul_ps(d2, d2));
+			acc3 = _mm_add_ps(acc3, _mm_mul_ps(d3, d3));
+		}
+
+		_MM_TRANSPOSE4_PS(acc0, acc1, acc2, acc3);
+		__m128 sums = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+
+		// most blocks hold nothing nearer than the current k-th
+		int closer = _mm_movemask_ps(_mm_cmplt_ps(sums, _mm_set1_ps(mNearestDistance[k - 1])));
+		if (closer == 0)
+		{
+			continue;
+		}
+
+		float distances[4];
+		_mm_storeu_ps(distances, sums);
+
+		for (int i = 0; i < 4; ++i)
+		{
+			if (closer & (1 << i))
+			{
+				this->insertNearest(distances[i], labels[s + i], k);
+			}
+		}
+	}
+
+	for (; s < count; ++s)
+	{
+		const float* sample = samples + s * dimensions;
+		__m128 acc = _mm_setzero_ps();
+
+		for (UINT d = 0; d < dimensions; d += 4)
+		{
+			__m128 diff = _mm_sub_ps(_mm_loadu_ps(sample + d), _mm_loadu_ps(features + d));
+			acc = _mm_add_ps(acc, _mm_mul_ps(diff, diff));
+		}
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, acc);
+		this->insertNearest((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]), labels[s], k);
+	}
+
+	result.distance = mNearestDistance[0] / mFeatureJointCount;
+	if (result.distance > mParams.maxDistance)
+	{
+		return 0;
+	}
+
+	std::fill(mVotes.begin(), mVotes.end(), 0.0f);
+	float total = 0;
+
+	for (UINT i = 0; i < k; ++i)
+	{
+		float weight = 1.0f / (mNearestDistance[i] / mFeatureJointCount + POSE_VOTE_EPSILON);
+		mVotes[mNearestLabel[i]] += weight;
+		total += weight;
+	}
+
+	int winner = static_cast<int>(std::max_element(mVotes.begin(), mVotes.end()) - mVotes.begin());
+	result.label = winner;
+	result.confidence = mVotes[winner] / total;
+
+	return (heldLabel >= 0 && heldLabel < static_cast<int>(mVotes.size())) ? mVotes[heldLabel] / total : 0;
+}
+
+void PoseClassifier::insertNearest(float distance, int label, UINT k)
+{
+	if (distance >= mNearestDistance[k - 1])
+	{
+		return;
+	}
+
+	UINT j = k - 1;
+	while (j > 0 && mNearestDistance[j - 1] > distance)
+	{
+		mNearestDistance[j] = mNearestDistance[j - 1];
+		mNearestLabel[j] = mNearestLabel[j - 1];
+		j--;
+	}
+
+	mNearestDistance[j] = distance;
+	mNearestLabel[j] = label;
+}
+
+UINT PoseClassifier::process(const JointStore& joints, double time, std::vector<PoseTransition>& transitions)
+{
+	const JointMask featureJoints = mLibrary.getFeatureJoints();
+	UINT classified = 0;
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		BodyState& state = mBodies[b];
+
+		if (!joints.isTracked[b] || joints.trackingId[b] != state.trackingId)
+		{
+			this->endPose(b, transitions);
+			state.trackingId = joints.isTracked[b] ? joints.trackingId[b] : 0;
+			state.candidate = -1;
+		}
+
+		if (!joints.isTracked[b] || mLibrary.getCount() == 0 || mLibrary.getDimensions() == 0)
+		{
+			continue;
+		}
+
+		// a frame with missing joints changes nothing
+		if (!PoseLibrary::extractFeatures(joints, b, featureJoints, &mFeatures[0]))
+		{
+			continue;
+		}
+
+		PoseResult result;
+		float held = this->classify(&mFeatures[0], state.pose, result);
+		classified++;
+
+		if (state.pose >= 0)
+		{
+			state.confidence = held;
+
+			if (held >= mParams.exitConfidence)
+			{
+				continue;
+			}
+
+			this->endPose(b, transitions);
+		}
+
+		if (result.label < 0 || result.confidence < mParams.enterConfidence)
+		{
+			state.candidate = -1;
+			continue;
+		}
+
+		if (state.candidate != result.label)
+		{
+			state.candidate = result.label;
+			state.candidateSince = time;
+		}
+
+		if (time - state.candidateSince >= mParams.holdSeconds)
+		{
+			state.pose = result.label;
+			state.confidence = result.confidence;
+			state.candidate = -1;
+
+			PoseTransition transition = { POSE_TRANSITION_BEGIN, state.pose, b, state.trackingId, state.confidence };
+			transitions.push_back(transition);
+		}
+	}
+
+	return classified;
+}
+
+void PoseClassifier::endPose(int body, std::vector<PoseTransition>& transitions)
+{
+	BodyState& state = mBodies[body];
+
+	if (state.pose >= 0)
+	{
+		PoseTransition transition = { POSE_TRANSITION_END, state.pose, body, state.trackingId, state.confidence };
+		transitions.push_back(transition);
+	}
+
+	state.pose = -1;
+	state.confidence = 0;
+}
\ No newline at end of file
@@ -0,0 +1,376 @@
+#include "KCDPoseLibrary.h"
+#include <fstream>
+#include <cmath>
+#include <string.h>
+
+using namespace kcd;
+
+struct PoseLibraryHeader
+{
+	UINT magic;
+	UINT version;
+	UINT featureJoints;
+	UINT dimensions;
+	UINT count;
+	UINT labelCount;
+	UINT labelBytes;
+	UINT reserved;
+};
+
+static inline UINT padded(UINT bytes)
+{
+	return (bytes + 3u) & ~3u;
+}
+
+// normalized joint positions to a feature vector, in JointType order
+static void packFeatures(const float normalized[JointType_Count][3], JointMask featureJoints, UINT dimensions, float* features)
+{
+	UINT n = 0;
+
+	for (int jt = 0; jt < JointType_Count; ++jt)
+	{
+		if (featureJoints & JOINT_BIT(jt))
+		{
+			features[n++] = normalized[jt][0];
+			features[n++] = normalized[jt][1];
+			features[n++] = normalized[jt][2];
+		}
+	}
+
+	while (n < dimensions)
+	{
+		features[n++] = 0;
+	}
+}
+
+PoseLibrary::PoseLibrary(JointMask featureJoints)
+{
+	this->clear(featureJoints);
+}
+
+PoseLibrary::~PoseLibrary() { }
+
+void PoseLibrary::clear(JointMask featureJoints)
+{
+	mFeatureJoints = featureJoints & JOINT_MASK_ALL;
+	mDimensions = PoseLibrary::dimensionsFor(mFeatureJoints);
+	mLabelNames.clear();
+	mLabels.clear();
+	mFeatures.clear();
+}
+
+int PoseLibrary::addLabel(const std::string& name)
+{
+	int label = this->findLabel(name);
+	if (label >= 0)
+	{
+		return label;
+	}
+
+	if (mLabelNames.size() >= POSE_MAX_LABELS)
+	{
+		return -1;
+	}
+
+	mLabelNames.push_back(name);
+	return static_cast<int>(mLabelNames.size()) - 1;
+}
+
+int PoseLibrary::findLabel(const std::string& name) const
+{
+	for (size_t i = 0; i < mLabelNames.size(); ++i)
+	{
+		if (mLabelNames[i] == name)
+		{
+			return static_cast<int>(i);
+		}
+	}
+
+	return -1;
+}
+
+bool PoseLibrary::addSample(int label, const float* features)
+{
+	if (label < 0 || label >= static_cast<int>(mLabelNames.size()) || features == NULL)
+	{
+		return false;
+	}
+
+	mLabels.push_back(static_cast<USHORT>(label));
+	mFeatures.insert(mFeatures.end(), features, features + mDimensions);
+	return true;
+}
+
+bool PoseLibrary::load(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	PoseLibraryHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		return false;
+	}
+
+	if (header.magic != POSE_LIBRARY_MAGIC || header.version != POSE_LIBRARY_VERSION ||
+		(header.featureJoints & ~JOINT_MASK_ALL) || header.dimensions != PoseLibrary::dimensionsFor(header.featureJoints) ||
+		header.labelCount > POSE_MAX_LABELS || header.labelBytes != padded(header.labelBytes))
+	{
+		return false;
+	}
+
+	std::vector<char> names(header.labelBytes);
+	std::vector<USHORT> labels(header.count + (header.count & 1)); // with the padding
+	std::vector<float> features(static_cast<size_t>(header.count) * header.dimensions);
+
+	// three reads, labels and features land in their final buffers
+	if (header.labelBytes && !file.read(&names[0], header.labelBytes))
+	{
+		return false;
+	}
+
+	if (header.count)
+	{
+		if (!file.read(reinterpret_cast<char*>(&labels[0]), labels.size() * sizeof(USHORT)))
+		{
+			return false;
+		}
+		labels.resize(header.count);
+
+		if (!file.read(reinterpret_cast<char*>(&features[0]), features.size() * sizeof(float)))
+		{
+			return false;
+		}
+	}
+
+	std::vector<std::string> labelNames;
+	size_t offset = 0;
+
+	for (UINT i = 0; i < header.labelCount; ++i)
+	{
+		const char* name = names.empty() ? NULL : &names[offset];
+		size_t length = (name == NULL) ? 0 : strnlen(name, names.size() - offset);
+
+		if (offset + length >= names.size())
+		{
+			return false;
+		}
+
+		labelNames.push_back(std::string(name, length));
+		offset += length + 1;
+	}
+
+	for (UINT i = 0; i < header.count; ++i)
+	{
+		if (labels[i] >= header.labelCount)
+		{
+			return false;
+		}
+	}
+
+	mFeatureJoints = header.featureJoints;
+	mDimensions = header.dimensions;
+	mLabelNames.swap(labelNames);
+	mLabels.swap(labels);
+	mFeatures.swap(features);
+	return true;
+}
+
+bool PoseLibrary::save(const std::string& path) const
+{
+	std::vector<char> names;
+	for (size_t i = 0; i < mLabelNames.size(); ++i)
+	{
+		names.insert(names.end(), mLabelNames[i].begin(), mLabelNames[i].end());
+		names.push_back('\0');
+	}
+	names.resize(padded(static_cast<UINT>(names.size())), '\0');
+
+	PoseLibraryHeader header = {};
+	header.magic = POSE_LIBRARY_MAGIC;
+	header.version = POSE_LIBRARY_VERSION;
+	header.featureJoints = mFeatureJoints;
+	header.dimensions = mDimensions;
+	header.count = this->getCount();
+	header.labelCount = this->getLabelCount();
+	header.labelBytes = static_cast<UINT>(names.size());
+
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	if (!names.empty())
+	{
+		file.write(&names[0], names.size());
+	}
+
+	if (header.count)
+	{
+		const USHORT zero = 0;
+		file.write(reinterpret_cast<const char*>(&mLabels[0]), mLabels.size() * sizeof(USHORT));
+		if (header.count & 1)
+		{
+			file.write(reinterpret_cast<const char*>(&zero), sizeof(zero));
+		}
+
+		file.write(reinterpret_cast<const char*>(&mFeatures[0]), mFeatures.size() * sizeof(float));
+	}
+
+	return file.good();
+}
+
+/*
+* A standing skeleton in feature space (torso length 1, hips along +X, SpineBase at the origin),
+* arms swung sideways by an angle from hanging down, each sample jittered by a few degrees
+*/
+void PoseLibrary::addDefaultPoses(UINT samplesPerPose)
+{
+	if (mFeatureJoints != POSE_JOINT_MASK_DEFAULT)
+	{
+		return;
+	}
+
+	const char* names[5] = { "ArmsDown", "TPose", "ArmsUp", "RightHandUp", "LeftHandUp" };
+	const float leftAngles[5] = { 10, 90, 170, 10, 170 };
+	const float rightAngles[5] = { 10, 90, 170, 170, 10 };
+	const float segments[3] = { 0.6f, 0.55f, 0.15f }; // upper arm, forearm, hand
+	const float degrees = 3.14159265f / 180.0f;
+
+	float skeleton[JointType_Count][3];
+	memset(skeleton, 0, sizeof(skeleton));
+
+	const float torso[6][4] = {
+		{ JointType_SpineMid, 0, 0.5f, 0 },
+		{ JointType_SpineShoulder, 0, 1.0f, 0 },
+		{ JointType_Neck, 0, 1.15f, 0 },
+		{ JointType_Head, 0, 1.4f, 0 },
+		{ JointType_ShoulderLeft, -0.35f, 0.95f, 0 },
+		{ JointType_ShoulderRight, 0.35f, 0.95f, 0 }
+	};
+
+	for (int i = 0; i < 6; ++i)
+	{
+		int jt = static_cast<int>(torso[i][0]);
+		skeleton[jt][0] = torso[i][1];
+		skeleton[jt][1] = torso[i][2];
+		skeleton[jt][2] = torso[i][3];
+	}
+
+	const int arms[2][4] = {
+		{ JointType_ShoulderLeft, JointType_ElbowLeft, JointType_WristLeft, JointType_HandLeft },
+		{ JointType_ShoulderRight, JointType_ElbowRight, JointType_WristRight, JointType_HandRight }
+	};
+
+	std::vector<float> features(mDimensions);
+	UINT seed = 12345u;
+
+	for (int p = 0; p < 5; ++p)
+	{
+		int label = this->addLabel(names[p]);
+
+		for (UINT s = 0; s < samplesPerPose; ++s)
+		{
+			for (int a = 0; a < 2; ++a)
+			{
+				float side = (a == 0) ? -1.0f : 1.0f;
+				float angle = (a == 0) ? leftAngles[p] : rightAngles[p];
+
+				for (int k = 0; k < 3; ++k)
+				{
+					// +-12 degrees sideways, +-0.1 forward
+					seed = seed * 1664525u + 1013904223u;
+					float jitter = (static_cast<float>(seed >> 8) / 16777216.0f - 0.5f) * 24.0f;
+					seed = seed * 1664525u + 1013904223u;
+					float depth = (static_cast<float>(seed >> 8) / 16777216.0f - 0.5f) * 0.2f;
+
+					float theta = (angle + jitter) * degrees;
+					const float* from = skeleton[arms[a][k]];
+					float* to = skeleton[arms[a][k + 1]];
+
+					to[0] = from[0] + side * sinf(theta) * segments[k];
+					to[1] = from[1] - cosf(theta) * segments[k];
+					to[2] = from[2] - depth * segments[k];
+				}
+			}
+
+			packFeatures(skeleton, mFeatureJoints, mDimensions, &features[0]);
+			this->addSample(label, &features[0]);
+		}
+	}
+}
+
+UINT PoseLibrary::dimensionsFor(JointMask featureJoints)
+{
+	UINT count = 0;
+	for (JointMask bits = featureJoints & JOINT_MASK_ALL; bits != 0; bits &= bits - 1)
+	{
+		count++;
+	}
+
+	return (count * 3 + 3u) & ~3u;
+}
+
+JointMask PoseLibrary::requiredJoints(JointMask featureJoints)
+{
+	return (featureJoints & JOINT_MASK_ALL) | JOINT_BIT(JointType_SpineBase) | JOINT_BIT(JointType_SpineShoulder) | JOINT_BIT(JointType_HipLeft) | JOINT_BIT(JointType_HipRight);
+}
+
+bool PoseLibrary::extractFeatures(const JointStore& joints, int body, JointMask featureJoints, float* features)
+{
+	JointMask required = PoseLibrary::requiredJoints(featureJoints);
+	if ((joints.seen[body] & required) != required)
+	{
+		return false;
+	}
+
+	const int root = JointStore::index(body, JointType_SpineBase);
+	const int shoulder = JointStore::index(body, JointType_SpineShoulder);
+	const int hipLeft = JointStore::index(body, JointType_HipLeft);
+	const int hipRight = JointStore::index(body, JointType_HipRight);
+
+	float tx = joints.positionX[shoulder] - joints.positionX[root];
+	float ty = joints.positionY[shoulder] - joints.positionY[root];
+	float tz = joints.positionZ[shoulder] - joints.positionZ[root];
+	float torso = sqrtf(tx * tx + ty * ty + tz * tz);
+
+	// facing: the hip line, around the vertical axis
+	float hx = joints.positionX[hipRight] - joints.positionX[hipLeft];
+	float hz = joints.positionZ[hipRight] - joints.positionZ[hipLeft];
+	float hip = sqrtf(hx * hx + hz * hz);
+
+	if (torso < POSE_MIN_TORSO || hip <= 0)
+	{
+		return false;
+	}
+
+	const float scale = 1.0f / torso;
+	const float c = hx / hip;
+	const float s = hz / hip;
+
+	float normalized[JointType_Count][3];
+
+	for (int jt = 0; jt < JointType_Count; ++jt)
+	{
+		if (featureJoints & JOINT_BIT(jt))
+		{
+			int i = JointStore::index(body, jt);
+			float x = joints.positionX[i] - joints.positionX[root];
+			float y = joints.positionY[i] - joints.positionY[root];
+			float z = joints.positionZ[i] - joints.positionZ[root];
+
+			normalized[jt][0] = (c * x + s * z) * scale;
+			normalized[jt][1] = y * scale;
+			normalized[jt][2] = (c * z - s * x) * scale;
+		}
+	}
+
+	packFeatures(normalized, featureJoints, PoseLibrary::dimensionsFor(featureJoints), features);
+	return true;
+}
\ No newline at end of file
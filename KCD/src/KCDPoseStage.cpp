@@ -0,0 +1,187 @@
+#include "KCDPoseStage.h"
+#include <string.h>
+
+using namespace kcd;
+
+PoseStage::PoseStage() :
+IPoseOutput(POSE_EVENT_QUEUE_SIZE),
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mJointStoreSrc(NULL),
+mStoredJointsTarget(NULL),
+mLastRelativeTime(0),
+mPerformanceFrequency(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	mTransitions.reserve(2 * BODY_COUNT);
+	mEvents.reserve(2 * BODY_COUNT);
+
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+PoseStage::~PoseStage() { }
+
+HRESULT PoseStage::thread_setup()
+{
+	mClassifierMutex.lock();
+	mClassifier.reset();
+	mClassifierMutex.unlock();
+
+	mLastRelativeTime = 0;
+	return S_OK;
+}
+
+HRESULT PoseStage::thread_process()
+{
+	BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+
+	// once per body frame
+	if (bodyData.relativeTime == 0 || bodyData.relativeTime == mLastRelativeTime)
+	{
+		return E_FAIL;
+	}
+	mLastRelativeTime = bodyData.relativeTime;
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER end = { 0 };
+	QueryPerformanceCounter(&start);
+
+	const JointStore& joints = mJointStoreSrc->getLatestJoints();
+	const UINT64 frameId = mDeviceSrc->getLatestFrameId();
+
+	mTransitions.clear();
+	mEvents.clear();
+
+	mClassifierMutex.lock();
+	UINT classified = mClassifier.process(joints, static_cast<double>(bodyData.relativeTime) * 1e-7, mTransitions);
+	UINT librarySize = mClassifier.getLibrary().getCount();
+	mClassifierMutex.unlock();
+
+	for (size_t i = 0; i < mTransitions.size(); ++i)
+	{
+		const PoseTransition& transition = mTransitions[i];
+		PoseEvent evt = { (transition.type == POSE_TRANSITION_BEGIN) ? POSE_BEGIN : POSE_END, transition.pose, transition.body, transition.trackingId, transition.confidence, frameId };
+		mEvents.push_back(evt);
+	}
+
+	QueryPerformanceCounter(&end);
+
+	mClassifierMutex.lock();
+	mStats.librarySize = librarySize;
+	mStats.classified = classified;
+	mStats.processMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+	mClassifierMutex.unlock();
+
+	// after the timing: publisher thread subscribers run here
+	if (!mEvents.empty())
+	{
+		this->publish(&mEvents[0], mEvents.size());
+	}
+
+	return S_OK;
+}
+
+void PoseStage::update()
+{
+	this->dispatchMain();
+}
+
+void PoseStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void PoseStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void PoseStage::setJointStoreSource(IJointStoreSourceRef jointStoreSrc)
+{
+	mJointStoreSrc = jointStoreSrc;
+}
+
+void PoseStage::setStoredJointsTarget(BodyStageRef body)
+{
+	mClassifierMutex.lock();
+	mStoredJointsTarget = body;
+	mClassifierMutex.unlock();
+
+	if (body)
+	{
+		body->setStoredJoints(this->getRequiredJoints(), STORED_JOINTS_POSE);
+	}
+}
+
+void PoseStage::setLibrary(const PoseLibrary& library)
+{
+	std::vector<std::string> names;
+	for (UINT i = 0; i < library.getLabelCount(); ++i)
+	{
+		names.push_back(library.getLabelName(i));
+	}
+
+	mClassifierMutex.lock();
+	mClassifier.setLibrary(library);
+	mPoseNames.swap(names);
+	BodyStageRef body = mStoredJointsTarget;
+	mClassifierMutex.unlock();
+
+	if (body)
+	{
+		body->setStoredJoints(PoseLibrary::requiredJoints(library.getFeatureJoints()), STORED_JOINTS_POSE);
+	}
+}
+
+bool PoseStage::loadLibrary(const std::string& path)
+{
+	PoseLibrary library;
+	if (!library.load(path))
+	{
+		return false;
+	}
+
+	this->setLibrary(library);
+	return true;
+}
+
+std::string PoseStage::getPoseName(int poseId)
+{
+	std::string name;
+
+	mClassifierMutex.lock();
+	if (poseId >= 0 && poseId < static_cast<int>(mPoseNames.size()))
+	{
+		name = mPoseNames[poseId];
+	}
+	mClassifierMutex.unlock();
+
+	return name;
+}
+
+JointMask PoseStage::getRequiredJoints()
+{
+	mClassifierMutex.lock();
+	JointMask joints = PoseLibrary::requiredJoints(mClassifier.getLibrary().getFeatureJoints());
+	mClassifierMutex.unlock();
+	return joints;
+}
+
+void PoseStage::setParams(const PoseClassifierParams& params)
+{
+	mClassifierMutex.lock();
+	mClassifier.setParams(params);
+	mClassifierMutex.unlock();
+}
+
+PoseStats PoseStage::getStats()
+{
+	mClassifierMutex.lock();
+	PoseStats stats = mStats;
+	mClassifierMutex.unlock();
+	return stats;
+}
\ No newline at end of file
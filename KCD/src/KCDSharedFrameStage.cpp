@@ -0,0 +1,198 @@
+#include "KCDSharedFrameStage.h"
+#include "KCDDeviceStage.h"
+#include <string.h>
+
+using namespace kcd;
+
+SharedFrameStage::SharedFrameStage() :
+mDeviceSrc(NULL),
+mBodyDataSrc(NULL),
+mJointStoreSrc(NULL),
+mColorBufferSrc(NULL),
+mMaskBufferSrc(NULL),
+mName(SHARED_FRAME_DEFAULT_NAME),
+mEnabled(false),
+mIsPublishing(false),
+mPerformanceFrequency(0),
+mPublishMicroseconds(0),
+mLastFrameId(0)
+{
+	LARGE_INTEGER qpf = { 0 };
+	if (QueryPerformanceFrequency(&qpf))
+	{
+		mPerformanceFrequency = double(qpf.QuadPart);
+	}
+}
+
+SharedFrameStage::~SharedFrameStage() { }
+
+void SharedFrameStage::teardown()
+{
+	mWriter.close();
+	mIsPublishing = false;
+}
+
+HRESULT SharedFrameStage::thread_process()
+{
+	if (!mEnabled)
+	{
+		if (mWriter.isOpen())
+		{
+			mWriter.close();
+			mIsPublishing = false;
+		}
+
+		return S_OK;
+	}
+
+	if (!mWriter.isOpen())
+	{
+		mNameMutex.lock();
+		std::string name = mName;
+		mNameMutex.unlock();
+
+		mIsPublishing = mWriter.create(DeviceStage::ColorFrameWidth, DeviceStage::ColorFrameHeight, name);
+
+		if (!mIsPublishing)
+		{
+			// not retried every frame: disabling and enabling again does
+			mEnabled = false;
+			return E_FAIL;
+		}
+	}
+
+	if (!mDeviceSrc || !mColorBufferSrc)
+	{
+		return S_OK;
+	}
+
+	// once per device frame, and only for frames with color: the pipeline spins in between
+	UINT64 frameId = mDeviceSrc->getLatestFrameId();
+	if (frameId == mLastFrameId)
+	{
+		return S_OK;
+	}
+
+	const BYTE* colorBuffer = mColorBufferSrc->getLatestColorBuffer();
+	if (!colorBuffer)
+	{
+		return S_OK;
+	}
+	mLastFrameId = frameId;
+
+	LARGE_INTEGER start = { 0 };
+	LARGE_INTEGER end = { 0 };
+	QueryPerformanceCounter(&start);
+
+	SharedFrameSlotHeader* slot = mWriter.beginFrame();
+	SharedFrameContext& context = slot->context;
+	memset(&context, 0, sizeof(context));
+
+	context.frameId = frameId;
+
+	if (mBodyDataSrc)
+	{
+		BodyData bodyData = mBodyDataSrc->getLatestBodyData();
+		context.relativeTime = bodyData.relativeTime;
+		context.hasActiveUser = bodyData.hasActiveUser ? 1 : 0;
+		context.activeBodyIndex = bodyData.activeBodyIndex;
+		context.activeTrackingId = bodyData.activeUserTrackingId;
+	}
+
+	memcpy(mWriter.getColor(slot), colorBuffer, DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight * BGRA_SIZE);
+	context.hasColor = 1;
+
+	MaskData maskData = { NULL, false };
+	if (mMaskBufferSrc)
+	{
+		maskData = mMaskBufferSrc->getLatestMaskBuffer();
+	}
+
+	if (maskData.hasMask && maskData.maskBuffer)
+	{
+		memcpy(mWriter.getMask(slot), maskData.maskBuffer, DeviceStage::ColorFrameWidth * DeviceStage::ColorFrameHeight * MASK_SIZE);
+		context.hasMask = 1;
+	}
+
+	this->writeJoints(slot);
+
+	mWriter.endFrame(slot);
+
+	QueryPerformanceCounter(&end);
+	mPublishMicroseconds = (mPerformanceFrequency > 0) ? static_cast<float>(double(end.QuadPart - start.QuadPart) * 1e6 / mPerformanceFrequency) : 0;
+
+	return S_OK;
+}
+
+void SharedFrameStage::writeJoints(SharedFrameSlotHeader* slot)
+{
+	memset(slot->joints, 0, sizeof(slot->joints));
+
+	if (!mJointStoreSrc)
+	{
+		return;
+	}
+
+	const JointStore& joints = mJointStoreSrc->getLatestJoints();
+
+	for (int body = 0; body < JointStore::BodyCount; ++body)
+	{
+		if (!joints.isTracked[body])
+		{
+			continue;
+		}
+
+		slot->context.trackedBodies |= (1u << body);
+		slot->context.trackingId[body] = joints.trackingId[body];
+
+		for (int jointType = 0; jointType < JointStore::JointCount; ++jointType)
+		{
+			// joints not stored this frame keep tracking state 0
+			if (!(joints.seen[body] & JOINT_BIT(jointType)))
+			{
+				continue;
+			}
+
+			int i = JointStore::index(body, jointType);
+			SharedFrameJoint& joint = slot->joints[i];
+			joint.x = joints.positionX[i];
+			joint.y = joints.positionY[i];
+			joint.z = joints.positionZ[i];
+			joint.colorX = joints.colorX[i];
+			joint.colorY = joints.colorY[i];
+			joint.trackingState = joints.trackingState[i];
+		}
+	}
+}
+
+void SharedFrameStage::setName(const std::string& name)
+{
+	mNameMutex.lock();
+	mName = name;
+	mNameMutex.unlock();
+}
+
+void SharedFrameStage::setDeviceSource(IDeviceSourceRef deviceSrc)
+{
+	mDeviceSrc = deviceSrc;
+}
+
+void SharedFrameStage::setBodyDataSource(IBodyDataSourceRef bodyDataSrc)
+{
+	mBodyDataSrc = bodyDataSrc;
+}
+
+void SharedFrameStage::setJointStoreSource(IJointStoreSourceRef jointStoreSrc)
+{
+	mJointStoreSrc = jointStoreSrc;
+}
+
+void SharedFrameStage::setColorBufferSource(IColorBufferSourceRef colorBufferSrc)
+{
+	mColorBufferSrc = colorBufferSrc;
+}
+
+void SharedFrameStage::setMaskBufferSource(IMaskBufferSourceRef maskBufferSrc)
+{
+	mMaskBufferSrc = maskBufferSrc;
+}
\ No newline at end of file
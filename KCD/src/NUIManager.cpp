@@ -2,7 +2,8 @@
 
 using namespace kcd;
 
-NUIManager::NUIManager()
+NUIManager::NUIManager() :
+mStages(0)
 {
 
 }
@@ -12,7 +13,7 @@ NUIManager::~NUIManager()
 
 }
 
-void NUIManager::setup()
+void NUIManager::setup(const NUISettings& settings)
 {
 	ci::app::App* mainApp = ci::app::App::get();
 	if (!mainApp)
@@ -21,35 +22,107 @@ void NUIManager::setup()
 	}
 
 	mPipeline = PipelineRef(new Pipeline());
+	mBufferPool = BufferPoolRef(new BufferPool());
 
 	mDevice = DeviceStageRef(new DeviceStage());
+	mBodyIndexStats = BodyIndexStatsStageRef(new BodyIndexStatsStage());
 	mActiveUser = ActiveUserStageRef(new ActiveUserStage());
+	mFloor = FloorStageRef(new FloorStage());
 	mBody = BodyStageRef(new BodyStage());
+	mJointFilter = JointFilterStageRef(new JointFilterStage());
+	mGesture = GestureStageRef(new GestureStage());
+	mPose = PoseStageRef(new PoseStage());
 	mMask = MaskStageRef(new MaskStage());
 	mColor = ColorStageRef(new ColorStage());
+	mDepth = DepthStageRef(new DepthStage());
+	mComposite = CompositeStageRef(new CompositeStage());
+	mPointCloud = PointCloudStageRef(new PointCloudStage());
+	mSharedFrame = SharedFrameStageRef(new SharedFrameStage());
+	mEventRecorder = EventRecorderStageRef(new EventRecorderStage());
 	mPerf = PerformanceQueryStageRef(new PerformanceQueryStage());
 
 	mColor->setDeviceSource(mDevice);
+	mColor->setBufferPool(mBufferPool);
+	mDepth->setDeviceSource(mDevice);
+	mDepth->setBufferPool(mBufferPool);
+	mBodyIndexStats->setDeviceSource(mDevice);
 	mActiveUser->setDeviceSource(mDevice);
-	mActiveUser->setActiveUserDistanceSource(mBody);
+	mActiveUser->setBodyIndexStatsSource(mBodyIndexStats);
+	mFloor->setDeviceSource(mDevice);
+	mFloor->setBodyDataSource(mActiveUser);
 	mBody->setDeviceSource(mDevice);
 	mBody->setBodyDataSource(mActiveUser);
+	mJointFilter->setDeviceSource(mDevice);
+	mJointFilter->setBodyDataSource(mActiveUser);
+	mJointFilter->setJointStoreSource(mBody);
+	mGesture->setDeviceSource(mDevice);
+	mGesture->setBodyDataSource(mActiveUser);
+	mGesture->setJointStoreSource(mBody);
+	mGesture->addDefaultTemplates();
+	mPose->setDeviceSource(mDevice);
+	mPose->setBodyDataSource(mActiveUser);
+	mPose->setJointStoreSource(mBody);
+	PoseLibrary poses;
+	poses.addDefaultPoses();
+	mPose->setLibrary(poses);
 	mMask->setDeviceSource(mDevice);
+	mMask->setBufferPool(mBufferPool);
 	mMask->setBodyDataSource(mActiveUser);
+	mMask->setHoleFilling(settings.holeFilling);
+	mMask->setMaskMorphology(settings.maskOpenRadius, settings.maskBlurSize);
+	mPointCloud->setDeviceSource(mDevice);
+	mPointCloud->setBodyDataSource(mActiveUser);
+	mPointCloud->setColorBufferSource(mColor);
+	mComposite->setColorBufferSource(mColor);
+	mComposite->setMaskBufferSource(mMask);
+	mSharedFrame->setDeviceSource(mDevice);
+	mSharedFrame->setBodyDataSource(mActiveUser);
+	mSharedFrame->setJointStoreSource(mBody);
+	mSharedFrame->setColorBufferSource(mColor);
+	mSharedFrame->setMaskBufferSource(mMask);
+	mEventRecorder->setDeviceSource(mDevice);
+	mEventRecorder->setBodyDataSource(mActiveUser);
+	mEventRecorder->setActiveUserOutput(mActiveUser);
+	mEventRecorder->setBodyJointBatchOutput(mBody->getBatchOutput());
 	mPerf->setTimeSource(mColor);
 
+	// joints beyond the subscription are only stored for the stages that run, the filter smooths every joint
+	mBody->setStoredJoints((settings.stages & NUI_STAGE_GESTURE) ? mGesture->getRequiredJoints() : 0, kcd::STORED_JOINTS_GESTURE);
+	mPose->setStoredJointsTarget((settings.stages & NUI_STAGE_POSE) ? mBody : BodyStageRef());
+	mBody->setStoredJoints((settings.stages & NUI_STAGE_JOINT_FILTER) ? JOINT_MASK_ALL : 0, kcd::STORED_JOINTS_FILTER);
+
 	mPipeline->addStage(mDevice);
+	mPipeline->addStage(mBodyIndexStats);
 	mPipeline->addStage(mActiveUser);
+	this->addOptionalStage(mFloor, settings.stages & NUI_STAGE_FLOOR);
 	mPipeline->addStage(mBody);
+	this->addOptionalStage(mJointFilter, settings.stages & NUI_STAGE_JOINT_FILTER);
+	this->addOptionalStage(mGesture, settings.stages & NUI_STAGE_GESTURE);
+	this->addOptionalStage(mPose, settings.stages & NUI_STAGE_POSE);
 	mPipeline->addStage(mMask);
 	mPipeline->addStage(mColor);
+	mPipeline->addStage(mComposite);
+	this->addOptionalStage(mDepth, settings.stages & NUI_STAGE_DEPTH);
+	this->addOptionalStage(mPointCloud, settings.stages & NUI_STAGE_POINT_CLOUD);
+	mPipeline->addStage(mSharedFrame);
+	this->addOptionalStage(mEventRecorder, settings.stages & NUI_STAGE_EVENT_RECORDER);
 	mPipeline->addStage(mPerf);
 
+	mStages = settings.stages;
+
 	mUpdateConnection = mainApp->getSignalUpdate().connect(std::bind(&NUIManager::update, this));
 
 	mPipeline->start();
 }
 
+void NUIManager::addOptionalStage(IStageRef stage, UINT enabled)
+{
+	if (enabled)
+	{
+		mPipeline->addStage(stage);
+	}
+}
+
 void NUIManager::teardown()
 {
 	mUpdateConnection.disconnect();
@@ -66,11 +139,51 @@ ITextureOutputRef NUIManager::getColorTextureOutput()
 	return this->mColor;
 }
 
+ITextureOutputRef NUIManager::getDepthTextureOutput()
+{
+	return this->mDepth;
+}
+
 ITextureOutputRef NUIManager::getMaskTextureOutput()
 {
 	return this->mMask;
 }
 
+IImageOutputRef NUIManager::getColorImageOutput()
+{
+	return this->mColor;
+}
+
+IImageOutputRef NUIManager::getDepthImageOutput()
+{
+	return this->mDepth;
+}
+
+IImageOutputRef NUIManager::getMaskImageOutput()
+{
+	return this->mMask;
+}
+
+ITextureOutputRef NUIManager::getCompositeTextureOutput()
+{
+	return this->mComposite;
+}
+
+IDistanceFieldOutputRef NUIManager::getDistanceFieldOutput()
+{
+	return this->mMask;
+}
+
+IRegisteredDepthOutputRef NUIManager::getRegisteredDepthOutput()
+{
+	return this->mMask;
+}
+
+ISilhouetteOutputRef NUIManager::getSilhouetteOutput()
+{
+	return this->mMask;
+}
+
 IPerformanceOutputRef NUIManager::getPerformaceOutput()
 {
 	return this->mPerf;
@@ -81,33 +194,172 @@ kcd::IActiveUserOutputRef NUIManager::getActiveUserOutput()
 	return this->mActiveUser;
 }
 
+kcd::IEngagedUserOutputRef NUIManager::getEngagedUserOutput()
+{
+	return this->mActiveUser->getEngagedUserOutput();
+}
+
+kcd::IBodyIndexStatsOutputRef NUIManager::getBodyIndexStatsOutput()
+{
+	return this->mBodyIndexStats;
+}
+
+kcd::IFloorOutputRef NUIManager::getFloorOutput()
+{
+	return this->mFloor;
+}
+
 kcd::IBodyJointOutputRef NUIManager::getBodyJointOutput()
 {
 	return this->mBody;
 }
 
+kcd::IPointCloudOutputRef NUIManager::getPointCloudOutput()
+{
+	return this->mPointCloud;
+}
+
+const kcd::JointHistory& NUIManager::getJointHistory()
+{
+	return this->mBody->getJointHistory();
+}
+
+kcd::IJointStoreOutputRef NUIManager::getPredictedJointOutput()
+{
+	return this->mJointFilter;
+}
+
+bool NUIManager::isStageEnabled(NUIOptionalStage stage) const
+{
+	return (mStages & stage) != 0;
+}
+
+kcd::BodyStageRef NUIManager::getBodyStage()
+{
+	return this->mBody;
+}
+
+kcd::GestureStageRef NUIManager::getGestureStage()
+{
+	return this->mGesture;
+}
+
+kcd::PoseStageRef NUIManager::getPoseStage()
+{
+	return this->mPose;
+}
+
+kcd::PointCloudStageRef NUIManager::getPointCloudStage()
+{
+	return this->mPointCloud;
+}
+
+kcd::FloorStageRef NUIManager::getFloorStage()
+{
+	return this->mFloor;
+}
+
+kcd::DepthStageRef NUIManager::getDepthStage()
+{
+	return this->mDepth;
+}
+
+kcd::CompositeStageRef NUIManager::getCompositeStage()
+{
+	return this->mComposite;
+}
+
+kcd::BufferPoolRef NUIManager::getBufferPool()
+{
+	return this->mBufferPool;
+}
+
+kcd::SharedFrameStageRef NUIManager::getSharedFrameStage()
+{
+	return this->mSharedFrame;
+}
+
+kcd::EventRecorderStageRef NUIManager::getEventRecorderStage()
+{
+	return this->mEventRecorder;
+}
+
+kcd::IBodyJointBatchOutputRef NUIManager::getBodyJointBatchOutput()
+{
+	return this->mBody->getBatchOutput();
+}
+
+kcd::IJointStoreOutputRef NUIManager::getJointStoreOutput()
+{
+	return this->mBody;
+}
+
 ci::gl::TextureRef NUIManager::GetColorTextureRef()
 {
 	return NUIManager::DefaultManager().getColorTextureOutput()->getTextureReference();
 }
 
+ci::gl::TextureRef NUIManager::GetDepthTextureRef()
+{
+	return NUIManager::DefaultManager().getDepthTextureOutput()->getTextureReference();
+}
+
 ci::gl::TextureRef NUIManager::GetMaskTextureRef()
 {
 	return NUIManager::DefaultManager().getMaskTextureOutput()->getTextureReference();
 }
 
+ci::gl::TextureRef NUIManager::GetCompositeTextureRef()
+{
+	return NUIManager::DefaultManager().getCompositeTextureOutput()->getTextureReference();
+}
+
+ci::gl::TextureRef NUIManager::GetDistanceTextureRef()
+{
+	return NUIManager::DefaultManager().getDistanceFieldOutput()->getDistanceTextureReference();
+}
+
+ci::gl::TextureRef NUIManager::GetRegisteredDepthTextureRef()
+{
+	return NUIManager::DefaultManager().getRegisteredDepthOutput()->getRegisteredDepthTextureReference();
+}
+
+const SilhouetteData& NUIManager::GetSilhouetteData()
+{
+	return NUIManager::DefaultManager().getSilhouetteOutput()->getLatestSilhouette();
+}
+
 const PerformanceQueryData& NUIManager::GetPerformaceQueryData()
 {
 	return NUIManager::DefaultManager().getPerformaceOutput()->getPerformanceQuery();
 }
 
-void NUIManager::AttachActiveUserObserver(Observer<ActiveUserEvent>& observer)
+EventSubscriptionRef NUIManager::SubscribeActiveUser(const IActiveUserOutput::Handler& handler, EventDelivery delivery)
+{
+	return NUIManager::DefaultManager().getActiveUserOutput()->subscribe(handler, delivery);
+}
+
+EventSubscriptionRef NUIManager::SubscribeEngagedUser(const IEngagedUserOutput::Handler& handler, EventDelivery delivery)
 {
-	NUIManager::DefaultManager().getActiveUserOutput()->attach(observer);
+	return NUIManager::DefaultManager().getEngagedUserOutput()->subscribe(handler, delivery);
 }
 
-void NUIManager::AttachBodyJointObserver(Observer<BodyJointEvent>& observer)
+EventSubscriptionRef NUIManager::SubscribeBodyJoint(const IBodyJointOutput::Handler& handler, EventDelivery delivery)
 {
-	NUIManager::DefaultManager().getBodyJointOutput()->attach(observer);
+	return NUIManager::DefaultManager().getBodyJointOutput()->subscribe(handler, delivery);
 }
 
+EventSubscriptionRef NUIManager::SubscribeBodyJointBatch(const IBodyJointBatchOutput::Handler& handler, EventDelivery delivery)
+{
+	return NUIManager::DefaultManager().getBodyJointBatchOutput()->subscribe(handler, delivery);
+}
+
+EventSubscriptionRef NUIManager::SubscribeGesture(const IGestureOutput::Handler& handler, EventDelivery delivery)
+{
+	return NUIManager::DefaultManager().getGestureStage()->subscribe(handler, delivery);
+}
+
+EventSubscriptionRef NUIManager::SubscribePose(const IPoseOutput::Handler& handler, EventDelivery delivery)
+{
+	return NUIManager::DefaultManager().getPoseStage()->subscribe(handler, delivery);
+}
\ No newline at end of file
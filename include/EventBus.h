@@ -0,0 +1,431 @@
+#ifndef __EVENT_BUS_H__
+#define __EVENT_BUS_H__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include "Process.h"
+
+/*
+* Typed event bus: events are published in batches and handed to subscribers as a const reference to the batch
+* Each subscriber picks where it is called:
+* - EVENT_DELIVERY_PUBLISHER_THREAD: inside publish(), on the publishing thread (the pipeline thread for stages),
+*   no latency, the handler runs on the pipeline's time
+* - EVENT_DELIVERY_MAIN_THREAD: queued, called from dispatchMain(), which stages call in update()
+* - EVENT_DELIVERY_DISPATCHER: queued, called on a thread of the bus, started with its first such subscriber
+* Subscribing and unsubscribing never lock: subscribers live in a fixed array of slots claimed with a
+* compare-and-swap, and publishing counts itself in and out of a slot, so cancelling waits for a call in progress
+* on another thread. A handler may cancel its own subscription. Batches are published from one thread at a time.
+* Queued batches are kept as published, up to the capacity of the bus in events; beyond that they are dropped and counted.
+*/
+
+#define EVENT_BUS_MAX_SUBSCRIBERS 16
+#define EVENT_BUS_DEFAULT_CAPACITY 1024 // queued events, per queued delivery
+
+typedef enum EventDelivery
+{
+	EVENT_DELIVERY_PUBLISHER_THREAD = 0,
+	EVENT_DELIVERY_MAIN_THREAD,
+	EVENT_DELIVERY_DISPATCHER,
+	EVENT_DELIVERY_COUNT
+};
+
+template <class T>
+struct EventBatch
+{
+	const T* events;
+	size_t count;
+
+	size_t size() const { return count; }
+	const T& operator[](size_t i) const { return events[i]; }
+	const T* begin() const { return events; }
+	const T* end() const { return events + count; }
+};
+
+/*
+* Cancels its subscription when destroyed; may outlive the bus
+*/
+class EventSubscription
+{
+public:
+	EventSubscription(const std::function<void()>& cancel) : mCancel(cancel) {}
+	virtual ~EventSubscription() { this->cancel(); }
+
+	// no call starts after this returns
+	void cancel()
+	{
+		if (mCancel)
+		{
+			std::function<void()> cancel = mCancel;
+			mCancel = nullptr;
+			cancel();
+		}
+	}
+
+	bool isActive() const { return mCancel != nullptr; }
+
+private:
+	EventSubscription(EventSubscription const&);
+	void operator=(EventSubscription const&);
+
+	std::function<void()> mCancel;
+};
+
+typedef std::shared_ptr<EventSubscription> EventSubscriptionRef;
+
+template <class T>
+class EventBus
+{
+public:
+	typedef std::function<void(const EventBatch<T>&)> Handler;
+
+	EventBus(size_t capacity = EVENT_BUS_DEFAULT_CAPACITY) :
+		mSlots(new Slots()),
+		mCapacity(capacity),
+		mDroppedEvents(0),
+		mDispatcherPending(false)
+	{
+		mMainQueue.reserve(capacity);
+		mDispatcherQueue.reserve(capacity);
+	}
+
+	virtual ~EventBus()
+	{
+		this->stopDispatcher();
+	}
+
+	// NULL when all slots are taken
+	EventSubscriptionRef subscribe(const Handler& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD)
+	{
+		if (!handler || delivery < 0 || delivery >= EVENT_DELIVERY_COUNT)
+		{
+			return NULL;
+		}
+
+		if (delivery == EVENT_DELIVERY_DISPATCHER)
+		{
+			this->startDispatcher();
+		}
+
+		Subscriber* subscriber = new Subscriber(handler, delivery);
+
+		for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; ++i)
+		{
+			Subscriber* expected = NULL;
+
+			if (mSlots->slots[i].subscriber.compare_exchange_strong(expected, subscriber))
+			{
+				mSlots->counts[delivery]++;
+
+				std::shared_ptr<Slots> slots = mSlots;
+				return EventSubscriptionRef(new EventSubscription([slots, i, subscriber]() { Slots::cancel(*slots, i, subscriber); }));
+			}
+		}
+
+		delete subscriber;
+		return NULL;
+	}
+
+	// one call per event, for handlers that don't care about batches
+	EventSubscriptionRef subscribeEach(const std::function<void(const T&)>& handler, EventDelivery delivery = EVENT_DELIVERY_MAIN_THREAD)
+	{
+		if (!handler)
+		{
+			return NULL;
+		}
+
+		return this->subscribe([handler](const EventBatch<T>& batch)
+		{
+			for (size_t i = 0; i < batch.size(); ++i)
+			{
+				handler(batch[i]);
+			}
+		}, delivery);
+	}
+
+	size_t subscriberCount() const
+	{
+		size_t count = 0;
+		for (int d = 0; d < EVENT_DELIVERY_COUNT; ++d)
+		{
+			count += mSlots->counts[d];
+		}
+		return count;
+	}
+
+	size_t subscriberCount(EventDelivery delivery) const { return mSlots->counts[delivery]; }
+
+	void publish(const T* events, size_t count)
+	{
+		if (events == NULL || count == 0)
+		{
+			return;
+		}
+
+		EventBatch<T> batch = { events, count };
+
+		if (mSlots->counts[EVENT_DELIVERY_PUBLISHER_THREAD] > 0)
+		{
+			Slots::deliver(*mSlots, EVENT_DELIVERY_PUBLISHER_THREAD, batch);
+		}
+
+		if (mSlots->counts[EVENT_DELIVERY_MAIN_THREAD] > 0)
+		{
+			this->enqueue(mMainQueue, events, count);
+		}
+
+		if (mSlots->counts[EVENT_DELIVERY_DISPATCHER] > 0)
+		{
+			if (this->enqueue(mDispatcherQueue, events, count))
+			{
+				mDispatcherQueue.mutex.lock();
+				mDispatcherPending = true;
+				mDispatcherQueue.mutex.unlock();
+				mDispatcherReady.notify_one();
+			}
+		}
+	}
+
+	void publish(const T& event) { this->publish(&event, 1); }
+
+	// the app thread, in update(): calls the main thread subscribers with the batches queued since the last call
+	void dispatchMain()
+	{
+		this->drain(mMainQueue, mMainDrain, EVENT_DELIVERY_MAIN_THREAD);
+	}
+
+	// queued events that didn't fit
+	uint64_t getDroppedCount() const { return mDroppedEvents; }
+
+private:
+	EventBus(EventBus const&);
+	void operator=(EventBus const&);
+
+	struct Subscriber
+	{
+		Subscriber(const Handler& handler, EventDelivery delivery) : handler(handler), delivery(delivery), retired(false) {}
+
+		Handler handler;
+		EventDelivery delivery;
+		bool retired; // cancelled by its own handler, deleted by the call once it returns
+	};
+
+	struct Slot
+	{
+		Slot() : subscriber(NULL), inFlight(0), callingThread(0) {}
+
+		std::atomic<Subscriber*> subscriber;
+		std::atomic<int> inFlight; // publishers looking at the slot
+		std::atomic<size_t> callingThread; // thread in the handler, 0 when none
+	};
+
+	// shared with the subscription handles
+	struct Slots
+	{
+		Slots()
+		{
+			for (int d = 0; d < EVENT_DELIVERY_COUNT; ++d)
+			{
+				counts[d] = 0;
+			}
+		}
+
+		~Slots()
+		{
+			for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; ++i)
+			{
+				delete slots[i].subscriber.load();
+			}
+		}
+
+		static size_t currentThread()
+		{
+			// never 0
+			return std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+		}
+
+		static void deliver(Slots& slots, EventDelivery delivery, const EventBatch<T>& batch)
+		{
+			for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; ++i)
+			{
+				Slot& slot = slots.slots[i];
+
+				if (slot.subscriber.load() == NULL)
+				{
+					continue;
+				}
+
+				// counted in before the pointer is read again: a cancel either sees us or we see NULL
+				slot.inFlight++;
+				Subscriber* subscriber = slot.subscriber.load();
+
+				if (subscriber != NULL && subscriber->delivery == delivery)
+				{
+					slot.callingThread = currentThread();
+					subscriber->handler(batch);
+					slot.callingThread = 0;
+
+					if (subscriber->retired)
+					{
+						// other threads may still be reading it to skip it
+						while (slot.inFlight > 1)
+						{
+							std::this_thread::yield();
+						}
+
+						delete subscriber;
+					}
+				}
+
+				slot.inFlight--;
+			}
+		}
+
+		static void cancel(Slots& slots, int i, Subscriber* subscriber)
+		{
+			Slot& slot = slots.slots[i];
+			Subscriber* expected = subscriber;
+
+			if (!slot.subscriber.compare_exchange_strong(expected, NULL))
+			{
+				return;
+			}
+
+			slots.counts[subscriber->delivery]--;
+
+			if (slot.callingThread == currentThread())
+			{
+				subscriber->retired = true;
+				return;
+			}
+
+			while (slot.inFlight > 0)
+			{
+				std::this_thread::yield();
+			}
+
+			delete subscriber;
+		}
+
+		Slot slots[EVENT_BUS_MAX_SUBSCRIBERS];
+		std::atomic<int> counts[EVENT_DELIVERY_COUNT];
+	};
+
+	// events in publish order and where each batch ends
+	struct Queue
+	{
+		void reserve(size_t capacity)
+		{
+			events.reserve(capacity);
+			batchEnds.reserve(capacity);
+		}
+
+		void clear()
+		{
+			events.clear();
+			batchEnds.clear();
+		}
+
+		std::vector<T> events;
+		std::vector<size_t> batchEnds;
+		std::mutex mutex;
+	};
+
+	std::shared_ptr<Slots> mSlots;
+	size_t mCapacity;
+	std::atomic<uint64_t> mDroppedEvents;
+
+	Queue mMainQueue;
+	Queue mMainDrain;
+
+	Queue mDispatcherQueue;
+	Queue mDispatcherDrain;
+	Process mDispatcher;
+	std::mutex mDispatcherStartMutex;
+	std::condition_variable mDispatcherReady;
+	bool mDispatcherPending;
+
+	bool enqueue(Queue& queue, const T* events, size_t count)
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.events.size() + count > mCapacity)
+		{
+			mDroppedEvents += count;
+			return false;
+		}
+
+		queue.events.insert(queue.events.end(), events, events + count);
+		queue.batchEnds.push_back(queue.events.size());
+		return true;
+	}
+
+	// swapped out under the lock, delivered without it; both sides keep their storage
+	void drain(Queue& queue, Queue& drain, EventDelivery delivery)
+	{
+		queue.mutex.lock();
+		queue.events.swap(drain.events);
+		queue.batchEnds.swap(drain.batchEnds);
+		queue.mutex.unlock();
+
+		size_t begin = 0;
+
+		for (size_t b = 0; b < drain.batchEnds.size(); ++b)
+		{
+			EventBatch<T> batch = { &drain.events[0] + begin, drain.batchEnds[b] - begin };
+			Slots::deliver(*mSlots, delivery, batch);
+			begin = drain.batchEnds[b];
+		}
+
+		drain.clear();
+	}
+
+	void startDispatcher()
+	{
+		std::lock_guard<std::mutex> lock(mDispatcherStartMutex);
+
+		if (mDispatcher.mRunning)
+		{
+			return;
+		}
+
+		mDispatcher.mThreadCallback = [this]()
+		{
+			while (mDispatcher.mRunning)
+			{
+				{
+					std::unique_lock<std::mutex> lock(mDispatcherQueue.mutex);
+					mDispatcherReady.wait(lock, [this]() { return mDispatcherPending || !mDispatcher.mRunning; });
+					mDispatcherPending = false;
+				}
+
+				if (mDispatcher.mRunning)
+				{
+					this->drain(mDispatcherQueue, mDispatcherDrain, EVENT_DELIVERY_DISPATCHER);
+				}
+			}
+		};
+
+		mDispatcher.start();
+	}
+
+	void stopDispatcher()
+	{
+		std::lock_guard<std::mutex> lock(mDispatcherStartMutex);
+
+		mDispatcherQueue.mutex.lock();
+		mDispatcher.mRunning = false;
+		mDispatcherQueue.mutex.unlock();
+		mDispatcherReady.notify_all();
+
+		mDispatcher.stop();
+	}
+};
+
+#endif //__EVENT_BUS_H__
\ No newline at end of file
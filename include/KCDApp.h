@@ -11,13 +11,13 @@
 #include <vector>
 #include "KCDPipeline.h"
 #include "KCDDeviceStage.h"
-#include "Subject.h"
+#include "EventBus.h"
 
 #define DEBUG_DRAW 1
 #define NANO100_TO_ONE_SECOND 10000000.0
 #define PROFILE_KINECT_FPS 1
 
-class KCDApp : public ci::app::AppNative, public Observer<kcd::ActiveUserEvent>, public Observer<kcd::BodyJointEvent>
+class KCDApp : public ci::app::AppNative
 {
 public:
 	void setup();
@@ -29,8 +29,8 @@ public:
 	void prepareSettings(ci::app::AppBasic::Settings* settings);
 	void shutdown();
 
-	virtual void onEvent(kcd::ActiveUserEvent what, const Subject<kcd::ActiveUserEvent>& sender);
-	virtual void onEvent(kcd::BodyJointEvent what, const Subject<kcd::BodyJointEvent>& sender);
+	void onActiveUserEvents(const EventBatch<kcd::ActiveUserEvent>& events);
+	void onBodyJointEvents(const EventBatch<kcd::BodyJointEvent>& events);
 
 private:
 
@@ -40,6 +40,9 @@ private:
 
 	bool						mFullScreen;
 	bool mHasUser;
+
+	EventSubscriptionRef mActiveUserSubscription;
+	EventSubscriptionRef mBodyJointSubscription;
 	
 	std::map<JointType, bool> mDrawBodyJoints;
 	std::map<JointType, ci::Vec2f> mBodyJointsPos;
@@ -0,0 +1,140 @@
+#ifndef __SHARED_FRAME_H__
+#define __SHARED_FRAME_H__
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include "SharedMemory.h"
+
+/*
+* Processed frames published to other processes through a ring of slots in shared memory
+* One writer, any number of read-only readers, nobody waits. Each slot starts with a seqlock counter:
+* odd while the writer fills the slot, bumped back to even when done. A reader points straight into the
+* newest slot and checks the counter again once it's done reading: unchanged means the frame it read
+* was whole. With SHARED_FRAME_DEFAULT_SLOTS a reader has two frame periods before its slot is reused.
+* Counters are 32 bit so that loading them never writes, even in a 32 bit process on a read-only mapping.
+* No Kinect or Cinder types: subscribers only need this header, SharedMemory and their sources.
+*/
+
+#define SHARED_FRAME_MAGIC 0x4644434Bu // "KCDF"
+#define SHARED_FRAME_VERSION 1
+#define SHARED_FRAME_DEFAULT_NAME "KCDFrames"
+#define SHARED_FRAME_DEFAULT_SLOTS 3
+#define SHARED_FRAME_BODY_COUNT 6 // BODY_COUNT
+#define SHARED_FRAME_JOINT_COUNT 25 // JointType_Count
+
+struct SharedFrameJoint
+{
+	float x; // camera space, meters
+	float y;
+	float z;
+	float colorX; // color space, pixels
+	float colorY;
+	uint32_t trackingState; // TrackingState, 0 when not stored this frame
+};
+
+struct SharedFrameContext
+{
+	uint64_t frameId;
+	int64_t relativeTime; // body frame time, 100 ns units
+	uint64_t activeTrackingId;
+	uint32_t hasActiveUser;
+	uint32_t activeBodyIndex;
+	uint32_t hasColor; // BGRA, colorWidth x colorHeight
+	uint32_t hasMask; // one byte per color pixel, 255 on the active user
+	uint32_t trackedBodies; // bit n: body n tracked, its joints valid
+	uint32_t reserved;
+	uint64_t trackingId[SHARED_FRAME_BODY_COUNT];
+};
+
+struct SharedFrameSlotHeader
+{
+	std::atomic<uint32_t> sequence; // odd while written
+	uint32_t reserved;
+	SharedFrameContext context;
+	SharedFrameJoint joints[SHARED_FRAME_BODY_COUNT * SHARED_FRAME_JOINT_COUNT]; // body * SHARED_FRAME_JOINT_COUNT + jointType
+};
+
+struct SharedFrameHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize; // bytes, page multiple
+	uint32_t slotsOffset; // from the start of the mapping
+	uint32_t colorWidth;
+	uint32_t colorHeight;
+	uint32_t colorOffset; // from the start of a slot
+	uint32_t maskOffset;
+	std::atomic<uint32_t> published; // frames published; the newest is in slot (published - 1) % slotCount
+};
+
+// pointers into the mapping, valid while SharedFrameSubscriber::validate() says so
+struct SharedFrameView
+{
+	const SharedFrameContext* context;
+	const SharedFrameJoint* joints;
+	const uint8_t* color;
+	const uint8_t* mask;
+	uint32_t colorWidth;
+	uint32_t colorHeight;
+	uint32_t published; // publish count of the frame
+	uint32_t sequence; // slot counter when acquired
+	const SharedFrameSlotHeader* slot;
+};
+
+class SharedFrameWriter
+{
+public:
+	SharedFrameWriter();
+	virtual ~SharedFrameWriter();
+
+	bool create(uint32_t colorWidth, uint32_t colorHeight, const std::string& name = SHARED_FRAME_DEFAULT_NAME, uint32_t slots = SHARED_FRAME_DEFAULT_SLOTS);
+	void close();
+	bool isOpen() const { return mHeader != NULL; }
+
+	// the slot of the next frame, marked as being written; context, joints, color and mask to be filled
+	SharedFrameSlotHeader* beginFrame();
+	uint8_t* getColor(SharedFrameSlotHeader* slot) const;
+	uint8_t* getMask(SharedFrameSlotHeader* slot) const;
+	// the slot becomes the newest frame
+	void endFrame(SharedFrameSlotHeader* slot);
+
+private:
+	SharedFrameWriter(SharedFrameWriter const&);
+	void operator=(SharedFrameWriter const&);
+
+	SharedMemory mMemory;
+	SharedFrameHeader* mHeader;
+};
+
+class SharedFrameSubscriber
+{
+public:
+	SharedFrameSubscriber();
+	virtual ~SharedFrameSubscriber();
+
+	// fails until a writer has created the ring
+	bool open(const std::string& name = SHARED_FRAME_DEFAULT_NAME);
+	void close();
+	bool isOpen() const { return mHeader != NULL; }
+
+	// the newest frame, when newer than the last one acquired; no copies
+	bool acquireLatest(SharedFrameView& view);
+
+	// true when the frame is still whole: call after reading through the view, drop what was read otherwise
+	bool validate(const SharedFrameView& view) const;
+
+	uint32_t getTornFrames() const { return mTornFrames; }
+
+private:
+	SharedFrameSubscriber(SharedFrameSubscriber const&);
+	void operator=(SharedFrameSubscriber const&);
+
+	SharedMemory mMemory;
+	const SharedFrameHeader* mHeader;
+	uint32_t mLastPublished;
+	mutable uint32_t mTornFrames;
+};
+
+#endif //__SHARED_FRAME_H__
\ No newline at end of file
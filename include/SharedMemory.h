@@ -0,0 +1,46 @@
+#ifndef __SHARED_MEMORY_H__
+#define __SHARED_MEMORY_H__
+
+#include <string>
+#include <cstddef>
+
+/*
+* Named shared memory, created read/write by one process and opened read-only by others
+* Windows file mapping (Local\ namespace) or POSIX shm_open, chosen at compile time. The creator
+* removes the name when it closes (POSIX); mappings already open stay valid until closed.
+* Names are exclusive: create fails while the name exists, including one left behind by a crashed
+* POSIX writer, which has to be removed (shm_unlink, /dev/shm) before the name can be used again.
+*/
+
+class SharedMemory
+{
+public:
+	SharedMemory();
+	virtual ~SharedMemory();
+
+	// zero filled, fails when the name already exists: one writer per name
+	bool create(const std::string& name, size_t size);
+	bool openReadOnly(const std::string& name);
+	void close();
+
+	bool isOpen() const { return mData != NULL; }
+	void* getData() const { return mData; }
+	// rounded up to whole pages when opened
+	size_t getSize() const { return mSize; }
+
+private:
+	SharedMemory(SharedMemory const&);
+	void operator=(SharedMemory const&);
+
+	void* mData;
+	size_t mSize;
+	bool mIsOwner;
+	std::string mName;
+#ifdef _WIN32
+	void* mMapping; // HANDLE
+#else
+	int mDescriptor;
+#endif
+};
+
+#endif //__SHARED_MEMORY_H__
\ No newline at end of file
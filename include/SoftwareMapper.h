@@ -0,0 +1,148 @@
+#ifndef __SOFTWARE_MAPPER_H__
+#define __SOFTWARE_MAPPER_H__
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+* Depth, camera and color space mapping in software, from a calibration instead of the sensor runtime
+* Depth pixels become camera space through a unit ray table (X/Z and Y/Z per depth pixel), camera space
+* goes to color pixels through the fitted color camera projection and back to depth pixels through the
+* depth intrinsics. The per pixel terms of depth to color are precomputed, a pixel costs two multiply-adds
+* and a divide, four pixels at a time with SSE2. No sensor runtime needed: a calibration exported once
+* from the device mapper is saved, loaded and validated against the mappings captured with it anywhere.
+*/
+
+#define MAPPER_CALIBRATION_MAGIC 0x4C41434Bu // "KCAL"
+#define MAPPER_CALIBRATION_VERSION 2u
+
+// same layout as the sensor CameraSpacePoint, ColorSpacePoint and DepthSpacePoint
+struct MapperPoint3
+{
+	float X;
+	float Y;
+	float Z;
+};
+
+struct MapperPoint2
+{
+	float X;
+	float Y;
+};
+
+// one mapping of the device mapper, camera space point and where it went
+struct MapperSample
+{
+	MapperPoint3 camera;
+	MapperPoint2 color;
+	MapperPoint2 depth;
+};
+
+struct MapperCalibration
+{
+	MapperCalibration();
+
+	int depthWidth;
+	int depthHeight;
+	int colorWidth;
+	int colorHeight;
+
+	// depth camera, pixels, radial distortion of the normalized image radius r^2, r^4, r^6
+	float depthFocalX;
+	float depthFocalY;
+	float depthPrincipalX;
+	float depthPrincipalY;
+	float depthRadial[3];
+
+	// color camera intrinsics times depth to color extrinsics, camera space to homogeneous color pixels, 3x4 row major
+	float colorProjection[12];
+
+	// X/Z, Y/Z pairs per depth pixel, empty: computed from the depth intrinsics
+	std::vector<float> depthRays;
+
+	std::vector<MapperSample> samples;
+
+	// held out from the fit, off its sampling grid, to validate against
+	std::vector<MapperSample> validationSamples;
+
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	// least squares fit of colorProjection to the samples, at least 6 needed
+	bool fitColorProjection();
+};
+
+// software against captured mappings, pixels and meters
+struct MapperValidation
+{
+	size_t sampleCount;
+	float meanColorError;
+	float maxColorError;
+	float meanDepthError;
+	float maxDepthError;
+	float meanCameraError;
+	float maxCameraError;
+};
+
+class SoftwareMapper
+{
+public:
+	SoftwareMapper();
+	virtual ~SoftwareMapper();
+
+	// builds the tables, false and not valid for an incomplete calibration
+	bool setCalibration(const MapperCalibration& calibration);
+	void clearCalibration();
+	const MapperCalibration& getCalibration() const { return mCalibration; }
+	bool isValid() const { return mValid; }
+
+	// depth in millimeters; pixels without depth map to -infinity, as with the sensor mapper
+	void mapDepthFrameToCameraSpace(const uint16_t* depth, MapperPoint3* cameraPoints) const;
+	void mapDepthFrameToColorSpace(const uint16_t* depth, MapperPoint2* colorPoints) const;
+
+	void mapCameraPointsToColorSpace(size_t count, const MapperPoint3* cameraPoints, MapperPoint2* colorPoints) const;
+	void mapCameraPointsToDepthSpace(size_t count, const MapperPoint3* cameraPoints, MapperPoint2* depthPoints) const;
+
+	/*
+	* Depth pixel seen at every color pixel, -infinity where none lands
+	* The depth frame is mapped forward and each quad of neighbouring depth pixels fills the color pixels it
+	* covers, the nearest depth wins; quads across depth edges are left out
+	*/
+	void mapColorFrameToDepthSpace(const uint16_t* depth, MapperPoint2* depthPoints);
+
+	// pass samples the color projection was not fitted to, calibration.validationSamples
+	void validate(const std::vector<MapperSample>& samples, MapperValidation& result) const;
+
+	// X/Z and Y/Z of every depth pixel, 16 byte aligned
+	const float* getRayX() const { return mRayX; }
+	const float* getRayY() const { return mRayY; }
+
+	// per depth pixel, z meters: color u = (z * U + P[3]) / (z * W + P[11]), v = (z * V + P[7]) / (z * W + P[11])
+	const float* getColorU() const { return mColorU; }
+	const float* getColorV() const { return mColorV; }
+	const float* getColorW() const { return mColorW; }
+
+private:
+	SoftwareMapper(SoftwareMapper const&);
+	void operator=(SoftwareMapper const&);
+
+	MapperCalibration mCalibration;
+	bool mValid;
+
+	float* mRayX;
+	float* mRayY;
+
+	float* mColorU;
+	float* mColorV;
+	float* mColorW;
+
+	std::vector<MapperPoint2> mFrameColorPoints;
+	std::vector<uint16_t> mColorDepth;
+
+	void release();
+	void rayAt(float x, float y, float& rayX, float& rayY) const;
+};
+
+#endif //__SOFTWARE_MAPPER_H__
\ No newline at end of file
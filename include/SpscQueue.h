@@ -0,0 +1,94 @@
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/*
+* Bounded single producer / single consumer queue, lock-free
+* One thread pushes, one other thread pops. The storage is allocated once, push fails when full.
+* Head and tail live on separate cache lines so producer and consumer don't share one.
+*/
+
+template <class T>
+class SpscQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	SpscQueue(size_t capacity = 1024) :
+		mHead(0),
+		mTail(0)
+	{
+		size_t size = 2;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+
+		mBuffer.resize(size);
+		mMask = size - 1;
+	}
+
+	virtual ~SpscQueue() {}
+
+	size_t capacity() const { return mBuffer.size(); }
+
+	// producer
+	bool push(const T& item)
+	{
+		size_t tail = mTail.load(std::memory_order_relaxed);
+
+		if (tail - mHead.load(std::memory_order_acquire) >= mBuffer.size())
+		{
+			return false;
+		}
+
+		mBuffer[tail & mMask] = item;
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer
+	bool pop(T& item)
+	{
+		return this->popBatch(&item, 1) == 1;
+	}
+
+	// consumer, copies up to maxCount items in order, returns how many
+	size_t popBatch(T* items, size_t maxCount)
+	{
+		size_t head = mHead.load(std::memory_order_relaxed);
+		size_t available = mTail.load(std::memory_order_acquire) - head;
+		size_t count = (available < maxCount) ? available : maxCount;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			items[i] = mBuffer[(head + i) & mMask];
+		}
+
+		mHead.store(head + count, std::memory_order_release);
+		return count;
+	}
+
+	// approximate unless called from the consumer with the producer idle
+	size_t size() const
+	{
+		return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+	}
+
+private:
+	SpscQueue(SpscQueue const&);
+	void operator=(SpscQueue const&);
+
+	std::vector<T> mBuffer;
+	size_t mMask;
+
+	char mPadding0[64];
+	std::atomic<size_t> mHead; // next item to pop, written by the consumer
+	char mPadding1[64];
+	std::atomic<size_t> mTail; // next free slot, written by the producer
+	char mPadding2[64];
+};
+
+#endif //__SPSC_QUEUE_H__
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef __TEXTURE_STREAM_H__
+#define __TEXTURE_STREAM_H__
+
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Texture.h"
+
+/*
+* Frames written on one thread streamed into a texture on the GL thread, through a ring of pixel buffers
+* Free buffers stay mapped: the producer writes a frame straight into one (beginWrite / endWrite) and the
+* GL thread only unmaps it, issues the buffer to texture copy and fences it (update). A buffer is mapped again,
+* unsynchronized, once its fence has signaled, so neither thread waits on the GPU. A newer frame replaces
+* a ready one that wasn't uploaded yet; with no buffer free the producer skips the frame.
+* The texture is allocated once and its TextureRef never changes. Only plain GL calls and std timing,
+* so it runs under any GL 3.2 context, software ones included.
+*/
+
+#define TEXTURE_STREAM_DEFAULT_SLOTS 3
+
+struct TextureStreamStats
+{
+	uint64_t uploads; // frames copied to the texture
+	uint64_t skipped; // frames the producer had no free buffer for
+	uint64_t replaced; // ready frames replaced by a newer one before their upload
+	uint64_t busyChecks; // fences found unsignaled, the GPU still reading
+	float uploadMicroseconds; // GL thread, latest unmap, copy and fence issue
+	float mapMicroseconds; // GL thread, latest map of the freed buffers
+};
+
+class TextureStream
+{
+public:
+	TextureStream();
+	virtual ~TextureStream();
+
+	// GL thread; format and type as for glTexSubImage2D, tightly packed rows
+	bool allocate(int width, int height, GLenum internalFormat, GLenum format, GLenum type, int bytesPerPixel, int slots = TEXTURE_STREAM_DEFAULT_SLOTS);
+	void release();
+	bool isAllocated() const { return mTexture != 0; }
+
+	// producer thread: memory for one frame, write only (mapped buffers are uncached), NULL when none is free
+	void* beginWrite();
+	// the written frame becomes the one uploaded next
+	void endWrite();
+	// gives the buffer back unused
+	void cancelWrite();
+
+	// GL thread, once per app frame: uploads the latest frame, recycles buffers; true when the texture changed
+	bool update();
+
+	GLuint getTextureName() const { return mTexture; }
+	ci::gl::TextureRef getTextureReference() const { return mTextureRef; }
+
+	// true once a frame has been uploaded
+	bool hasFrame() const { return mHasFrame; }
+
+	TextureStreamStats getStats();
+
+	int getWidth() const { return mWidth; }
+	int getHeight() const { return mHeight; }
+	size_t getFrameSize() const { return mFrameSize; }
+
+private:
+	TextureStream(TextureStream const&);
+	void operator=(TextureStream const&);
+
+	typedef enum SlotState
+	{
+		SLOT_UNMAPPED, // waiting to be mapped by the GL thread
+		SLOT_FREE, // mapped, the producer may take it
+		SLOT_WRITING,
+		SLOT_READY, // written, waiting for upload
+		SLOT_IN_FLIGHT // copy issued, fence pending
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		GLsync fence;
+		void* memory;
+		SlotState state;
+	};
+
+	std::vector<Slot> mSlots;
+	int mWriting; // slot held by the producer, -1 none
+	int mReady; // latest written slot, -1 none
+	std::mutex mSlotsMutex;
+
+	GLuint mTexture;
+	ci::gl::TextureRef mTextureRef;
+	int mWidth;
+	int mHeight;
+	GLenum mFormat;
+	GLenum mType;
+	size_t mFrameSize;
+	bool mHasFrame;
+
+	TextureStreamStats mStats; // under mSlotsMutex
+
+	void mapFreedSlots();
+};
+
+#endif //__TEXTURE_STREAM_H__
\ No newline at end of file
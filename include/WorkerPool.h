@@ -0,0 +1,57 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/*
+* Fixed set of worker threads for data-parallel loops
+* parallelFor() splits [0, count) into chunks, runs them on the workers and the calling thread,
+* and returns once every chunk is done. Calls are serialized, one loop runs at a time.
+*/
+
+class WorkerPool
+{
+public:
+	static WorkerPool& DefaultPool()
+	{
+		static WorkerPool _instance;
+		return _instance;
+	}
+
+	// 0 threads: one less than the hardware concurrency, the caller being the last one
+	WorkerPool(unsigned int threadCount = 0);
+	virtual ~WorkerPool();
+
+	void parallelFor(int count, const std::function<void(int begin, int end)>& task);
+
+	unsigned int getThreadCount() const { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+private:
+	WorkerPool(WorkerPool const&);
+	void operator=(WorkerPool const&);
+
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::shared_ptr<std::thread>> mThreads;
+	std::mutex mLoopMutex; // one parallelFor at a time
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+
+	const std::function<void(int, int)>* mTask;
+	int mCount;
+	int mChunkSize;
+	std::atomic<int> mNextChunk;
+	int mChunksLeft;
+	unsigned int mGeneration;
+	bool mRunning;
+};
+
+#endif //__WORKER_POOL_H__
\ No newline at end of file
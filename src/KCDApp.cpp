@@ -48,13 +48,15 @@ void KCDApp::setup()
 #endif
 
 	NUIManager::DefaultManager().setup();
-	NUIManager::AttachActiveUserObserver(*this);
-	NUIManager::AttachBodyJointObserver(*this);
+	mActiveUserSubscription = NUIManager::SubscribeActiveUser([this](const EventBatch<ActiveUserEvent>& events) { this->onActiveUserEvents(events); });
+	mBodyJointSubscription = NUIManager::SubscribeBodyJoint([this](const EventBatch<BodyJointEvent>& events) { this->onBodyJointEvents(events); });
 
 }
 
 void KCDApp::shutdown()
 {
+	mActiveUserSubscription.reset();
+	mBodyJointSubscription.reset();
 	NUIManager::DefaultManager().teardown();
 }
 
@@ -74,33 +76,41 @@ void KCDApp::keyDown(KeyEvent evt)
 	}
 }
 
-void KCDApp::onEvent(kcd::ActiveUserEvent what, const Subject<ActiveUserEvent>& sender)
+void KCDApp::onActiveUserEvents(const EventBatch<ActiveUserEvent>& events)
 {
-	if (what == kcd::ACTIVE_USER_NEW)
+	for (size_t i = 0; i < events.size(); ++i)
 	{
-		mHasUser = true;
-	}
-	else if (what == kcd::ACTIVE_USER_LOST)
-	{
-		mHasUser = false;
+		if (events[i] == kcd::ACTIVE_USER_NEW)
+		{
+			mHasUser = true;
+		}
+		else if (events[i] == kcd::ACTIVE_USER_LOST)
+		{
+			mHasUser = false;
+		}
 	}
 }
 
-void KCDApp::onEvent(kcd::BodyJointEvent what, const Subject<kcd::BodyJointEvent>& sender)
+void KCDApp::onBodyJointEvents(const EventBatch<BodyJointEvent>& events)
 {
-	if (what.jointId == JointType_HandLeft
-		|| what.jointId == JointType_HandRight
-		|| what.jointId == JointType_Head
-		|| what.jointId == JointType_SpineBase)
+	for (size_t i = 0; i < events.size(); ++i)
 	{
-		if (what.eventType == BODY_JOINT_APPEAR || what.eventType == BODY_JOINT_MOVE)
-		{
-			mDrawBodyJoints[what.jointId] = true;
-			mBodyJointsPos[what.jointId] = what.screenSpacePosition;
-		}
-		else if (what.eventType == BODY_JOINT_DISAPPEAR)
+		const BodyJointEvent& what = events[i];
+
+		if (what.jointId == JointType_HandLeft
+			|| what.jointId == JointType_HandRight
+			|| what.jointId == JointType_Head
+			|| what.jointId == JointType_SpineBase)
 		{
-			mDrawBodyJoints[what.jointId] = false;
+			if (what.eventType == BODY_JOINT_APPEAR || what.eventType == BODY_JOINT_MOVE)
+			{
+				mDrawBodyJoints[what.jointId] = true;
+				mBodyJointsPos[what.jointId] = what.screenSpacePosition;
+			}
+			else if (what.eventType == BODY_JOINT_DISAPPEAR)
+			{
+				mDrawBodyJoints[what.jointId] = false;
+			}
 		}
 	}
 }
@@ -0,0 +1,200 @@
+#include "SharedFrame.h"
+#include <string.h>
+
+using namespace std;
+
+static uint32_t alignUp(size_t size, size_t alignment)
+{
+	return static_cast<uint32_t>((size + alignment - 1) / alignment * alignment);
+}
+
+SharedFrameWriter::SharedFrameWriter() :
+mHeader(NULL)
+{
+
+}
+
+SharedFrameWriter::~SharedFrameWriter()
+{
+	this->close();
+}
+
+bool SharedFrameWriter::create(uint32_t colorWidth, uint32_t colorHeight, const string& name, uint32_t slots)
+{
+	this->close();
+
+	const size_t page = 4096;
+	uint32_t colorOffset = alignUp(sizeof(SharedFrameSlotHeader), 64);
+	uint32_t maskOffset = alignUp(colorOffset + static_cast<size_t>(colorWidth) * colorHeight * 4, 64);
+	uint32_t slotSize = alignUp(maskOffset + static_cast<size_t>(colorWidth) * colorHeight, page);
+	uint32_t slotsOffset = alignUp(sizeof(SharedFrameHeader), page);
+
+	if (slots < 2 || !mMemory.create(name, slotsOffset + static_cast<size_t>(slotSize) * slots))
+	{
+		return false;
+	}
+
+	SharedFrameHeader* header = static_cast<SharedFrameHeader*>(mMemory.getData());
+	header->version = SHARED_FRAME_VERSION;
+	header->slotCount = slots;
+	header->slotSize = slotSize;
+	header->slotsOffset = slotsOffset;
+	header->colorWidth = colorWidth;
+	header->colorHeight = colorHeight;
+	header->colorOffset = colorOffset;
+	header->maskOffset = maskOffset;
+	header->published.store(0, memory_order_relaxed);
+
+	// readers check the magic last
+	atomic_thread_fence(memory_order_release);
+	header->magic = SHARED_FRAME_MAGIC;
+
+	mHeader = header;
+	return true;
+}
+
+void SharedFrameWriter::close()
+{
+	mHeader = NULL;
+	mMemory.close();
+}
+
+SharedFrameSlotHeader* SharedFrameWriter::beginFrame()
+{
+	if (mHeader == NULL)
+	{
+		return NULL;
+	}
+
+	uint32_t index = mHeader->published.load(memory_order_relaxed) % mHeader->slotCount;
+	SharedFrameSlotHeader* slot = reinterpret_cast<SharedFrameSlotHeader*>(static_cast<uint8_t*>(mMemory.getData()) + mHeader->slotsOffset + static_cast<size_t>(index) * mHeader->slotSize);
+
+	// odd: readers of this slot see it changing
+	slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	return slot;
+}
+
+uint8_t* SharedFrameWriter::getColor(SharedFrameSlotHeader* slot) const
+{
+	return reinterpret_cast<uint8_t*>(slot) + mHeader->colorOffset;
+}
+
+uint8_t* SharedFrameWriter::getMask(SharedFrameSlotHeader* slot) const
+{
+	return reinterpret_cast<uint8_t*>(slot) + mHeader->maskOffset;
+}
+
+void SharedFrameWriter::endFrame(SharedFrameSlotHeader* slot)
+{
+	if (mHeader == NULL || slot == NULL)
+	{
+		return;
+	}
+
+	slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_release);
+	mHeader->published.store(mHeader->published.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+SharedFrameSubscriber::SharedFrameSubscriber() :
+mHeader(NULL),
+mLastPublished(0),
+mTornFrames(0)
+{
+
+}
+
+SharedFrameSubscriber::~SharedFrameSubscriber()
+{
+	this->close();
+}
+
+bool SharedFrameSubscriber::open(const string& name)
+{
+	this->close();
+
+	if (!mMemory.openReadOnly(name) || mMemory.getSize() < sizeof(SharedFrameHeader))
+	{
+		mMemory.close();
+		return false;
+	}
+
+	const SharedFrameHeader* header = static_cast<const SharedFrameHeader*>(mMemory.getData());
+	bool valid = header->magic == SHARED_FRAME_MAGIC;
+	atomic_thread_fence(memory_order_acquire);
+
+	valid = valid && header->version == SHARED_FRAME_VERSION && header->slotCount >= 2;
+	valid = valid && static_cast<size_t>(header->slotsOffset) + static_cast<size_t>(header->slotSize) * header->slotCount <= mMemory.getSize();
+
+	if (!valid)
+	{
+		mMemory.close();
+		return false;
+	}
+
+	mHeader = header;
+	mLastPublished = 0;
+	return true;
+}
+
+void SharedFrameSubscriber::close()
+{
+	mHeader = NULL;
+	mMemory.close();
+}
+
+bool SharedFrameSubscriber::acquireLatest(SharedFrameView& view)
+{
+	if (mHeader == NULL)
+	{
+		return false;
+	}
+
+	uint32_t published = mHeader->published.load(memory_order_acquire);
+
+	if (published == 0 || published == mLastPublished)
+	{
+		return false;
+	}
+
+	uint32_t index = (published - 1) % mHeader->slotCount;
+	const uint8_t* base = static_cast<const uint8_t*>(mMemory.getData()) + mHeader->slotsOffset + static_cast<size_t>(index) * mHeader->slotSize;
+	const SharedFrameSlotHeader* slot = reinterpret_cast<const SharedFrameSlotHeader*>(base);
+
+	uint32_t sequence = slot->sequence.load(memory_order_acquire);
+
+	// the writer lapped the ring and is already rewriting it
+	if (sequence & 1)
+	{
+		++mTornFrames;
+		return false;
+	}
+
+	view.context = &slot->context;
+	view.joints = slot->joints;
+	view.color = base + mHeader->colorOffset;
+	view.mask = base + mHeader->maskOffset;
+	view.colorWidth = mHeader->colorWidth;
+	view.colorHeight = mHeader->colorHeight;
+	view.published = published;
+	view.sequence = sequence;
+	view.slot = slot;
+
+	mLastPublished = published;
+	return true;
+}
+
+bool SharedFrameSubscriber::validate(const SharedFrameView& view) const
+{
+	// reads through the view are done before the counter is checked again
+	atomic_thread_fence(memory_order_acquire);
+
+	if (view.slot == NULL || view.slot->sequence.load(memory_order_relaxed) != view.sequence)
+	{
+		++mTornFrames;
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
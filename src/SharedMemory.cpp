@@ -0,0 +1,231 @@
+#include "SharedMemory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+using namespace std;
+
+#ifdef _WIN32
+static string platformName(const string& name)
+{
+	return "Local\\" + name;
+}
+#else
+static string platformName(const string& name)
+{
+	return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+#endif
+
+SharedMemory::SharedMemory() :
+mData(NULL),
+mSize(0),
+mIsOwner(false),
+#ifdef _WIN32
+mMapping(NULL)
+#else
+mDescriptor(-1)
+#endif
+{
+
+}
+
+SharedMemory::~SharedMemory()
+{
+	this->close();
+}
+
+#ifdef _WIN32
+
+bool SharedMemory::create(const string& name, size_t size)
+{
+	this->close();
+
+	UINT64 size64 = size;
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64 & 0xFFFFFFFF), platformName(name).c_str());
+
+	if (mapping == NULL)
+	{
+		return false;
+	}
+
+	// the name belongs to another writer
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+
+	if (data == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	memset(data, 0, size);
+
+	mMapping = mapping;
+	mData = data;
+	mSize = size;
+	mIsOwner = true;
+	mName = name;
+	return true;
+}
+
+bool SharedMemory::openReadOnly(const string& name)
+{
+	this->close();
+
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, platformName(name).c_str());
+
+	if (mapping == NULL)
+	{
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (data == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info = { 0 };
+	VirtualQuery(data, &info, sizeof(info));
+
+	mMapping = mapping;
+	mData = data;
+	mSize = info.RegionSize;
+	mIsOwner = false;
+	mName = name;
+	return true;
+}
+
+void SharedMemory::close()
+{
+	if (mData)
+	{
+		UnmapViewOfFile(mData);
+		mData = NULL;
+	}
+
+	if (mMapping)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+
+	mSize = 0;
+	mIsOwner = false;
+}
+
+#else
+
+bool SharedMemory::create(const string& name, size_t size)
+{
+	this->close();
+
+	// fails on an existing name, so only names this process created are unlinked
+	int descriptor = shm_open(platformName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+	if (descriptor < 0)
+	{
+		return false;
+	}
+
+	if (ftruncate(descriptor, static_cast<off_t>(size)) != 0)
+	{
+		::close(descriptor);
+		shm_unlink(platformName(name).c_str());
+		return false;
+	}
+
+	void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+
+	if (data == MAP_FAILED)
+	{
+		::close(descriptor);
+		shm_unlink(platformName(name).c_str());
+		return false;
+	}
+
+	memset(data, 0, size);
+
+	mDescriptor = descriptor;
+	mData = data;
+	mSize = size;
+	mIsOwner = true;
+	mName = name;
+	return true;
+}
+
+bool SharedMemory::openReadOnly(const string& name)
+{
+	this->close();
+
+	int descriptor = shm_open(platformName(name).c_str(), O_RDONLY, 0);
+
+	if (descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+
+	if (fstat(descriptor, &info) != 0 || info.st_size <= 0)
+	{
+		::close(descriptor);
+		return false;
+	}
+
+	void* data = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+
+	if (data == MAP_FAILED)
+	{
+		::close(descriptor);
+		return false;
+	}
+
+	mDescriptor = descriptor;
+	mData = data;
+	mSize = static_cast<size_t>(info.st_size);
+	mIsOwner = false;
+	mName = name;
+	return true;
+}
+
+void SharedMemory::close()
+{
+	if (mData)
+	{
+		munmap(mData, mSize);
+		mData = NULL;
+	}
+
+	if (mDescriptor >= 0)
+	{
+		::close(mDescriptor);
+		mDescriptor = -1;
+	}
+
+	if (mIsOwner)
+	{
+		shm_unlink(platformName(mName).c_str());
+	}
+
+	mSize = 0;
+	mIsOwner = false;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,751 @@
+#include "SoftwareMapper.h"
+#include <emmintrin.h>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#define MAPPER_UNDISTORT_ITERATIONS 20
+#define MAPPER_EDGE_MILLIMETERS 50 // depth step between neighbours that breaks a quad
+#define MAPPER_MAX_QUAD_PIXELS 24.0f // color pixels, wider quads are surfaces seen edge on
+#define MAPPER_MAX_FRAME_SIZE 8192
+#define MAPPER_MAX_SAMPLES (1 << 20)
+
+struct MapperCalibrationHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t depthWidth;
+	uint32_t depthHeight;
+	uint32_t colorWidth;
+	uint32_t colorHeight;
+	uint32_t rayCount;
+	uint32_t sampleCount;
+	uint32_t validationCount;
+};
+
+// depth intrinsics, color projection and one float of padding, in file order
+#define MAPPER_CALIBRATION_PARAMS 20
+
+static const float NegativeInfinity = -std::numeric_limits<float>::infinity();
+
+MapperCalibration::MapperCalibration() :
+depthWidth(512),
+depthHeight(424),
+colorWidth(1920),
+colorHeight(1080),
+depthFocalX(0),
+depthFocalY(0),
+depthPrincipalX(0),
+depthPrincipalY(0)
+{
+	memset(depthRadial, 0, sizeof(depthRadial));
+	memset(colorProjection, 0, sizeof(colorProjection));
+}
+
+bool MapperCalibration::load(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	MapperCalibrationHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		return false;
+	}
+
+	if (header.magic != MAPPER_CALIBRATION_MAGIC || header.version != MAPPER_CALIBRATION_VERSION ||
+		header.depthWidth == 0 || header.depthWidth > MAPPER_MAX_FRAME_SIZE || header.depthHeight == 0 || header.depthHeight > MAPPER_MAX_FRAME_SIZE ||
+		header.colorWidth == 0 || header.colorWidth > MAPPER_MAX_FRAME_SIZE || header.colorHeight == 0 || header.colorHeight > MAPPER_MAX_FRAME_SIZE ||
+		(header.rayCount != 0 && header.rayCount != header.depthWidth * header.depthHeight) || header.sampleCount > MAPPER_MAX_SAMPLES ||
+		header.validationCount > MAPPER_MAX_SAMPLES)
+	{
+		return false;
+	}
+
+	float params[MAPPER_CALIBRATION_PARAMS];
+	std::vector<float> rays(static_cast<size_t>(header.rayCount) * 2);
+	std::vector<MapperSample> mapped(header.sampleCount);
+	std::vector<MapperSample> heldOut(header.validationCount);
+
+	if (!file.read(reinterpret_cast<char*>(params), sizeof(params)))
+	{
+		return false;
+	}
+
+	if (!rays.empty() && !file.read(reinterpret_cast<char*>(&rays[0]), rays.size() * sizeof(float)))
+	{
+		return false;
+	}
+
+	if (!mapped.empty() && !file.read(reinterpret_cast<char*>(&mapped[0]), mapped.size() * sizeof(MapperSample)))
+	{
+		return false;
+	}
+
+	if (!heldOut.empty() && !file.read(reinterpret_cast<char*>(&heldOut[0]), heldOut.size() * sizeof(MapperSample)))
+	{
+		return false;
+	}
+
+	depthWidth = static_cast<int>(header.depthWidth);
+	depthHeight = static_cast<int>(header.depthHeight);
+	colorWidth = static_cast<int>(header.colorWidth);
+	colorHeight = static_cast<int>(header.colorHeight);
+	depthFocalX = params[0];
+	depthFocalY = params[1];
+	depthPrincipalX = params[2];
+	depthPrincipalY = params[3];
+	memcpy(depthRadial, params + 4, sizeof(depthRadial));
+	memcpy(colorProjection, params + 7, sizeof(colorProjection));
+	depthRays.swap(rays);
+	samples.swap(mapped);
+	validationSamples.swap(heldOut);
+	return true;
+}
+
+bool MapperCalibration::save(const std::string& path) const
+{
+	MapperCalibrationHeader header = {};
+	header.magic = MAPPER_CALIBRATION_MAGIC;
+	header.version = MAPPER_CALIBRATION_VERSION;
+	header.depthWidth = static_cast<uint32_t>(depthWidth);
+	header.depthHeight = static_cast<uint32_t>(depthHeight);
+	header.colorWidth = static_cast<uint32_t>(colorWidth);
+	header.colorHeight = static_cast<uint32_t>(colorHeight);
+	header.rayCount = static_cast<uint32_t>(depthRays.size() / 2);
+	header.sampleCount = static_cast<uint32_t>(samples.size());
+	header.validationCount = static_cast<uint32_t>(validationSamples.size());
+
+	float params[MAPPER_CALIBRATION_PARAMS] = { 0 };
+	params[0] = depthFocalX;
+	params[1] = depthFocalY;
+	params[2] = depthPrincipalX;
+	params[3] = depthPrincipalY;
+	memcpy(params + 4, depthRadial, sizeof(depthRadial));
+	memcpy(params + 7, colorProjection, sizeof(colorProjection));
+
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(params), sizeof(params));
+
+	if (!depthRays.empty())
+	{
+		file.write(reinterpret_cast<const char*>(&depthRays[0]), depthRays.size() * sizeof(float));
+	}
+
+	if (!samples.empty())
+	{
+		file.write(reinterpret_cast<const char*>(&samples[0]), samples.size() * sizeof(MapperSample));
+	}
+
+	if (!validationSamples.empty())
+	{
+		file.write(reinterpret_cast<const char*>(&validationSamples[0]), validationSamples.size() * sizeof(MapperSample));
+	}
+
+	return file.good();
+}
+
+/*
+* Direct linear transform with the Z coefficient of the last row fixed to 1 (the color camera looks down Z),
+* pixels scaled to the frame size so the normal equations stay well conditioned
+*/
+bool MapperCalibration::fitColorProjection()
+{
+	double ata[11][11];
+	double atb[11];
+	memset(ata, 0, sizeof(ata));
+	memset(atb, 0, sizeof(atb));
+
+	size_t used = 0;
+
+	for (size_t s = 0; s < samples.size(); ++s)
+	{
+		const MapperSample& sample = samples[s];
+		double x = sample.camera.X;
+		double y = sample.camera.Y;
+		double z = sample.camera.Z;
+		double u = sample.color.X / colorWidth;
+		double v = sample.color.Y / colorHeight;
+
+		if (!(z > 0) || !(std::fabs(u) < 10) || !(std::fabs(v) < 10))
+		{
+			continue;
+		}
+
+		const double rowU[11] = { x, y, z, 1, 0, 0, 0, 0, -u * x, -u * y, -u };
+		const double rowV[11] = { 0, 0, 0, 0, x, y, z, 1, -v * x, -v * y, -v };
+
+		for (int i = 0; i < 11; ++i)
+		{
+			for (int j = 0; j < 11; ++j)
+			{
+				ata[i][j] += rowU[i] * rowU[j] + rowV[i] * rowV[j];
+			}
+
+			atb[i] += rowU[i] * u * z + rowV[i] * v * z;
+		}
+
+		used++;
+	}
+
+	if (used < 6)
+	{
+		return false;
+	}
+
+	// gaussian elimination, partial pivoting
+	for (int c = 0; c < 11; ++c)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < 11; ++r)
+		{
+			if (std::fabs(ata[r][c]) > std::fabs(ata[pivot][c]))
+			{
+				pivot = r;
+			}
+		}
+
+		if (std::fabs(ata[pivot][c]) < 1e-12)
+		{
+			return false;
+		}
+
+		if (pivot != c)
+		{
+			for (int j = 0; j < 11; ++j)
+			{
+				std::swap(ata[c][j], ata[pivot][j]);
+			}
+			std::swap(atb[c], atb[pivot]);
+		}
+
+		for (int r = c + 1; r < 11; ++r)
+		{
+			double f = ata[r][c] / ata[c][c];
+			for (int j = c; j < 11; ++j)
+			{
+				ata[r][j] -= f * ata[c][j];
+			}
+			atb[r] -= f * atb[c];
+		}
+	}
+
+	double solution[11];
+	for (int r = 10; r >= 0; --r)
+	{
+		double sum = atb[r];
+		for (int j = r + 1; j < 11; ++j)
+		{
+			sum -= ata[r][j] * solution[j];
+		}
+		solution[r] = sum / ata[r][r];
+	}
+
+	for (int i = 0; i < 4; ++i)
+	{
+		colorProjection[i] = static_cast<float>(solution[i] * colorWidth);
+		colorProjection[4 + i] = static_cast<float>(solution[4 + i] * colorHeight);
+	}
+
+	colorProjection[8] = static_cast<float>(solution[8]);
+	colorProjection[9] = static_cast<float>(solution[9]);
+	colorProjection[10] = 1.0f;
+	colorProjection[11] = static_cast<float>(solution[10]);
+	return true;
+}
+
+SoftwareMapper::SoftwareMapper() :
+mValid(false),
+mRayX(NULL),
+mRayY(NULL),
+mColorU(NULL),
+mColorV(NULL),
+mColorW(NULL)
+{
+
+}
+
+SoftwareMapper::~SoftwareMapper()
+{
+	this->release();
+}
+
+void SoftwareMapper::release()
+{
+	float** tables[5] = { &mRayX, &mRayY, &mColorU, &mColorV, &mColorW };
+
+	for (int t = 0; t < 5; ++t)
+	{
+		if (*tables[t])
+		{
+			_mm_free(*tables[t]);
+			*tables[t] = NULL;
+		}
+	}
+
+	mValid = false;
+}
+
+void SoftwareMapper::clearCalibration()
+{
+	this->release();
+}
+
+bool SoftwareMapper::setCalibration(const MapperCalibration& calibration)
+{
+	this->release();
+	mCalibration = calibration;
+
+	const MapperCalibration& c = mCalibration;
+	const size_t area = static_cast<size_t>(c.depthWidth) * c.depthHeight;
+
+	if (c.depthWidth <= 0 || c.depthHeight <= 0 || c.colorWidth <= 0 || c.colorHeight <= 0 ||
+		!(c.depthFocalX > 0) || !(c.depthFocalY > 0) || (!c.depthRays.empty() && c.depthRays.size() != area * 2) ||
+		(c.colorProjection[8] == 0 && c.colorProjection[9] == 0 && c.colorProjection[10] == 0))
+	{
+		return false;
+	}
+
+	float** tables[5] = { &mRayX, &mRayY, &mColorU, &mColorV, &mColorW };
+
+	for (int t = 0; t < 5; ++t)
+	{
+		*tables[t] = static_cast<float*>(_mm_malloc(area * sizeof(float), 16));
+		if (*tables[t] == NULL)
+		{
+			this->release();
+			return false;
+		}
+	}
+
+	const float* p = c.colorProjection;
+
+	for (int y = 0; y < c.depthHeight; ++y)
+	{
+		for (int x = 0; x < c.depthWidth; ++x)
+		{
+			size_t i = static_cast<size_t>(y) * c.depthWidth + x;
+			float rayX = 0;
+			float rayY = 0;
+
+			if (!c.depthRays.empty())
+			{
+				rayX = c.depthRays[2 * i];
+				rayY = c.depthRays[2 * i + 1];
+			}
+			else
+			{
+				// undistorted by fixed point iteration, image Y points down, camera Y up
+				float xd = (x - c.depthPrincipalX) / c.depthFocalX;
+				float yd = (y - c.depthPrincipalY) / c.depthFocalY;
+				float xu = xd;
+				float yu = yd;
+
+				for (int k = 0; k < MAPPER_UNDISTORT_ITERATIONS; ++k)
+				{
+					float r2 = xu * xu + yu * yu;
+					float f = 1.0f + r2 * (c.depthRadial[0] + r2 * (c.depthRadial[1] + r2 * c.depthRadial[2]));
+					xu = xd / f;
+					yu = yd / f;
+				}
+
+				rayX = xu;
+				rayY = -yu;
+			}
+
+			mRayX[i] = rayX;
+			mRayY[i] = rayY;
+			mColorU[i] = p[0] * rayX + p[1] * rayY + p[2];
+			mColorV[i] = p[4] * rayX + p[5] * rayY + p[6];
+			mColorW[i] = p[8] * rayX + p[9] * rayY + p[10];
+		}
+	}
+
+	mFrameColorPoints.resize(area);
+	mColorDepth.resize(static_cast<size_t>(c.colorWidth) * c.colorHeight);
+	mValid = true;
+	return true;
+}
+
+// four depth readings as meters
+static inline __m128 loadMeters(const uint16_t* depth)
+{
+	__m128i d = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth)), _mm_setzero_si128());
+	return _mm_mul_ps(_mm_cvtepi32_ps(d), _mm_set1_ps(0.001f));
+}
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+void SoftwareMapper::mapDepthFrameToCameraSpace(const uint16_t* depth, MapperPoint3* cameraPoints) const
+{
+	if (!mValid)
+	{
+		return;
+	}
+
+	const size_t area = static_cast<size_t>(mCalibration.depthWidth) * mCalibration.depthHeight;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 invalid = _mm_set1_ps(NegativeInfinity);
+	size_t i = 0;
+
+	for (; i + 4 <= area; i += 4)
+	{
+		__m128 z = loadMeters(depth + i);
+		__m128 valid = _mm_cmpgt_ps(z, zero);
+
+		float xs[4];
+		float ys[4];
+		float zs[4];
+		_mm_storeu_ps(xs, select(valid, _mm_mul_ps(_mm_load_ps(mRayX + i), z), invalid));
+		_mm_storeu_ps(ys, select(valid, _mm_mul_ps(_mm_load_ps(mRayY + i), z), invalid));
+		_mm_storeu_ps(zs, select(valid, z, invalid));
+
+		for (int k = 0; k < 4; ++k)
+		{
+			cameraPoints[i + k].X = xs[k];
+			cameraPoints[i + k].Y = ys[k];
+			cameraPoints[i + k].Z = zs[k];
+		}
+	}
+
+	for (; i < area; ++i)
+	{
+		float z = depth[i] * 0.001f;
+		MapperPoint3& point = cameraPoints[i];
+		point.X = (depth[i] != 0) ? mRayX[i] * z : NegativeInfinity;
+		point.Y = (depth[i] != 0) ? mRayY[i] * z : NegativeInfinity;
+		point.Z = (depth[i] != 0) ? z : NegativeInfinity;
+	}
+}
+
+void SoftwareMapper::mapDepthFrameToColorSpace(const uint16_t* depth, MapperPoint2* colorPoints) const
+{
+	if (!mValid)
+	{
+		return;
+	}
+
+	const size_t area = static_cast<size_t>(mCalibration.depthWidth) * mCalibration.depthHeight;
+	const float* p = mCalibration.colorProjection;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 invalid = _mm_set1_ps(NegativeInfinity);
+	const __m128 p3 = _mm_set1_ps(p[3]);
+	const __m128 p7 = _mm_set1_ps(p[7]);
+	const __m128 p11 = _mm_set1_ps(p[11]);
+	size_t i = 0;
+
+	for (; i + 4 <= area; i += 4)
+	{
+		__m128 z = loadMeters(depth + i);
+		__m128 w = _mm_add_ps(_mm_mul_ps(z, _mm_load_ps(mColorW + i)), p11);
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_cmpgt_ps(w, zero));
+
+		__m128 u = _mm_div_ps(_mm_add_ps(_mm_mul_ps(z, _mm_load_ps(mColorU + i)), p3), w);
+		__m128 v = _mm_div_ps(_mm_add_ps(_mm_mul_ps(z, _mm_load_ps(mColorV + i)), p7), w);
+		u = select(valid, u, invalid);
+		v = select(valid, v, invalid);
+
+		// interleaved X, Y pairs
+		float* out = reinterpret_cast<float*>(colorPoints + i);
+		_mm_storeu_ps(out, _mm_unpacklo_ps(u, v));
+		_mm_storeu_ps(out + 4, _mm_unpackhi_ps(u, v));
+	}
+
+	for (; i < area; ++i)
+	{
+		float z = depth[i] * 0.001f;
+		float w = z * mColorW[i] + p[11];
+		bool valid = depth[i] != 0 && w > 0;
+		colorPoints[i].X = valid ? (z * mColorU[i] + p[3]) / w : NegativeInfinity;
+		colorPoints[i].Y = valid ? (z * mColorV[i] + p[7]) / w : NegativeInfinity;
+	}
+}
+
+// four camera space points, the tail padded with invalid points
+static inline void loadPoints(const MapperPoint3* points, size_t count, __m128& x, __m128& y, __m128& z)
+{
+	MapperPoint3 padded[4];
+
+	if (count < 4)
+	{
+		const MapperPoint3 none = { 0, 0, 0 };
+		for (size_t k = 0; k < 4; ++k)
+		{
+			padded[k] = (k < count) ? points[k] : none;
+		}
+		points = padded;
+	}
+
+	x = _mm_setr_ps(points[0].X, points[1].X, points[2].X, points[3].X);
+	y = _mm_setr_ps(points[0].Y, points[1].Y, points[2].Y, points[3].Y);
+	z = _mm_setr_ps(points[0].Z, points[1].Z, points[2].Z, points[3].Z);
+}
+
+static inline void storePoints(__m128 u, __m128 v, size_t count, MapperPoint2* points)
+{
+	float pairs[8];
+	_mm_storeu_ps(pairs, _mm_unpacklo_ps(u, v));
+	_mm_storeu_ps(pairs + 4, _mm_unpackhi_ps(u, v));
+	memcpy(points, pairs, std::min(count, static_cast<size_t>(4)) * sizeof(MapperPoint2));
+}
+
+void SoftwareMapper::mapCameraPointsToColorSpace(size_t count, const MapperPoint3* cameraPoints, MapperPoint2* colorPoints) const
+{
+	if (!mValid)
+	{
+		return;
+	}
+
+	const float* p = mCalibration.colorProjection;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 invalid = _mm_set1_ps(NegativeInfinity);
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		__m128 x, y, z;
+		loadPoints(cameraPoints + i, count - i, x, y, z);
+
+		__m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p[8])), _mm_mul_ps(y, _mm_set1_ps(p[9]))), _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p[10])), _mm_set1_ps(p[11])));
+		__m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p[0])), _mm_mul_ps(y, _mm_set1_ps(p[1]))), _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p[2])), _mm_set1_ps(p[3])));
+		__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p[4])), _mm_mul_ps(y, _mm_set1_ps(p[5]))), _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p[6])), _mm_set1_ps(p[7])));
+
+		// false for NaN and infinite inputs as well
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_cmpgt_ps(w, zero));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(w, _mm_set1_ps(std::numeric_limits<float>::max())));
+
+		storePoints(select(valid, _mm_div_ps(u, w), invalid), select(valid, _mm_div_ps(v, w), invalid), count - i, colorPoints + i);
+	}
+}
+
+void SoftwareMapper::mapCameraPointsToDepthSpace(size_t count, const MapperPoint3* cameraPoints, MapperPoint2* depthPoints) const
+{
+	if (!mValid)
+	{
+		return;
+	}
+
+	const MapperCalibration& c = mCalibration;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 invalid = _mm_set1_ps(NegativeInfinity);
+	const __m128 k1 = _mm_set1_ps(c.depthRadial[0]);
+	const __m128 k2 = _mm_set1_ps(c.depthRadial[1]);
+	const __m128 k3 = _mm_set1_ps(c.depthRadial[2]);
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		__m128 x, y, z;
+		loadPoints(cameraPoints + i, count - i, x, y, z);
+
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_cmplt_ps(z, _mm_set1_ps(std::numeric_limits<float>::max())));
+		__m128 inverseZ = _mm_div_ps(one, select(valid, z, one));
+
+		// normalized image coordinates, Y down
+		__m128 xn = _mm_mul_ps(x, inverseZ);
+		__m128 yn = _mm_sub_ps(zero, _mm_mul_ps(y, inverseZ));
+		__m128 r2 = _mm_add_ps(_mm_mul_ps(xn, xn), _mm_mul_ps(yn, yn));
+		__m128 f = _mm_add_ps(one, _mm_mul_ps(r2, _mm_add_ps(k1, _mm_mul_ps(r2, _mm_add_ps(k2, _mm_mul_ps(r2, k3))))));
+
+		__m128 u = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(xn, f), _mm_set1_ps(c.depthFocalX)), _mm_set1_ps(c.depthPrincipalX));
+		__m128 v = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(yn, f), _mm_set1_ps(c.depthFocalY)), _mm_set1_ps(c.depthPrincipalY));
+
+		storePoints(select(valid, u, invalid), select(valid, v, invalid), count - i, depthPoints + i);
+	}
+}
+
+void SoftwareMapper::mapColorFrameToDepthSpace(const uint16_t* depth, MapperPoint2* depthPoints)
+{
+	if (!mValid)
+	{
+		return;
+	}
+
+	const int depthWidth = mCalibration.depthWidth;
+	const int depthHeight = mCalibration.depthHeight;
+	const int colorWidth = mCalibration.colorWidth;
+	const int colorHeight = mCalibration.colorHeight;
+	const size_t colorArea = static_cast<size_t>(colorWidth) * colorHeight;
+
+	this->mapDepthFrameToColorSpace(depth, &mFrameColorPoints[0]);
+
+	const MapperPoint2 none = { NegativeInfinity, NegativeInfinity };
+	std::fill(depthPoints, depthPoints + colorArea, none);
+	std::fill(mColorDepth.begin(), mColorDepth.end(), static_cast<uint16_t>(0xFFFF));
+
+	for (int y = 0; y + 1 < depthHeight; ++y)
+	{
+		for (int x = 0; x + 1 < depthWidth; ++x)
+		{
+			const size_t i = static_cast<size_t>(y) * depthWidth + x;
+			const uint16_t d[4] = { depth[i], depth[i + 1], depth[i + depthWidth], depth[i + depthWidth + 1] };
+
+			if (d[0] == 0 || d[1] == 0 || d[2] == 0 || d[3] == 0)
+			{
+				continue;
+			}
+
+			uint16_t nearest = std::min(std::min(d[0], d[1]), std::min(d[2], d[3]));
+			uint16_t farthest = std::max(std::max(d[0], d[1]), std::max(d[2], d[3]));
+
+			if (farthest - nearest > MAPPER_EDGE_MILLIMETERS)
+			{
+				continue;
+			}
+
+			const MapperPoint2& c00 = mFrameColorPoints[i];
+			const MapperPoint2& c10 = mFrameColorPoints[i + 1];
+			const MapperPoint2& c01 = mFrameColorPoints[i + depthWidth];
+			const MapperPoint2& c11 = mFrameColorPoints[i + depthWidth + 1];
+
+			float uMin = std::min(std::min(c00.X, c10.X), std::min(c01.X, c11.X));
+			float uMax = std::max(std::max(c00.X, c10.X), std::max(c01.X, c11.X));
+			float vMin = std::min(std::min(c00.Y, c10.Y), std::min(c01.Y, c11.Y));
+			float vMax = std::max(std::max(c00.Y, c10.Y), std::max(c01.Y, c11.Y));
+
+			// false for unmapped corners too
+			if (!(uMax - uMin < MAPPER_MAX_QUAD_PIXELS) || !(vMax - vMin < MAPPER_MAX_QUAD_PIXELS))
+			{
+				continue;
+			}
+
+			float du = c10.X - c00.X;
+			float dv = c01.Y - c00.Y;
+
+			if (std::fabs(du) < 1e-3f || std::fabs(dv) < 1e-3f)
+			{
+				continue;
+			}
+
+			// quads off the frame are skipped, what is left is clamped and truncates like ceil / floor
+			if (uMax < 0 || vMax < 0 || uMin > colorWidth - 1 || vMin > colorHeight - 1)
+			{
+				continue;
+			}
+
+			int u0 = (uMin > 0) ? static_cast<int>(uMin) + (static_cast<float>(static_cast<int>(uMin)) < uMin) : 0;
+			int u1 = std::min(colorWidth - 1, static_cast<int>(uMax));
+			int v0 = (vMin > 0) ? static_cast<int>(vMin) + (static_cast<float>(static_cast<int>(vMin)) < vMin) : 0;
+			int v1 = std::min(colorHeight - 1, static_cast<int>(vMax));
+
+			const float inverseDu = 1.0f / du;
+			const float inverseDv = 1.0f / dv;
+
+			for (int cv = v0; cv <= v1; ++cv)
+			{
+				float fy = y + std::min(1.0f, std::max(0.0f, (cv - c00.Y) * inverseDv));
+				uint16_t* zRow = &mColorDepth[static_cast<size_t>(cv) * colorWidth];
+				MapperPoint2* outRow = depthPoints + static_cast<size_t>(cv) * colorWidth;
+
+				for (int cu = u0; cu <= u1; ++cu)
+				{
+					if (nearest < zRow[cu])
+					{
+						zRow[cu] = nearest;
+						outRow[cu].X = x + std::min(1.0f, std::max(0.0f, (cu - c00.X) * inverseDu));
+						outRow[cu].Y = fy;
+					}
+				}
+			}
+		}
+	}
+}
+
+// bilinear in the ray table, clamped to the frame
+void SoftwareMapper::rayAt(float x, float y, float& rayX, float& rayY) const
+{
+	const int width = mCalibration.depthWidth;
+	const int height = mCalibration.depthHeight;
+
+	x = std::min(std::max(x, 0.0f), static_cast<float>(width - 1));
+	y = std::min(std::max(y, 0.0f), static_cast<float>(height - 1));
+
+	int x0 = std::min(static_cast<int>(x), width - 2);
+	int y0 = std::min(static_cast<int>(y), height - 2);
+	float fx = x - x0;
+	float fy = y - y0;
+	size_t i = static_cast<size_t>(y0) * width + x0;
+
+	rayX = (mRayX[i] * (1 - fx) + mRayX[i + 1] * fx) * (1 - fy) + (mRayX[i + width] * (1 - fx) + mRayX[i + width + 1] * fx) * fy;
+	rayY = (mRayY[i] * (1 - fx) + mRayY[i + 1] * fx) * (1 - fy) + (mRayY[i + width] * (1 - fx) + mRayY[i + width + 1] * fx) * fy;
+}
+
+void SoftwareMapper::validate(const std::vector<MapperSample>& samples, MapperValidation& result) const
+{
+	memset(&result, 0, sizeof(result));
+
+	if (!mValid || samples.empty() || mCalibration.depthWidth < 2 || mCalibration.depthHeight < 2)
+	{
+		return;
+	}
+
+	std::vector<MapperPoint3> cameraPoints(samples.size());
+	std::vector<MapperPoint2> colorPoints(samples.size());
+	std::vector<MapperPoint2> depthPoints(samples.size());
+
+	for (size_t s = 0; s < samples.size(); ++s)
+	{
+		cameraPoints[s] = samples[s].camera;
+	}
+
+	this->mapCameraPointsToColorSpace(samples.size(), &cameraPoints[0], &colorPoints[0]);
+	this->mapCameraPointsToDepthSpace(samples.size(), &cameraPoints[0], &depthPoints[0]);
+
+	double colorSum = 0;
+	double depthSum = 0;
+	double cameraSum = 0;
+
+	for (size_t s = 0; s < samples.size(); ++s)
+	{
+		const MapperSample& sample = samples[s];
+
+		// samples the sensor could not map say nothing
+		if (!(std::fabs(sample.color.X) < 1e6f) || !(std::fabs(sample.depth.X) < 1e6f) || !(sample.camera.Z > 0))
+		{
+			continue;
+		}
+
+		float colorError = std::sqrt((colorPoints[s].X - sample.color.X) * (colorPoints[s].X - sample.color.X) + (colorPoints[s].Y - sample.color.Y) * (colorPoints[s].Y - sample.color.Y));
+		float depthError = std::sqrt((depthPoints[s].X - sample.depth.X) * (depthPoints[s].X - sample.depth.X) + (depthPoints[s].Y - sample.depth.Y) * (depthPoints[s].Y - sample.depth.Y));
+
+		// the depth pixel back to camera space at the sample depth
+		float rayX = 0;
+		float rayY = 0;
+		this->rayAt(sample.depth.X, sample.depth.Y, rayX, rayY);
+		float ex = rayX * sample.camera.Z - sample.camera.X;
+		float ey = rayY * sample.camera.Z - sample.camera.Y;
+		float cameraError = std::sqrt(ex * ex + ey * ey);
+
+		// an unmapped point counts as infinitely far off
+		colorError = (colorError == colorError) ? colorError : std::numeric_limits<float>::infinity();
+		depthError = (depthError == depthError) ? depthError : std::numeric_limits<float>::infinity();
+
+		colorSum += colorError;
+		depthSum += depthError;
+		cameraSum += cameraError;
+		result.maxColorError = std::max(result.maxColorError, colorError);
+		result.maxDepthError = std::max(result.maxDepthError, depthError);
+		result.maxCameraError = std::max(result.maxCameraError, cameraError);
+		result.sampleCount++;
+	}
+
+	if (result.sampleCount > 0)
+	{
+		result.meanColorError = static_cast<float>(colorSum / result.sampleCount);
+		result.meanDepthError = static_cast<float>(depthSum / result.sampleCount);
+		result.meanCameraError = static_cast<float>(cameraSum / result.sampleCount);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include "TextureStream.h"
+#include <chrono>
+#include <string.h>
+
+using namespace std;
+
+static inline float microsecondsSince(const chrono::high_resolution_clock::time_point& start)
+{
+	return chrono::duration<float, micro>(chrono::high_resolution_clock::now() - start).count();
+}
+
+TextureStream::TextureStream() :
+mWriting(-1),
+mReady(-1),
+mTexture(0),
+mWidth(0),
+mHeight(0),
+mFormat(0),
+mType(0),
+mFrameSize(0),
+mHasFrame(false)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+// GL objects go in release(), on the GL thread
+TextureStream::~TextureStream() { }
+
+bool TextureStream::allocate(int width, int height, GLenum internalFormat, GLenum format, GLenum type, int bytesPerPixel, int slots)
+{
+	this->release();
+
+	if (width <= 0 || height <= 0 || bytesPerPixel <= 0 || slots < 2)
+	{
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mFormat = format;
+	mType = type;
+	mFrameSize = static_cast<size_t>(width) * height * bytesPerPixel;
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_2D, mTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	mSlots.resize(slots);
+
+	for (int i = 0; i < slots; ++i)
+	{
+		Slot& slot = mSlots[i];
+		slot.fence = 0;
+		slot.memory = NULL;
+		slot.state = SLOT_UNMAPPED;
+
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, mFrameSize, NULL, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	mTextureRef = ci::gl::Texture::create(GL_TEXTURE_2D, mTexture, width, height, true);
+
+	this->mapFreedSlots();
+
+	return true;
+}
+
+void TextureStream::release()
+{
+	mSlotsMutex.lock();
+
+	for (size_t i = 0; i < mSlots.size(); ++i)
+	{
+		Slot& slot = mSlots[i];
+
+		if (slot.fence)
+		{
+			glDeleteSync(slot.fence);
+		}
+
+		if (slot.memory)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+
+		glDeleteBuffers(1, &slot.buffer);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	mSlots.clear();
+	mWriting = -1;
+	mReady = -1;
+	mSlotsMutex.unlock();
+
+	mTextureRef.reset();
+
+	if (mTexture)
+	{
+		glDeleteTextures(1, &mTexture);
+		mTexture = 0;
+	}
+
+	mHasFrame = false;
+}
+
+void* TextureStream::beginWrite()
+{
+	void* memory = NULL;
+
+	mSlotsMutex.lock();
+
+	if (mWriting < 0)
+	{
+		for (size_t i = 0; i < mSlots.size(); ++i)
+		{
+			if (mSlots[i].state == SLOT_FREE)
+			{
+				mSlots[i].state = SLOT_WRITING;
+				mWriting = static_cast<int>(i);
+				memory = mSlots[i].memory;
+				break;
+			}
+		}
+
+		if (memory == NULL)
+		{
+			mStats.skipped++;
+		}
+	}
+
+	mSlotsMutex.unlock();
+
+	return memory;
+}
+
+void TextureStream::endWrite()
+{
+	mSlotsMutex.lock();
+
+	if (mWriting >= 0)
+	{
+		// still mapped, back to the producer
+		if (mReady >= 0)
+		{
+			mSlots[mReady].state = SLOT_FREE;
+			mStats.replaced++;
+		}
+
+		mSlots[mWriting].state = SLOT_READY;
+		mReady = mWriting;
+		mWriting = -1;
+	}
+
+	mSlotsMutex.unlock();
+}
+
+void TextureStream::cancelWrite()
+{
+	mSlotsMutex.lock();
+
+	if (mWriting >= 0)
+	{
+		mSlots[mWriting].state = SLOT_FREE;
+		mWriting = -1;
+	}
+
+	mSlotsMutex.unlock();
+}
+
+bool TextureStream::update()
+{
+	if (!mTexture)
+	{
+		return false;
+	}
+
+	int ready = -1;
+
+	mSlotsMutex.lock();
+	if (mReady >= 0)
+	{
+		ready = mReady;
+		mReady = -1;
+		mSlots[ready].state = SLOT_IN_FLIGHT;
+	}
+	mSlotsMutex.unlock();
+
+	// in flight and unmapped slots belong to the GL thread, only their state is shared
+	if (ready >= 0)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		Slot& slot = mSlots[ready];
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		slot.memory = NULL;
+
+		// tightly packed rows, the caller's alignment is put back
+		GLint alignment = 4;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+
+		glBindTexture(GL_TEXTURE_2D, mTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, mFormat, mType, NULL);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mHasFrame = true;
+
+		float elapsed = microsecondsSince(start);
+
+		mSlotsMutex.lock();
+		mStats.uploads++;
+		mStats.uploadMicroseconds = elapsed;
+		mSlotsMutex.unlock();
+	}
+
+	this->mapFreedSlots();
+
+	return ready >= 0;
+}
+
+// in flight slots whose copy is done are mapped again, unsynchronized: the fence says the GPU is done with them
+void TextureStream::mapFreedSlots()
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	uint64_t busy = 0;
+	bool mapped = false;
+
+	for (size_t i = 0; i < mSlots.size(); ++i)
+	{
+		Slot& slot = mSlots[i];
+
+		mSlotsMutex.lock();
+		SlotState state = slot.state;
+		mSlotsMutex.unlock();
+
+		if (state == SLOT_IN_FLIGHT)
+		{
+			GLenum result = glClientWaitSync(slot.fence, 0, 0);
+
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			{
+				++busy;
+				continue;
+			}
+
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			state = SLOT_UNMAPPED;
+
+			mSlotsMutex.lock();
+			slot.state = SLOT_UNMAPPED;
+			mSlotsMutex.unlock();
+		}
+
+		if (state == SLOT_UNMAPPED)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			void* memory = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, mFrameSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+			if (memory)
+			{
+				mSlotsMutex.lock();
+				slot.memory = memory;
+				slot.state = SLOT_FREE;
+				mSlotsMutex.unlock();
+				mapped = true;
+			}
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	float elapsed = microsecondsSince(start);
+
+	mSlotsMutex.lock();
+	mStats.busyChecks += busy;
+	if (mapped)
+	{
+		mStats.mapMicroseconds = elapsed;
+	}
+	mSlotsMutex.unlock();
+}
+
+TextureStreamStats TextureStream::getStats()
+{
+	mSlotsMutex.lock();
+	TextureStreamStats stats = mStats;
+	mSlotsMutex.unlock();
+	return stats;
+}
\ No newline at end of file
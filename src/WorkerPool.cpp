@@ -0,0 +1,133 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+using namespace std;
+
+WorkerPool::WorkerPool(unsigned int threadCount) :
+mTask(nullptr),
+mCount(0),
+mChunkSize(1),
+mNextChunk(0),
+mChunksLeft(0),
+mGeneration(0),
+mRunning(true)
+{
+	if (threadCount == 0)
+	{
+		unsigned int hardware = thread::hardware_concurrency();
+		threadCount = (hardware > 1) ? hardware - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		mThreads.push_back(shared_ptr<thread>(new thread(&WorkerPool::workerLoop, this)));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mRunning = false;
+	}
+
+	mWorkReady.notify_all();
+
+	for (size_t i = 0; i < mThreads.size(); ++i)
+	{
+		mThreads[i]->join();
+	}
+
+	mThreads.clear();
+}
+
+void WorkerPool::parallelFor(int count, const function<void(int, int)>& task)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	lock_guard<mutex> loopLock(mLoopMutex);
+
+	// a few chunks per thread evens out uneven rows
+	int chunks = std::min(count, static_cast<int>(this->getThreadCount()) * 4);
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mTask = &task;
+		mCount = count;
+		mChunkSize = (count + chunks - 1) / chunks;
+		mChunksLeft = (count + mChunkSize - 1) / mChunkSize;
+		mNextChunk = 0;
+		mGeneration++;
+	}
+
+	mWorkReady.notify_all();
+
+	this->runChunks();
+
+	unique_lock<mutex> lock(mMutex);
+	while (mChunksLeft > 0)
+	{
+		mWorkDone.wait(lock);
+	}
+
+	mTask = nullptr;
+}
+
+void WorkerPool::runChunks()
+{
+	int done = 0;
+
+	while (true)
+	{
+		int chunk = mNextChunk++;
+		int begin = chunk * mChunkSize;
+
+		if (begin >= mCount)
+		{
+			break;
+		}
+
+		(*mTask)(begin, std::min(begin + mChunkSize, mCount));
+		done++;
+	}
+
+	if (done > 0)
+	{
+		lock_guard<mutex> lock(mMutex);
+		mChunksLeft -= done;
+
+		if (mChunksLeft == 0)
+		{
+			mWorkDone.notify_all();
+		}
+	}
+}
+
+void WorkerPool::workerLoop()
+{
+	unsigned int seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(mMutex);
+
+			while (mRunning && (seenGeneration == mGeneration || mTask == nullptr))
+			{
+				mWorkReady.wait(lock);
+			}
+
+			if (!mRunning)
+			{
+				return;
+			}
+
+			seenGeneration = mGeneration;
+		}
+
+		this->runChunks();
+	}
+}
\ No newline at end of file
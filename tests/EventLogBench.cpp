@@ -0,0 +1,258 @@
+/*
+* Event log throughput: 20000 frames of full skeleton joint events, an active user event every 1000 frames
+* and a frame context per frame are recorded, read back and checked, then replayed as fast as possible
+* Also checks that a write error, past a file size limit, closes the log and isn't counted as written
+*
+* Linux, from the repository root:
+*   g++ -std=c++17 -O2 -msse2 -Itests/shim -IKCD/include -Iinclude tests/EventLogBench.cpp KCD/src/KCDEventLog.cpp KCD/src/KCDEventReplayer.cpp src/Process.cpp -o EventLogBench -lGL -lpthread
+*   ./EventLogBench [scratch file]
+* Exits non zero when the log doesn't read back as written or a write error goes unnoticed
+*
+* Recorded on a single core x86-64 Linux VM, g++ -O2, three runs:
+*   record       25.6 26.2 21.6 M events/s on the calling thread, 6.3 bytes per joint event
+*   read back    30.8 30.6 23.0 M events/s
+*   replay       84.7 81.0 70.1 M events/s, publisher thread subscriber
+*   replay       56.5 54.2 40.8 M events/s, main thread subscriber dispatched by play
+* A sensor produces 25 joint events per body frame, 750 per second for one user
+*/
+
+#include "KCDEventLog.h"
+#include "KCDEventReplayer.h"
+#include <stdio.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <limits>
+
+using namespace kcd;
+
+static const int Frames = 20000;
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void makeFrame(int frame, std::vector<BodyJointEvent>& events)
+{
+	events.clear();
+
+	for (int jt = 0; jt < JointType_Count; ++jt)
+	{
+		float x = 960 + 300 * sinf(frame * 0.03f + jt);
+		float y = 540 + 200 * cosf(frame * 0.02f + jt);
+
+		// unmapped now and then
+		if (jt == JointType_HandLeft && frame % 50 == 0)
+		{
+			x = -std::numeric_limits<float>::infinity();
+		}
+
+		events.push_back(BodyJointEvent((frame == 1) ? BODY_JOINT_APPEAR : BODY_JOINT_MOVE, static_cast<JointType>(jt), ci::Vec2f(x, y), 1000 + frame));
+	}
+}
+
+static EventFrameContext makeContext(int frame)
+{
+	EventFrameContext context;
+	context.frameId = 1000 + frame;
+	context.relativeTime = static_cast<INT64>(frame) * 333333;
+	context.hasActiveUser = (frame % 3) != 0;
+	context.activeBodyIndex = frame % BODY_COUNT;
+	context.activeTrackingId = 72057594037930000ull + frame / 500;
+	context.engagedUserCount = frame % 4;
+	return context;
+}
+
+static bool record(const std::string& path)
+{
+	EventLogWriter writer;
+	if (!writer.open(path))
+	{
+		printf("can't open %s\n", path.c_str());
+		return false;
+	}
+
+	std::vector<BodyJointEvent> events;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int f = 1; f <= Frames; ++f)
+	{
+		makeFrame(f, events);
+		EventBatch<BodyJointEvent> joints = { &events[0], events.size() };
+		writer.writeBodyJointEvents(joints);
+
+		if (f % 1000 == 1)
+		{
+			ActiveUserEvent evt = ((f / 1000) % 2) ? ACTIVE_USER_LOST : ACTIVE_USER_NEW;
+			EventBatch<ActiveUserEvent> users = { &evt, 1 };
+			writer.writeActiveUserEvents(users);
+		}
+
+		writer.writeFrameContext(makeContext(f));
+	}
+	double seconds = elapsedSeconds(start);
+	writer.close();
+
+	if (writer.hasFailed() || writer.getDroppedRecordCount() != 0)
+	{
+		printf("recording failed, %llu records dropped\n", static_cast<unsigned long long>(writer.getDroppedRecordCount()));
+		return false;
+	}
+
+	printf("record %.1f M events/s, %.1f bytes per joint event\n", writer.getEventCount() / seconds / 1e6,
+		double(writer.getBytesWritten()) / (Frames * JointType_Count));
+	return true;
+}
+
+static bool readBack(const std::string& path)
+{
+	EventLogReader reader;
+	if (!reader.open(path))
+	{
+		printf("can't read %s\n", path.c_str());
+		return false;
+	}
+
+	std::vector<BodyJointEvent> expected;
+	EventLogRecord record;
+	int frame = 0;
+	int contexts = 0;
+	UINT64 events = 0;
+	float maxError = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (reader.next(record))
+	{
+		if (record.type == EVENT_LOG_BODY_JOINT)
+		{
+			makeFrame(++frame, expected);
+			if (record.count != expected.size())
+			{
+				printf("frame %d: %u joint events\n", frame, static_cast<UINT>(record.count));
+				return false;
+			}
+
+			for (size_t i = 0; i < record.count; ++i)
+			{
+				const BodyJointEvent& a = expected[i];
+				const BodyJointEvent& b = record.bodyJointEvents[i];
+				bool unmapped = !(fabsf(a.screenSpacePosition.x) <= std::numeric_limits<float>::max());
+
+				if (a.jointId != b.jointId || a.eventType != b.eventType || a.frameId != b.frameId ||
+					(unmapped && b.screenSpacePosition.x != -std::numeric_limits<float>::infinity()))
+				{
+					printf("frame %d: joint event %u differs\n", frame, static_cast<UINT>(i));
+					return false;
+				}
+
+				maxError = unmapped ? maxError : std::max(maxError, fabsf(a.screenSpacePosition.x - b.screenSpacePosition.x));
+				maxError = std::max(maxError, fabsf(a.screenSpacePosition.y - b.screenSpacePosition.y));
+			}
+		}
+		else if (record.type == EVENT_LOG_FRAME_CONTEXT)
+		{
+			EventFrameContext context = makeContext(++contexts);
+			if (record.context.frameId != context.frameId || record.context.activeTrackingId != context.activeTrackingId ||
+				record.context.hasActiveUser != context.hasActiveUser)
+			{
+				printf("frame context %d differs\n", contexts);
+				return false;
+			}
+		}
+
+		events += record.count;
+	}
+	double seconds = elapsedSeconds(start);
+
+	if (reader.isDamaged() || frame != Frames || contexts != Frames || maxError > 0.5f / EVENT_LOG_POSITION_SCALE)
+	{
+		printf("read back %d frames, %d contexts, damaged %d, position error %f\n", frame, contexts, reader.isDamaged() ? 1 : 0, maxError);
+		return false;
+	}
+
+	printf("read back %.1f M events/s\n", events / seconds / 1e6);
+	return true;
+}
+
+static bool replay(const std::string& path)
+{
+	EventReplayer replayer;
+	if (!replayer.open(path))
+	{
+		return false;
+	}
+
+	UINT64 seen = 0;
+	EventSubscriptionRef publisher = replayer.getBodyJointBatchOutput()->subscribe([&](const EventBatch<BodyJointEvent>& events) { seen += events.size(); }, EVENT_DELIVERY_PUBLISHER_THREAD);
+	EventReplayStats stats = replayer.play(EVENT_REPLAY_AS_FAST_AS_POSSIBLE, false, 10);
+	printf("replay %.1f M events/s, publisher thread subscriber\n", stats.eventsPerSecond / 1e6);
+	publisher.reset();
+
+	UINT64 mainSeen = 0;
+	EventSubscriptionRef main = replayer.getBodyJointBatchOutput()->subscribe([&](const EventBatch<BodyJointEvent>& events) { mainSeen += events.size(); });
+	stats = replayer.play(EVENT_REPLAY_AS_FAST_AS_POSSIBLE, true, 5);
+	printf("replay %.1f M events/s, main thread subscriber dispatched by play\n", stats.eventsPerSecond / 1e6);
+
+	return seen == 10ull * Frames * JointType_Count && mainSeen + replayer.getBodyJointBatchOutput()->getDroppedCount() == 5ull * Frames * JointType_Count;
+}
+
+// a file size limit fails the writes past it with EFBIG
+static bool checkWriteError(const std::string& path)
+{
+	const rlim_t limit = 256 * 1024;
+	struct rlimit previous;
+	struct rlimit limited;
+	getrlimit(RLIMIT_FSIZE, &previous);
+	limited = previous;
+	limited.rlim_cur = limit;
+
+	signal(SIGXFSZ, SIG_IGN);
+	if (setrlimit(RLIMIT_FSIZE, &limited) != 0)
+	{
+		printf("can't limit the file size, write error check skipped\n");
+		return true;
+	}
+
+	EventLogWriter writer;
+	bool opened = writer.open(path);
+
+	std::vector<BodyJointEvent> events;
+	for (int f = 1; opened && f <= Frames && writer.isOpen(); ++f)
+	{
+		makeFrame(f, events);
+		EventBatch<BodyJointEvent> joints = { &events[0], events.size() };
+		writer.writeBodyJointEvents(joints);
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+	}
+
+	bool stopped = opened && !writer.isOpen() && writer.hasFailed();
+	writer.close();
+	setrlimit(RLIMIT_FSIZE, &previous);
+
+	struct stat info;
+	UINT64 fileSize = (stat(path.c_str(), &info) == 0) ? static_cast<UINT64>(info.st_size) : 0;
+
+	// the chunk that failed may be partly in the file, as a damaged last record, but isn't counted
+	if (!stopped || writer.getBytesWritten() == 0 || writer.getBytesWritten() > fileSize)
+	{
+		printf("write error: open %d failed %d, %llu bytes counted, file %llu bytes\n", writer.isOpen() ? 1 : 0, writer.hasFailed() ? 1 : 0,
+			static_cast<unsigned long long>(writer.getBytesWritten()), static_cast<unsigned long long>(fileSize));
+		return false;
+	}
+
+	printf("write error at %llu bytes closed the log, %llu bytes counted\n", static_cast<unsigned long long>(fileSize), static_cast<unsigned long long>(writer.getBytesWritten()));
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = (argc > 1) ? argv[1] : "EventLogBench.kevl";
+
+	bool ok = record(path) && readBack(path) && replay(path) && checkWriteError(path);
+
+	remove(path.c_str());
+	return ok ? 0 : 1;
+}
\ No newline at end of file
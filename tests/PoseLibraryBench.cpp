@@ -0,0 +1,149 @@
+/*
+* Pose classification and library load time against libraries of thousands of samples
+*
+* Linux, from the repository root:
+*   g++ -std=c++11 -O2 -msse2 -Itests/shim -IKCD/include tests/PoseLibraryBench.cpp KCD/src/KCDPoseLibrary.cpp KCD/src/KCDPoseClassifier.cpp KCD/src/KCDJointStore.cpp -o PoseLibraryBench
+*   ./PoseLibraryBench [scratch file]
+* Windows: build the same four files with the Kinect SDK include path instead of tests/shim
+*
+* Recorded on a single core x86-64 Linux VM (Xeon), g++ -O2, 6 tracked bodies per frame, median of 5 runs:
+*   samples   process/frame   save+load
+*      1000           52 us       295 us
+*      5000          229 us       822 us
+*     10000          501 us      1496 us
+*     20000         1143 us      2723 us
+* The brute force k nearest search is linear in the library size, 20000 samples still leave most of
+* a 33 ms body frame to the other stages; loading is file bound and happens on the app thread
+*/
+
+#include "KCDPoseClassifier.h"
+#include <stdio.h>
+#include <cmath>
+#include <chrono>
+
+using namespace kcd;
+
+// camera space skeleton 2.5 m from the sensor, arm angles in degrees from hanging down
+static void setSkeleton(JointStore& joints, int body, float leftArm, float rightArm, float yaw)
+{
+	float p[JointType_Count][3];
+	memset(p, 0, sizeof(p));
+
+	const float torso[][4] = {
+		{ JointType_SpineBase, 0, 0, 0 }, { JointType_SpineMid, 0, 0.5f, 0 }, { JointType_SpineShoulder, 0, 1.0f, 0 },
+		{ JointType_Neck, 0, 1.15f, 0 }, { JointType_Head, 0, 1.4f, 0 },
+		{ JointType_ShoulderLeft, -0.35f, 0.95f, 0 }, { JointType_ShoulderRight, 0.35f, 0.95f, 0 },
+		{ JointType_HipLeft, -0.2f, 0, 0 }, { JointType_HipRight, 0.2f, 0, 0 }
+	};
+	for (size_t i = 0; i < _countof(torso); ++i)
+	{
+		int jt = static_cast<int>(torso[i][0]);
+		p[jt][0] = torso[i][1];
+		p[jt][1] = torso[i][2];
+		p[jt][2] = torso[i][3];
+	}
+
+	const int arms[2][4] = {
+		{ JointType_ShoulderLeft, JointType_ElbowLeft, JointType_WristLeft, JointType_HandLeft },
+		{ JointType_ShoulderRight, JointType_ElbowRight, JointType_WristRight, JointType_HandRight }
+	};
+	const float segment[3] = { 0.6f, 0.55f, 0.15f };
+
+	for (int a = 0; a < 2; ++a)
+	{
+		float side = a ? 1.0f : -1.0f;
+		float angle = (a ? rightArm : leftArm) * 3.14159265f / 180.0f;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			const float* from = p[arms[a][k]];
+			float* to = p[arms[a][k + 1]];
+			to[0] = from[0] + side * sinf(angle) * segment[k];
+			to[1] = from[1] - cosf(angle) * segment[k];
+			to[2] = from[2];
+		}
+	}
+
+	float c = cosf(yaw);
+	float s = sinf(yaw);
+
+	joints.isTracked[body] = true;
+	joints.trackingId[body] = 7 + body;
+	joints.seen[body] = JOINT_MASK_ALL;
+
+	for (int jt = 0; jt < JointType_Count; ++jt)
+	{
+		int i = JointStore::index(body, jt);
+		float x = p[jt][0] * 0.5f;
+		float y = p[jt][1] * 0.5f;
+		float z = p[jt][2] * 0.5f;
+		joints.positionX[i] = c * x - s * z + 0.3f;
+		joints.positionY[i] = y - 0.3f;
+		joints.positionZ[i] = s * x + c * z + 2.5f;
+	}
+}
+
+static double elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = (argc > 1) ? argv[1] : "PoseLibraryBench.bin";
+	const UINT samplesPerPose[] = { 200, 1000, 2000, 4000 };
+	const int frames = 100;
+	const int reloads = 10;
+
+	JointStore joints;
+	joints.clear();
+	for (int b = 0; b < BODY_COUNT; ++b)
+	{
+		setSkeleton(joints, b, 90, 90, 0.1f * b);
+	}
+
+	printf("  samples   process/frame   save+load\n");
+
+	for (size_t n = 0; n < _countof(samplesPerPose); ++n)
+	{
+		PoseLibrary library;
+		library.addDefaultPoses(samplesPerPose[n]);
+
+		PoseClassifier classifier;
+		classifier.setLibrary(library);
+
+		std::vector<PoseTransition> transitions;
+		UINT classified = 0;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int f = 0; f < frames; ++f)
+		{
+			transitions.clear();
+			classified += classifier.process(joints, f / 30.0, transitions);
+		}
+		double process = elapsedMicroseconds(start) / frames;
+
+		if (classified != frames * BODY_COUNT)
+		{
+			printf("classified %u bodies of %d\n", classified, frames * BODY_COUNT);
+			return 1;
+		}
+
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < reloads; ++r)
+		{
+			PoseLibrary loaded;
+			if (!library.save(path) || !loaded.load(path) || loaded.getCount() != library.getCount())
+			{
+				printf("save or load failed: %s\n", path.c_str());
+				return 1;
+			}
+		}
+		double reload = elapsedMicroseconds(start) / reloads;
+
+		printf("%9u %12.0f us %9.0f us\n", library.getCount(), process, reload);
+	}
+
+	remove(path.c_str());
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+* TextureStream under a software GL: a producer thread writes 1080p BGRA frames at 30 fps while the GL
+* thread updates at 60 fps and reads every uploaded frame back to check it; then the upload cost is compared
+* with a plain glTexSubImage2D from client memory
+* Headless through an EGL pbuffer on Mesa's llvmpipe (OSMesa isn't installed on the machine this was recorded on)
+*
+* Linux, from the repository root:
+*   g++ -std=c++11 -O2 -Itests/shim -Iinclude tests/TextureStreamTest.cpp src/TextureStream.cpp -o TextureStreamTest -lEGL -lGL -lpthread
+*   EGL_PLATFORM=surfaceless ./TextureStreamTest
+* Exits non zero on a GL error or a frame read back with the wrong contents
+*
+* Recorded on a single core x86-64 Linux VM, llvmpipe (LLVM 15.0.6, 256 bits), GL 4.5 Mesa 22.3.6, three runs:
+*   uploads 72 71 72, bad 0, skipped 0, replaced 0, busy 0
+*   TextureStream update (latest frame)     4483 5049 5037 us, map 10 9 9 us
+*   glTexSubImage2D from client memory      3349 4097 4513 us
+* llvmpipe copies the buffer into the texture on the calling thread, one more copy than the direct upload,
+* so the GL thread pays for it here; with a hardware driver the copy is a DMA and update only issues it
+*/
+
+#include <EGL/egl.h>
+#include "TextureStream.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const int Width = 1920;
+static const int Height = 1080;
+
+static bool createContext()
+{
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+	{
+		printf("no EGL display\n");
+		return false;
+	}
+
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0)
+	{
+		printf("no EGL config\n");
+		return false;
+	}
+
+	const EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2, EGL_NONE };
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+
+	if (context == EGL_NO_CONTEXT || surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+	{
+		printf("no GL context: %x\n", eglGetError());
+		return false;
+	}
+
+	printf("%s | %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+	return true;
+}
+
+// glTexSubImage2D straight from client memory, the upload TextureStream replaces
+static double measureDirectUpload(int uploads)
+{
+	std::vector<uint32_t> pixels(Width * Height, 0x80402010u);
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	glFinish();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < uploads; ++i)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Width, Height, GL_BGRA, GL_UNSIGNED_BYTE, &pixels[0]);
+	}
+	glFinish();
+	double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / uploads;
+
+	glDeleteTextures(1, &texture);
+	return microseconds;
+}
+
+int main()
+{
+	if (!createContext())
+	{
+		return 1;
+	}
+
+	TextureStream stream;
+	if (!stream.allocate(Width, Height, GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 4))
+	{
+		printf("allocate failed\n");
+		return 1;
+	}
+
+	// every pixel of frame f is f
+	std::atomic<bool> running(true);
+	std::thread producer([&]()
+	{
+		uint32_t frame = 0;
+		while (running)
+		{
+			uint32_t* pixels = static_cast<uint32_t*>(stream.beginWrite());
+			if (pixels)
+			{
+				++frame;
+				for (int i = 0; i < Width * Height; ++i)
+				{
+					pixels[i] = frame;
+				}
+				stream.endWrite();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(33));
+		}
+	});
+
+	std::vector<uint32_t> readBack(Width * Height);
+	unsigned bad = 0;
+	uint32_t lastFrame = 0;
+
+	for (int appFrame = 0; appFrame < 120; ++appFrame)
+	{
+		if (stream.update())
+		{
+			glBindTexture(GL_TEXTURE_2D, stream.getTextureName());
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, &readBack[0]);
+
+			// whole and never older than the previous upload
+			uint32_t frame = readBack[0];
+			for (int i = 0; i < Width * Height; i += 997)
+			{
+				bad += (readBack[i] != frame) ? 1 : 0;
+			}
+			bad += (frame < lastFrame) ? 1 : 0;
+			lastFrame = frame;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(16));
+	}
+
+	running = false;
+	producer.join();
+
+	TextureStreamStats stats = stream.getStats();
+	GLenum error = glGetError();
+	stream.release();
+
+	printf("uploads %llu bad %u skipped %llu replaced %llu busy %llu\n", static_cast<unsigned long long>(stats.uploads), bad,
+		static_cast<unsigned long long>(stats.skipped), static_cast<unsigned long long>(stats.replaced), static_cast<unsigned long long>(stats.busyChecks));
+	printf("TextureStream update %.0f us, map %.0f us\n", stats.uploadMicroseconds, stats.mapMicroseconds);
+	printf("glTexSubImage2D from client memory %.0f us\n", measureDirectUpload(30));
+
+	error = (error != GL_NO_ERROR) ? error : glGetError();
+	if (error != GL_NO_ERROR)
+	{
+		printf("GL error %x\n", error);
+	}
+
+	return (error == GL_NO_ERROR && bad == 0 && stats.uploads > 0) ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#ifndef __KINECT_SHIM_H__
+#define __KINECT_SHIM_H__
+
+/*
+* Kinect SDK and Win32 declarations the KCD headers use, enough to build the tests under
+* tests/ on Linux with g++; Windows builds use the SDK headers instead of this directory
+* Sensor and mapper interfaces are declared only, tests that need them provide a fake
+*/
+
+#include <time.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+typedef unsigned char BYTE;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef int32_t INT32;
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+typedef uint32_t DWORD;
+typedef int32_t HRESULT;
+typedef long LONG;
+typedef int BOOL;
+typedef unsigned char BOOLEAN;
+typedef float FLOAT;
+typedef void* HANDLE;
+
+typedef union
+{
+	struct { uint32_t LowPart; int32_t HighPart; };
+	int64_t QuadPart;
+} LARGE_INTEGER;
+
+// nanoseconds of CLOCK_MONOTONIC
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+	frequency->QuadPart = 1000000000LL;
+	return 1;
+}
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* counter)
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	counter->QuadPart = t.tv_sec * 1000000000LL + t.tv_nsec;
+	return 1;
+}
+
+inline void* _aligned_malloc(size_t size, size_t alignment)
+{
+	void* p = NULL;
+	return (posix_memalign(&p, alignment, size) == 0) ? p : NULL;
+}
+
+inline void _aligned_free(void* p) { free(p); }
+inline void CoTaskMemFree(void*) { }
+
+#define S_OK ((HRESULT)0L)
+#define S_FALSE ((HRESULT)1L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define E_PENDING ((HRESULT)0x8000000AL)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define _countof(a) (sizeof(a) / sizeof(a[0]))
+#define __forceinline inline
+#define __declspec(x) __declspec_##x
+#define __declspec_align(n) __attribute__((aligned(n)))
+#define WINAPI
+
+#define BODY_COUNT 6
+
+struct DepthSpacePoint { float X, Y; };
+struct ColorSpacePoint { float X, Y; };
+struct CameraSpacePoint { float X, Y, Z; };
+struct PointF { float X, Y; };
+struct Vector4 { float x, y, z, w; };
+
+enum JointType
+{
+	JointType_SpineBase = 0, JointType_SpineMid, JointType_Neck, JointType_Head,
+	JointType_ShoulderLeft, JointType_ElbowLeft, JointType_WristLeft, JointType_HandLeft,
+	JointType_ShoulderRight, JointType_ElbowRight, JointType_WristRight, JointType_HandRight,
+	JointType_HipLeft, JointType_KneeLeft, JointType_AnkleLeft, JointType_FootLeft,
+	JointType_HipRight, JointType_KneeRight, JointType_AnkleRight, JointType_FootRight,
+	JointType_SpineShoulder, JointType_HandTipLeft, JointType_ThumbLeft, JointType_HandTipRight, JointType_ThumbRight,
+	JointType_Count
+};
+
+enum TrackingState { TrackingState_NotTracked = 0, TrackingState_Inferred, TrackingState_Tracked };
+
+struct Joint { ::JointType JointType; CameraSpacePoint Position; ::TrackingState TrackingState; };
+struct JointOrientation { ::JointType JointType; Vector4 Orientation; };
+
+struct CameraIntrinsics
+{
+	float FocalLengthX, FocalLengthY, PrincipalPointX, PrincipalPointY;
+	float RadialDistortionSecondOrder, RadialDistortionFourthOrder, RadialDistortionSixthOrder;
+};
+
+struct IUnknown
+{
+	virtual ~IUnknown() { }
+	virtual UINT Release() { return 0; }
+};
+
+struct IBody : IUnknown
+{
+	virtual HRESULT GetJoints(UINT capacity, Joint* joints) = 0;
+	virtual HRESULT GetJointOrientations(UINT capacity, JointOrientation* orientations) = 0;
+	virtual HRESULT get_IsTracked(BOOLEAN* tracked) = 0;
+	virtual HRESULT get_TrackingId(UINT64* trackingId) = 0;
+};
+
+struct ICoordinateMapper : IUnknown
+{
+	virtual HRESULT MapCameraPointToDepthSpace(CameraSpacePoint cameraPoint, DepthSpacePoint* depthPoint) = 0;
+	virtual HRESULT MapCameraPointToColorSpace(CameraSpacePoint cameraPoint, ColorSpacePoint* colorPoint) = 0;
+	virtual HRESULT MapCameraPointsToColorSpace(UINT cameraPointCount, const CameraSpacePoint* cameraPoints, UINT colorPointCount, ColorSpacePoint* colorPoints) = 0;
+	virtual HRESULT MapCameraPointsToDepthSpace(UINT cameraPointCount, const CameraSpacePoint* cameraPoints, UINT depthPointCount, DepthSpacePoint* depthPoints) = 0;
+	virtual HRESULT MapDepthPointToCameraSpace(DepthSpacePoint depthPoint, UINT16 depth, CameraSpacePoint* cameraPoint) = 0;
+	virtual HRESULT MapDepthPointsToColorSpace(UINT depthPointCount, const DepthSpacePoint* depthPoints, UINT depthCount, const UINT16* depths, UINT colorPointCount, ColorSpacePoint* colorPoints) = 0;
+	virtual HRESULT MapDepthFrameToCameraSpace(UINT depthPointCount, const UINT16* depthFrameData, UINT cameraPointCount, CameraSpacePoint* cameraSpacePoints) = 0;
+	virtual HRESULT MapDepthFrameToColorSpace(UINT depthPointCount, const UINT16* depthFrameData, UINT colorPointCount, ColorSpacePoint* colorSpacePoints) = 0;
+	virtual HRESULT MapColorFrameToDepthSpace(UINT depthDataPointCount, const UINT16* depthFrameData, UINT depthPointCount, DepthSpacePoint* depthSpacePoints) = 0;
+	virtual HRESULT MapColorFrameToCameraSpace(UINT depthDataPointCount, const UINT16* depthFrameData, UINT cameraPointCount, CameraSpacePoint* cameraSpacePoints) = 0;
+	virtual HRESULT GetDepthFrameToCameraSpaceTable(UINT* tableEntryCount, PointF** tableEntries) = 0;
+	virtual HRESULT GetDepthCameraIntrinsics(CameraIntrinsics* cameraIntrinsics) = 0;
+};
+
+// frames and the sensor are only passed around by the code the tests build
+struct IKinectSensor;
+struct IMultiSourceFrameReader;
+struct IMultiSourceFrame;
+struct IColorFrame;
+struct IDepthFrame;
+struct IBodyIndexFrame;
+struct IBodyFrame;
+
+#endif //__KINECT_SHIM_H__
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef __CINDER_APP_SHIM_H__
+#define __CINDER_APP_SHIM_H__
+
+#include <cmath>
+
+// the types the KCD pipeline interfaces use, in place of Cinder's App header
+namespace boost { namespace signals2 {
+	class connection
+	{
+	public:
+		void disconnect() { }
+	};
+} }
+
+namespace cinder {
+	template<class T> class Vec2
+	{
+	public:
+		T x;
+		T y;
+
+		Vec2() : x(0), y(0) { }
+		Vec2(T nx, T ny) : x(nx), y(ny) { }
+
+		Vec2 operator+(const Vec2& rhs) const { return Vec2(x + rhs.x, y + rhs.y); }
+		Vec2 operator-(const Vec2& rhs) const { return Vec2(x - rhs.x, y - rhs.y); }
+		Vec2 operator*(const Vec2& rhs) const { return Vec2(x * rhs.x, y * rhs.y); }
+		Vec2 operator*(T rhs) const { return Vec2(x * rhs, y * rhs); }
+
+		T lengthSquared() const { return x * x + y * y; }
+		T length() const { return std::sqrt(this->lengthSquared()); }
+		T distance(const Vec2& rhs) const { return (*this - rhs).length(); }
+	};
+
+	typedef Vec2<float> Vec2f;
+	typedef Vec2<int> Vec2i;
+}
+
+namespace ci = cinder;
+
+#endif //__CINDER_APP_SHIM_H__
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef __CINDER_GL_TEXTURE_SHIM_H__
+#define __CINDER_GL_TEXTURE_SHIM_H__
+
+#include <memory>
+#include "cinder/gl/gl.h"
+
+// only what TextureStream uses: wrapping an existing texture name
+namespace cinder { namespace gl {
+	class Texture;
+	typedef std::shared_ptr<Texture> TextureRef;
+
+	class Texture
+	{
+	public:
+		static TextureRef create(GLenum target, GLuint textureId, int width, int height, bool doNotDispose)
+		{
+			TextureRef texture(new Texture());
+			texture->mTarget = target;
+			texture->mTextureId = textureId;
+			texture->mWidth = width;
+			texture->mHeight = height;
+			return texture;
+		}
+
+		GLuint getId() const { return mTextureId; }
+
+	private:
+		GLenum mTarget;
+		GLuint mTextureId;
+		int mWidth;
+		int mHeight;
+	};
+} }
+
+namespace ci = cinder;
+
+#endif //__CINDER_GL_TEXTURE_SHIM_H__
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef __CINDER_GL_SHIM_H__
+#define __CINDER_GL_SHIM_H__
+
+// system GL with prototypes for GL 3.2 entry points, in place of Cinder's GL header
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#endif //__CINDER_GL_SHIM_H__
\ No newline at end of file